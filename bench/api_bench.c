@@ -0,0 +1,286 @@
+/*
+ * api_bench.c
+ * Description:
+ * PCD API round-trip latency benchmark
+ *
+ * Copyright (C) 2010 PCD Project - http://www.rt-embedded.com/pcd
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* The benchmark measures the time of PCD_api_get_rule_state requests, for a
+ * rule which exists and for one which does not. With -p, it starts PCD in
+ * debug mode with a rules file of a single rule, and stops it at the end.
+ * PCD daemonizes, the benchmark is a child subreaper so the daemon is
+ * reparented to it. Otherwise, it sends the requests to the running PCD.
+ *
+ * Usage: api_bench [-p PCD] [-r rule] [-n iterations]
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include "pcdapi.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define API_BENCH_DEFAULT_ITERATIONS    10000
+#define API_BENCH_DEFAULT_RULE          "BENCH_IDLE"
+
+/* Time given to PCD to start answering requests */
+#define API_BENCH_START_TIMEOUT_MS      5000
+
+static const char apiBenchRules[] =
+    "RULE = BENCH_IDLE\n"
+    "START_COND = NONE\n"
+    "COMMAND = NONE\n"
+    "SCHED = NICE,0\n"
+    "DAEMON = NO\n"
+    "END_COND = NONE\n"
+    "END_COND_TIMEOUT = -1\n"
+    "FAILURE_ACTION = NONE\n"
+    "ACTIVE = YES\n";
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static unsigned long long api_bench_get_time_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (unsigned long long)ts.tv_sec * 1000000000 ) + ts.tv_nsec;
+}
+
+static int api_bench_parse_rule_id( ruleId_t *ruleId, const char *str )
+{
+    const char *sp = strchr( str, '_' );
+
+    memset( ruleId, 0, sizeof( ruleId_t ) );
+
+    if ( ( !sp ) || ( sp - str >= PCD_RULEID_MAX_GROUP_NAME_SIZE ) || ( strlen( sp + 1 ) >= PCD_RULEID_MAX_RULE_NAME_SIZE ) )
+        return -1;
+
+    memcpy( ruleId->groupName, str, sp - str );
+    strcpy( ruleId->ruleName, sp + 1 );
+
+    return 0;
+}
+
+/* Find the daemonized PCD, it is the only child of the benchmark */
+static pid_t api_bench_find_child( void )
+{
+    struct dirent *entry;
+    pid_t child = -1;
+    DIR *dir;
+
+    if ( ( dir = opendir( "/proc" ) ) == NULL )
+        return -1;
+
+    while ( ( child < 0 ) && ( ( entry = readdir( dir ) ) != NULL ) )
+    {
+        char filename[ PATH_MAX ];
+        char line[ 256 ];
+        FILE *in;
+        char *sp;
+        int ppid;
+
+        if ( ( entry->d_name[ 0 ] < '0' ) || ( entry->d_name[ 0 ] > '9' ) )
+            continue;
+
+        snprintf( filename, sizeof( filename ), "/proc/%s/stat", entry->d_name );
+
+        if ( ( in = fopen( filename, "r" ) ) == NULL )
+            continue;
+
+        if ( ( fgets( line, sizeof( line ), in ) ) && ( ( sp = strrchr( line, ')' ) ) != NULL ) &&
+             ( sscanf( sp + 2, "%*c %d", &ppid ) == 1 ) && ( ppid == getpid() ) )
+        {
+            child = atoi( entry->d_name );
+        }
+
+        fclose( in );
+    }
+
+    closedir( dir );
+
+    return child;
+}
+
+/* Start PCD, and return the pid of the daemon */
+static pid_t api_bench_start_pcd( const char *pcdPath, const char *rulesFilename )
+{
+    pid_t pid;
+    int status;
+
+    if ( prctl( PR_SET_CHILD_SUBREAPER, 1 ) < 0 )
+    {
+        perror( "prctl" );
+        return -1;
+    }
+
+    if ( ( pid = fork() ) == 0 )
+    {
+        int fd = open( "/dev/null", O_WRONLY );
+
+        dup2( fd, STDOUT_FILENO );
+        dup2( fd, STDERR_FILENO );
+        execl( pcdPath, pcdPath, "-d", "-f", rulesFilename, (char *)NULL );
+        _exit( 1 );
+    }
+
+    if ( pid < 0 )
+        return -1;
+
+    /* The started process exits as soon as PCD daemonizes */
+    if ( ( waitpid( pid, &status, 0 ) < 0 ) || ( !WIFEXITED( status ) ) || ( WEXITSTATUS( status ) != 0 ) )
+        return -1;
+
+    return api_bench_find_child();
+}
+
+static void api_bench_run( const char *name, const ruleId_t *ruleId, u_int32_t iterations )
+{
+    pcdApiRuleState_e ruleState;
+    unsigned long long total = 0, min = ~0ULL, max = 0;
+    u_int32_t i;
+
+    for ( i = 0; i < iterations; i++ )
+    {
+        unsigned long long start = api_bench_get_time_ns();
+        unsigned long long elapsed;
+
+        PCD_api_get_rule_state( ruleId, &ruleState );
+
+        elapsed = api_bench_get_time_ns() - start;
+        total += elapsed;
+
+        if ( elapsed < min )
+            min = elapsed;
+
+        if ( elapsed > max )
+            max = elapsed;
+    }
+
+    printf( "bench=api call=get_rule_state rule=%s iterations=%u mean_ns=%llu min_ns=%llu max_ns=%llu\n",
+            name, iterations, total / iterations, min, max );
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *pcdPath = NULL, *ruleName = API_BENCH_DEFAULT_RULE;
+    char rulesFilename[] = "/tmp/api_benchXXXXXX";
+    u_int32_t iterations = API_BENCH_DEFAULT_ITERATIONS;
+    pcdApiRuleState_e ruleState;
+    ruleId_t ruleId, missingId;
+    unsigned long long deadline;
+    pid_t pcdPid = -1;
+    int opt, ret = 0;
+
+    while ( ( opt = getopt( argc, argv, "p:r:n:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'p':
+                pcdPath = optarg;
+                break;
+            case 'r':
+                ruleName = optarg;
+                break;
+            case 'n':
+                iterations = atoi( optarg );
+                break;
+            default:
+                fprintf( stderr, "Usage: %s [-p PCD] [-r rule] [-n iterations]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( ( iterations == 0 ) || ( api_bench_parse_rule_id( &ruleId, ruleName ) < 0 ) )
+    {
+        fprintf( stderr, "Invalid parameters\n" );
+        return 1;
+    }
+
+    if ( pcdPath )
+    {
+        int fd = mkstemp( rulesFilename );
+
+        if ( ( fd < 0 ) || ( write( fd, apiBenchRules, sizeof( apiBenchRules ) - 1 ) != sizeof( apiBenchRules ) - 1 ) )
+        {
+            fprintf( stderr, "Failed to write the rules file\n" );
+            return 1;
+        }
+
+        close( fd );
+
+        if ( ( pcdPid = api_bench_start_pcd( pcdPath, rulesFilename ) ) < 0 )
+        {
+            fprintf( stderr, "Failed to start PCD, is it already running?\n" );
+            unlink( rulesFilename );
+            return 1;
+        }
+    }
+
+    /* Wait until PCD answers */
+    deadline = api_bench_get_time_ns() + API_BENCH_START_TIMEOUT_MS * 1000000ULL;
+
+    while ( PCD_api_get_rule_state( &ruleId, &ruleState ) != PCD_STATUS_OK )
+    {
+        if ( api_bench_get_time_ns() > deadline )
+        {
+            fprintf( stderr, "PCD does not answer, or rule %s does not exist\n", ruleName );
+            ret = 1;
+            break;
+        }
+
+        usleep( 10000 );
+    }
+
+    if ( ret == 0 )
+    {
+        memcpy( &missingId, &ruleId, sizeof( missingId ) );
+        strcpy( missingId.ruleName, "MISSING" );
+
+        api_bench_run( "existing", &ruleId, iterations );
+        api_bench_run( "missing", &missingId, iterations );
+    }
+
+    if ( pcdPid > 0 )
+    {
+        /* PCD stops all the rules and exits */
+        kill( pcdPid, SIGTERM );
+        waitpid( pcdPid, NULL, 0 );
+        unlink( rulesFilename );
+    }
+
+    return ret;
+}
@@ -0,0 +1,443 @@
+/*
+ * engine_bench.c
+ * Description:
+ * Micro-benchmarks of the PCD engine hot paths
+ *
+ * Copyright (C) 2010 PCD Project - http://www.rt-embedded.com/pcd
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* The benchmark links with the PCD objects, and calls the engine functions
+ * directly, without the event loop:
+ * - The start and end condition check functions.
+ * - PCD_rulesdb_get_rule_by_id, with hits and misses, as the database grows.
+ * - PCD_timer_iterate, with rules which are polled on every iteration, and
+ *   with rules which wait for a dependency and cost nothing until notified.
+ * - PCD_parser_parse, on generated rules files.
+ * All the rules live in the same database, every benchmark uses its own groups.
+ *
+ * Usage: engine_bench [-s largest size] [-n iterations]
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "system_types.h"
+#include "rules_db.h"
+#include "condchk.h"
+#include "process.h"
+#include "timer.h"
+#include "parser.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define ENGINE_BENCH_DEFAULT_SIZE           10000
+#define ENGINE_BENCH_DEFAULT_ITERATIONS     100000
+
+/* Dependencies of the RULE_COMPLETED check */
+#define ENGINE_BENCH_DEPS                   4
+
+/* Globals of the PCD main module. Poll on every timer iteration */
+bool_t verboseOutput = False;
+bool_t debugMode = True;
+u_int32_t PCD_TIMER_TICK = 0;
+
+static u_int32_t iterations = ENGINE_BENCH_DEFAULT_ITERATIONS;
+
+typedef struct benchStats_t
+{
+    unsigned long long  total;
+    unsigned long long  min;
+    unsigned long long  max;
+
+} benchStats_t;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static unsigned long long engine_bench_get_time_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (unsigned long long)ts.tv_sec * 1000000000 ) + ts.tv_nsec;
+}
+
+static void engine_bench_stats_init( benchStats_t *stats )
+{
+    stats->total = 0;
+    stats->min = ~0ULL;
+    stats->max = 0;
+}
+
+static void engine_bench_stats_add( benchStats_t *stats, unsigned long long elapsed )
+{
+    stats->total += elapsed;
+
+    if ( elapsed < stats->min )
+        stats->min = elapsed;
+
+    if ( elapsed > stats->max )
+        stats->max = elapsed;
+}
+
+static rule_t *engine_bench_new_rule( const char *groupName, u_int32_t idx )
+{
+    rule_t rule;
+
+    memset( &rule, 0, sizeof( rule ) );
+    snprintf( rule.ruleId.groupName, sizeof( rule.ruleId.groupName ), "%s", groupName );
+    snprintf( rule.ruleId.ruleName, sizeof( rule.ruleId.ruleName ), "R%u", idx );
+
+    if ( PCD_rulesdb_add_rule( &rule ) != PCD_STATUS_OK )
+        return NULL;
+
+    return PCD_rulesdb_get_rule_by_id( &rule.ruleId );
+}
+
+/* Time a condition check function, the batches amortize the clock reads */
+static void engine_bench_cond( const char *name, condCheckFunc func, rule_t *rule )
+{
+    unsigned long long start;
+    u_int32_t i;
+
+    start = engine_bench_get_time_ns();
+
+    for ( i = 0; i < iterations; i++ )
+        func( rule );
+
+    printf( "bench=condchk cond=%s iterations=%u mean_ns=%llu\n",
+            name, iterations, ( engine_bench_get_time_ns() - start ) / iterations );
+}
+
+static void engine_bench_condchk( void )
+{
+    static ruleCache_t deps[ ENGINE_BENCH_DEPS ];
+    static procObj_t proc;
+    rule_t rule;
+    u_int32_t i;
+
+    memset( &rule, 0, sizeof( rule ) );
+
+    rule.startCondition.type = PCD_START_COND_KEYWORD_NONE;
+    engine_bench_cond( "start_NONE", PCD_start_cond_check_get_function( rule.startCondition.type ), &rule );
+
+    rule.startCondition.type = PCD_START_COND_KEYWORD_FILE;
+    rule.startCondition.filename = "/";
+    engine_bench_cond( "start_FILE", PCD_start_cond_check_get_function( rule.startCondition.type ), &rule );
+
+    /* All the dependencies completed, so all of them are checked */
+    for ( i = 0; i < ENGINE_BENCH_DEPS; i++ )
+    {
+        deps[ i ].rule = engine_bench_new_rule( "CONDDEP", i );
+
+        if ( !deps[ i ].rule )
+            return;
+
+        deps[ i ].ruleId = deps[ i ].rule->ruleId;
+        deps[ i ].rule->ruleState = PCD_RULE_COMPLETED;
+    }
+
+    rule.startCondition.type = PCD_START_COND_KEYWORD_RULE_COMPLETED;
+    rule.startCondition.ruleCompleted = deps;
+    rule.startCondition.numRuleCompleted = ENGINE_BENCH_DEPS;
+    engine_bench_cond( "start_RULE_COMPLETED", PCD_start_cond_check_get_function( rule.startCondition.type ), &rule );
+
+    rule.startCondition.type = PCD_START_COND_KEYWORD_NETDEVICE;
+    rule.startCondition.netDevice = "lo";
+    rule.startCondition.netDeviceState = PCD_COND_NETDEVICE_UP;
+    engine_bench_cond( "start_NETDEVICE", PCD_start_cond_check_get_function( rule.startCondition.type ), &rule );
+
+    rule.startCondition.type = PCD_START_COND_KEYWORD_IPC_OWNER;
+    rule.startCondition.ipcOwner = 1;
+    engine_bench_cond( "start_IPC_OWNER", PCD_start_cond_check_get_function( rule.startCondition.type ), &rule );
+
+    rule.startCondition.type = PCD_START_COND_KEYWORD_ENV_VAR;
+    rule.startCondition.envVar.envVarName = "PATH";
+    rule.startCondition.envVar.envVarValue = "";
+    engine_bench_cond( "start_ENV_VAR", PCD_start_cond_check_get_function( rule.startCondition.type ), &rule );
+
+    rule.endCondition.type = PCD_END_COND_KEYWORD_NONE;
+    engine_bench_cond( "end_NONE", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+
+    rule.endCondition.type = PCD_END_COND_KEYWORD_FILE;
+    rule.endCondition.filename = "/";
+    engine_bench_cond( "end_FILE", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+
+    proc.retstat = PCD_PROCESS_RETEXITED;
+    rule.proc = &proc;
+    rule.endCondition.type = PCD_END_COND_KEYWORD_EXIT;
+    engine_bench_cond( "end_EXIT", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+    rule.proc = NULL;
+
+    rule.endCondition.type = PCD_END_COND_KEYWORD_NETDEVICE;
+    rule.endCondition.netDevice = "lo";
+    rule.endCondition.netDeviceState = PCD_COND_NETDEVICE_UP;
+    engine_bench_cond( "end_NETDEVICE", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+
+    rule.endCondition.type = PCD_END_COND_KEYWORD_IPC_OWNER;
+    rule.endCondition.ipcOwner = 1;
+    engine_bench_cond( "end_IPC_OWNER", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+
+    rule.endCondition.type = PCD_END_COND_KEYWORD_PROCESS_READY;
+    engine_bench_cond( "end_PROCESS_READY", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+
+    rule.endCondition.type = PCD_END_COND_KEYWORD_WAIT;
+    engine_bench_cond( "end_WAIT", PCD_end_cond_check_get_function( rule.endCondition.type ), &rule );
+}
+
+static void engine_bench_rulesdb( u_int32_t maxSize )
+{
+    ruleId_t *ids;
+    u_int32_t size, numRules = 0, i;
+
+    if ( ( ids = malloc( sizeof( ruleId_t ) * maxSize ) ) == NULL )
+        return;
+
+    for ( size = 10; size <= maxSize; size *= 10 )
+    {
+        benchStats_t hits, misses;
+        ruleId_t missId;
+
+        /* Grow the database, 50 rules in a group */
+        while ( numRules < size )
+        {
+            char groupName[ PCD_RULEID_MAX_GROUP_NAME_SIZE ];
+            rule_t *rule;
+
+            snprintf( groupName, sizeof( groupName ), "DB%u", numRules / 50 );
+
+            if ( ( rule = engine_bench_new_rule( groupName, numRules ) ) == NULL )
+            {
+                free( ids );
+                return;
+            }
+
+            ids[ numRules++ ] = rule->ruleId;
+        }
+
+        engine_bench_stats_init( &hits );
+        engine_bench_stats_init( &misses );
+
+        /* The missing rule is in an existing group */
+        memcpy( &missId, &ids[ 0 ], sizeof( missId ) );
+        strcpy( missId.ruleName, "MISSING" );
+
+        for ( i = 0; i < iterations; i++ )
+        {
+            unsigned long long start = engine_bench_get_time_ns();
+
+            PCD_rulesdb_get_rule_by_id( &ids[ ( i * 7919 ) % numRules ] );
+            engine_bench_stats_add( &hits, engine_bench_get_time_ns() - start );
+
+            start = engine_bench_get_time_ns();
+            PCD_rulesdb_get_rule_by_id( &missId );
+            engine_bench_stats_add( &misses, engine_bench_get_time_ns() - start );
+        }
+
+        printf( "bench=rulesdb_get_rule_by_id result=hit rules=%u iterations=%u mean_ns=%llu min_ns=%llu max_ns=%llu\n",
+                numRules, iterations, hits.total / iterations, hits.min, hits.max );
+        printf( "bench=rulesdb_get_rule_by_id result=miss rules=%u iterations=%u mean_ns=%llu min_ns=%llu max_ns=%llu\n",
+                numRules, iterations, misses.total / iterations, misses.min, misses.max );
+    }
+
+    free( ids );
+}
+
+static void engine_bench_timer( u_int32_t maxSize )
+{
+    rule_t *blocker;
+    u_int32_t size, group = 0, i;
+    ruleCache_t dep;
+
+    /* Rules in the idle mode wait for a rule which never completes */
+    if ( ( blocker = engine_bench_new_rule( "TIMERDEP", 0 ) ) == NULL )
+        return;
+
+    dep.rule = blocker;
+    dep.ruleId = blocker->ruleId;
+
+    PCD_timer_start();
+
+    for ( size = 10; size <= maxSize; size *= 10 )
+    {
+        const char *modes[] = { "poll", "idle" };
+        u_int32_t mode;
+
+        for ( mode = 0; mode < 2; mode++ )
+        {
+            char groupName[ PCD_RULEID_MAX_GROUP_NAME_SIZE ];
+            rule_t **rules;
+            benchStats_t stats;
+            u_int32_t loops = ( mode == 0 ) ? ( iterations / size ) + 1 : iterations;
+
+            if ( ( rules = malloc( sizeof( rule_t * ) * size ) ) == NULL )
+                return;
+
+            snprintf( groupName, sizeof( groupName ), "TIMER%u", group++ );
+
+            for ( i = 0; i < size; i++ )
+            {
+                if ( ( rules[ i ] = engine_bench_new_rule( groupName, i ) ) == NULL )
+                {
+                    free( rules );
+                    return;
+                }
+
+                if ( mode == 0 )
+                {
+                    /* The variable is never set, the condition is polled */
+                    rules[ i ]->startCondition.type = PCD_START_COND_KEYWORD_ENV_VAR;
+                    rules[ i ]->startCondition.envVar.envVarName = "PCD_BENCH_UNSET";
+                    rules[ i ]->startCondition.envVar.envVarValue = "1";
+                }
+                else
+                {
+                    rules[ i ]->startCondition.type = PCD_START_COND_KEYWORD_RULE_COMPLETED;
+                    rules[ i ]->startCondition.ruleCompleted = &dep;
+                    rules[ i ]->startCondition.numRuleCompleted = 1;
+                }
+
+                PCD_timer_enqueue_rule( rules[ i ] );
+            }
+
+            /* The first iteration checks the new rules, and files them in the wait lists */
+            PCD_timer_iterate();
+
+            engine_bench_stats_init( &stats );
+
+            for ( i = 0; i < loops; i++ )
+            {
+                unsigned long long start = engine_bench_get_time_ns();
+
+                PCD_timer_iterate();
+                engine_bench_stats_add( &stats, engine_bench_get_time_ns() - start );
+            }
+
+            printf( "bench=timer_iterate mode=%s timers=%u iterations=%u mean_ns=%llu min_ns=%llu max_ns=%llu\n",
+                    modes[ mode ], size, loops, stats.total / loops, stats.min, stats.max );
+
+            for ( i = 0; i < size; i++ )
+                PCD_timer_dequeue_rule( rules[ i ], False );
+
+            /* Release the dequeued objects */
+            PCD_timer_iterate();
+
+            free( rules );
+        }
+    }
+
+    PCD_timer_stop();
+}
+
+static void engine_bench_parser( u_int32_t maxSize )
+{
+    u_int32_t size, group = 0, i;
+
+    for ( size = 10; size <= maxSize; size *= 10 )
+    {
+        char filename[] = "/tmp/engine_benchXXXXXX";
+        unsigned long long start, elapsed;
+        FILE *out;
+        int fd;
+
+        if ( ( fd = mkstemp( filename ) ) < 0 )
+            return;
+
+        if ( ( out = fdopen( fd, "w" ) ) == NULL )
+        {
+            close( fd );
+            unlink( filename );
+            return;
+        }
+
+        /* A chain of rules with a command line, 50 rules in a group */
+        for ( i = 0; i < size; i++ )
+        {
+            fprintf( out, "RULE = P%u_R%u\n", group + ( i / 50 ), i );
+
+            if ( i == 0 )
+                fprintf( out, "START_COND = NONE\n" );
+            else
+                fprintf( out, "START_COND = RULE_COMPLETED,P%u_R%u\n", group + ( ( i - 1 ) / 50 ), i - 1 );
+
+            fprintf( out, "COMMAND = /bin/echo -n rule %u\nSCHED = NICE,0\nDAEMON = NO\nEND_COND = EXIT,0\n"
+                          "END_COND_TIMEOUT = 1000\nFAILURE_ACTION = NONE\nACTIVE = NO\n\n", i );
+        }
+
+        fclose( out );
+        group += ( size / 50 ) + 1;
+
+        start = engine_bench_get_time_ns();
+
+        if ( PCD_parser_parse( filename ) != PCD_STATUS_OK )
+        {
+            unlink( filename );
+            return;
+        }
+
+        elapsed = engine_bench_get_time_ns() - start;
+        unlink( filename );
+
+        printf( "bench=parser rules=%u total_us=%llu rules_per_sec=%llu\n",
+                size, elapsed / 1000, ( size * 1000000000ULL ) / ( elapsed ? elapsed : 1 ) );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    u_int32_t maxSize = ENGINE_BENCH_DEFAULT_SIZE;
+    int opt;
+
+    while ( ( opt = getopt( argc, argv, "s:n:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 's':
+                maxSize = atoi( optarg );
+                break;
+            case 'n':
+                iterations = atoi( optarg );
+                break;
+            default:
+                fprintf( stderr, "Usage: %s [-s largest size] [-n iterations]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( ( maxSize < 10 ) || ( iterations == 0 ) )
+    {
+        fprintf( stderr, "Invalid parameters\n" );
+        return 1;
+    }
+
+    engine_bench_condchk();
+    engine_bench_rulesdb( maxSize );
+    engine_bench_timer( maxSize );
+    engine_bench_parser( maxSize );
+
+    return 0;
+}
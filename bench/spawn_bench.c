@@ -0,0 +1,219 @@
+/*
+ * spawn_bench.c
+ * Description:
+ * Spawn-to-exec latency benchmark: fork, vfork and posix_spawn
+ *
+ * Copyright (C) 2010 PCD Project - http://www.rt-embedded.com/pcd
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* The benchmark grows its heap to emulate a supervisor with many rules, then
+ * measures the time from the spawn call until the child executes the program.
+ * The child holds the write end of a close-on-exec pipe, the parent reads it
+ * until EOF, which happens exactly when the child executes.
+ *
+ * Usage: spawn_bench [-m heap size in MB] [-n iterations] [-c command]
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define SPAWN_BENCH_DEFAULT_HEAP_MB     64
+#define SPAWN_BENCH_DEFAULT_ITERATIONS  200
+#define SPAWN_BENCH_DEFAULT_COMMAND     "/bin/true"
+
+extern char **environ;
+
+typedef enum spawnMethod_e
+{
+    SPAWN_METHOD_FORK,
+    SPAWN_METHOD_VFORK,
+    SPAWN_METHOD_POSIX_SPAWN,
+
+} spawnMethod_e;
+
+static const char *spawnMethodName[] = { "fork", "vfork", "posix_spawn" };
+
+static char *benchArgs[ 2 ];
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static unsigned long long spawn_bench_get_time_us( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (unsigned long long)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
+
+static pid_t spawn_bench_spawn( spawnMethod_e method )
+{
+    pid_t pid = -1;
+
+    switch ( method )
+    {
+        case SPAWN_METHOD_FORK:
+            pid = fork();
+            break;
+
+        case SPAWN_METHOD_VFORK:
+            pid = vfork();
+            break;
+
+        case SPAWN_METHOD_POSIX_SPAWN:
+            if ( posix_spawn( &pid, benchArgs[ 0 ], NULL, NULL, benchArgs, environ ) != 0 )
+                return -1;
+            return pid;
+    }
+
+    if ( pid == 0 )
+    {
+        execv( benchArgs[ 0 ], benchArgs );
+        _exit( 127 );
+    }
+
+    return pid;
+}
+
+static int spawn_bench_run( spawnMethod_e method, int iterations, int heapMb )
+{
+    unsigned long long total = 0, min = ~0ULL, max = 0;
+    int i;
+
+    for ( i = 0; i < iterations; i++ )
+    {
+        unsigned long long start, elapsed;
+        int fds[ 2 ];
+        char c;
+        pid_t pid;
+        int st;
+
+        if ( pipe2( fds, O_CLOEXEC ) < 0 )
+        {
+            perror( "pipe2" );
+            return -1;
+        }
+
+        start = spawn_bench_get_time_us();
+
+        pid = spawn_bench_spawn( method );
+
+        close( fds[ 1 ] );
+
+        if ( pid < 0 )
+        {
+            fprintf( stderr, "%s: spawn failed\n", spawnMethodName[ method ] );
+            close( fds[ 0 ] );
+            return -1;
+        }
+
+        /* EOF once the child executed, the write end is close-on-exec */
+        while ( read( fds[ 0 ], &c, 1 ) > 0 );
+
+        elapsed = spawn_bench_get_time_us() - start;
+
+        close( fds[ 0 ] );
+        waitpid( pid, &st, 0 );
+
+        total += elapsed;
+        if ( elapsed < min )
+            min = elapsed;
+        if ( elapsed > max )
+            max = elapsed;
+    }
+
+    printf( "bench=spawn method=%s heap_mb=%d iterations=%d mean_us=%llu min_us=%llu max_us=%llu\n",
+            spawnMethodName[ method ], heapMb, iterations, total / iterations, min, max );
+
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    int heapMb = SPAWN_BENCH_DEFAULT_HEAP_MB;
+    int iterations = SPAWN_BENCH_DEFAULT_ITERATIONS;
+    char *heap;
+    int opt;
+
+    benchArgs[ 0 ] = SPAWN_BENCH_DEFAULT_COMMAND;
+    benchArgs[ 1 ] = NULL;
+
+    while ( ( opt = getopt( argc, argv, "m:n:c:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'm':
+                heapMb = atoi( optarg );
+                break;
+            case 'n':
+                iterations = atoi( optarg );
+                break;
+            case 'c':
+                benchArgs[ 0 ] = optarg;
+                break;
+            default:
+                fprintf( stderr, "Usage: %s [-m heap size in MB] [-n iterations] [-c command]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( ( heapMb < 0 ) || ( iterations <= 0 ) )
+    {
+        fprintf( stderr, "Invalid parameters\n" );
+        return 1;
+    }
+
+    /* Touch every page, fork copies the page tables of the whole heap */
+    heap = malloc( (size_t)heapMb * 1024 * 1024 + 1 );
+
+    if ( !heap )
+    {
+        perror( "malloc" );
+        return 1;
+    }
+
+    memset( heap, 1, (size_t)heapMb * 1024 * 1024 );
+
+    if ( ( spawn_bench_run( SPAWN_METHOD_FORK, iterations, heapMb ) < 0 ) ||
+         ( spawn_bench_run( SPAWN_METHOD_VFORK, iterations, heapMb ) < 0 ) ||
+         ( spawn_bench_run( SPAWN_METHOD_POSIX_SPAWN, iterations, heapMb ) < 0 ) )
+    {
+        free( heap );
+        return 1;
+    }
+
+    free( heap );
+
+    return 0;
+}
@@ -84,6 +84,8 @@
     General functions:
     1. IPC_cleanup_proc -> A general function to cleanup resources of a context. Can be used by a process monitor.
     2. IPC_general_func -> A general purpose function. Not used currently.
+    3. IPC_get_fd       -> Get the file descriptor of a destination point, for select/poll/epoll loops.
+    4. IPC_recv_msgs    -> Receive all the pending messages at once, instead of IPC_wait_msg (Server).
  
  * Copyright (C) 2011 PCD Project - http://www.rt-embedded.com/pcd
  * 
@@ -97,7 +99,8 @@
 typedef enum
 {
 	IPC_STATUS_OK = 0,
-	IPC_STATUS_NOK = -1
+	IPC_STATUS_NOK = -1,
+	IPC_STATUS_BUSY = -2	/* The destination cannot receive now, try again later */
 	
 } IPC_status_e;
 
@@ -129,6 +132,13 @@ enum { IPC_NO_OWNER = ~0U };
 
 typedef u_int32_t IPC_context_t;
 
+/*! \def IPC_MAX_LIST_SIZE
+ *  \brief Maximum size of the IPC clients list, contexts are below it
+ */
+#ifndef IPC_MAX_LIST_SIZE
+#define IPC_MAX_LIST_SIZE   32
+#endif /* IPC_MAX_LIST_SIZE */
+
 /*!\fn IPC_init
  * \brief Initialize the IPC module. To be used in case it requires general init.
  * \param[in] 		flags: Special handling flags
@@ -147,7 +157,7 @@ IPC_status_e IPC_deinit( u_int32_t flags );
  * \param[in] 		myName: Context socket identifier
  * \param[in] 		flags: Special handling flags
  * \param[out]      myContext: Context handle, to be used with the IPC API
- * \return			IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ * \return			IPC_STATUS_OK - Success, IPC_STATUS_BUSY - The list of clients is full, IPC_STATUS_NOK - Error
  */
 IPC_status_e IPC_start( char *myName, IPC_context_t *myContext, u_int32_t flags );
 
@@ -183,8 +193,8 @@ IPC_status_e IPC_free_msg( IPC_message_t *msg );
 /*!\fn IPC_send_msg
  * \brief Send a message to a destination. Use either the destination's context or name.
  * \param[in] 		destContext: Destination context (message target)
- * \param[in] 		msg: Pointer to an IPC message
- * \return			IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ * \param[in] 		msg: Pointer to an IPC message, freed only on success
+ * \return			IPC_STATUS_OK - Success, IPC_STATUS_BUSY - The receive queue of the destination is full, IPC_STATUS_NOK - Error
  */
 IPC_status_e IPC_send_msg( IPC_context_t destContext, IPC_message_t *msg );
 
@@ -197,11 +207,21 @@ IPC_status_e IPC_send_msg( IPC_context_t destContext, IPC_message_t *msg );
  */
 IPC_status_e IPC_wait_msg( IPC_context_t myContext, IPC_message_t **msgBuffer, IPC_timeout_e timeout );
 
+/*!\fn IPC_recv_msgs
+ * \brief Receive the pending messages without waiting, up to a given number, in a single system call where
+ * supported. Each message is allocated to its actual size, invalid messages are dropped.
+ * \param[in] 		myContext: Context handle
+ * \param[out] 	    msgBuffers: Array of pointers to IPC messages, populated with the received messages
+ * \param[in,out] 	numMsgs: Size of the array, and the number of received messages (zero if none was pending)
+ * \return			IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ */
+IPC_status_e IPC_recv_msgs( IPC_context_t myContext, IPC_message_t **msgBuffers, u_int32_t *numMsgs );
+
 /*!\fn IPC_reply_msg
  * \brief Reply to an incoming message. Incoming message needs to be freed after replying.
  * \param[in]       incomingMsg: The IPC message which we want to reply to.
- * \param[in] 	    replyMsg: The IPC reply message
- * \return			IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ * \param[in] 	    replyMsg: The IPC reply message, freed only on success
+ * \return			IPC_STATUS_OK - Success, IPC_STATUS_BUSY - The receive queue of the destination is full, IPC_STATUS_NOK - Error
  */
 IPC_status_e IPC_reply_msg( IPC_message_t *incomingMsg, IPC_message_t *replyMsg );
 
@@ -244,6 +264,22 @@ IPC_status_e IPC_set_owner( IPC_context_t myContext, u_int32_t owner );
  */
 IPC_status_e IPC_get_context_by_owner( IPC_context_t *destContext, u_int32_t owner );
 
+/*!\fn IPC_get_fd
+ * \brief Get the file descriptor of a destination point, to be watched by the caller's event loop (optional).
+ * \param[in] 		myContext: Context handle
+ * \param[out] 	    fd: The file descriptor of the context
+ * \return			IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ */
+IPC_status_e IPC_get_fd( IPC_context_t myContext, int32_t *fd );
+
+/*!\fn IPC_get_context_pid
+ * \brief Get the process which started a destination point (optional).
+ * \param[in] 		context: Context handle
+ * \param[out] 	    pid: Process ID, 0 if the destination point is not started
+ * \return			IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ */
+IPC_status_e IPC_get_context_pid( IPC_context_t context, pid_t *pid );
+
 /*!\fn IPC_general_func
  * \brief Optional general function for any extension required.
  * \param[in]       value: Some value
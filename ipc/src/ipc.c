@@ -44,17 +44,33 @@
  * - Hai Shalom: Added deinit function
  * - Hai Shalom: Added a lock to protect from concurrent accesses from 
  *               the same context (threads).
+ * - Reclaim the records of processes which exited without stopping their
+ *   destination points, cleanup all the records of a process, and do not
+ *   hold the context lock while waiting for a message.
+ * - Enlarge the maximum message size for batch requests.
+ * - Receive several messages in a single system call. Tell the caller when
+ *   a reply cannot be sent because the receive queue of the client is full.
+ * - Tell the caller when a message cannot be sent because the receive queue
+ *   of the destination is full.
+ * - Tell the caller when a destination point cannot be started because the
+ *   list of clients is full.
+ * - Get the process which started a destination point.
  */
 
+/* Required for recvmmsg */
+#define _GNU_SOURCE
+
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <syslog.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <pthread.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/shm.h>
 #include <sys/un.h>
 #include "system_types.h"
@@ -104,20 +120,18 @@
 
 */
 
-/*! \def IPC_MAX_LIST_SIZE
- *  \brief Maximum size of the IPC clients list
- */
-#ifndef IPC_MAX_LIST_SIZE
-#define IPC_MAX_LIST_SIZE   32
-#endif /* IPC_MAX_LIST_SIZE */
-
 /*! \def IPC_MAX_BUFFER_SIZE
  *  \brief Maximum IPC message size
  */
 #ifndef IPC_MAX_BUFFER_SIZE
-#define IPC_MAX_BUFFER_SIZE 1024
+#define IPC_MAX_BUFFER_SIZE 4096
 #endif /* IPC_MAX_BUFFER_SIZE */
 
+/*! \def IPC_MAX_RECV_MSGS
+ *  \brief Maximum number of messages received in a single system call
+ */
+#define IPC_MAX_RECV_MSGS   16
+
 /*! \def IPC_SOCKET_PATH
  *  \brief The path for the IPC sockets (platform depended - can be overridden by the makefile)
  */
@@ -298,7 +312,7 @@ IPC_status_e IPC_deinit( u_int32_t flags )
 
 /*!\fn IPC_start
  * \brief Start a communication channel.
- * \return          IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ * \return          IPC_STATUS_OK - Success, IPC_STATUS_BUSY - The list of clients is full, IPC_STATUS_NOK - Error
  */
 IPC_status_e IPC_start( char *myName, IPC_context_t *myContext, u_int32_t flags )
 {
@@ -330,12 +344,24 @@ IPC_status_e IPC_start( char *myName, IPC_context_t *myContext, u_int32_t flags
 
     if ( i == IPC_MAX_LIST_SIZE )
     {
-        pthread_mutex_unlock( &IPC_Clients->lock );
+        /* Reclaim a record of a process which exited without stopping its destination point */
+        for ( i = 0; i < IPC_MAX_LIST_SIZE; i++ )
+        {
+            if ( ( kill( IPC_Clients->list[ i ].pid, 0 ) < 0 ) && ( errno == ESRCH ) )
+            {
+                unlink( IPC_Clients->list[ i ].path );
+                memset( &IPC_Clients->list[ i ], 0, sizeof( IPC_client_t ) );
+                break;
+            }
+        }
+    }
 
-        IPC_PRINTF_ERROR_STDERR( "Maximum amount of clients has reached, consider enlarging the list" );
+    if ( i == IPC_MAX_LIST_SIZE )
+    {
+        pthread_mutex_unlock( &IPC_Clients->lock );
 
-        /* No more space in list */
-        return IPC_STATUS_NOK;
+        /* No more space in list, until another client stops */
+        return IPC_STATUS_BUSY;
     }
 
     flags |= MSG_DONTWAIT;
@@ -528,6 +554,13 @@ IPC_status_e IPC_send_msg( IPC_context_t destContext, IPC_message_t *msg )
     if ( sendto( IPC_Clients->list[ msg->context ].fd, msg, msg->size, IPC_Clients->list[ msg->context ].flags, (struct sockaddr *)&to, sizeof(struct sockaddr_un) ) < 0 )
     {
         pthread_mutex_unlock( &info.lock );
+
+        /* The destination did not read its previous messages yet */
+        if ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) )
+        {
+            return IPC_STATUS_BUSY;
+        }
+
         IPC_PRINTF_ERROR_STDERR( "Send IPC messaged failed" );
         return IPC_STATUS_NOK;
     }
@@ -579,7 +612,7 @@ IPC_status_e IPC_wait_msg( IPC_context_t myContext, IPC_message_t **msgBuffer, I
         {
             /* Define the timeout while waiting for the message */
             to.tv_sec = timeout / 1000;
-            to.tv_usec = timeout - ( to.tv_sec * 1000 );
+            to.tv_usec = ( timeout % 1000 ) * 1000;
         }
     }
 
@@ -587,10 +620,8 @@ IPC_status_e IPC_wait_msg( IPC_context_t myContext, IPC_message_t **msgBuffer, I
     FD_ZERO(&rdset);
     FD_SET(fd, &rdset);
 
-    /* Wait for the lock */
-    pthread_mutex_lock( &info.lock );
-
-    /* Wait for incoming messages. Deal with signals correctly */
+    /* Wait for incoming messages. Deal with signals correctly. The lock is not held
+     * while waiting, other threads may send and wait on their own contexts meanwhile */
     do
     {
         ret = select( fd+1, &rdset, 0, 0, pto );
@@ -600,7 +631,6 @@ IPC_status_e IPC_wait_msg( IPC_context_t myContext, IPC_message_t **msgBuffer, I
     if(ret <= 0)
     {
         /* timeout or error, return with error */
-        pthread_mutex_unlock( &info.lock );
         return IPC_STATUS_NOK;
     }
     else
@@ -617,6 +647,9 @@ IPC_status_e IPC_wait_msg( IPC_context_t myContext, IPC_message_t **msgBuffer, I
                 goto wait_msg_fail;
             }
 
+            /* Wait for the lock */
+            pthread_mutex_lock( &info.lock );
+
             /* Receive the message */
             ret = recv(fd, localMsgBuffer, IPC_MAX_BUFFER_SIZE, MSG_DONTWAIT | MSG_NOSIGNAL);
             
@@ -643,6 +676,151 @@ IPC_status_e IPC_wait_msg( IPC_context_t myContext, IPC_message_t **msgBuffer, I
     return IPC_STATUS_NOK;
 }
 
+/*!\fn IPC_copy_msg
+ * \brief Check a received message, and copy it to a buffer of its actual size.
+ * \return          Pointer to an IPC message - Success, NULL - Invalid message or error
+ */
+static IPC_message_t *IPC_copy_msg( const u_int8_t *buffer, int32_t len )
+{
+    const IPC_message_t *received = (const IPC_message_t *)buffer;
+    IPC_message_t *msg;
+
+    if ( ( len < (int32_t)sizeof( IPC_message_t ) ) || ( received->magic != IPC_MESSAGE_MAGIC ) ||
+         ( received->size != (u_int32_t)len ) || ( received->context < 0 ) || ( received->context >= IPC_MAX_LIST_SIZE ) )
+    {
+        IPC_PRINTF_ERROR_STDERR( "Invalid IPC message" );
+        return NULL;
+    }
+
+    msg = malloc( len );
+
+    if ( !msg )
+    {
+        IPC_PRINTF_ERROR_STDERR( "Failed to allocate IPC message memory" );
+        return NULL;
+    }
+
+    memcpy( msg, buffer, len );
+
+    return msg;
+}
+
+/*!\fn IPC_recv_msgs
+ * \brief Receive the pending messages without waiting, up to a given number.
+ * \return          IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ */
+IPC_status_e IPC_recv_msgs( IPC_context_t myContext, IPC_message_t **msgBuffers, u_int32_t *numMsgs )
+{
+    int32_t i = (int32_t)myContext;
+    u_int32_t max, received = 0, n;
+    u_int8_t *buffer;
+    int32_t fd, ret;
+#ifdef MSG_WAITFORONE
+    struct mmsghdr hdrs[ IPC_MAX_RECV_MSGS ];
+    struct iovec iovs[ IPC_MAX_RECV_MSGS ];
+#endif
+
+    ENTER_FUNC;
+
+    /* Sanity checks */
+    if( !initDone || i >= IPC_MAX_LIST_SIZE || !msgBuffers || !numMsgs || IPC_Clients->list[ i ].fd == 0 )
+    {
+        return IPC_STATUS_NOK;
+    }
+
+    fd = (int32_t)IPC_Clients->list[ i ].fd;
+    max = ( *numMsgs < IPC_MAX_RECV_MSGS ) ? *numMsgs : IPC_MAX_RECV_MSGS;
+    *numMsgs = 0;
+
+    if ( max == 0 )
+    {
+        return IPC_STATUS_OK;
+    }
+
+#ifdef MSG_WAITFORONE
+    /* Receive all the messages at once, each to a buffer of the maximum size */
+    buffer = malloc( max * IPC_MAX_BUFFER_SIZE );
+
+    if( !buffer )
+    {
+        IPC_PRINTF_ERROR_STDERR( "Failed to allocate IPC message memory" );
+        return IPC_STATUS_NOK;
+    }
+
+    memset( hdrs, 0, sizeof( hdrs ) );
+
+    for ( n = 0; n < max; n++ )
+    {
+        iovs[ n ].iov_base = buffer + ( n * IPC_MAX_BUFFER_SIZE );
+        iovs[ n ].iov_len = IPC_MAX_BUFFER_SIZE;
+        hdrs[ n ].msg_hdr.msg_iov = &iovs[ n ];
+        hdrs[ n ].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Wait for the lock */
+    pthread_mutex_lock( &info.lock );
+
+    do
+    {
+        ret = recvmmsg( fd, hdrs, max, MSG_DONTWAIT, NULL );
+
+    } while( ret == -1 && errno == EINTR );
+
+    pthread_mutex_unlock( &info.lock );
+
+    for ( n = 0; ( ret > 0 ) && ( n < (u_int32_t)ret ); n++ )
+    {
+        /* Invalid messages are dropped */
+        if ( ( msgBuffers[ received ] = IPC_copy_msg( buffer + ( n * IPC_MAX_BUFFER_SIZE ), hdrs[ n ].msg_len ) ) != NULL )
+        {
+            received++;
+        }
+    }
+#else
+    /* No recvmmsg in this C library, receive the messages one by one */
+    buffer = malloc( IPC_MAX_BUFFER_SIZE );
+
+    if( !buffer )
+    {
+        IPC_PRINTF_ERROR_STDERR( "Failed to allocate IPC message memory" );
+        return IPC_STATUS_NOK;
+    }
+
+    /* Wait for the lock */
+    pthread_mutex_lock( &info.lock );
+
+    for ( n = 0; n < max; n++ )
+    {
+        ret = recv( fd, buffer, IPC_MAX_BUFFER_SIZE, MSG_DONTWAIT | MSG_NOSIGNAL );
+
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                n--;
+                continue;
+            }
+
+            break;
+        }
+
+        /* Invalid messages are dropped */
+        if ( ( msgBuffers[ received ] = IPC_copy_msg( buffer, ret ) ) != NULL )
+        {
+            received++;
+        }
+    }
+
+    pthread_mutex_unlock( &info.lock );
+#endif
+
+    free( buffer );
+
+    *numMsgs = received;
+
+    return IPC_STATUS_OK;
+}
+
 /*!\fn IPC_reply_msg
  * \brief Reply to an incoming message. Incoming message needs to be freed after replying.
  * \return          IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
@@ -670,6 +848,12 @@ IPC_status_e IPC_reply_msg( IPC_message_t *incomingMsg, IPC_message_t *replyMsg
     if ( sendto( IPC_Clients->list[ (int32_t)replyMsg->context ].fd, replyMsg, replyMsg->size, IPC_Clients->list[ (int32_t)replyMsg->context ].flags, (struct sockaddr *)&to, sizeof(struct sockaddr_un) ) < 0 )
     {
         pthread_mutex_unlock( &info.lock );
+
+        /* The destination did not read its previous messages yet */
+        if ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) )
+        {
+            return IPC_STATUS_BUSY;
+        }
         
         IPC_PRINTF_ERROR_STDERR( "Send IPC messaged failed" );
         return IPC_STATUS_NOK;
@@ -702,6 +886,50 @@ IPC_status_e IPC_get_msg_context( IPC_message_t *msg, IPC_context_t *msgContext
     return IPC_STATUS_OK;
 }
 
+/*!\fn IPC_get_fd
+ * \brief Get the file descriptor of a destination point (optional).
+ * \return          IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ */
+IPC_status_e IPC_get_fd( IPC_context_t myContext, int32_t *fd )
+{
+    int32_t i = (int32_t)myContext;
+
+    ENTER_FUNC;
+
+    /* Sanity checks, the descriptor is valid only in the owner process */
+    if( !initDone || !fd || i >= IPC_MAX_LIST_SIZE || IPC_Clients->list[ i ].fd == 0 || IPC_Clients->list[ i ].pid != getpid() )
+    {
+        return IPC_STATUS_NOK;
+    }
+
+    *fd = IPC_Clients->list[ i ].fd;
+    return IPC_STATUS_OK;
+}
+
+/*!\fn IPC_get_context_pid
+ * \brief Get the process which started a destination point (optional).
+ * \return          IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
+ */
+IPC_status_e IPC_get_context_pid( IPC_context_t context, pid_t *pid )
+{
+    int32_t i = (int32_t)context;
+
+    ENTER_FUNC;
+
+    /* Sanity checks */
+    if( !initDone || !pid || i < 0 || i >= IPC_MAX_LIST_SIZE )
+    {
+        return IPC_STATUS_NOK;
+    }
+
+    pthread_mutex_lock( &IPC_Clients->lock );
+
+    *pid = ( IPC_Clients->list[ i ].fd != 0 ) ? IPC_Clients->list[ i ].pid : 0;
+
+    pthread_mutex_unlock( &IPC_Clients->lock );
+    return IPC_STATUS_OK;
+}
+
 /*!\fn IPC_cleanup_proc
  * \brief Cleanup IPC resources of a specific process (optional).
  * \return          IPC_STATUS_OK - Success, IPC_STATUS_NOK - Error
@@ -719,10 +947,10 @@ IPC_status_e IPC_cleanup_proc( pid_t pid )
    
     while ( i < IPC_MAX_LIST_SIZE )
     {
-        /* Remove all entries of a specific pid */
+        /* Remove all entries of a specific pid, a process may own several */
         if ( ( IPC_Clients->list[ i ].fd != 0 ) && ( IPC_Clients->list[ i ].pid == pid ) )
         {
-            return IPC_stop( (IPC_context_t)i );
+            IPC_stop( (IPC_context_t)i );
         }
 
         i++;
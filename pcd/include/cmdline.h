@@ -0,0 +1,93 @@
+/*
+ * cmdline.h
+ * Description:
+ * PCD command line template header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+#ifndef _CMDLINE_H_
+#define _CMDLINE_H_
+
+/***************************************************************************/
+/*! \file cmdline.h
+ *  \brief PCD command line template header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+
+/**************************************************************************/
+/*      INTERFACE TYPES and STRUCT Definitions                            */
+/**************************************************************************/
+
+struct cmdLine_t;
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_cmdline_compile
+ *  \brief          Compile a command and its parameters into an argument vector template
+ *  \param[in]      Command, parameters (NULL if none)
+ *  \param[in,out]  None
+ *  \return         Command line template - Success, NULL - Error
+ */
+struct cmdLine_t *PCD_cmdline_compile( const char *command, const char *params );
+
+/*! \fn             PCD_cmdline_free
+ *  \brief          Release a command line template
+ *  \param[in]      Command line template
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_cmdline_free( struct cmdLine_t *cmdLine );
+
+/*! \fn             PCD_cmdline_get_args
+ *  \brief          Get the argument vector. Variables are expanded again only if their value changed
+ *  \param[in]      Command line template
+ *  \param[in,out]  None
+ *  \return         NULL terminated argument vector, valid until the next call - Success, NULL - Error
+ */
+char **PCD_cmdline_get_args( struct cmdLine_t *cmdLine );
+
+/*! \fn             PCD_cmdline_get_redirect
+ *  \brief          Get the file which the standard output is redirected to
+ *  \param[in]      Command line template
+ *  \param[in,out]  None
+ *  \return         File name, NULL - No redirection
+ */
+const char *PCD_cmdline_get_redirect( struct cmdLine_t *cmdLine );
+
+/*! \fn             PCD_cmdline_get_params
+ *  \brief          Get the parameters which the template was compiled from
+ *  \param[in]      Command line template
+ *  \param[in,out]  None
+ *  \return         Parameters, NULL - None
+ */
+const char *PCD_cmdline_get_params( struct cmdLine_t *cmdLine );
+
+#endif /* _CMDLINE_H_ */
@@ -52,8 +52,6 @@ struct rule_t;
 /**************************************************************************/
 typedef PCD_status_e (*condCheckFunc)( struct rule_t *rule );
 
-#define PCD_COND_MAX_SIZE   32
-
 /* List of all start condition keywords */
 #define PCD_START_COND_KEYWORDS \
     PCD_START_COND_KEYWORD( NONE )\
@@ -127,20 +125,29 @@ PCD_END_COND_KEYWORDS
 
 #undef PCD_END_COND_KEYWORD
 
-#define PCD_START_COND_MAX_IDS      8
-
-/*! \struct rule_t
+/*! \struct envVar_t
  *  \brief Environment variable structure
  */
 typedef struct envVar_t
 {
-    char    envVarName[ PCD_COND_MAX_SIZE ];
-    char    envVarValue[ PCD_COND_MAX_SIZE ];
+    const char  *envVarName;
+    const char  *envVarValue;
 
 } envVar_t;
 
 struct rule_t;
 
+/*! \enum  netDevState_e
+ *  \brief Network device state required by NETDEVICE conditions
+ */
+typedef enum netDevState_e
+{
+    PCD_COND_NETDEVICE_EXISTS,      /* The device exists */
+    PCD_COND_NETDEVICE_UP,          /* The device is administratively up */
+    PCD_COND_NETDEVICE_ADDR,        /* The device has an address assigned */
+
+} netDevState_e;
+
 /*! \ruleCache_t
  *  \brief Rule cache structure
  */
@@ -159,9 +166,17 @@ typedef struct startCond_t
     startCond_e type;
     union
     {
-        char        filename[ PCD_COND_MAX_SIZE ];
-        ruleCache_t ruleCompleted[ PCD_START_COND_MAX_IDS ];
-        char        netDevice[ IF_NAMESIZE ];
+        const char  *filename;
+        struct
+        {
+        ruleCache_t *ruleCompleted;     /* Rules to wait for, allocated by the parser */
+        u_int32_t   numRuleCompleted;
+        };
+        struct
+        {
+        const char  *netDevice;
+        netDevState_e netDeviceState;
+        };
         u_int32_t   ipcOwner;
         envVar_t    envVar;
     };
@@ -176,9 +191,17 @@ typedef struct endCond_t
     endCond_e type;
     union
     {
-    char    filename[ PCD_COND_MAX_SIZE ];
+    const char *filename;
+    struct
+    {
     u_int32_t  delay[2];
-    char    netDevice[ IF_NAMESIZE ];
+    u_int64_t  waitDeadline;    /* Set by the timer, absolute monotonic time in ms */
+    };
+    struct
+    {
+    const char *netDevice;
+    netDevState_e netDeviceState;
+    };
     u_int32_t  ipcOwner;
     u_int32_t  exitStatus;
     u_int32_t  signal;
@@ -0,0 +1,110 @@
+/*
+ * event.h
+ * Description:
+ * PCD event loop header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+/***************************************************************************/
+/*! \file event.h
+ *  \brief PCD event loop header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+
+/**************************************************************************/
+/*      INTERFACE TYPES and STRUCT Definitions                            */
+/**************************************************************************/
+
+/*! \def PCD_EVENT_TIMEOUT_FOREVER
+ *  \brief Disarm the wakeup timer, sleep until a file descriptor is ready
+ */
+#define PCD_EVENT_TIMEOUT_FOREVER       (~0U)
+
+/*! \typedef eventHandlerFunc
+ *  \brief Event handler function, called when the file descriptor is readable
+ */
+typedef void (*eventHandlerFunc)( int32_t fd, void *data );
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_event_init
+ *  \brief          Module's init function
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_event_init( void );
+
+/*! \fn             PCD_event_add
+ *  \brief          Watch a file descriptor for incoming data
+ *  \param[in]      File descriptor, handler function, handler data
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_event_add( int32_t fd, eventHandlerFunc handler, void *data );
+
+/*! \fn             PCD_event_remove
+ *  \brief          Stop watching a file descriptor
+ *  \param[in]      File descriptor
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, PCD_STATUS_BAD_PARAMS - The file descriptor is not watched
+ */
+PCD_status_e PCD_event_remove( int32_t fd );
+
+/*! \fn             PCD_event_set_timeout
+ *  \brief          Arm the wakeup timer
+ *  \param[in]      Timeout in ms, 0 - wake immediately, PCD_EVENT_TIMEOUT_FOREVER - disarm
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_event_set_timeout( u_int32_t timeout );
+
+/*! \fn             PCD_event_wait
+ *  \brief          Block until one or more events arrive, and dispatch them
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_event_wait( void );
+
+/*! \fn             PCD_event_get_time
+ *  \brief          Get a monotonic time stamp
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Time in ms since an arbitrary point
+ */
+u_int64_t PCD_event_get_time( void );
+
+#endif /* _EVENT_H_ */
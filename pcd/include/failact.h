@@ -91,7 +91,7 @@ typedef struct failureAction_t
     failureAction_e action;
     union
     {
-        ruleId_t ruleId;
+        ruleId_t *ruleId;       /* Rule to execute, allocated by the parser */
     };
 
 } failureAction_t;
@@ -0,0 +1,94 @@
+/*
+ * filewatch.h
+ * Description:
+ * PCD file watcher header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+#ifndef _FILEWATCH_H_
+#define _FILEWATCH_H_
+
+/***************************************************************************/
+/*! \file filewatch.h
+ *  \brief PCD file watcher header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+
+/**************************************************************************/
+/*      INTERFACE TYPES and STRUCT Definitions                            */
+/**************************************************************************/
+
+struct fileWatch_t;
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_filewatch_init
+ *  \brief          Module's init function
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_filewatch_init( void );
+
+/*! \fn             PCD_filewatch_add
+ *  \brief          Start watching a file. Files in the same directory share a single watch
+ *  \param[in]      File name
+ *  \param[in,out]  None
+ *  \return         Watch handle - Success, NULL - Error
+ */
+struct fileWatch_t *PCD_filewatch_add( const char *filename );
+
+/*! \fn             PCD_filewatch_release
+ *  \brief          Stop watching a file
+ *  \param[in]      Watch handle
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_filewatch_release( struct fileWatch_t *fileWatch );
+
+/*! \fn             PCD_filewatch_is_active
+ *  \brief          Check if changes of the file are reported by the kernel
+ *  \param[in]      Watch handle
+ *  \param[in,out]  None
+ *  \return         True - Watched by inotify, False - The file must be polled
+ */
+bool_t PCD_filewatch_is_active( struct fileWatch_t *fileWatch );
+
+/*! \fn             PCD_filewatch_check
+ *  \brief          Check if a file exists, without touching the file system if it is watched
+ *  \param[in]      File name
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - File exists, PCD_STATUS_NOK - File does not exist
+ */
+PCD_status_e PCD_filewatch_check( const char *filename );
+
+#endif /* _FILEWATCH_H_ */
@@ -0,0 +1,73 @@
+/*
+ * netwatch.h
+ * Description:
+ * PCD network device watcher header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+#ifndef _NETWATCH_H_
+#define _NETWATCH_H_
+
+/***************************************************************************/
+/*! \file netwatch.h
+ *  \brief PCD network device watcher header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+#include "condchk.h"
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_netwatch_init
+ *  \brief          Module's init function
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_netwatch_init( void );
+
+/*! \fn             PCD_netwatch_is_active
+ *  \brief          Check if network device changes are reported by the kernel
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         True - Watched by rtnetlink, False - Network devices must be polled
+ */
+bool_t PCD_netwatch_is_active( void );
+
+/*! \fn             PCD_netwatch_check
+ *  \brief          Check the state of a network device
+ *  \param[in]      Network device name, required state
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Device is in the required state, PCD_STATUS_NOK - Otherwise
+ */
+PCD_status_e PCD_netwatch_check( const char *netDevice, netDevState_e state );
+
+#endif /* _NETWATCH_H_ */
@@ -63,6 +63,8 @@
     PCD_PARSER_KEYWORD( SCHED,              0 )\
     PCD_PARSER_KEYWORD( DAEMON,             0 )\
     PCD_PARSER_KEYWORD( USER,               0 )\
+    PCD_PARSER_KEYWORD( STOP_SIGNAL,        0 )\
+    PCD_PARSER_KEYWORD( STOP_TIMEOUT,       0 )\
     PCD_PARSER_KEYWORD( VERSION,            0 )\
     PCD_PARSER_KEYWORD( INCLUDE,            0 )\
 
@@ -39,6 +39,7 @@
 /**************************************************************************/
 /*      INCLUDES                                                          */
 /**************************************************************************/
+#include <stddef.h>
 #include "system_types.h"
 #include "ruleid.h"
 #include "pcdapi.h"
@@ -61,9 +62,88 @@ typedef enum
     PCD_API_GET_RULE_STATE,
     PCD_API_REDUCE_NETRX_PRIORITY,
     PCD_API_RESTORE_NETRX_PRIORITY,
+    PCD_API_DUMP_TRACE,
+    PCD_API_GET_STATS,
+    PCD_API_BATCH,
+    PCD_API_SUBSCRIBE,
+    PCD_API_UNSUBSCRIBE,
+    PCD_API_EVENT,                  /* Sent by the PCD to the subscribers only */
 
 } pcdApi_e;
 
+/*! \def PCD_API_BATCH_STRINGS_SIZE
+ *  \brief Size of the optional parameters of all the entries of a batch request
+ */
+#define PCD_API_BATCH_STRINGS_SIZE      1024
+
+/*! \struct pcdApiBatchRequest_t
+ *  \brief An entry of a batch request
+ */
+typedef struct pcdApiBatchRequest_t
+{
+    ruleId_t    ruleId;
+    pcdApi_e    type;
+    int32_t     sig;
+    u_int16_t   paramsOffset;   /* Offset of the optional parameters in the strings plus one, zero if none */
+
+} pcdApiBatchRequest_t;
+
+/*! \struct pcdApiBatch_t
+ *  \brief Batch request, the entries are handled in a single main loop iteration
+ */
+typedef struct pcdApiBatch_t
+{
+    u_int32_t               numEntries;
+    pcdApiBatchRequest_t    entries[ PCD_API_BATCH_MAX_ENTRIES ];
+    char                    strings[ PCD_API_BATCH_STRINGS_SIZE ];
+
+} pcdApiBatch_t;
+
+/*! \struct pcdApiBatchResult_t
+ *  \brief Result of an entry of a batch request
+ */
+typedef struct pcdApiBatchResult_t
+{
+    PCD_status_e        retval;
+    pcdApiRuleState_e   ruleState;
+
+} pcdApiBatchResult_t;
+
+/*! \struct pcdApiSubscription_t
+ *  \brief Subscription request, the rule ID of the message selects the rules
+ */
+typedef struct pcdApiSubscription_t
+{
+    u_int32_t   subscriptionId;     /* Zero in PCD_API_UNSUBSCRIBE removes all the subscriptions of the destination point */
+    int32_t     context;            /* Destination point which receives the events */
+
+} pcdApiSubscription_t;
+
+/*! \def PCD_API_EVENT_MAX_ENTRIES
+ *  \brief Maximum number of state changes in a single event message
+ */
+#define PCD_API_EVENT_MAX_ENTRIES       32
+
+/*! \struct pcdApiEvent_t
+ *  \brief State change of a rule
+ */
+typedef struct pcdApiEvent_t
+{
+    ruleId_t            ruleId;
+    pcdApiRuleState_e   ruleState;
+
+} pcdApiEvent_t;
+
+/*! \struct pcdApiEvents_t
+ *  \brief State changes of a main loop iteration, in the order they happened
+ */
+typedef struct pcdApiEvents_t
+{
+    u_int32_t       numEvents;
+    pcdApiEvent_t   entries[ PCD_API_EVENT_MAX_ENTRIES ];
+
+} pcdApiEvents_t;
+
 /*! \struct pcdApiMessage_t
  *  \brief PCD API message structure
  */
@@ -78,10 +158,21 @@ typedef struct pcdApiMessage_t
     };
     ruleId_t    ruleId;
     u_int32_t      msgId;
-    char        params[ CONFIG_PCD_MAX_PARAM_SIZE ];   /* Optional parameters */
+    union
+    {
+        char                    params[ CONFIG_PCD_MAX_PARAM_SIZE ];   /* Optional parameters */
+        pcdApiBatch_t           batch;                          /* Sent only in PCD_API_BATCH */
+        pcdApiSubscription_t    subscription;                   /* Sent only in PCD_API_SUBSCRIBE and PCD_API_UNSUBSCRIBE */
+    };
 
 } pcdApiMessage_t;
 
+/*! \def PCD_API_MESSAGE_SIZE
+ *  \brief Size of a request message, batch requests are larger
+ */
+#define PCD_API_MESSAGE_SIZE( type )    ( ( ( type ) == PCD_API_BATCH ) ? sizeof( pcdApiMessage_t ) : \
+                                          offsetof( pcdApiMessage_t, params ) + CONFIG_PCD_MAX_PARAM_SIZE )
+
 /*! \struct pcdApiReplyMessage_t
  *  \brief PCD API reply message structure
  */
@@ -93,13 +184,29 @@ typedef struct pcdApiReplyMessage_t
         pcdApiRuleState_e   ruleState;
     };
     PCD_status_e      retval;
+    union
+    {
+        pcdApiStats_t         stats;                                    /* Sent only in reply to PCD_API_GET_STATS */
+        pcdApiBatchResult_t   results[ PCD_API_BATCH_MAX_ENTRIES ];     /* Sent only in reply to PCD_API_BATCH */
+        pcdApiEvents_t        events;                                   /* Sent only in PCD_API_EVENT, with a zero msgId */
+    };
 
 } pcdApiReplyMessage_t;
 
+/*! \def PCD_API_REPLY_MESSAGE_SIZE
+ *  \brief Size of a reply message, the statistics, the batch results and the events are sent only when required
+ */
+#define PCD_API_REPLY_MESSAGE_SIZE( type )  ( ( ( type ) == PCD_API_GET_STATS ) ? offsetof( pcdApiReplyMessage_t, stats ) + sizeof( pcdApiStats_t ) : \
+                                              ( ( type ) == PCD_API_BATCH ) ? offsetof( pcdApiReplyMessage_t, results ) + sizeof( pcdApiBatchResult_t ) * PCD_API_BATCH_MAX_ENTRIES : \
+                                              ( ( type ) == PCD_API_EVENT ) ? offsetof( pcdApiReplyMessage_t, events ) + sizeof( pcdApiEvents_t ) : \
+                                              offsetof( pcdApiReplyMessage_t, stats ) )
+
 /**************************************************************************/
 /*      INTERFACE FUNCTIONS Prototypes:                                   */
 /**************************************************************************/
 
+struct rule_t;
+
 /*! \fn             PCD_api_init
  *  \brief          Module's init function
  *  \param[in]      None
@@ -117,15 +224,47 @@ PCD_status_e PCD_api_init( void );
 PCD_status_e PCD_api_deinit( void );
 
 /*! \fn             PCD_api_check_messages
- *  \brief          Check for incoming messages
+ *  \brief          Receive the incoming messages, and handle the requests of the clients in turns, within a time budget
  *  \param[in]      None
  *  \param[in,out]  None
  *  \return         PCD_STATUS_OK - Success, Otherwise - Error
  */
 PCD_status_e PCD_api_check_messages( void );
 
+/*! \fn             PCD_api_get_timeout
+ *  \brief          Get the time until the waiting requests can be handled
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Timeout in ms, 0 - requests are waiting, PCD_EVENT_TIMEOUT_FOREVER - none is waiting
+ */
+u_int32_t PCD_api_get_timeout( void );
+
+/*! \fn             PCD_api_notify_rule
+ *  \brief          Send a state change event of a rule to its subscribers, if its state as seen by the API changed
+ *  \param[in]      rule
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_api_notify_rule( struct rule_t *rule );
+
+/*! \fn             PCD_api_send_events
+ *  \brief          Send the state change events of the main loop iteration to the subscribers
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_api_send_events( void );
+
+/*! \fn             PCD_api_cleanup_proc
+ *  \brief          Forget the subscriptions of a process which exited, before its destination points are reclaimed
+ *  \param[in]      pid
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_api_cleanup_proc( pid_t pid );
+
 /*! \fn             PCD_api_reply_message
- *  \brief          Reply a termination request message
+ *  \brief          Reply a request message which was not handled immediately, such as a termination request
  *  \param[in]      cookie: caller encapsulated message, retval: return status
  *  \param[in,out]  None
  *  \return         None
@@ -0,0 +1,108 @@
+/*
+ * pool.h
+ * Description:
+ * PCD object pools header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+#ifndef _POOL_H_
+#define _POOL_H_
+
+/***************************************************************************/
+/*! \file pool.h
+ *  \brief PCD object pools header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+
+/**************************************************************************/
+/*      INTERFACE TYPES and STRUCT Definitions                            */
+/**************************************************************************/
+
+/*! \struct pool_t
+ *  \brief Pool of fixed size objects. Objects are allocated in slabs and are never
+ *         returned to the heap. With CONFIG_PCD_POOL_FIXED, a pool holds a single slab
+ */
+typedef struct pool_t
+{
+    const char      *name;
+    u_int32_t       objSize;
+    u_int32_t       slabObjs;       /* Objects per slab, the capacity of a fixed pool */
+    u_int32_t       numSlabs;
+    u_int32_t       used;
+    u_int32_t       highWater;      /* Maximum objects in use at the same time */
+    u_int32_t       failures;       /* Allocations which failed */
+    void            *freeList;
+
+    struct pool_t   *next;          /* Registered pools */
+
+} pool_t;
+
+/*! \def PCD_POOL_DECLARE
+ *  \brief Declare a pool of objects of a type
+ */
+#define PCD_POOL_DECLARE( _var, _name, _type, _slabObjs ) \
+    static pool_t _var = { _name, sizeof( _type ), _slabObjs, 0, 0, 0, 0, NULL, NULL }
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_pool_alloc
+ *  \brief          Allocate a zeroed object from a pool
+ *  \param[in]      Pool
+ *  \param[in,out]  None
+ *  \return         Object - Success, NULL - Pool exhausted or no memory
+ */
+void *PCD_pool_alloc( pool_t *pool );
+
+/*! \fn             PCD_pool_free
+ *  \brief          Return an object to its pool
+ *  \param[in]      Pool, Object
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_pool_free( pool_t *pool, void *obj );
+
+/*! \fn             PCD_pool_get_first
+ *  \brief          Get the first registered pool, the next ones are linked by their next field
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Pool, NULL - No pools
+ */
+pool_t *PCD_pool_get_first( void );
+
+/*! \fn             PCD_pool_dump
+ *  \brief          Print the usage and high-water marks of all the pools
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_pool_dump( void );
+
+#endif /* _POOL_H_ */
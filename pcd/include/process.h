@@ -87,12 +87,16 @@ typedef struct procObj_t
     procState_e     state;
     procExit_e      retstat;
     int32_t           retcode;
-    u_int32_t          tm;
+    u_int64_t       deadline;       /* Time of the next state transition in ms, 0 - Now */
     bool_t            signaled;
     void            *cookie;
+    int32_t         pidfd;          /* Process file descriptor, -1 if not used */
+    bool_t          shutdown;       /* Stopped by the shutdown sequence */
 
     struct procObj_t *prev;
     struct procObj_t *next;
+    struct procObj_t *hashNext;     /* Pid hash chain */
+    struct procObj_t *exitNext;     /* Exited processes queue */
 
 } procObj_t;
 
@@ -140,6 +144,22 @@ PCD_status_e PCD_process_iterate_start( void );
  */
 PCD_status_e PCD_process_iterate_stop( void );
 
+/*! \fn             PCD_process_iterate_exited
+ *  \brief          Handle the processes that exited since the last call
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_process_iterate_exited( void );
+
+/*! \fn             PCD_process_get_timeout
+ *  \brief          Get the time until the next process state transition (starting, stopping, etc.)
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Timeout in ms, 0 - Process iteration is required, PCD_EVENT_TIMEOUT_FOREVER - All processes are running
+ */
+u_int32_t PCD_process_get_timeout( void );
+
 /*! \fn             PCD_process_signal_by_rule
  *  \brief          Signal a process, find it by its rule
  *  \param[in]      Rule, Signal
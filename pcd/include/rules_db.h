@@ -50,6 +50,7 @@
 #include "condchk.h"
 #include "schedtype.h"
 #include "rulestate.h"
+#include "stats.h"
 #include "failact.h"
 
 /**************************************************************************/
@@ -57,29 +58,50 @@
 /**************************************************************************/
 
 struct procObj_t;
+struct timerObj_t;
+struct cmdLine_t;
+struct ruleGroup_t;
 
 /*! \struct rule_t
- *  \brief Rule structure
+ *  \brief Rule structure. The fields which the state machine touches on every
+ *         event come first, the fields which are only read when the rule is
+ *         started or checked follow. Condition strings are interned by the parser.
  */
 typedef struct rule_t
 {
+    /* Hot part */
+    pcdRuleState_e      ruleState;
+    u_int32_t           pendingDeps;        /* Dependencies which did not complete yet */
+    u_int32_t           stopPending;        /* Dependents which did not stop yet, on shutdown */
+    u_int32_t           numDependents;
+    struct procObj_t    *proc;
+    struct timerObj_t   *timerObj;          /* Timer object while the rule is queued */
+    struct rule_t       **dependents;       /* Rules which wait for this rule to complete */
+    struct ruleGroup_t  *group;             /* Group of the rule, its name is shared by all the rules of the group */
+    struct rule_t       *next;
+    struct rule_t       *hashNext;          /* Rule hash chain */
+
+    /* Cold part */
     ruleId_t            ruleId;
     startCond_t         startCondition;
     endCond_t           endCondition;
-    u_int32_t              timeout;
+    failureAction_t     failureAction;
     char                *command;
     char                *params;
-    char                *optionalParams;
-    failureAction_t     failureAction;
+    const char          *optionalParams;    /* Parameters of the optional command line, NULL if not set */
+    struct cmdLine_t    *cmdLine;           /* Compiled command and parameters, NULL if no command */
+    struct cmdLine_t    *optionalCmdLine;   /* Compiled command and the last optional parameters */
     schedType_t         sched;
-    bool_t                daemon;
+    u_int32_t           timeout;
     uid_t               uid;
-    pcdRuleState_e      ruleState;
-    bool_t                indexed;
-
-    struct procObj_t    *proc;
-
-    struct rule_t       *next;
+    int32_t             stopSignal;         /* Signal which stops the process, 0 - SIGTERM */
+    u_int32_t           stopTimeout;        /* Time in ms until a stopped process is killed, 0 - Default */
+    bool_t              daemon;
+    bool_t              indexed;
+    struct rule_t       *indexedNext;       /* Indexed rules of the group */
+    u_int32_t           maxDependents;      /* Allocated size of the dependents array */
+    ruleStats_t         stats;
+    u_int32_t           apiState;           /* Rule state of the API (pcdApiRuleState_e) in the last state change event */
 
 } rule_t;
 
@@ -89,8 +111,11 @@ typedef struct rule_t
 typedef struct ruleGroup_t
 {
     char                *groupName;
+    u_int32_t           hash;               /* Hash of the group name */
     rule_t              *firstRule;
+    rule_t              *indexedRules;      /* Rules which have copies by index */
     struct ruleGroup_t  *next;
+    struct ruleGroup_t  *hashNext;          /* Group hash chain */
 
 } ruleGroup_t;
 
@@ -146,6 +171,23 @@ rule_t *PCD_rulesdb_get_next( void );
  */
 PCD_status_e PCD_rulesdb_activate( void );
 
+/*! \fn             PCD_rulesdb_set_rule_state
+ *  \brief          Change the state of a rule, and wake up its dependents when it completes
+ *  \param[in]      Rule, New state
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_rulesdb_set_rule_state( rule_t *rule, pcdRuleState_e ruleState );
+
+/*! \fn             PCD_rulesdb_count_pending_deps
+ *  \brief          Link a rule to its RULE_COMPLETED dependencies, and count the ones which did not complete yet.
+ *                  Called when the rule is enqueued, the state changes of the dependencies update the count afterwards
+ *  \param[in]      Rule
+ *  \param[in,out]  None
+ *  \return         Number of pending dependencies. Dependencies which are not found are not counted
+ */
+u_int32_t PCD_rulesdb_count_pending_deps( rule_t *rule );
+
 /*! \fn             PCD_rulesdb_setup_optional_params
  *  \brief          Setup optional parameters in rule
  *  \param[in]      Rule, Optional parameters
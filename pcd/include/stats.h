@@ -0,0 +1,169 @@
+/*
+ * stats.h
+ * Description:
+ * PCD runtime statistics header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/***************************************************************************/
+/*! \file stats.h
+ *  \brief PCD runtime statistics header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+
+/**************************************************************************/
+/*      INTERFACE TYPES and STRUCT Definitions                            */
+/**************************************************************************/
+
+struct rule_t;
+struct pcdApiStats_t;
+
+/*! \struct ruleStats_t
+ *  \brief Counters of a rule
+ */
+typedef struct ruleStats_t
+{
+    u_int32_t           starts;             /* Start condition met, the rule was started */
+    u_int32_t           restarts;           /* Restarts by the RESTART failure action */
+    u_int32_t           failures;
+    u_int32_t           timeouts;           /* End condition timeouts */
+    u_int32_t           exits;              /* Processes which exited */
+    int32_t             lastExitStatus;     /* Wait status of the last process which exited */
+    u_int32_t           readies;            /* PROCESS_READY events */
+    u_int32_t           readyLatency;       /* From the spawn of the last process to PROCESS_READY, in ms */
+    u_int64_t           uptime;             /* Time the processes of the rule ran, in ms */
+    u_int64_t           spawnTime;          /* Spawn time of the running process in ms, 0 if none */
+
+} ruleStats_t;
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_stats_get_time_us
+ *  \brief          Get the monotonic time in us
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Time in us
+ */
+u_int64_t PCD_stats_get_time_us( void );
+
+/*! \fn             PCD_stats_loop_iteration
+ *  \brief          Count a main loop iteration, and the time it took to handle it
+ *  \param[in]      Start time of the iteration in us
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_loop_iteration( u_int64_t startTime );
+
+/*! \fn             PCD_stats_count_message
+ *  \brief          Count a handled API message
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_count_message( void );
+
+/*! \fn             PCD_stats_count_errlog_write
+ *  \brief          Count a write to the error log
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_count_errlog_write( void );
+
+/*! \fn             PCD_stats_process_spawned
+ *  \brief          Record the spawn of the process of a rule
+ *  \param[in]      Rule
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_process_spawned( struct rule_t *rule );
+
+/*! \fn             PCD_stats_process_ready
+ *  \brief          Record the time from the spawn of the process of a rule to PROCESS_READY
+ *  \param[in]      Rule
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_process_ready( struct rule_t *rule );
+
+/*! \fn             PCD_stats_process_exited
+ *  \brief          Record the exit of the process of a rule
+ *  \param[in]      Rule, Wait status
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_process_exited( struct rule_t *rule, int32_t status );
+
+/*! \fn             PCD_stats_get
+ *  \brief          Get the daemon counters, and the counters of a rule
+ *  \param[in]      Rule, NULL for the daemon counters only
+ *  \param[in,out]  Statistics
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_stats_get( const struct rule_t *rule, struct pcdApiStats_t *stats );
+
+/*! \fn             PCD_stats_set_output
+ *  \brief          Set the file which the statistics are periodically written to, in Prometheus text format
+ *  \param[in]      Filename
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_set_output( const char *filename );
+
+/*! \fn             PCD_stats_write_output
+ *  \brief          Write the statistics to the output file now, if one was set
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_write_output( void );
+
+/*! \fn             PCD_stats_get_timeout
+ *  \brief          Get the time until the statistics are written next
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Time in ms, PCD_EVENT_TIMEOUT_FOREVER if there is no output file
+ */
+u_int32_t PCD_stats_get_timeout( void );
+
+/*! \fn             PCD_stats_iterate
+ *  \brief          Write the statistics to the output file when the interval expires
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_stats_iterate( void );
+
+#endif /* _STATS_H_ */
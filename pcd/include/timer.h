@@ -43,6 +43,7 @@
 #include "rules_db.h"
 #include "condchk.h"
 #include "failact.h"
+#include "filewatch.h"
 #include <time.h>
 
 /**************************************************************************/
@@ -65,10 +66,21 @@ typedef struct timerObj_t
     condCheckFunc       startCondCheckFunc;
     condCheckFunc       endCondCheckFunc;
     failActionFunc      failureActionFunc;
-    u_int32_t              timeout;
+    u_int64_t           timeoutDeadline;    /* End condition timeout, 0 - Forever */
+    u_int64_t           deadline;           /* Nearest deadline, the deadline heap key */
+    u_int32_t           heapIndex;
+    struct fileWatch_t  *fileWatch;         /* Armed FILE condition */
+    bool_t              retry;              /* Start condition is retried every tick */
+    bool_t              ready;              /* Conditions are checked on the next iteration */
+    bool_t              dequeued;           /* Removed from the queue at the end of the iteration */
 
     struct timerObj_t   *prev;
     struct timerObj_t   *next;
+    struct timerObj_t   *readyPrev;         /* Ready list */
+    struct timerObj_t   *readyNext;
+    struct timerObj_t   *waitPrev;          /* Poll or watch list of the condition */
+    struct timerObj_t   *waitNext;
+    struct timerObj_t   **waitList;         /* NULL if woken up by a deadline or an event */
 
 } timerObj_t;
 
@@ -92,6 +104,22 @@ PCD_status_e PCD_timer_init( void );
  */
 bool_t PCD_timer_iterate( void );
 
+/*! \fn             PCD_timer_get_timeout
+ *  \brief          Get the time until the next required timer iteration
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         Timeout in ms, PCD_EVENT_TIMEOUT_FOREVER - No rules are waiting
+ */
+u_int32_t PCD_timer_get_timeout( void );
+
+/*! \fn             PCD_timer_is_idle
+ *  \brief          Check if no rule is queued, all the rules either completed, failed or were never started
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         True - No rule is queued, False - Rules wait for their conditions
+ */
+bool_t PCD_timer_is_idle( void );
+
 /*! \fn             PCD_timer_start
  *  \brief          Start the timer
  *  \param[in]      None
@@ -124,4 +152,20 @@ PCD_status_e PCD_timer_enqueue_rule( rule_t *rule );
  */
 PCD_status_e PCD_timer_dequeue_rule( rule_t *rule, bool_t failed );
 
+/*! \fn             PCD_timer_notify_rule
+ *  \brief          Check the conditions of a queued rule on the next iteration
+ *  \param[in]      Rule
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_timer_notify_rule( rule_t *rule );
+
+/*! \fn             PCD_timer_notify_watch
+ *  \brief          Check the rules which wait for a watched file or network device on the next iteration
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_timer_notify_watch( void );
+
 #endif /* _TIMER_H_ */
@@ -0,0 +1,115 @@
+/*
+ * trace.h
+ * Description:
+ * PCD rule state trace header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/***************************************************************************/
+/*! \file trace.h
+ *  \brief PCD rule state trace header file
+****************************************************************************/
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include "system_types.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      INTERFACE TYPES and STRUCT Definitions                            */
+/**************************************************************************/
+
+struct rule_t;
+
+/*! \enum pcdTraceEvent_e
+ *  \brief Traced rule events
+ */
+typedef enum
+{
+    PCD_TRACE_ENQUEUE,                  /* Rule is waiting for its start condition */
+    PCD_TRACE_START_COND,               /* Start condition satisfied, waiting for the end condition */
+    PCD_TRACE_SPAWN,                    /* Process is about to be spawned */
+    PCD_TRACE_EXEC,                     /* Process was spawned, the value is its pid */
+    PCD_TRACE_READY,                    /* PROCESS_READY received */
+    PCD_TRACE_END_COND,                 /* End condition satisfied */
+    PCD_TRACE_COMPLETED,                /* Rule completed */
+    PCD_TRACE_NOT_COMPLETED,            /* Rule did not complete, end condition failed or timed out */
+    PCD_TRACE_FAILED,                   /* Rule failed */
+    PCD_TRACE_IDLE,                     /* Rule was stopped */
+    PCD_TRACE_EXIT,                     /* Process exited, the value is its wait status */
+    PCD_TRACE_LAST,
+
+} pcdTraceEvent_e;
+
+/*! \def PCD_TRACE
+ *  \brief Record a rule event in the trace buffer, compiled out when the buffer is disabled
+ */
+#if CONFIG_PCD_TRACE_ENTRIES > 0
+#define PCD_TRACE( _rule, _event, _value )  PCD_trace_add( _rule, _event, _value )
+#else
+#define PCD_TRACE( _rule, _event, _value )
+#endif
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn             PCD_trace_add
+ *  \brief          Record a rule event with a monotonic time stamp. The oldest event is overwritten when the buffer is full
+ *  \param[in]      Rule, Event, Event value
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_trace_add( const struct rule_t *rule, pcdTraceEvent_e event, int32_t value );
+
+/*! \fn             PCD_trace_dump
+ *  \brief          Write the recorded events to a file, in Chrome trace event JSON format
+ *  \param[in]      Filename, create only a new file (no existing file or link is written)
+ *  \param[in,out]  None
+ *  \return         PCD_STATUS_OK - Success, Otherwise - Error
+ */
+PCD_status_e PCD_trace_dump( const char *filename, bool_t create );
+
+/*! \fn             PCD_trace_set_output
+ *  \brief          Set the file which the trace is written to when the boot settles and when PCD terminates
+ *  \param[in]      Filename
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_trace_set_output( const char *filename );
+
+/*! \fn             PCD_trace_write_output
+ *  \brief          Write the trace to the output file, if one was set
+ *  \param[in]      None
+ *  \param[in,out]  None
+ *  \return         None
+ */
+void PCD_trace_write_output( void );
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,497 @@
+/*
+ * cmdline.c
+ * Description:
+ * PCD command line template implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "system_types.h"
+#include "cmdline.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define PCD_CMDLINE_WHITE_SPACES    " \t\n\r"
+
+/* An argument of the template. A variable argument is replaced with the
+   words of its value, taken from CONFIG_PCD_TEMP_PATH/<name> or from the environment */
+typedef struct cmdLineToken_t
+{
+    char            *text;          /* Static argument, or the text before the variable */
+    char            *name;          /* Variable name, NULL for a static argument */
+    char            *suffix;        /* Text after the variable */
+    char            *path;          /* Variable file */
+
+    /* Cached expansion of the variable */
+    bool_t          cached;
+    bool_t          fromFile;
+    char            *value;         /* Expanded words, each one NULL terminated */
+    u_int32_t       numWords;
+    char            *envValue;      /* Value taken from the environment */
+    ino_t           ino;            /* Identity of the variable file, when taken from a file */
+    off_t           size;
+    struct timespec mtime;
+
+} cmdLineToken_t;
+
+typedef struct cmdLine_t
+{
+    char            *command;
+    char            *params;
+    char            *buffer;        /* Static arguments, points into a copy of the parameters */
+    char            *redirect;      /* Standard output file, NULL if none */
+    cmdLineToken_t  *tokens;
+    u_int32_t       numTokens;
+
+    char            **args;         /* Argument vector of the last expansion */
+    u_int32_t       maxArgs;
+    bool_t          built;
+
+} cmdLine_t;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static char *PCD_cmdline_read_file( const char *path, off_t size )
+{
+    char *buff;
+    ssize_t len = 0;
+    int32_t fd;
+
+    fd = open( path, O_RDONLY );
+
+    if ( fd < 0 )
+        return NULL;
+
+    buff = malloc( size + 1 );
+
+    if ( buff )
+    {
+        /* The file may have changed since stat, read what is there */
+        while ( len < size )
+        {
+            ssize_t ret = read( fd, buff + len, size - len );
+
+            if ( ret <= 0 )
+                break;
+
+            len += ret;
+        }
+
+        buff[ len ] = '\0';
+
+        /* An empty file does not define the variable */
+        if ( len == 0 )
+        {
+            free( buff );
+            buff = NULL;
+        }
+    }
+
+    close( fd );
+
+    return buff;
+}
+
+static PCD_status_e PCD_cmdline_expand( cmdLineToken_t *token, const char *raw )
+{
+    char *dst;
+    u_int32_t len;
+
+    free( token->value );
+    token->value = NULL;
+    token->numWords = 0;
+
+    if ( !raw )
+        return PCD_STATUS_OK;
+
+    len = strlen( token->text ) + strlen( raw ) + strlen( token->suffix ) + 1;
+
+    token->value = malloc( len );
+
+    if ( !token->value )
+        return PCD_STATUS_NOK;
+
+    /* The text around the variable is attached to the first and last words */
+    dst = token->value;
+    strcpy( dst, token->text );
+    dst += strlen( dst );
+
+    while ( *raw )
+    {
+        size_t wordLen;
+
+        raw += strspn( raw, PCD_CMDLINE_WHITE_SPACES );
+        wordLen = strcspn( raw, PCD_CMDLINE_WHITE_SPACES );
+
+        if ( !wordLen )
+            break;
+
+        if ( token->numWords )
+            dst++;
+
+        memcpy( dst, raw, wordLen );
+        dst += wordLen;
+        *dst = '\0';
+        raw += wordLen;
+        token->numWords++;
+    }
+
+    if ( !token->numWords )
+    {
+        /* An empty variable is ignored, together with its surrounding text */
+        free( token->value );
+        token->value = NULL;
+        return PCD_STATUS_OK;
+    }
+
+    strcpy( dst, token->suffix );
+
+    return PCD_STATUS_OK;
+}
+
+static bool_t PCD_cmdline_refresh_var( cmdLineToken_t *token )
+{
+    struct stat st;
+    char *buff = NULL;
+    char *env;
+
+    /* A variable file has precedence over the environment */
+    if ( ( stat( token->path, &st ) == 0 ) && ( S_ISREG( st.st_mode ) ) )
+    {
+        if ( ( token->cached ) && ( token->fromFile ) &&
+             ( token->ino == st.st_ino ) && ( token->size == st.st_size ) &&
+             ( token->mtime.tv_sec == st.st_mtim.tv_sec ) && ( token->mtime.tv_nsec == st.st_mtim.tv_nsec ) )
+        {
+            return False;
+        }
+
+        buff = PCD_cmdline_read_file( token->path, st.st_size );
+    }
+
+    if ( buff )
+    {
+        token->fromFile = True;
+        token->ino = st.st_ino;
+        token->size = st.st_size;
+        token->mtime = st.st_mtim;
+
+        free( token->envValue );
+        token->envValue = NULL;
+
+        token->cached = ( PCD_cmdline_expand( token, buff ) == PCD_STATUS_OK );
+        free( buff );
+        return True;
+    }
+
+    env = getenv( token->name );
+
+    if ( ( token->cached ) && ( !token->fromFile ) )
+    {
+        if ( ( !env && !token->envValue ) ||
+             ( env && token->envValue && ( strcmp( env, token->envValue ) == 0 ) ) )
+        {
+            return False;
+        }
+    }
+
+    free( token->envValue );
+    token->envValue = NULL;
+    token->fromFile = False;
+
+    if ( env )
+    {
+        token->envValue = strdup( env );
+
+        if ( !token->envValue )
+        {
+            token->cached = False;
+            PCD_cmdline_expand( token, NULL );
+            return True;
+        }
+    }
+
+    token->cached = ( PCD_cmdline_expand( token, token->envValue ) == PCD_STATUS_OK );
+
+    return True;
+}
+
+static PCD_status_e PCD_cmdline_build( cmdLine_t *cmdLine )
+{
+    u_int32_t i, j, numArgs = 1;
+
+    for ( i = 0; i < cmdLine->numTokens; i++ )
+    {
+        numArgs += cmdLine->tokens[ i ].name ? cmdLine->tokens[ i ].numWords : 1;
+    }
+
+    if ( numArgs > cmdLine->maxArgs )
+    {
+        char **args = realloc( cmdLine->args, ( numArgs + 1 ) * sizeof( char * ) );
+
+        if ( !args )
+            return PCD_STATUS_NOK;
+
+        cmdLine->args = args;
+        cmdLine->maxArgs = numArgs;
+    }
+
+    numArgs = 0;
+    cmdLine->args[ numArgs++ ] = cmdLine->command;
+
+    for ( i = 0; i < cmdLine->numTokens; i++ )
+    {
+        cmdLineToken_t *token = &cmdLine->tokens[ i ];
+        char *word;
+
+        if ( !token->name )
+        {
+            cmdLine->args[ numArgs++ ] = token->text;
+            continue;
+        }
+
+        for ( j = 0, word = token->value; j < token->numWords; j++, word += strlen( word ) + 1 )
+        {
+            cmdLine->args[ numArgs++ ] = word;
+        }
+    }
+
+    cmdLine->args[ numArgs ] = NULL;
+
+    return PCD_STATUS_OK;
+}
+
+static PCD_status_e PCD_cmdline_compile_var( cmdLineToken_t *token, char *dollar )
+{
+    char *name, *suffix;
+    size_t nameLen;
+
+    if ( dollar[ 1 ] == '{' )
+    {
+        /* ${name}suffix */
+        name = dollar + 2;
+        suffix = strchr( name, '}' );
+
+        if ( !suffix )
+            return PCD_STATUS_OK;
+
+        nameLen = suffix - name;
+        suffix++;
+    }
+    else
+    {
+        /* $name, the name ends with the first character which cannot be a part of it */
+        name = dollar + 1;
+
+        for ( suffix = name; ( isalnum( (unsigned char)*suffix ) ) || ( *suffix == '_' ); suffix++ );
+
+        nameLen = suffix - name;
+    }
+
+    /* Not a variable, keep the argument as is */
+    if ( !nameLen )
+        return PCD_STATUS_OK;
+
+    token->name = strndup( name, nameLen );
+    token->suffix = strdup( suffix );
+    token->path = malloc( strlen( CONFIG_PCD_TEMP_PATH ) + nameLen + 2 );
+
+    if ( ( !token->name ) || ( !token->suffix ) || ( !token->path ) )
+        return PCD_STATUS_NOK;
+
+    sprintf( token->path, CONFIG_PCD_TEMP_PATH "/%s", token->name );
+
+    /* The text before the variable */
+    *dollar = '\0';
+
+    return PCD_STATUS_OK;
+}
+
+struct cmdLine_t *PCD_cmdline_compile( const char *command, const char *params )
+{
+    cmdLine_t *cmdLine;
+    char *token, *saveptr = NULL;
+    u_int32_t maxTokens = 0;
+
+    if ( !command )
+        return NULL;
+
+    cmdLine = calloc( 1, sizeof( cmdLine_t ) );
+
+    if ( !cmdLine )
+        return NULL;
+
+    cmdLine->command = strdup( command );
+
+    if ( !cmdLine->command )
+        goto compile_error;
+
+    if ( params )
+    {
+        const char *ptr;
+
+        cmdLine->params = strdup( params );
+        cmdLine->buffer = strdup( params );
+
+        if ( ( !cmdLine->params ) || ( !cmdLine->buffer ) )
+            goto compile_error;
+
+        /* Count the words, an upper limit of the number of arguments */
+        for ( ptr = params + strspn( params, PCD_CMDLINE_WHITE_SPACES ); *ptr; ptr += strspn( ptr, PCD_CMDLINE_WHITE_SPACES ) )
+        {
+            ptr += strcspn( ptr, PCD_CMDLINE_WHITE_SPACES );
+            maxTokens++;
+        }
+    }
+
+    if ( maxTokens )
+    {
+        cmdLine->tokens = calloc( maxTokens, sizeof( cmdLineToken_t ) );
+
+        if ( !cmdLine->tokens )
+            goto compile_error;
+    }
+
+    token = cmdLine->buffer ? strtok_r( cmdLine->buffer, PCD_CMDLINE_WHITE_SPACES, &saveptr ) : NULL;
+
+    while ( token )
+    {
+        cmdLineToken_t *newToken;
+        char *dollar;
+
+        /* Redirection, the next word is the output file */
+        if ( strchr( token, '>' ) )
+        {
+            token = strtok_r( NULL, PCD_CMDLINE_WHITE_SPACES, &saveptr );
+
+            if ( token )
+            {
+                cmdLine->redirect = token;
+                token = strtok_r( NULL, PCD_CMDLINE_WHITE_SPACES, &saveptr );
+            }
+            continue;
+        }
+
+        newToken = &cmdLine->tokens[ cmdLine->numTokens++ ];
+        newToken->text = token;
+
+        dollar = strchr( token, '$' );
+
+        if ( dollar )
+        {
+            if ( PCD_cmdline_compile_var( newToken, dollar ) != PCD_STATUS_OK )
+                goto compile_error;
+        }
+
+        token = strtok_r( NULL, PCD_CMDLINE_WHITE_SPACES, &saveptr );
+    }
+
+    return cmdLine;
+
+compile_error:
+    PCD_PRINTF_STDERR( "Failed to compile command line of %s", command );
+    PCD_cmdline_free( cmdLine );
+    return NULL;
+}
+
+void PCD_cmdline_free( struct cmdLine_t *cmdLine )
+{
+    u_int32_t i;
+
+    if ( !cmdLine )
+        return;
+
+    for ( i = 0; i < cmdLine->numTokens; i++ )
+    {
+        cmdLineToken_t *token = &cmdLine->tokens[ i ];
+
+        free( token->name );
+        free( token->suffix );
+        free( token->path );
+        free( token->value );
+        free( token->envValue );
+    }
+
+    free( cmdLine->tokens );
+    free( cmdLine->args );
+    free( cmdLine->buffer );
+    free( cmdLine->params );
+    free( cmdLine->command );
+    free( cmdLine );
+}
+
+char **PCD_cmdline_get_args( struct cmdLine_t *cmdLine )
+{
+    bool_t changed;
+    u_int32_t i;
+
+    if ( !cmdLine )
+        return NULL;
+
+    changed = !cmdLine->built;
+
+    /* Static arguments were resolved when compiled, only refresh the variables */
+    for ( i = 0; i < cmdLine->numTokens; i++ )
+    {
+        if ( ( cmdLine->tokens[ i ].name ) && ( PCD_cmdline_refresh_var( &cmdLine->tokens[ i ] ) ) )
+        {
+            changed = True;
+        }
+    }
+
+    if ( changed )
+    {
+        cmdLine->built = ( PCD_cmdline_build( cmdLine ) == PCD_STATUS_OK );
+
+        if ( !cmdLine->built )
+            return NULL;
+    }
+
+    return cmdLine->args;
+}
+
+const char *PCD_cmdline_get_redirect( struct cmdLine_t *cmdLine )
+{
+    return cmdLine ? cmdLine->redirect : NULL;
+}
+
+const char *PCD_cmdline_get_params( struct cmdLine_t *cmdLine )
+{
+    return cmdLine ? cmdLine->params : NULL;
+}
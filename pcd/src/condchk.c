@@ -45,6 +45,9 @@
 #include "process.h"
 #include "timer.h"
 #include "ipc.h"
+#include "event.h"
+#include "filewatch.h"
+#include "netwatch.h"
 #include "pcd.h"
 
 /**************************************************************************/
@@ -100,13 +103,8 @@ PCD_status_e PCD_start_cond_check_NONE( rule_t *rule )
 
 PCD_status_e PCD_start_cond_check_FILE( rule_t *rule )
 {
-    struct stat fbuf;
-
-    /* Try to open the file */
-    if ( stat(rule->startCondition.filename, &fbuf) )
-        return PCD_STATUS_NOK;
-
-    return PCD_STATUS_OK;
+    /* Watched files are not accessed, the file watcher tracks their existence */
+    return PCD_filewatch_check( rule->startCondition.filename );
 }
 
 
@@ -122,13 +120,8 @@ PCD_status_e PCD_start_cond_check_RULE_COMPLETED( rule_t *rule )
     rule_t *checkRule;
     u_int32_t i = 0;
 
-    while ( i < PCD_START_COND_MAX_IDS )
+    while ( i < rule->startCondition.numRuleCompleted )
     {
-        if ( !rule->startCondition.ruleCompleted[ i ].ruleId.groupName[ 0 ] )
-        {
-            break;
-        }
-
         /* Do we have the rule pointer in cache? */
         checkRule = rule->startCondition.ruleCompleted[ i ].rule;
 
@@ -144,7 +137,7 @@ PCD_status_e PCD_start_cond_check_RULE_COMPLETED( rule_t *rule )
             PCD_PRINTF_STDERR( "Warning, rule %s_%s not found", rule->startCondition.ruleCompleted[ i ].ruleId.groupName, rule->startCondition.ruleCompleted[ i ].ruleId.ruleName );
 
             /* There is no way to complete this rule */
-            rule->ruleState = PCD_RULE_NOT_COMPLETED;
+            PCD_rulesdb_set_rule_state( rule, PCD_RULE_NOT_COMPLETED );
             return PCD_STATUS_NOK;
         }
 
@@ -170,34 +163,8 @@ PCD_status_e PCD_start_cond_check_RULE_COMPLETED( rule_t *rule )
 
 PCD_status_e PCD_start_cond_check_NETDEVICE( rule_t *rule )
 {
-    int32_t sock;
-    struct ifreq ifr;
-    PCD_status_e ret = PCD_STATUS_NOK;
-
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    ifr.ifr_addr.sa_family = AF_INET;
-
-    if ( sock < 0 )
-    {
-        return PCD_STATUS_NOK;
-    }
-
-    strncpy(ifr.ifr_name, rule->startCondition.netDevice, IF_NAMESIZE);
-    ifr.ifr_hwaddr.sa_family = 1;
-
-    /* Get interface mac address */
-    if ( ioctl(sock, SIOCGIFHWADDR, &ifr) < 0 )
-    {
-        ret = PCD_STATUS_NOK;
-    }
-    else
-    {
-        ret = PCD_STATUS_OK;
-    }
-
-    close(sock);
-
-    return ret;
+    /* Look the device up in the interface table of the network device watcher */
+    return PCD_netwatch_check( rule->startCondition.netDevice, rule->startCondition.netDeviceState );
 }
 
 
@@ -231,13 +198,8 @@ PCD_status_e PCD_end_cond_check_NONE( rule_t *rule )
 
 PCD_status_e PCD_end_cond_check_FILE( rule_t *rule )
 {
-    struct stat fbuf;
-
-    /* Try to open the file */
-    if ( stat(rule->endCondition.filename, &fbuf) )
-        return PCD_STATUS_NOK;
-
-    return PCD_STATUS_OK;
+    /* Watched files are not accessed, the file watcher tracks their existence */
+    return PCD_filewatch_check( rule->endCondition.filename );
 }
 
 
@@ -258,34 +220,8 @@ PCD_status_e PCD_end_cond_check_EXIT( rule_t *rule )
 
 PCD_status_e PCD_end_cond_check_NETDEVICE( rule_t *rule )
 {
-    int32_t sock;
-    struct ifreq ifr;
-    PCD_status_e ret = PCD_STATUS_NOK;
-
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    ifr.ifr_addr.sa_family = AF_INET;
-
-    if ( sock < 0 )
-    {
-        return PCD_STATUS_NOK;
-    }
-
-    strncpy(ifr.ifr_name, rule->endCondition.netDevice, IF_NAMESIZE);
-    ifr.ifr_hwaddr.sa_family = 1;
-
-    /* Get interface mac address */
-    if ( ioctl(sock, SIOCGIFHWADDR, &ifr) < 0 )
-    {
-        ret = PCD_STATUS_NOK;
-    }
-    else
-    {
-        ret = PCD_STATUS_OK;
-    }
-
-    close(sock);
-
-    return ret;
+    /* Look the device up in the interface table of the network device watcher */
+    return PCD_netwatch_check( rule->endCondition.netDevice, rule->endCondition.netDeviceState );
 }
 
 
@@ -314,20 +250,11 @@ PCD_status_e PCD_end_cond_check_PROCESS_READY( rule_t *rule )
 
 PCD_status_e PCD_end_cond_check_WAIT( rule_t *rule )
 {
-    u_int32_t *delay = &rule->endCondition.delay[0];
-
-    /* Reduce time tick and check if time has expired */
-    if ( *delay < PCD_TIMER_TICK )
+    /* The deadline is set by the timer when the rule starts waiting for its end condition */
+    if ( PCD_event_get_time() >= rule->endCondition.waitDeadline )
     {
-        /* Restore the delay value and return OK, time has expired */
-        *delay = rule->endCondition.delay[1];
         return PCD_STATUS_OK;
     }
-    else
-    {
-        /* Time not expired yet */
-        *delay -= PCD_TIMER_TICK;
-    }
 
     return PCD_STATUS_NOK;
 }
@@ -43,6 +43,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include "errlog.h"
+#include "stats.h"
 #include "pcd.h"
 
 #define PCD_ERRLOG_MIN_FREE_SIZE        ( ( PCD_ERRLOG_MAX_FILE_SIZE * 3 ) / 4 )
@@ -220,6 +221,8 @@ void PCD_errlog_log( char *buffer, bool_t timeStamp )
     if( write( fd, buffer, strlen( buffer ) ) <= 0 )
 		goto close_file;
 
+    PCD_stats_count_errlog_write();
+
 close_file:
 	/* Close file (we want to avoid FFS corruption) */
     PCD_errlog_close_file();
@@ -0,0 +1,239 @@
+/*
+ * event.c
+ * Description:
+ * PCD event loop implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "system_types.h"
+#include "event.h"
+#include "pcd.h"
+#include "pool.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+/* Maximum events handled in a single wakeup */
+#define PCD_EVENT_MAX_EVENTS    16
+
+typedef struct eventObj_t
+{
+    int32_t             fd;
+    eventHandlerFunc    handler;
+    void                *data;
+
+    struct eventObj_t   *next;
+
+} eventObj_t;
+
+static int32_t epollFd = -1;
+static int32_t timerFd = -1;
+static eventObj_t *eventList = NULL;
+static eventObj_t *removedList = NULL;
+
+PCD_POOL_DECLARE( eventPool, "events", eventObj_t, CONFIG_PCD_POOL_EVENTS );
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static void PCD_event_timer_handler( int32_t fd, void *data )
+{
+    u_int64_t expirations;
+
+    /* Acknowledge the expiration, otherwise the fd stays readable.
+       The main loop handles the wakeup itself */
+    if ( read( fd, &expirations, sizeof( expirations ) ) != sizeof( expirations ) )
+    {
+        PCD_DEBUG_PRINTF( "Spurious event loop timer wakeup" );
+    }
+}
+
+PCD_status_e PCD_event_init( void )
+{
+    epollFd = epoll_create1( EPOLL_CLOEXEC );
+
+    if ( epollFd < 0 )
+    {
+        PCD_PRINTF_STDERR( "Failed to create event loop" );
+        return PCD_STATUS_NOK;
+    }
+
+    timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+    if ( timerFd < 0 )
+    {
+        PCD_PRINTF_STDERR( "Failed to create event loop timer" );
+        close( epollFd );
+        epollFd = -1;
+        return PCD_STATUS_NOK;
+    }
+
+    return PCD_event_add( timerFd, PCD_event_timer_handler, NULL );
+}
+
+PCD_status_e PCD_event_add( int32_t fd, eventHandlerFunc handler, void *data )
+{
+    struct epoll_event ev;
+    eventObj_t *newObj;
+
+    if ( ( epollFd < 0 ) || ( fd < 0 ) || ( !handler ) )
+        return PCD_STATUS_BAD_PARAMS;
+
+    newObj = PCD_pool_alloc( &eventPool );
+
+    if ( !newObj )
+    {
+        PCD_PRINTF_STDERR( "memory allocation failure" );
+        return PCD_STATUS_NOK;
+    }
+
+    newObj->fd = fd;
+    newObj->handler = handler;
+    newObj->data = data;
+
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = EPOLLIN;
+    ev.data.ptr = newObj;
+
+    if ( epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+    {
+        PCD_PRINTF_STDERR( "Failed to watch file descriptor %d", fd );
+        PCD_pool_free( &eventPool, newObj );
+        return PCD_STATUS_NOK;
+    }
+
+    newObj->next = eventList;
+    eventList = newObj;
+
+    return PCD_STATUS_OK;
+}
+
+PCD_status_e PCD_event_remove( int32_t fd )
+{
+    eventObj_t **searchList = &eventList;
+
+    while ( *searchList )
+    {
+        eventObj_t *eventObj = *searchList;
+
+        if ( eventObj->fd == fd )
+        {
+            epoll_ctl( epollFd, EPOLL_CTL_DEL, fd, NULL );
+
+            *searchList = eventObj->next;
+
+            /* Pending events of this wakeup may still point to the object,
+               release it only after dispatching */
+            eventObj->handler = NULL;
+            eventObj->next = removedList;
+            removedList = eventObj;
+            return PCD_STATUS_OK;
+        }
+
+        searchList = &eventObj->next;
+    }
+
+    /* The file descriptor is not watched */
+    return PCD_STATUS_BAD_PARAMS;
+}
+
+void PCD_event_set_timeout( u_int32_t timeout )
+{
+    struct itimerspec its;
+
+    memset( &its, 0, sizeof( its ) );
+
+    if ( timeout != PCD_EVENT_TIMEOUT_FOREVER )
+    {
+        /* An all zero value disarms the timer, use the shortest possible timeout instead */
+        if ( timeout == 0 )
+        {
+            its.it_value.tv_nsec = 1;
+        }
+        else
+        {
+            its.it_value.tv_sec = timeout / 1000;
+            its.it_value.tv_nsec = ( timeout % 1000 ) * 1000000;
+        }
+    }
+
+    timerfd_settime( timerFd, 0, &its, NULL );
+}
+
+void PCD_event_wait( void )
+{
+    struct epoll_event events[ PCD_EVENT_MAX_EVENTS ];
+    int32_t numEvents;
+    int32_t i;
+
+    /* Sleep until something happens. Deal with signals correctly */
+    do
+    {
+        numEvents = epoll_wait( epollFd, events, PCD_EVENT_MAX_EVENTS, -1 );
+
+    } while ( numEvents == -1 && errno == EINTR );
+
+    for ( i = 0; i < numEvents; i++ )
+    {
+        eventObj_t *eventObj = events[ i ].data.ptr;
+
+        if ( eventObj->handler )
+        {
+            eventObj->handler( eventObj->fd, eventObj->data );
+        }
+    }
+
+    /* Release objects removed while dispatching */
+    while ( removedList )
+    {
+        eventObj_t *eventObj = removedList;
+
+        removedList = eventObj->next;
+        PCD_pool_free( &eventPool, eventObj );
+    }
+}
+
+u_int64_t PCD_event_get_time( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (u_int64_t)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
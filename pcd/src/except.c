@@ -59,11 +59,13 @@
 #include "timer.h"
 #include "pcd.h"
 #include "except.h"
+#include "event.h"
 #include "errlog.h"
 
 #define PCD_ERRLOG_BUF_SIZE             1024
 
 static int32_t fd = -1;
+static int32_t writerFd = -1;
 static fd_set rdset;
 
 /* This translates a signal code into a readable string */
@@ -454,6 +456,11 @@ static void PCD_dump_fault_info( exception_t *exception )
     i = write( STDERR_FILENO, "\n**************************************************************************\n", 76 );
 }
 
+static void PCD_exception_event_handler( int32_t eventFd, void *data )
+{
+    PCD_exception_listen();
+}
+
 PCD_status_e PCD_exception_init( void )
 {
     /* Create a FIFO stream that PCD will listen to */
@@ -475,15 +482,32 @@ PCD_status_e PCD_exception_init( void )
         return PCD_STATUS_NOK;
     }
 
+    /* Hold a writer of our own. Otherwise the FIFO reports a hangup forever
+       after the first crashing process closes it, and wakes up the main loop */
+    writerFd = open( PCD_EXCEPTION_FILE, O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+
+    if ( writerFd < 0 )
+    {
+        PCD_PRINTF_STDERR( "Failed to open exception file %s",  PCD_EXCEPTION_FILE );
+        return PCD_STATUS_NOK;
+    }
+
     /* Clear read fd */
     FD_ZERO(&rdset);
     FD_SET(fd, &rdset);
 
-    return PCD_STATUS_OK;
+    /* Incoming exceptions wake up the main loop */
+    return PCD_event_add( fd, PCD_exception_event_handler, NULL );
 }
 
 PCD_status_e PCD_exception_close( void )
 {
+    if ( writerFd > 0 )
+    {
+        close( writerFd );
+        writerFd = -1;
+    }
+
     if ( fd > 0 )
     {
         /* Close FIFO */
@@ -99,6 +99,8 @@ rule_t *PCD_failure_action_RESTART( rule_t *rule )
         PCD_process_stop( rule, True, NULL );
     }
 
+    rule->stats.restarts++;
+
     /* Reenqueue rule */
     return( rule );
 }
@@ -108,18 +110,18 @@ rule_t *PCD_failure_action_EXEC_RULE( rule_t *rule )
     rule_t *execRule;
 
     /* Find rule to execute */
-    execRule = PCD_rulesdb_get_rule_by_id( &rule->failureAction.ruleId );
+    execRule = PCD_rulesdb_get_rule_by_id( rule->failureAction.ruleId );
 
     if ( !execRule )
     {
-        PCD_PRINTF_STDERR( "Failed to execute rule %s_%s, rule not found!", rule->failureAction.ruleId.groupName, rule->failureAction.ruleId.ruleName );
+        PCD_PRINTF_STDERR( "Failed to execute rule %s_%s, rule not found!", rule->failureAction.ruleId->groupName, rule->failureAction.ruleId->ruleName );
         return NULL;
     }
 
     /* Check if rule is already running */
     if ( PCD_RULE_ACTIVE( execRule ) )
     {
-        PCD_PRINTF_STDERR( "Failed to execute rule %s_%s, rule already running!", rule->failureAction.ruleId.groupName, rule->failureAction.ruleId.ruleName );
+        PCD_PRINTF_STDERR( "Failed to execute rule %s_%s, rule already running!", rule->failureAction.ruleId->groupName, rule->failureAction.ruleId->ruleName );
         return NULL;
     }
 
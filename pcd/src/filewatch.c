@@ -0,0 +1,496 @@
+/*
+ * filewatch.c
+ * Description:
+ * PCD file watcher implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "system_types.h"
+#include "condchk.h"
+#include "filewatch.h"
+#include "event.h"
+#include "timer.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+/* Watched files hashed by name, must be a power of 2 */
+#define PCD_FILEWATCH_HASH_SIZE     64
+
+/* Directory events which may change the existence of a file */
+#define PCD_FILEWATCH_DIR_EVENTS    ( IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | \
+                                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR )
+
+typedef struct fileWatchDir_t
+{
+    char                    *path;
+    int32_t                 wd;         /* -1 - Not watched, the files are polled */
+    u_int32_t               refCount;
+    struct fileWatch_t      *files;
+
+    struct fileWatchDir_t   *next;
+
+} fileWatchDir_t;
+
+typedef struct fileWatch_t
+{
+    char                    *filename;
+    const char              *name;      /* Name within the directory */
+    fileWatchDir_t          *dir;
+    u_int32_t               refCount;
+    bool_t                  exists;
+
+    struct fileWatch_t      *hashNext;
+    struct fileWatch_t      *dirNext;
+
+} fileWatch_t;
+
+static int32_t inotifyFd = -1;
+static fileWatchDir_t *dirList = NULL;
+static fileWatch_t *fileHash[ PCD_FILEWATCH_HASH_SIZE ];
+
+static u_int32_t PCD_filewatch_hash( const char *filename );
+static fileWatch_t *PCD_filewatch_find( const char *filename );
+static fileWatchDir_t *PCD_filewatch_dir_get( const char *path );
+static void PCD_filewatch_dir_put( fileWatchDir_t *dir );
+static void PCD_filewatch_refresh( fileWatchDir_t *dir );
+static void PCD_filewatch_handle_event( struct inotify_event *event );
+static void PCD_filewatch_event_handler( int32_t fd, void *data );
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+PCD_status_e PCD_filewatch_init( void )
+{
+    inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    if ( inotifyFd < 0 )
+    {
+        /* Not fatal, FILE conditions are polled instead */
+        PCD_PRINTF_WARNING_STDOUT( "inotify is not available, polling files" );
+        return PCD_STATUS_OK;
+    }
+
+    if ( PCD_event_add( inotifyFd, PCD_filewatch_event_handler, NULL ) != PCD_STATUS_OK )
+    {
+        close( inotifyFd );
+        inotifyFd = -1;
+        return PCD_STATUS_NOK;
+    }
+
+    return PCD_STATUS_OK;
+}
+
+fileWatch_t *PCD_filewatch_add( const char *filename )
+{
+    fileWatch_t *fileWatch;
+    const char *slash;
+    struct stat fbuf;
+
+    if ( !filename )
+        return NULL;
+
+    /* Rules waiting for the same file share the watch */
+    fileWatch = PCD_filewatch_find( filename );
+
+    if ( fileWatch )
+    {
+        fileWatch->refCount++;
+        return fileWatch;
+    }
+
+    fileWatch = malloc( sizeof( fileWatch_t ) );
+
+    if ( !fileWatch )
+    {
+        PCD_PRINTF_STDERR( "memory allocation failure" );
+        return NULL;
+    }
+
+    memset( fileWatch, 0, sizeof( fileWatch_t ) );
+
+    fileWatch->filename = strdup( filename );
+
+    if ( !fileWatch->filename )
+    {
+        PCD_PRINTF_STDERR( "memory allocation failure" );
+        free( fileWatch );
+        return NULL;
+    }
+
+    fileWatch->refCount = 1;
+
+    /* Split the directory part, the kernel reports the file by its name within the directory */
+    slash = strrchr( fileWatch->filename, '/' );
+    fileWatch->name = slash ? slash + 1 : fileWatch->filename;
+
+    if ( *fileWatch->name )
+    {
+        char path[ PATH_MAX ];
+
+        if ( !slash )
+        {
+            strcpy( path, "." );
+        }
+        else if ( slash == fileWatch->filename )
+        {
+            strcpy( path, "/" );
+        }
+        else
+        {
+            u_int32_t len = slash - fileWatch->filename;
+
+            if ( len >= sizeof( path ) )
+                len = sizeof( path ) - 1;
+
+            memcpy( path, fileWatch->filename, len );
+            path[ len ] = '\0';
+        }
+
+        fileWatch->dir = PCD_filewatch_dir_get( path );
+
+        if ( fileWatch->dir )
+        {
+            fileWatch->dirNext = fileWatch->dir->files;
+            fileWatch->dir->files = fileWatch;
+        }
+    }
+
+    /* Check the initial state only after the watch is set, so a creation cannot be missed */
+    fileWatch->exists = ( stat( fileWatch->filename, &fbuf ) == 0 ) ? True : False;
+
+    fileWatch->hashNext = fileHash[ PCD_filewatch_hash( filename ) ];
+    fileHash[ PCD_filewatch_hash( filename ) ] = fileWatch;
+
+    return fileWatch;
+}
+
+void PCD_filewatch_release( fileWatch_t *fileWatch )
+{
+    fileWatch_t **searchList;
+
+    if ( ( !fileWatch ) || ( --fileWatch->refCount > 0 ) )
+        return;
+
+    searchList = &fileHash[ PCD_filewatch_hash( fileWatch->filename ) ];
+
+    while ( *searchList )
+    {
+        if ( *searchList == fileWatch )
+        {
+            *searchList = fileWatch->hashNext;
+            break;
+        }
+
+        searchList = &(*searchList)->hashNext;
+    }
+
+    if ( fileWatch->dir )
+    {
+        searchList = &fileWatch->dir->files;
+
+        while ( *searchList )
+        {
+            if ( *searchList == fileWatch )
+            {
+                *searchList = fileWatch->dirNext;
+                break;
+            }
+
+            searchList = &(*searchList)->dirNext;
+        }
+
+        PCD_filewatch_dir_put( fileWatch->dir );
+    }
+
+    free( fileWatch->filename );
+    free( fileWatch );
+}
+
+bool_t PCD_filewatch_is_active( fileWatch_t *fileWatch )
+{
+    if ( ( fileWatch ) && ( fileWatch->dir ) && ( fileWatch->dir->wd >= 0 ) )
+        return True;
+
+    return False;
+}
+
+PCD_status_e PCD_filewatch_check( const char *filename )
+{
+    fileWatch_t *fileWatch = PCD_filewatch_find( filename );
+    struct stat fbuf;
+
+    /* The kernel keeps us up to date */
+    if ( PCD_filewatch_is_active( fileWatch ) )
+    {
+        return fileWatch->exists ? PCD_STATUS_OK : PCD_STATUS_NOK;
+    }
+
+    /* Not watched, try to open the file */
+    if ( stat( filename, &fbuf ) )
+        return PCD_STATUS_NOK;
+
+    return PCD_STATUS_OK;
+}
+
+static u_int32_t PCD_filewatch_hash( const char *filename )
+{
+    u_int32_t hash = 5381;
+
+    while ( *filename )
+    {
+        hash = ( hash * 33 ) + (u_int8_t)*filename++;
+    }
+
+    return hash & ( PCD_FILEWATCH_HASH_SIZE - 1 );
+}
+
+static fileWatch_t *PCD_filewatch_find( const char *filename )
+{
+    fileWatch_t *fileWatch = fileHash[ PCD_filewatch_hash( filename ) ];
+
+    while ( fileWatch )
+    {
+        if ( strcmp( fileWatch->filename, filename ) == 0 )
+            return fileWatch;
+
+        fileWatch = fileWatch->hashNext;
+    }
+
+    return NULL;
+}
+
+static fileWatchDir_t *PCD_filewatch_dir_get( const char *path )
+{
+    fileWatchDir_t *dir = dirList;
+    int32_t wd;
+
+    /* No inotify, poll */
+    if ( inotifyFd < 0 )
+        return NULL;
+
+    while ( dir )
+    {
+        if ( strcmp( dir->path, path ) == 0 )
+        {
+            dir->refCount++;
+            return dir;
+        }
+
+        dir = dir->next;
+    }
+
+    /* A directory which does not exist yet cannot be watched, its files are polled */
+    wd = inotify_add_watch( inotifyFd, path, PCD_FILEWATCH_DIR_EVENTS );
+
+    if ( wd < 0 )
+    {
+        PCD_DEBUG_PRINTF( "Cannot watch directory %s, polling", path );
+    }
+    else
+    {
+        /* Other names of the same directory (such as "dir/." or a link) get the same watch, share it */
+        for ( dir = dirList; dir; dir = dir->next )
+        {
+            if ( dir->wd == wd )
+            {
+                dir->refCount++;
+                return dir;
+            }
+        }
+    }
+
+    dir = malloc( sizeof( fileWatchDir_t ) );
+
+    if ( !dir )
+    {
+        PCD_PRINTF_STDERR( "memory allocation failure" );
+        goto alloc_error;
+    }
+
+    dir->path = strdup( path );
+
+    if ( !dir->path )
+    {
+        PCD_PRINTF_STDERR( "memory allocation failure" );
+        free( dir );
+        goto alloc_error;
+    }
+
+    dir->wd = wd;
+    dir->refCount = 1;
+    dir->files = NULL;
+    dir->next = dirList;
+    dirList = dir;
+
+    return dir;
+
+alloc_error:
+    if ( wd >= 0 )
+    {
+        inotify_rm_watch( inotifyFd, wd );
+    }
+
+    return NULL;
+}
+
+static void PCD_filewatch_dir_put( fileWatchDir_t *dir )
+{
+    fileWatchDir_t **searchList = &dirList;
+
+    if ( --dir->refCount > 0 )
+        return;
+
+    if ( dir->wd >= 0 )
+    {
+        inotify_rm_watch( inotifyFd, dir->wd );
+    }
+
+    while ( *searchList )
+    {
+        if ( *searchList == dir )
+        {
+            *searchList = dir->next;
+            break;
+        }
+
+        searchList = &(*searchList)->next;
+    }
+
+    free( dir->path );
+    free( dir );
+}
+
+static void PCD_filewatch_refresh( fileWatchDir_t *dir )
+{
+    fileWatchDir_t *searchDir = dir ? dir : dirList;
+
+    while ( searchDir )
+    {
+        fileWatch_t *fileWatch = searchDir->files;
+        struct stat fbuf;
+
+        while ( fileWatch )
+        {
+            fileWatch->exists = ( stat( fileWatch->filename, &fbuf ) == 0 ) ? True : False;
+            fileWatch = fileWatch->dirNext;
+        }
+
+        if ( dir )
+            break;
+
+        searchDir = searchDir->next;
+    }
+}
+
+static void PCD_filewatch_handle_event( struct inotify_event *event )
+{
+    fileWatchDir_t *dir = dirList;
+    fileWatch_t *fileWatch;
+
+    /* Events were lost, check all the files again */
+    if ( event->mask & IN_Q_OVERFLOW )
+    {
+        PCD_filewatch_refresh( NULL );
+        return;
+    }
+
+    while ( ( dir ) && ( dir->wd != event->wd ) )
+    {
+        dir = dir->next;
+    }
+
+    if ( !dir )
+        return;
+
+    if ( event->mask & ( IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED ) )
+    {
+        /* The directory is gone, poll its files from now on */
+        if ( !( event->mask & IN_IGNORED ) )
+        {
+            inotify_rm_watch( inotifyFd, dir->wd );
+        }
+
+        PCD_DEBUG_PRINTF( "Directory %s is no longer watched, polling", dir->path );
+        dir->wd = -1;
+        return;
+    }
+
+    if ( !event->len )
+        return;
+
+    /* Update only the files that were named by the event */
+    fileWatch = dir->files;
+
+    while ( fileWatch )
+    {
+        if ( strcmp( fileWatch->name, event->name ) == 0 )
+        {
+            struct stat fbuf;
+
+            fileWatch->exists = ( stat( fileWatch->filename, &fbuf ) == 0 ) ? True : False;
+        }
+
+        fileWatch = fileWatch->dirNext;
+    }
+}
+
+static void PCD_filewatch_event_handler( int32_t fd, void *data )
+{
+    char buff[ 4096 ] __attribute__ ( ( aligned( __alignof__( struct inotify_event ) ) ) );
+    ssize_t len;
+
+    while ( ( len = read( fd, buff, sizeof( buff ) ) ) > 0 )
+    {
+        char *ptr = buff;
+
+        while ( ptr < buff + len )
+        {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+
+            PCD_filewatch_handle_event( event );
+
+            ptr += sizeof( struct inotify_event ) + event->len;
+        }
+    }
+
+    /* Check the rules which wait for watched files */
+    PCD_timer_notify_watch();
+}
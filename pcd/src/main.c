@@ -48,9 +48,14 @@
 #include "timer.h"
 #include "pcd_api.h"
 #include "except.h"
+#include "event.h"
+#include "filewatch.h"
+#include "netwatch.h"
 #include "pcd.h"
 #include "pcdapi.h"
 #include "errlog.h"
+#include "trace.h"
+#include "stats.h"
 
 #include "pcd_version.h"
 
@@ -58,11 +63,9 @@
 /*      LOCAL DEFINITIONS AND VARIABLES                                   */
 /**************************************************************************/
 
-/* PCD Process tick: 1500ms */
-#define PCD_PROCESS_TICK  ( 1500 )
-
 static char *rulesFilename = NULL;
 static bool_t crashDaemonMode = False;
+static bool_t traceWritten = False;
 
 static void PCD_main_usage( char *execname );
 bool_t verboseOutput = False;
@@ -84,6 +87,8 @@ static void PCD_main_usage( char *execname )
     printf( "-t tick, --timer-tick=tick\tSetup timer ticks in ms (default 200ms).\n" );
     printf( "-e FILE, --errlog=FILE\t\tSpecify error log file (in nvram).\n" );
     printf( "-c, --crashd\t\t\tEnable crash-daemon only mode (no rules file).\n" );
+    printf( "-T FILE, --trace=FILE\t\tWrite the rules trace to FILE when the boot settles and on termination.\n" );
+    printf( "-m FILE, --metrics=FILE\t\tWrite the runtime statistics to FILE periodically, in Prometheus text format.\n" );
     printf( "-h, --help\t\t\tPrint this message and exit.\n" );
     printf( "-v, --version\t\t\tPrint PCD version information.\n" );
     exit(0);
@@ -108,6 +113,8 @@ void PCD_main_parse_params( int32_t argc, char *argv[] )
             {"debug",       no_argument,        0, 'd'},
             {"errlog",      required_argument,  0, 'e'},
             {"crashd",      no_argument,        0, 'c'},		
+            {"trace",       required_argument,  0, 'T'},
+            {"metrics",     required_argument,  0, 'm'},
             {"version",     no_argument,        0, 'V'},
 			{0, 0, 0, 0}
         };
@@ -115,7 +122,7 @@ void PCD_main_parse_params( int32_t argc, char *argv[] )
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long( argc, argv, "dpvVhcf:t:e:", long_options, &option_index );
+        c = getopt_long( argc, argv, "dpvVhcf:t:e:T:m:", long_options, &option_index );
 
         /* Detect the end of the options. */
         if ( c == -1 )
@@ -168,6 +175,14 @@ void PCD_main_parse_params( int32_t argc, char *argv[] )
                 PCD_errlog_init( optarg );
                 break;
 
+            case 'T':
+                PCD_trace_set_output( optarg );
+                break;
+
+            case 'm':
+                PCD_stats_set_output( optarg );
+                break;
+
             case 't':
                 PCD_TIMER_TICK = atoi( optarg );
 
@@ -229,12 +244,30 @@ void PCD_main_init( void )
 {
     /* Initialize the whole PCD subsystems. Exit abnormally in case something fails to init. */
 
+    /* Initialize the event loop first, other modules register to it */
+    if ( PCD_event_init() != PCD_STATUS_OK )
+    {
+        exit(1);
+    }
+
     /* Initialize the timer module */
     if ( PCD_timer_init() != PCD_STATUS_OK )
     {
         exit(1);
     }
 
+    /* Initialize the file watcher, used by FILE conditions */
+    if ( PCD_filewatch_init() != PCD_STATUS_OK )
+    {
+        exit(1);
+    }
+
+    /* Initialize the network device watcher, used by NETDEVICE conditions */
+    if ( PCD_netwatch_init() != PCD_STATUS_OK )
+    {
+        exit(1);
+    }
+
     /* Initialize process module */
     if ( PCD_process_init() != PCD_STATUS_OK )
     {
@@ -276,38 +309,83 @@ void PCD_main_init( void )
 
 void PCD_main_loop( void )
 {
-    u_int32_t pcdTimerTick;
-    u_int32_t tickCounter = PCD_PROCESS_TICK; /* Init tickCounter to perform an iteration */
-
-    /* Setup PCD tick */
-    pcdTimerTick = PCD_TIMER_TICK * 1000; /* Convert to uSeconds */
-
     /* An endless loop */
     while ( 1 )
     {
+        u_int32_t timeout;
+        u_int32_t processTimeout;
+        u_int32_t statsTimeout;
+        u_int32_t apiTimeout;
+        u_int64_t loopStart;
+        bool_t processFlag;
+
         fflush( stdout );
         fflush( stderr );
 
-        /* Check incoming messages */
-        PCD_api_check_messages();
+        /* Wake up for the timer only if rules are waiting for their conditions */
+        timeout = PCD_timer_get_timeout();
 
-        usleep( pcdTimerTick );
+        /* Processes in transition wake up on their next state transition */
+        processTimeout = PCD_process_get_timeout();
+
+        if ( processTimeout < timeout )
+        {
+            timeout = processTimeout;
+        }
+
+        /* The statistics file is written periodically */
+        statsTimeout = PCD_stats_get_timeout();
+
+        if ( statsTimeout < timeout )
+        {
+            timeout = statsTimeout;
+        }
+
+        /* Requests which are still waiting in the socket or in the client queues */
+        apiTimeout = PCD_api_get_timeout();
+
+        if ( apiTimeout < timeout )
+        {
+            timeout = apiTimeout;
+        }
+
+        PCD_event_set_timeout( timeout );
+
+        /* Sleep until something happens. Incoming messages, exceptions and signals are handled here */
+        PCD_event_wait();
+
+        loopStart = PCD_stats_get_time_us();
+
+        /* Handle the incoming requests */
+        PCD_api_check_messages();
 
         /* Iterate on timer loop */
-        if ( ( PCD_timer_iterate() ) || ( tickCounter >= PCD_PROCESS_TICK ) )
+        processFlag = PCD_timer_iterate();
+
+        /* Hand the exited processes to the state machine. The timer has already
+           checked their exit status against the end conditions */
+        PCD_process_iterate_exited();
+
+        /* Spawn the processes of rules which just started in the same loop turn */
+        if ( ( processFlag ) || ( PCD_process_get_timeout() == 0 ) )
         {
             /* Iterate on process loop */
             PCD_process_iterate_start();
             PCD_process_iterate_stop();
+        }
 
-            /* Check for incoming exceptions */
-            PCD_exception_listen();
-
-            tickCounter = 0;
+        /* Write the boot trace once no rule waits for its conditions anymore */
+        if ( ( !traceWritten ) && ( PCD_timer_is_idle() ) )
+        {
+            PCD_trace_write_output();
+            traceWritten = True;
         }
 
-        /* Advance the tick counter */
-        tickCounter += PCD_TIMER_TICK;
+        /* Send the state changes of this iteration to the subscribers */
+        PCD_api_send_events();
+
+        PCD_stats_iterate();
+        PCD_stats_loop_iteration( loopStart );
     }
 }
 
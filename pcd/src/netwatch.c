@@ -0,0 +1,535 @@
+/*
+ * netwatch.c
+ * Description:
+ * PCD network device watcher implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "system_types.h"
+#include "netwatch.h"
+#include "event.h"
+#include "timer.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define PCD_NETWATCH_BUFFER_SIZE    8192
+
+/* Maximum time to wait for a dump reply, in ms */
+#define PCD_NETWATCH_DUMP_TIMEOUT   1000
+
+typedef struct netAddr_t
+{
+    u_int8_t            family;
+    u_int8_t            prefixLen;
+    u_int8_t            addr[ 16 ];
+
+    struct netAddr_t    *next;
+
+} netAddr_t;
+
+typedef struct netIf_t
+{
+    int32_t             index;
+    char                name[ IF_NAMESIZE ];
+    u_int32_t           flags;
+    netAddr_t           *addrList;
+
+    struct netIf_t      *next;
+
+} netIf_t;
+
+static int32_t netlinkFd = -1;
+static u_int32_t netlinkSeq = 0;
+static netIf_t *ifList = NULL;
+
+static netIf_t *PCD_netwatch_find_by_index( int32_t index );
+static netIf_t *PCD_netwatch_find_by_name( const char *name );
+static void PCD_netwatch_free_if( netIf_t *netIf );
+static void PCD_netwatch_handle_link( struct nlmsghdr *nh );
+static void PCD_netwatch_handle_addr( struct nlmsghdr *nh );
+static PCD_status_e PCD_netwatch_parse( void *buff, int32_t len, u_int32_t seq );
+static PCD_status_e PCD_netwatch_dump( u_int16_t type );
+static PCD_status_e PCD_netwatch_sync( void );
+static void PCD_netwatch_event_handler( int32_t fd, void *data );
+static PCD_status_e PCD_netwatch_ioctl_check( const char *netDevice, netDevState_e state );
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+PCD_status_e PCD_netwatch_init( void )
+{
+    struct sockaddr_nl addr;
+
+    netlinkFd = socket( AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE );
+
+    if ( netlinkFd < 0 )
+    {
+        /* Not fatal, NETDEVICE conditions are polled instead */
+        PCD_PRINTF_WARNING_STDOUT( "rtnetlink is not available, polling network devices" );
+        return PCD_STATUS_OK;
+    }
+
+    memset( &addr, 0, sizeof( addr ) );
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+    if ( ( bind( netlinkFd, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 ) ||
+         ( PCD_netwatch_sync() != PCD_STATUS_OK ) )
+    {
+        PCD_PRINTF_WARNING_STDOUT( "Failed to subscribe to rtnetlink, polling network devices" );
+        close( netlinkFd );
+        netlinkFd = -1;
+        return PCD_STATUS_OK;
+    }
+
+    if ( PCD_event_add( netlinkFd, PCD_netwatch_event_handler, NULL ) != PCD_STATUS_OK )
+    {
+        close( netlinkFd );
+        netlinkFd = -1;
+        return PCD_STATUS_NOK;
+    }
+
+    return PCD_STATUS_OK;
+}
+
+bool_t PCD_netwatch_is_active( void )
+{
+    return ( netlinkFd >= 0 ) ? True : False;
+}
+
+PCD_status_e PCD_netwatch_check( const char *netDevice, netDevState_e state )
+{
+    netIf_t *netIf;
+
+    if ( netlinkFd < 0 )
+    {
+        return PCD_netwatch_ioctl_check( netDevice, state );
+    }
+
+    /* The interface table is kept up to date by the kernel */
+    netIf = PCD_netwatch_find_by_name( netDevice );
+
+    if ( !netIf )
+        return PCD_STATUS_NOK;
+
+    switch ( state )
+    {
+        case PCD_COND_NETDEVICE_UP:
+            return ( netIf->flags & IFF_UP ) ? PCD_STATUS_OK : PCD_STATUS_NOK;
+
+        case PCD_COND_NETDEVICE_ADDR:
+            return ( netIf->addrList ) ? PCD_STATUS_OK : PCD_STATUS_NOK;
+
+        default:
+            return PCD_STATUS_OK;
+    }
+}
+
+static netIf_t *PCD_netwatch_find_by_index( int32_t index )
+{
+    netIf_t *netIf = ifList;
+
+    while ( ( netIf ) && ( netIf->index != index ) )
+    {
+        netIf = netIf->next;
+    }
+
+    return netIf;
+}
+
+static netIf_t *PCD_netwatch_find_by_name( const char *name )
+{
+    netIf_t *netIf = ifList;
+
+    while ( ( netIf ) && ( strncmp( netIf->name, name, IF_NAMESIZE ) != 0 ) )
+    {
+        netIf = netIf->next;
+    }
+
+    return netIf;
+}
+
+static void PCD_netwatch_free_if( netIf_t *netIf )
+{
+    while ( netIf->addrList )
+    {
+        netAddr_t *netAddr = netIf->addrList;
+
+        netIf->addrList = netAddr->next;
+        free( netAddr );
+    }
+
+    free( netIf );
+}
+
+static void PCD_netwatch_handle_link( struct nlmsghdr *nh )
+{
+    struct ifinfomsg *ifi = NLMSG_DATA( nh );
+    struct rtattr *rta = IFLA_RTA( ifi );
+    int32_t len = IFLA_PAYLOAD( nh );
+    netIf_t **searchList = &ifList;
+    netIf_t *netIf;
+
+    if ( nh->nlmsg_type == RTM_DELLINK )
+    {
+        while ( *searchList )
+        {
+            if ( (*searchList)->index == ifi->ifi_index )
+            {
+                netIf = *searchList;
+                *searchList = netIf->next;
+                PCD_netwatch_free_if( netIf );
+                return;
+            }
+
+            searchList = &(*searchList)->next;
+        }
+
+        return;
+    }
+
+    netIf = PCD_netwatch_find_by_index( ifi->ifi_index );
+
+    if ( !netIf )
+    {
+        netIf = malloc( sizeof( netIf_t ) );
+
+        if ( !netIf )
+        {
+            PCD_PRINTF_STDERR( "memory allocation failure" );
+            return;
+        }
+
+        memset( netIf, 0, sizeof( netIf_t ) );
+        netIf->index = ifi->ifi_index;
+        netIf->next = ifList;
+        ifList = netIf;
+    }
+
+    netIf->flags = ifi->ifi_flags;
+
+    /* The name may change as well */
+    for ( ; RTA_OK( rta, len ); rta = RTA_NEXT( rta, len ) )
+    {
+        if ( rta->rta_type == IFLA_IFNAME )
+        {
+            memset( netIf->name, 0, sizeof( netIf->name ) );
+            strncpy( netIf->name, RTA_DATA( rta ), IF_NAMESIZE - 1 );
+        }
+    }
+}
+
+static void PCD_netwatch_handle_addr( struct nlmsghdr *nh )
+{
+    struct ifaddrmsg *ifa = NLMSG_DATA( nh );
+    struct rtattr *rta = IFA_RTA( ifa );
+    int32_t len = IFA_PAYLOAD( nh );
+    netIf_t *netIf = PCD_netwatch_find_by_index( ifa->ifa_index );
+    netAddr_t **searchList;
+    netAddr_t newAddr;
+    bool_t found = False;
+
+    /* Link local addresses are assigned automatically, they do not count */
+    if ( ( !netIf ) || ( ifa->ifa_scope == RT_SCOPE_LINK ) )
+        return;
+
+    memset( &newAddr, 0, sizeof( newAddr ) );
+    newAddr.family = ifa->ifa_family;
+    newAddr.prefixLen = ifa->ifa_prefixlen;
+
+    for ( ; RTA_OK( rta, len ); rta = RTA_NEXT( rta, len ) )
+    {
+        /* Prefer the local address, IFA_ADDRESS is the peer on point to point links */
+        if ( ( rta->rta_type == IFA_LOCAL ) || ( ( rta->rta_type == IFA_ADDRESS ) && ( !found ) ) )
+        {
+            u_int32_t size = RTA_PAYLOAD( rta );
+
+            if ( size > sizeof( newAddr.addr ) )
+                size = sizeof( newAddr.addr );
+
+            memset( newAddr.addr, 0, sizeof( newAddr.addr ) );
+            memcpy( newAddr.addr, RTA_DATA( rta ), size );
+            found = ( rta->rta_type == IFA_LOCAL ) ? True : found;
+        }
+    }
+
+    searchList = &netIf->addrList;
+
+    while ( *searchList )
+    {
+        netAddr_t *netAddr = *searchList;
+
+        if ( ( netAddr->family == newAddr.family ) && ( netAddr->prefixLen == newAddr.prefixLen ) &&
+             ( memcmp( netAddr->addr, newAddr.addr, sizeof( newAddr.addr ) ) == 0 ) )
+        {
+            if ( nh->nlmsg_type == RTM_DELADDR )
+            {
+                *searchList = netAddr->next;
+                free( netAddr );
+            }
+
+            /* Updates of a known address are ignored */
+            return;
+        }
+
+        searchList = &netAddr->next;
+    }
+
+    if ( nh->nlmsg_type == RTM_NEWADDR )
+    {
+        netAddr_t *netAddr = malloc( sizeof( netAddr_t ) );
+
+        if ( !netAddr )
+        {
+            PCD_PRINTF_STDERR( "memory allocation failure" );
+            return;
+        }
+
+        *netAddr = newAddr;
+        netAddr->next = netIf->addrList;
+        netIf->addrList = netAddr;
+    }
+}
+
+static PCD_status_e PCD_netwatch_parse( void *buff, int32_t len, u_int32_t seq )
+{
+    struct nlmsghdr *nh;
+    PCD_status_e retval = PCD_STATUS_WAIT;
+
+    for ( nh = buff; NLMSG_OK( nh, len ); nh = NLMSG_NEXT( nh, len ) )
+    {
+        switch ( nh->nlmsg_type )
+        {
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+                PCD_netwatch_handle_link( nh );
+                break;
+
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                PCD_netwatch_handle_addr( nh );
+                break;
+
+            case NLMSG_DONE:
+                /* End of the requested dump */
+                if ( ( seq ) && ( nh->nlmsg_seq == seq ) )
+                    retval = PCD_STATUS_OK;
+                break;
+
+            case NLMSG_ERROR:
+                /* An error code of 0 acknowledges the request, otherwise the dump failed */
+                if ( ( seq ) && ( nh->nlmsg_seq == seq ) )
+                {
+                    const struct nlmsgerr *err = NLMSG_DATA( nh );
+
+                    if ( ( nh->nlmsg_len < NLMSG_LENGTH( sizeof( struct nlmsgerr ) ) ) || ( err->error != 0 ) )
+                        return PCD_STATUS_NOK;
+
+                    retval = PCD_STATUS_OK;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return retval;
+}
+
+static PCD_status_e PCD_netwatch_dump( u_int16_t type )
+{
+    struct
+    {
+        struct nlmsghdr nh;
+        struct rtgenmsg gen;
+
+    } req;
+    char buff[ PCD_NETWATCH_BUFFER_SIZE ] __attribute__ ( ( aligned( __alignof__( struct nlmsghdr ) ) ) );
+    struct pollfd pfd;
+
+    memset( &req, 0, sizeof( req ) );
+    req.nh.nlmsg_len = NLMSG_LENGTH( sizeof( struct rtgenmsg ) );
+    req.nh.nlmsg_type = type;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++netlinkSeq;
+    req.gen.rtgen_family = AF_UNSPEC;
+
+    if ( send( netlinkFd, &req, req.nh.nlmsg_len, 0 ) < 0 )
+        return PCD_STATUS_NOK;
+
+    pfd.fd = netlinkFd;
+    pfd.events = POLLIN;
+
+    /* Events that arrive in the middle are handled as well */
+    while ( True )
+    {
+        int32_t len = recv( netlinkFd, buff, sizeof( buff ), 0 );
+
+        if ( len > 0 )
+        {
+            PCD_status_e retval = PCD_netwatch_parse( buff, len, req.nh.nlmsg_seq );
+
+            if ( retval != PCD_STATUS_WAIT )
+                return retval;
+        }
+        else if ( ( len < 0 ) && ( errno == EAGAIN ) )
+        {
+            if ( poll( &pfd, 1, PCD_NETWATCH_DUMP_TIMEOUT ) <= 0 )
+                return PCD_STATUS_TIMEOUT;
+        }
+        else if ( ( len < 0 ) && ( errno == EINTR ) )
+        {
+            continue;
+        }
+        else
+        {
+            return PCD_STATUS_NOK;
+        }
+    }
+}
+
+static PCD_status_e PCD_netwatch_sync( void )
+{
+    /* Rebuild the whole table */
+    while ( ifList )
+    {
+        netIf_t *netIf = ifList;
+
+        ifList = netIf->next;
+        PCD_netwatch_free_if( netIf );
+    }
+
+    /* Only one dump may run at a time, links first so that addresses find their interface */
+    if ( PCD_netwatch_dump( RTM_GETLINK ) != PCD_STATUS_OK )
+        return PCD_STATUS_NOK;
+
+    return PCD_netwatch_dump( RTM_GETADDR );
+}
+
+static void PCD_netwatch_event_handler( int32_t fd, void *data )
+{
+    char buff[ PCD_NETWATCH_BUFFER_SIZE ] __attribute__ ( ( aligned( __alignof__( struct nlmsghdr ) ) ) );
+    struct sockaddr_nl addr;
+    socklen_t addrLen;
+    int32_t len;
+
+    while ( True )
+    {
+        addrLen = sizeof( addr );
+        len = recvfrom( fd, buff, sizeof( buff ), 0, (struct sockaddr *)&addr, &addrLen );
+
+        if ( len <= 0 )
+            break;
+
+        /* Trust the kernel only */
+        if ( addr.nl_pid != 0 )
+            continue;
+
+        PCD_netwatch_parse( buff, len, 0 );
+    }
+
+    /* The socket buffer overran and events were lost, start over */
+    if ( ( len < 0 ) && ( errno == ENOBUFS ) )
+    {
+        PCD_PRINTF_WARNING_STDOUT( "rtnetlink events lost, reloading network devices" );
+
+        if ( PCD_netwatch_sync() != PCD_STATUS_OK )
+        {
+            /* The table is incomplete, events would never come for the missing devices */
+            PCD_PRINTF_STDERR( "Failed to reload network devices, polling network devices" );
+            PCD_event_remove( netlinkFd );
+            close( netlinkFd );
+            netlinkFd = -1;
+        }
+    }
+
+    /* Check the rules which wait for network devices */
+    PCD_timer_notify_watch();
+}
+
+static PCD_status_e PCD_netwatch_ioctl_check( const char *netDevice, netDevState_e state )
+{
+    int32_t sock;
+    struct ifreq ifr;
+    PCD_status_e ret = PCD_STATUS_NOK;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if ( sock < 0 )
+    {
+        return PCD_STATUS_NOK;
+    }
+
+    memset( &ifr, 0, sizeof( ifr ) );
+    strncpy(ifr.ifr_name, netDevice, IF_NAMESIZE - 1);
+
+    switch ( state )
+    {
+        case PCD_COND_NETDEVICE_UP:
+            /* Get interface flags */
+            if ( ( ioctl(sock, SIOCGIFFLAGS, &ifr) == 0 ) && ( ifr.ifr_flags & IFF_UP ) )
+                ret = PCD_STATUS_OK;
+            break;
+
+        case PCD_COND_NETDEVICE_ADDR:
+            /* Get interface IPv4 address */
+            ifr.ifr_addr.sa_family = AF_INET;
+            if ( ioctl(sock, SIOCGIFADDR, &ifr) == 0 )
+                ret = PCD_STATUS_OK;
+            break;
+
+        default:
+            /* Get interface mac address */
+            ifr.ifr_hwaddr.sa_family = 1;
+            if ( ioctl(sock, SIOCGIFHWADDR, &ifr) == 0 )
+                ret = PCD_STATUS_OK;
+            break;
+    }
+
+    close(sock);
+
+    return ret;
+}
@@ -0,0 +1,85 @@
+/*
+ * critpath.h
+ * Description:
+ * PCD boot critical path analysis header file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com 
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *  
+ */
+
+/***************************************************************************/
+
+/*! \file critpath.h
+    \brief Header file for the boot critical path analysis
+
+     The analysis combines the RULE_COMPLETED dependencies of the rules
+     with a recorded boot timeline, either the trace which PCD writes with
+     the --trace option, or a text file with a line per rule:
+     GROUP_RULE START READY COMPLETE, in ms, where READY may be '-'.
+
+****************************************************************************/
+
+#ifndef _CRITPATH_H_
+#define _CRITPATH_H_
+
+#include "system_types.h"
+#include "rules_db.h"
+
+/**************************************************************************/
+/*      INTERFACE FUNCTIONS Prototypes:                                   */
+/**************************************************************************/
+
+/*! \fn PCD_status_e PCD_critpath_add_rule
+ *  \brief Keep a parsed rule for the analysis
+ *  \param[in] rule.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_add_rule( const rule_t *newrule );
+
+/*! \fn PCD_status_e PCD_critpath_load_timeline
+ *  \brief Load the boot timeline of the rules
+ *  \param[in] timelineFilename.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_load_timeline( const char *timelineFilename );
+
+/*! \fn PCD_status_e PCD_critpath_analyze
+ *  \brief Compute the critical path, the slack of the rules and the gain of speeding them up, and print them
+ *  \param[in] numTop, number of rules to list by boot time gain.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_analyze( u_int32_t numTop );
+
+/*! \fn PCD_status_e PCD_critpath_write_graph
+ *  \brief Add all the rules to the graph, with their durations and the critical path highlighted
+ *  \param[in] graphHandle.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_write_graph( const void *graphHandle );
+
+#endif /* _CRITPATH_H_ */
@@ -58,6 +58,17 @@ typedef enum
 
 } pcdGraph_e;
 
+/*! \struct graphTiming_t
+    \brief Boot timing of a rule, shown in graph
+*/
+typedef struct graphTiming_t
+{
+    u_int64_t       durationUs;
+    bool_t          critical;       /* The rule is on the boot critical path */
+    const ruleId_t  *criticalDep;   /* Dependency on the critical path, NULL if none */
+
+} graphTiming_t;
+
 /**************************************************************************/
 /*      INTERFACE FUNCTIONS Prototypes:                                   */
 /**************************************************************************/
@@ -94,5 +105,13 @@ PCD_status_e PCD_graph_close_file( const char *graphFilename, const void *graphH
  */
 PCD_status_e PCD_graph_update_file( const rule_t *newrule, const void *graphHandle );
 
+/*! \fn PCD_status_e PCD_graph_update_file_timed
+ *  \brief Add a new item in graph, with its duration and critical path
+ *  \param[in] rule, timing (NULL if the rule has no timing), graphHandle.
+ *  \param[out] no output.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_graph_update_file_timed( const rule_t *newrule, const graphTiming_t *timing, const void *graphHandle );
+
 #endif /* _GRAPH_H_ */
 
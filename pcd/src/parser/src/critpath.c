@@ -0,0 +1,793 @@
+/*
+ * critpath.c
+ * Description:
+ * PCD boot critical path analysis implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com 
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *  
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "system_types.h"
+#include "rules_db.h"
+#include "parser.h"
+#include "condchk.h"
+#include "graph.h"
+#include "critpath.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+/* The boot is modelled as a graph of the RULE_COMPLETED dependencies. A rule
+   is ready to start when its last dependency completes, waits until it is
+   started, and runs for its duration until it completes. All the times are
+   in us, from the start of the boot. The slack of a rule is the time its
+   completion can be delayed without delaying the end of the boot, and its
+   gain is the time the boot would save if the rule took no time at all */
+
+#define CRITPATH_HASH_SIZE      1024
+#define CRITPATH_INIT_RULES     256
+#define CRITPATH_NO_TIME        (~0ULL)
+#define CRITPATH_LINE_SIZE      512
+
+typedef struct critRule_t
+{
+    rule_t              rule;           /* Copy of the parsed rule */
+    u_int64_t           startTime;      /* Start condition met, the command was started */
+    u_int64_t           readyTime;
+    u_int64_t           completeTime;
+    u_int64_t           waitTime;       /* From the completion of the dependencies to the start */
+    u_int64_t           duration;
+    u_int64_t           completion;     /* Completion in the model */
+    u_int64_t           newCompletion;  /* Completion in the model, with one rule taking no time */
+    u_int64_t           slack;
+    u_int64_t           gain;
+    int32_t             critDep;        /* Dependency which completed last, -1 if none */
+    u_int32_t           *deps;
+    u_int32_t           numDeps;
+    u_int32_t           *dependents;
+    u_int32_t           numDependents;
+    u_int32_t           pendingDeps;
+    bool_t              critical;
+    u_int32_t           hashNext;       /* Index + 1 of the next rule in the hash chain, 0 if none */
+
+} critRule_t;
+
+/* Rule of the trace, the trace has one process per group and one thread per rule */
+typedef struct critTrack_t
+{
+    u_int32_t           pid;
+    u_int32_t           tid;
+    int32_t             ruleIdx;
+    char                ruleName[ PCD_RULEID_MAX_RULE_NAME_SIZE ];
+
+} critTrack_t;
+
+typedef struct critGroup_t
+{
+    u_int32_t           pid;
+    char                groupName[ PCD_RULEID_MAX_GROUP_NAME_SIZE ];
+
+} critGroup_t;
+
+static critRule_t *critRules = NULL;
+static u_int32_t numCritRules = 0;
+static u_int32_t maxCritRules = 0;
+static u_int32_t critHash[ CRITPATH_HASH_SIZE ];
+
+/* Rules with timing, in topological order */
+static u_int32_t *critOrder = NULL;
+static u_int32_t numCritOrder = 0;
+
+static u_int64_t bootStart = CRITPATH_NO_TIME;
+static u_int64_t bootEnd;
+static bool_t timelineLoaded = False;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static u_int32_t PCD_critpath_hash( const char *groupName, const char *ruleName )
+{
+    u_int32_t hash = 5381;
+
+    while ( *groupName )
+        hash = ( hash * 33 ) ^ (unsigned char)*groupName++;
+
+    hash = ( hash * 33 ) ^ '_';
+
+    while ( *ruleName )
+        hash = ( hash * 33 ) ^ (unsigned char)*ruleName++;
+
+    return hash % CRITPATH_HASH_SIZE;
+}
+
+static int32_t PCD_critpath_find_rule( const char *groupName, const char *ruleName )
+{
+    u_int32_t idx = critHash[ PCD_critpath_hash( groupName, ruleName ) ];
+
+    while ( idx )
+    {
+        critRule_t *critRule = &critRules[ idx - 1 ];
+
+        if ( ( strcmp( critRule->rule.ruleId.groupName, groupName ) == 0 ) &&
+             ( strcmp( critRule->rule.ruleId.ruleName, ruleName ) == 0 ) )
+        {
+            return idx - 1;
+        }
+
+        idx = critRule->hashNext;
+    }
+
+    return -1;
+}
+
+static bool_t PCD_critpath_is_timed( const critRule_t *critRule )
+{
+    return ( ( critRule->startTime != CRITPATH_NO_TIME ) && ( critRule->completeTime != CRITPATH_NO_TIME ) );
+}
+
+static double PCD_critpath_ms( u_int64_t timeUs )
+{
+    return (double)timeUs / 1000;
+}
+
+/*! \fn PCD_status_e PCD_critpath_add_rule
+ *  \brief Keep a parsed rule for the analysis
+ *  \param[in] rule.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_add_rule( const rule_t *newrule )
+{
+    critRule_t *critRule;
+    u_int32_t hash;
+
+    if ( numCritRules == maxCritRules )
+    {
+        u_int32_t newMax = maxCritRules ? ( maxCritRules * 2 ) : CRITPATH_INIT_RULES;
+        critRule_t *newRules = realloc( critRules, newMax * sizeof( critRule_t ) );
+
+        if ( !newRules )
+        {
+            PCD_PRINTF_STDERR( "Failed to allocate memory" );
+            return PCD_STATUS_NOK;
+        }
+
+        critRules = newRules;
+        maxCritRules = newMax;
+    }
+
+    critRule = &critRules[ numCritRules ];
+    memset( critRule, 0, sizeof( critRule_t ) );
+    memcpy( &critRule->rule, newrule, sizeof( rule_t ) );
+    critRule->startTime = CRITPATH_NO_TIME;
+    critRule->readyTime = CRITPATH_NO_TIME;
+    critRule->completeTime = CRITPATH_NO_TIME;
+    critRule->critDep = -1;
+
+    hash = PCD_critpath_hash( newrule->ruleId.groupName, newrule->ruleId.ruleName );
+    critRule->hashNext = critHash[ hash ];
+    critHash[ hash ] = ++numCritRules;
+
+    return PCD_STATUS_OK;
+}
+
+/* Handle an event of a rule in the trace */
+static void PCD_critpath_trace_event( critRule_t *critRule, const char *event, u_int64_t timestamp )
+{
+    if ( strcmp( event, "enqueue" ) == 0 )
+    {
+        if ( timestamp < bootStart )
+            bootStart = timestamp;
+    }
+    else if ( strcmp( event, "start_cond" ) == 0 )
+    {
+        if ( critRule->startTime == CRITPATH_NO_TIME )
+            critRule->startTime = timestamp;
+    }
+    else if ( critRule->startTime != CRITPATH_NO_TIME )
+    {
+        /* Only the first run of a rule counts */
+        if ( ( strcmp( event, "ready" ) == 0 ) && ( critRule->readyTime == CRITPATH_NO_TIME ) )
+            critRule->readyTime = timestamp;
+        else if ( ( strcmp( event, "completed" ) == 0 ) && ( critRule->completeTime == CRITPATH_NO_TIME ) )
+            critRule->completeTime = timestamp;
+    }
+}
+
+static int PCD_critpath_track_cmp( const void *a, const void *b )
+{
+    const critTrack_t *trackA = a, *trackB = b;
+
+    if ( trackA->pid != trackB->pid )
+        return ( trackA->pid < trackB->pid ) ? -1 : 1;
+
+    if ( trackA->tid != trackB->tid )
+        return ( trackA->tid < trackB->tid ) ? -1 : 1;
+
+    return 0;
+}
+
+/* Load a trace written by PCD. The names of the groups and rules come first,
+   the file is read twice, the first pass maps the tracks to the rules */
+static PCD_status_e PCD_critpath_load_trace( FILE *in, const char *timelineFilename )
+{
+    critTrack_t *tracks = NULL, *track, key;
+    critGroup_t *groups = NULL;
+    u_int32_t numTracks = 0, numGroups = 0, i, j;
+    char line[ CRITPATH_LINE_SIZE ];
+    PCD_status_e ret = PCD_STATUS_OK;
+
+    while ( fgets( line, sizeof( line ), in ) )
+    {
+        char name[ PCD_RULEID_MAX_RULE_NAME_SIZE ];
+        u_int32_t pid, tid;
+        char *sp = line;
+
+        if ( *sp == ',' )
+            sp++;
+
+        if ( sscanf( sp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"%15[^\"]\"}}", &pid, name ) == 2 )
+        {
+            critGroup_t *newGroups = realloc( groups, ( numGroups + 1 ) * sizeof( critGroup_t ) );
+
+            if ( !newGroups )
+            {
+                ret = PCD_STATUS_NOK;
+                break;
+            }
+
+            groups = newGroups;
+            groups[ numGroups ].pid = pid;
+            strcpy( groups[ numGroups++ ].groupName, name );
+        }
+        else if ( sscanf( sp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%15[^\"]\"}}", &pid, &tid, name ) == 3 )
+        {
+            if ( ( numTracks & ( CRITPATH_INIT_RULES - 1 ) ) == 0 )
+            {
+                critTrack_t *newTracks = realloc( tracks, ( numTracks + CRITPATH_INIT_RULES ) * sizeof( critTrack_t ) );
+
+                if ( !newTracks )
+                {
+                    ret = PCD_STATUS_NOK;
+                    break;
+                }
+
+                tracks = newTracks;
+            }
+
+            tracks[ numTracks ].pid = pid;
+            tracks[ numTracks ].tid = tid;
+            tracks[ numTracks ].ruleIdx = -1;
+            strcpy( tracks[ numTracks++ ].ruleName, name );
+        }
+    }
+
+    if ( ret != PCD_STATUS_OK )
+    {
+        PCD_PRINTF_STDERR( "Failed to allocate memory" );
+        goto out;
+    }
+
+    /* Map the tracks to the rules of the rules file */
+    for ( i = 0; i < numTracks; i++ )
+    {
+        for ( j = 0; ( j < numGroups ) && ( groups[ j ].pid != tracks[ i ].pid ); j++ );
+
+        if ( j < numGroups )
+            tracks[ i ].ruleIdx = PCD_critpath_find_rule( groups[ j ].groupName, tracks[ i ].ruleName );
+
+        if ( tracks[ i ].ruleIdx < 0 )
+            PCD_PRINTF_WARNING_STDOUT( "Rule %s_%s of the timeline is not in the rules file", ( j < numGroups ) ? groups[ j ].groupName : "?", tracks[ i ].ruleName );
+    }
+
+    qsort( tracks, numTracks, sizeof( critTrack_t ), PCD_critpath_track_cmp );
+
+    rewind( in );
+
+    while ( fgets( line, sizeof( line ), in ) )
+    {
+        char event[ 16 ];
+        unsigned long long timestamp;
+        char *sp = line;
+
+        if ( *sp == ',' )
+            sp++;
+
+        if ( sscanf( sp, "{\"name\":\"%15[^\"]\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":%u,\"tid\":%u", event, &timestamp, &key.pid, &key.tid ) != 4 )
+            continue;
+
+        track = bsearch( &key, tracks, numTracks, sizeof( critTrack_t ), PCD_critpath_track_cmp );
+
+        if ( ( track ) && ( track->ruleIdx >= 0 ) )
+            PCD_critpath_trace_event( &critRules[ track->ruleIdx ], event, timestamp );
+    }
+
+    if ( numTracks == 0 )
+    {
+        PCD_PRINTF_STDERR( "No rules in trace %s", timelineFilename );
+        ret = PCD_STATUS_NOK;
+    }
+
+out:
+    free( tracks );
+    free( groups );
+
+    return ret;
+}
+
+static bool_t PCD_critpath_parse_time( const char *str, u_int64_t *timeUs )
+{
+    char *end;
+    double timeMs;
+
+    if ( strcmp( str, "-" ) == 0 )
+    {
+        *timeUs = CRITPATH_NO_TIME;
+        return True;
+    }
+
+    timeMs = strtod( str, &end );
+
+    if ( ( end == str ) || ( *end != '\0' ) || ( timeMs < 0 ) )
+        return False;
+
+    *timeUs = (u_int64_t)( timeMs * 1000 + 0.5 );
+
+    return True;
+}
+
+/* Load a timeline with a line per rule: GROUP_RULE START READY COMPLETE, in ms */
+static PCD_status_e PCD_critpath_load_text( FILE *in, const char *timelineFilename )
+{
+    char line[ CRITPATH_LINE_SIZE ];
+    u_int32_t lineNum = 0;
+
+    bootStart = 0;
+
+    while ( fgets( line, sizeof( line ), in ) )
+    {
+        char id[ PCD_RULEID_MAX_GROUP_NAME_SIZE + PCD_RULEID_MAX_RULE_NAME_SIZE ];
+        char start[ 32 ], ready[ 32 ], complete[ 32 ];
+        critRule_t *critRule;
+        int32_t ruleIdx;
+        char *sp;
+        int num;
+
+        lineNum++;
+
+        num = sscanf( line, "%31s %31s %31s %31s", id, start, ready, complete );
+
+        if ( ( num <= 0 ) || ( id[ 0 ] == '#' ) )
+            continue;
+
+        sp = strchr( id, '_' );
+
+        if ( ( num != 4 ) || ( !sp ) )
+        {
+            PCD_PRINTF_STDERR( "Invalid line %u in timeline %s", lineNum, timelineFilename );
+            return PCD_STATUS_NOK;
+        }
+
+        *sp = '\0';
+
+        if ( ( ruleIdx = PCD_critpath_find_rule( id, sp + 1 ) ) < 0 )
+        {
+            PCD_PRINTF_WARNING_STDOUT( "Rule %s_%s of the timeline is not in the rules file", id, sp + 1 );
+            continue;
+        }
+
+        critRule = &critRules[ ruleIdx ];
+
+        if ( ( !PCD_critpath_parse_time( start, &critRule->startTime ) ) ||
+             ( !PCD_critpath_parse_time( ready, &critRule->readyTime ) ) ||
+             ( !PCD_critpath_parse_time( complete, &critRule->completeTime ) ) ||
+             ( ( PCD_critpath_is_timed( critRule ) ) && ( critRule->completeTime < critRule->startTime ) ) )
+        {
+            PCD_PRINTF_STDERR( "Invalid times in line %u in timeline %s", lineNum, timelineFilename );
+            return PCD_STATUS_NOK;
+        }
+    }
+
+    return PCD_STATUS_OK;
+}
+
+/*! \fn PCD_status_e PCD_critpath_load_timeline
+ *  \brief Load the boot timeline of the rules
+ *  \param[in] timelineFilename.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_load_timeline( const char *timelineFilename )
+{
+    PCD_status_e ret;
+    FILE *in;
+    int c;
+
+    if ( ( in = fopen( timelineFilename, "r" ) ) == NULL )
+    {
+        PCD_PRINTF_STDERR( "Failed to open timeline %s", timelineFilename );
+        return PCD_STATUS_NOK;
+    }
+
+    /* A trace of PCD is a JSON object */
+    while ( ( ( c = fgetc( in ) ) == ' ' ) || ( c == '\t' ) || ( c == '\n' ) || ( c == '\r' ) );
+
+    rewind( in );
+
+    if ( c == '{' )
+    {
+        ret = PCD_critpath_load_trace( in, timelineFilename );
+    }
+    else
+    {
+        ret = PCD_critpath_load_text( in, timelineFilename );
+    }
+
+    fclose( in );
+
+    timelineLoaded = ( ret == PCD_STATUS_OK );
+
+    return ret;
+}
+
+/* Resolve the dependencies of the rules, and sort the rules with timing topologically */
+static PCD_status_e PCD_critpath_build_graph( void )
+{
+    u_int32_t i, j, head;
+
+    for ( i = 0; i < numCritRules; i++ )
+    {
+        critRule_t *critRule = &critRules[ i ];
+        const startCond_t *startCond = &critRule->rule.startCondition;
+
+        if ( ( !PCD_critpath_is_timed( critRule ) ) || ( startCond->type != PCD_START_COND_KEYWORD_RULE_COMPLETED ) ||
+             ( startCond->numRuleCompleted == 0 ) )
+            continue;
+
+        if ( ( critRule->deps = malloc( startCond->numRuleCompleted * sizeof( u_int32_t ) ) ) == NULL )
+            return PCD_STATUS_NOK;
+
+        for ( j = 0; j < startCond->numRuleCompleted; j++ )
+        {
+            int32_t depIdx = PCD_critpath_find_rule( startCond->ruleCompleted[ j ].ruleId.groupName, startCond->ruleCompleted[ j ].ruleId.ruleName );
+
+            /* A rule which did not complete cannot hold its dependents back */
+            if ( ( depIdx >= 0 ) && ( PCD_critpath_is_timed( &critRules[ depIdx ] ) ) )
+            {
+                critRule->deps[ critRule->numDeps++ ] = depIdx;
+                critRules[ depIdx ].numDependents++;
+            }
+        }
+    }
+
+    for ( i = 0; i < numCritRules; i++ )
+    {
+        if ( critRules[ i ].numDependents )
+        {
+            if ( ( critRules[ i ].dependents = malloc( critRules[ i ].numDependents * sizeof( u_int32_t ) ) ) == NULL )
+                return PCD_STATUS_NOK;
+
+            critRules[ i ].numDependents = 0;
+        }
+    }
+
+    if ( ( critOrder = malloc( ( numCritRules + 1 ) * sizeof( u_int32_t ) ) ) == NULL )
+        return PCD_STATUS_NOK;
+
+    for ( i = 0; i < numCritRules; i++ )
+    {
+        critRule_t *critRule = &critRules[ i ];
+
+        for ( j = 0; j < critRule->numDeps; j++ )
+        {
+            critRule_t *dep = &critRules[ critRule->deps[ j ] ];
+
+            dep->dependents[ dep->numDependents++ ] = i;
+        }
+
+        critRule->pendingDeps = critRule->numDeps;
+
+        if ( ( PCD_critpath_is_timed( critRule ) ) && ( critRule->numDeps == 0 ) )
+            critOrder[ numCritOrder++ ] = i;
+    }
+
+    for ( head = 0; head < numCritOrder; head++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ head ] ];
+
+        for ( j = 0; j < critRule->numDependents; j++ )
+        {
+            if ( --critRules[ critRule->dependents[ j ] ].pendingDeps == 0 )
+                critOrder[ numCritOrder++ ] = critRule->dependents[ j ];
+        }
+    }
+
+    for ( i = 0; i < numCritRules; i++ )
+    {
+        if ( critRules[ i ].pendingDeps )
+        {
+            PCD_PRINTF_STDERR( "Rule %s_%s is in a dependency loop", critRules[ i ].rule.ruleId.groupName, critRules[ i ].rule.ruleId.ruleName );
+            return PCD_STATUS_NOK;
+        }
+    }
+
+    return PCD_STATUS_OK;
+}
+
+/* Compute the completion of the rules in the model, with one rule taking no
+   time if skipIdx is not negative. Return the end of the boot */
+static u_int64_t PCD_critpath_forward( int32_t skipIdx )
+{
+    u_int64_t end = bootStart;
+    u_int32_t i, j;
+
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+        u_int64_t ready = bootStart;
+
+        for ( j = 0; j < critRule->numDeps; j++ )
+        {
+            if ( critRules[ critRule->deps[ j ] ].newCompletion > ready )
+                ready = critRules[ critRule->deps[ j ] ].newCompletion;
+        }
+
+        critRule->newCompletion = ready + critRule->waitTime + ( ( (int32_t)critOrder[ i ] == skipIdx ) ? 0 : critRule->duration );
+
+        if ( critRule->newCompletion > end )
+            end = critRule->newCompletion;
+    }
+
+    return end;
+}
+
+static int PCD_critpath_gain_cmp( const void *a, const void *b )
+{
+    const critRule_t *ruleA = &critRules[ *(const u_int32_t *)a ], *ruleB = &critRules[ *(const u_int32_t *)b ];
+
+    if ( ruleA->gain != ruleB->gain )
+        return ( ruleA->gain > ruleB->gain ) ? -1 : 1;
+
+    if ( ruleA->duration != ruleB->duration )
+        return ( ruleA->duration > ruleB->duration ) ? -1 : 1;
+
+    return 0;
+}
+
+/*! \fn PCD_status_e PCD_critpath_analyze
+ *  \brief Compute the critical path, the slack of the rules and the gain of speeding them up, and print them
+ *  \param[in] numTop, number of rules to list by boot time gain.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_analyze( u_int32_t numTop )
+{
+    u_int32_t *path, *ranked;
+    u_int32_t numPath = 0, numRanked = 0, i, j;
+    int32_t idx, lastIdx = -1;
+
+    if ( !timelineLoaded )
+        return PCD_STATUS_NOK;
+
+    if ( PCD_critpath_build_graph() != PCD_STATUS_OK )
+    {
+        PCD_PRINTF_STDERR( "Failed to build the dependency graph" );
+        return PCD_STATUS_NOK;
+    }
+
+    if ( numCritOrder == 0 )
+    {
+        PCD_PRINTF_STDERR( "No rule completed in the timeline" );
+        return PCD_STATUS_NOK;
+    }
+
+    /* The boot starts when the first rule is queued, or started */
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        if ( critRules[ critOrder[ i ] ].startTime < bootStart )
+            bootStart = critRules[ critOrder[ i ] ].startTime;
+    }
+
+    /* Split the recorded times to waiting and running */
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+        u_int64_t ready = bootStart;
+
+        for ( j = 0; j < critRule->numDeps; j++ )
+        {
+            if ( ( critRule->critDep < 0 ) || ( critRules[ critRule->deps[ j ] ].completeTime > ready ) )
+            {
+                critRule->critDep = critRule->deps[ j ];
+                ready = critRules[ critRule->critDep ].completeTime;
+            }
+        }
+
+        critRule->waitTime = ( critRule->startTime > ready ) ? ( critRule->startTime - ready ) : 0;
+        critRule->duration = critRule->completeTime - critRule->startTime;
+    }
+
+    bootEnd = PCD_critpath_forward( -1 );
+
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+
+        critRule->completion = critRule->newCompletion;
+
+        if ( ( lastIdx < 0 ) || ( critRule->completion >= critRules[ lastIdx ].completion ) )
+            lastIdx = critOrder[ i ];
+    }
+
+    /* Latest completion of each rule which does not delay the boot, kept in slack */
+    for ( i = numCritOrder; i-- > 0; )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+        u_int64_t latest = bootEnd;
+
+        for ( j = 0; j < critRule->numDependents; j++ )
+        {
+            critRule_t *dependent = &critRules[ critRule->dependents[ j ] ];
+            u_int64_t dependentLatest = dependent->slack - dependent->duration - dependent->waitTime;
+
+            if ( dependentLatest < latest )
+                latest = dependentLatest;
+        }
+
+        critRule->slack = latest;
+    }
+
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+
+        critRule->slack = ( critRule->slack > critRule->completion ) ? ( critRule->slack - critRule->completion ) : 0;
+    }
+
+    path = malloc( numCritOrder * sizeof( u_int32_t ) );
+    ranked = malloc( numCritOrder * sizeof( u_int32_t ) );
+
+    if ( ( !path ) || ( !ranked ) )
+    {
+        free( path );
+        free( ranked );
+        PCD_PRINTF_STDERR( "Failed to allocate memory" );
+        return PCD_STATUS_NOK;
+    }
+
+    /* Only a rule without slack can make the boot faster */
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+
+        if ( ( critRule->slack == 0 ) && ( critRule->duration > 0 ) )
+        {
+            critRule->gain = bootEnd - PCD_critpath_forward( critOrder[ i ] );
+
+            if ( critRule->gain > 0 )
+                ranked[ numRanked++ ] = critOrder[ i ];
+        }
+    }
+
+    qsort( ranked, numRanked, sizeof( u_int32_t ), PCD_critpath_gain_cmp );
+
+    /* The critical path leads to the rule which completed last, the last in topological order on a tie */
+    for ( idx = lastIdx; idx >= 0; idx = critRules[ idx ].critDep )
+    {
+        critRules[ idx ].critical = True;
+        path[ numPath++ ] = idx;
+    }
+
+    printf( "Boot time: %.1f ms, %u rules completed, %u rules did not\n\n",
+            PCD_critpath_ms( bootEnd - bootStart ), numCritOrder, numCritRules - numCritOrder );
+
+    printf( "Rules, * on the critical path:\n%-33s %10s %10s %10s %10s %10s %10s\n", "Rule", "Start", "Ready", "Complete", "Wait", "Duration", "Slack" );
+
+    for ( i = 0; i < numCritOrder; i++ )
+    {
+        critRule_t *critRule = &critRules[ critOrder[ i ] ];
+        char name[ PCD_RULEID_MAX_GROUP_NAME_SIZE + PCD_RULEID_MAX_RULE_NAME_SIZE + 2 ];
+        char ready[ 16 ];
+
+        snprintf( name, sizeof( name ), "%s%s_%s", critRule->critical ? "*" : " ", critRule->rule.ruleId.groupName, critRule->rule.ruleId.ruleName );
+
+        if ( critRule->readyTime != CRITPATH_NO_TIME )
+            snprintf( ready, sizeof( ready ), "%.1f", PCD_critpath_ms( critRule->readyTime - bootStart ) );
+        else
+            strcpy( ready, "-" );
+
+        printf( "%-33s %10.1f %10s %10.1f %10.1f %10.1f %10.1f\n", name,
+                PCD_critpath_ms( critRule->startTime - bootStart ), ready, PCD_critpath_ms( critRule->completeTime - bootStart ),
+                PCD_critpath_ms( critRule->waitTime ), PCD_critpath_ms( critRule->duration ), PCD_critpath_ms( critRule->slack ) );
+    }
+
+    printf( "\nCritical path:\n%-33s %10s %10s %10s\n", "Rule", "Start", "Wait", "Duration" );
+
+    while ( numPath-- > 0 )
+    {
+        critRule_t *critRule = &critRules[ path[ numPath ] ];
+
+        printf( " %s_%-*s %10.1f %10.1f %10.1f\n", critRule->rule.ruleId.groupName,
+                (int)( 31 - strlen( critRule->rule.ruleId.groupName ) ), critRule->rule.ruleId.ruleName,
+                PCD_critpath_ms( critRule->startTime - bootStart ), PCD_critpath_ms( critRule->waitTime ), PCD_critpath_ms( critRule->duration ) );
+    }
+
+    printf( "\nRules to speed up, by boot time saved if the rule took no time:\n%-33s %10s %10s\n", "Rule", "Saved", "Duration" );
+
+    for ( i = 0; ( i < numRanked ) && ( i < numTop ); i++ )
+    {
+        critRule_t *critRule = &critRules[ ranked[ i ] ];
+
+        printf( " %s_%-*s %10.1f %10.1f\n", critRule->rule.ruleId.groupName,
+                (int)( 31 - strlen( critRule->rule.ruleId.groupName ) ), critRule->rule.ruleId.ruleName,
+                PCD_critpath_ms( critRule->gain ), PCD_critpath_ms( critRule->duration ) );
+    }
+
+    free( path );
+    free( ranked );
+
+    return PCD_STATUS_OK;
+}
+
+/*! \fn PCD_status_e PCD_critpath_write_graph
+ *  \brief Add all the rules to the graph, with their durations and the critical path highlighted
+ *  \param[in] graphHandle.
+ *  \param[out] None.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_critpath_write_graph( const void *graphHandle )
+{
+    u_int32_t i;
+
+    for ( i = 0; i < numCritRules; i++ )
+    {
+        critRule_t *critRule = &critRules[ i ];
+        graphTiming_t timing;
+
+        if ( ( timelineLoaded ) && ( PCD_critpath_is_timed( critRule ) ) )
+        {
+            timing.durationUs = critRule->duration;
+            timing.critical = critRule->critical;
+            timing.criticalDep = ( critRule->critDep >= 0 ) ? &critRules[ critRule->critDep ].rule.ruleId : NULL;
+
+            if ( PCD_graph_update_file_timed( &critRule->rule, &timing, graphHandle ) != PCD_STATUS_OK )
+                return PCD_STATUS_NOK;
+        }
+        else if ( PCD_graph_update_file( &critRule->rule, graphHandle ) != PCD_STATUS_OK )
+        {
+            return PCD_STATUS_NOK;
+        }
+    }
+
+    return PCD_STATUS_OK;
+}
@@ -122,6 +122,17 @@ PCD_status_e PCD_graph_close_file( const char *graphFilename, const void *graphH
  *  \return OK or error status.
  */
 PCD_status_e PCD_graph_update_file( const rule_t *newrule, const void *graphHandle )
+{
+    return PCD_graph_update_file_timed( newrule, NULL, graphHandle );
+}
+
+/*! \fn PCD_status_e PCD_graph_update_file_timed
+ *  \brief Add a new item in graph, with its duration and critical path
+ *  \param[in] rule, timing (NULL if the rule has no timing), graphHandle.
+ *  \param[out] no output.
+ *  \return OK or error status.
+ */
+PCD_status_e PCD_graph_update_file_timed( const rule_t *newrule, const graphTiming_t *timing, const void *graphHandle )
 {
     FILE *myGraphHandle;
 
@@ -140,6 +151,7 @@ PCD_status_e PCD_graph_update_file( const rule_t *newrule, const void *graphHand
        )
     {
         char *shape;
+        const char *criticalStr;
 
         if ( strcmp( newrule->command, "NONE" ) == 0 )
         {
@@ -151,20 +163,37 @@ PCD_status_e PCD_graph_update_file( const rule_t *newrule, const void *graphHand
             shape = "ellipse";
         }
 
-        fprintf( myGraphHandle, "%s_%s [ label = \"%s\\n%s\", shape = %s ];\n", newrule->ruleId.groupName, newrule->ruleId.ruleName, newrule->ruleId.groupName, newrule->ruleId.ruleName, shape );
+        /* Critical path items are drawn in red */
+        criticalStr = ( ( timing ) && ( timing->critical ) ) ? ", color = red, penwidth = 2" : "";
+
+        if ( timing )
+        {
+            fprintf( myGraphHandle, "%s_%s [ label = \"%s\\n%s\\n%llu.%llu ms\", shape = %s%s ];\n", newrule->ruleId.groupName, newrule->ruleId.ruleName, newrule->ruleId.groupName, newrule->ruleId.ruleName,
+                     (unsigned long long)( ( timing->durationUs + 50 ) / 1000 ), (unsigned long long)( ( ( timing->durationUs + 50 ) % 1000 ) / 100 ), shape, criticalStr );
+        }
+        else
+        {
+            fprintf( myGraphHandle, "%s_%s [ label = \"%s\\n%s\", shape = %s ];\n", newrule->ruleId.groupName, newrule->ruleId.ruleName, newrule->ruleId.groupName, newrule->ruleId.ruleName, shape );
+        }
 
         if ( newrule->startCondition.type == PCD_START_COND_KEYWORD_RULE_COMPLETED )
         {
             u_int32_t i = 0;
 
-            while ( i < PCD_START_COND_MAX_IDS )
+            while ( i < newrule->startCondition.numRuleCompleted )
             {
-                if ( !newrule->startCondition.ruleCompleted[ i ].ruleId.groupName[ 0 ] )
+                const ruleId_t *depId = &newrule->startCondition.ruleCompleted[ i ].ruleId;
+
+                if ( ( timing ) && ( timing->critical ) && ( timing->criticalDep ) &&
+                     ( strcmp( depId->groupName, timing->criticalDep->groupName ) == 0 ) &&
+                     ( strcmp( depId->ruleName, timing->criticalDep->ruleName ) == 0 ) )
                 {
-                    break;
+                    fprintf( myGraphHandle, "%s_%s -> %s_%s [ color = red, penwidth = 2 ];\n", depId->groupName, depId->ruleName, newrule->ruleId.groupName, newrule->ruleId.ruleName );
+                }
+                else
+                {
+                    fprintf( myGraphHandle, "%s_%s -> %s_%s;\n", depId->groupName, depId->ruleName, newrule->ruleId.groupName, newrule->ruleId.ruleName );
                 }
-
-                fprintf( myGraphHandle, "%s_%s -> %s_%s;\n", newrule->startCondition.ruleCompleted[ i ].ruleId.groupName, newrule->startCondition.ruleCompleted[ i ].ruleId.ruleName, newrule->ruleId.groupName, newrule->ruleId.ruleName );
 
                 i++;
             }
@@ -176,33 +205,36 @@ PCD_status_e PCD_graph_update_file( const rule_t *newrule, const void *graphHand
                 graphNoStartCondCreated = True;
                 fprintf( myGraphHandle, "NoStartCondition [ label = \"No Start\\nCondition\", shape = diamond ];\n" );
             }
-            fprintf( myGraphHandle, "NoStartCondition -> %s_%s;\n", newrule->ruleId.groupName, newrule->ruleId.ruleName );
+            fprintf( myGraphHandle, "NoStartCondition -> %s_%s%s;\n", newrule->ruleId.groupName, newrule->ruleId.ruleName,
+                     ( ( timing ) && ( timing->critical ) ) ? " [ color = red, penwidth = 2 ]" : "" );
         }
         else
         {
             char *typeStr = NULL;
-            char condStr[ 32 ];
+            const char *condStr = NULL;
+            char ipcStr[ 16 ];
 
             switch ( newrule->startCondition.type )
             {
                 case PCD_START_COND_KEYWORD_FILE:
                     typeStr = "File";
-                    strcpy( condStr, newrule->startCondition.filename );
+                    condStr = newrule->startCondition.filename;
                     break;
 
                 case PCD_START_COND_KEYWORD_NETDEVICE:
                     typeStr = "Net deivce";
-                    strcpy( condStr, newrule->startCondition.netDevice );
+                    condStr = newrule->startCondition.netDevice;
                     break;
 
                 case PCD_START_COND_KEYWORD_IPC_OWNER:
                     typeStr = "IPC";
-                    sprintf( condStr, "%d", newrule->startCondition.ipcOwner );
+                    sprintf( ipcStr, "%d", newrule->startCondition.ipcOwner );
+                    condStr = ipcStr;
                     break;
 
                 case PCD_START_COND_KEYWORD_ENV_VAR:
                     typeStr = "Variable";
-                    strcpy( condStr, newrule->startCondition.envVar.envVarName );
+                    condStr = newrule->startCondition.envVar.envVarName;
                     break;
 
                 default:
@@ -43,9 +43,11 @@
 #include "condchk.h"
 #include "graph.h"
 #include "outputhdr.h"
+#include "critpath.h"
 
 #define MAX_FILENAME_LEN      255
 #define MAX_GROUPS            16
+#define DEFAULT_TOP_RULES     10
 
 static char *rulesFilename = NULL;
 bool_t verboseOutput = True;
@@ -56,6 +58,9 @@ static void *headerHandle = NULL;
 static void *graphHandle = NULL;
 static char *graphFilename = NULL;
 
+static char *timelineFilename = NULL;
+static u_int32_t numTopRules = DEFAULT_TOP_RULES;
+
 char hostPrefix[ 128 ] = { "\0"};
 
 static void PCD_main_usage( char *execname );
@@ -67,6 +72,8 @@ static void PCD_main_usage( char *execname )
     printf( "-g FILE, --graph=FILE\t\tGenerate a graph file.\n" );
     printf( "-d [0|1|2], --display=[0|1|2]\tItems to display in graph file (Active|All|Inactive).\n" );
     printf( "-o FILE, --output=FILE\t\tGenerate an output header file with rules definitions.\n" );
+    printf( "-t FILE, --timeline=FILE\tAnalyze the boot critical path with a boot timeline (PCD trace, or text).\n" );
+    printf( "-n N, --top=N\t\t\tNumber of rules to list by boot time saved (Default %u).\n", DEFAULT_TOP_RULES );
     printf( "-b DIR, --base-dir=DIR\t\tSpecify base directory on the host.\n" );
     printf( "-v, --verbose\t\t\tPrint parsed configuration.\n" );
     printf( "-h, --help\t\t\tPrint this message and exit.\n" );
@@ -89,7 +96,15 @@ PCD_status_e PCD_rulesdb_add_rule( rule_t *newrule )
         }
     }
 
-    if ( graphHandle )
+    if ( timelineFilename )
+    {
+        /* Keep the rule, the graph is written after the analysis */
+        if ( PCD_critpath_add_rule( newrule ) != PCD_STATUS_OK )
+        {
+            return PCD_STATUS_NOK;
+        }
+    }
+    else if ( graphHandle )
     {
         /* Add an entry in the graph file */
         if ( PCD_graph_update_file( newrule, graphHandle ) != PCD_STATUS_OK )
@@ -119,13 +134,15 @@ void PCD_main_parse_params( int32_t argc, char *argv[] )
             {"graph",      required_argument, 0, 'g'},
             {"display",    required_argument, 0, 'd'},
             {"base-dir",    required_argument, 0, 'b'},
+            {"timeline",   required_argument, 0, 't'},
+            {"top",        required_argument, 0, 'n'},
             {0, 0, 0, 0}
         };
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long( argc, argv, "vhf:t:o:g:d:b:", long_options, &option_index );
+        c = getopt_long( argc, argv, "vhf:t:n:o:g:d:b:", long_options, &option_index );
 
         /* Detect the end of the options. */
         if ( c == -1 )
@@ -185,6 +202,14 @@ void PCD_main_parse_params( int32_t argc, char *argv[] )
                 }
                 break;
 
+            case 't':
+                timelineFilename = optarg;
+                break;
+
+            case 'n':
+                numTopRules = atoi( optarg );
+                break;
+
             case 'b':
                 memset( hostPrefix, 0, sizeof( hostPrefix ) );
                 strncpy( hostPrefix, optarg, sizeof( hostPrefix ) -1 );
@@ -221,6 +246,18 @@ int main( int32_t argc, char *argv[] )
         goto cleanup;
     }
 
+    if ( timelineFilename )
+    {
+        /* Analyze the boot, and write the graph with its timing */
+        if ( ( PCD_critpath_load_timeline( timelineFilename ) != PCD_STATUS_OK ) ||
+             ( PCD_critpath_analyze( numTopRules ) != PCD_STATUS_OK ) ||
+             ( ( graphHandle ) && ( PCD_critpath_write_graph( graphHandle ) != PCD_STATUS_OK ) ) )
+        {
+            ret = 1;
+            goto cleanup;
+        }
+    }
+
     cleanup:
 
     /* Close the file in case it was open */
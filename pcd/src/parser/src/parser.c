@@ -39,6 +39,8 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -142,7 +144,6 @@ static const char *failureActionKeywords[] =
 #undef PCD_FAILURE_ACTION_KEYWORD
 
 #define PCD_PARSER_DELIMITERS     ", \t"
-#define PCD_PARSER_MAX_LINE_SIZE    256
 
 /**************************************************************************
  * Global definitions
@@ -157,6 +158,37 @@ static u_int32_t     totalRuleRecords = 0;   /* The number of records written in
 
 static void PCD_parser_dump_config( rule_t *rule );
 
+/* Condition strings are interned, rules which wait for the same file or device share a single copy */
+#define PCD_PARSER_STRINGS_HASH_SIZE    64
+
+typedef struct parserString_t
+{
+    struct parserString_t   *next;
+    char                    *str;
+
+} parserString_t;
+
+static parserString_t *stringsHash[ PCD_PARSER_STRINGS_HASH_SIZE ];
+
+/* Signals which can be used to stop a process, with or without the SIG prefix */
+static const struct
+{
+    const char  *name;
+    int32_t     sig;
+
+} parserStopSignals[] =
+{
+    { "TERM",   SIGTERM },
+    { "INT",    SIGINT },
+    { "QUIT",   SIGQUIT },
+    { "HUP",    SIGHUP },
+    { "USR1",   SIGUSR1 },
+    { "USR2",   SIGUSR2 },
+    { "PWR",    SIGPWR },
+    { "KILL",   SIGKILL },
+    { NULL,     0 }
+};
+
 /**************************************************************************/
 /*      IMPLEMENTATION                                                    */
 /**************************************************************************/
@@ -180,6 +212,12 @@ static void PCD_parser_dump_config( rule_t *rule )
     printf( "Scheduling: %s (%d)\n", rule->sched.type == PCD_SCHED_TYPE_FIFO ? "FIFO" : "NICE", rule->sched.niceSched );
     printf( "Daemon: %s\n", rule->daemon ? "YES":"NO"  );
     printf( "Active: %s\n", rule->ruleState == PCD_RULE_ACTIVE ? "YES":"NO"  );
+    printf( "Stop signal: %d\n", rule->stopSignal ? rule->stopSignal : SIGTERM );
+    printf( "Stop timeout: ");
+    if ( rule->stopTimeout == 0 )
+        printf( "Default\n" );
+    else
+        printf( "%ums\n", rule->stopTimeout );
     printf( "User id: " );
     if( rule->uid )
         printf( "%d\n", rule->uid );
@@ -317,7 +355,8 @@ extern char hostPrefix[ 128 ];
 static int32_t PCD_parser_read_config( const char *filename, bool_t toplevel )
 {
     FILE *in;
-    char buffer[PCD_PARSER_MAX_LINE_SIZE], orig[PCD_PARSER_MAX_LINE_SIZE], *token, *line;
+    char *buffer = NULL, *token, *line;
+    size_t bufferSize = 0;
     int32_t i, ret_val = 0;
     configKeywordHandler_t *kwPtr;
 #ifdef PCD_HOST_BUILD
@@ -351,15 +390,14 @@ static int32_t PCD_parser_read_config( const char *filename, bool_t toplevel )
     }
 #endif
 
-    while ( fgets( buffer, PCD_PARSER_MAX_LINE_SIZE, in ) )
+    /* Lines are not limited in length, a command may have a long list of parameters */
+    while ( getline( &buffer, &bufferSize, in ) != -1 )
     {
         lineNumber++;
 
         if ( strchr( buffer, '\n' ) )
             *(strchr( buffer, '\n' )) = '\0';
 
-        strncpy( orig, buffer, PCD_PARSER_MAX_LINE_SIZE );
-
         if ( strchr( buffer, '#' ) )
             *(strchr( buffer, '#' )) = '\0';
 
@@ -410,6 +448,7 @@ static int32_t PCD_parser_read_config( const char *filename, bool_t toplevel )
         }
     }
 
+    free( buffer );
     fclose( in );
 
     return( ret_val );
@@ -418,9 +457,12 @@ static int32_t PCD_parser_read_config( const char *filename, bool_t toplevel )
 static int32_t PCD_parser_generate_config( const char *filename )
 {
     int ret_val = -1;
+    struct timespec startTime, endTime;
 
     PCD_FUNC_ENTER_PRINT
 
+    clock_gettime( CLOCK_MONOTONIC, &startTime );
+
     if ( PCD_parser_read_config( filename, True ) )
     {
         PCD_PRINTF_STDERR( "Reading the input configuration" );
@@ -432,7 +474,11 @@ static int32_t PCD_parser_generate_config( const char *filename )
     generate_config_exit:
 
     if ( !ret_val )
-        PCD_PRINTF_STDOUT( "Loaded %d rules", totalRuleRecords );
+    {
+        clock_gettime( CLOCK_MONOTONIC, &endTime );
+        PCD_PRINTF_STDOUT( "Loaded %d rules in %ld ms", totalRuleRecords,
+                           ( ( endTime.tv_sec - startTime.tv_sec ) * 1000 ) + ( ( endTime.tv_nsec - startTime.tv_nsec ) / 1000000 ) );
+    }
 
     return( ret_val );
 }
@@ -466,6 +512,42 @@ static int32_t PCD_parser_init_kwHandlersList(void)
 /**************************************************************************
  * Implementation of the handlers.
  **************************************************************************/
+static const char *PCD_parser_intern_string( const char *str )
+{
+    parserString_t *entry;
+    u_int32_t hash = 2166136261U;
+    const char *sp;
+
+    for ( sp = str; *sp; sp++ )
+    {
+        hash = ( hash ^ (u_int8_t)*sp ) * 16777619U;
+    }
+
+    hash &= PCD_PARSER_STRINGS_HASH_SIZE - 1;
+
+    for ( entry = stringsHash[ hash ]; entry; entry = entry->next )
+    {
+        if ( strcmp( entry->str, str ) == 0 )
+            return entry->str;
+    }
+
+    /* Keep the string right after its entry, it is never released */
+    entry = malloc( sizeof( parserString_t ) + strlen( str ) + 1 );
+
+    if ( !entry )
+    {
+        PCD_PRINTF_STDERR( "failed to allocate memory" );
+        return NULL;
+    }
+
+    entry->str = (char *)( entry + 1 );
+    strcpy( entry->str, str );
+    entry->next = stringsHash[ hash ];
+    stringsHash[ hash ] = entry;
+
+    return entry->str;
+}
+
 static int32_t PCD_parser_parse_rule_id( ruleId_t *ruleId, char *line )
 {
     char *token1, *token2;
@@ -500,6 +582,32 @@ static int32_t PCD_parser_parse_rule_id( ruleId_t *ruleId, char *line )
     return 0;
 }
 
+static int32_t PCD_parser_parse_netdevice_state( netDevState_e *state, char *token )
+{
+    PCD_FUNC_ENTER_PRINT
+
+    /* The state is optional, by default the device only needs to exist */
+    if ( !token )
+    {
+        *state = PCD_COND_NETDEVICE_EXISTS;
+    }
+    else if ( strcmp( token, "UP" ) == 0 )
+    {
+        *state = PCD_COND_NETDEVICE_UP;
+    }
+    else if ( strcmp( token, "ADDR" ) == 0 )
+    {
+        *state = PCD_COND_NETDEVICE_ADDR;
+    }
+    else
+    {
+        PCD_PRINTF_STDERR( "Invalid network device state %s", token );
+        return -1;
+    }
+
+    return 0;
+}
+
 
 static int32_t PCD_parser_handle_VERSION( char *line )
 {
@@ -633,32 +741,46 @@ static int32_t PCD_parser_handle_START_COND( char *line )
         u_int32_t j = 0;
         char *token;
         char tempToken[ PCD_RULEID_MAX_GROUP_NAME_SIZE+PCD_RULEID_MAX_RULE_NAME_SIZE+2 ];
+        ruleCache_t *ruleCompleted = NULL;
 
-        /* Clear the structure */
-        memset( rule.startCondition.ruleCompleted, 0, sizeof( ruleCache_t ) * PCD_START_COND_MAX_IDS );
-
-        /* Parse all rules */
-        while ( ( j < PCD_START_COND_MAX_IDS ) && ( ( token = strtok(NULL, PCD_PARSER_DELIMITERS) ) != NULL ) )
+        /* Parse all rules, the array is sized by the number of rules */
+        while ( ( token = strtok(NULL, PCD_PARSER_DELIMITERS) ) != NULL )
         {
+            ruleCache_t *newRuleCompleted = realloc( ruleCompleted, sizeof( ruleCache_t ) * ( j + 1 ) );
+
+            if ( !newRuleCompleted )
+            {
+                PCD_PRINTF_STDERR( "failed to allocate memory" );
+                free( ruleCompleted );
+                return -1;
+            }
+
+            ruleCompleted = newRuleCompleted;
+            ruleCompleted[ j ].rule = NULL;
+
             memset( tempToken, 0, sizeof( tempToken ) );
             strncpy( tempToken, token, sizeof( tempToken ) - 1 );
 
-            if ( PCD_parser_parse_rule_id( &rule.startCondition.ruleCompleted[ j ].ruleId, tempToken ) != PCD_STATUS_OK )
+            if ( PCD_parser_parse_rule_id( &ruleCompleted[ j ].ruleId, tempToken ) != PCD_STATUS_OK )
             {
+                free( ruleCompleted );
                 return -1;
             }
 
-            PCD_DEBUG_PRINTF( "Parsed rule %s_%s, index %d", rule.startCondition.ruleCompleted[ j ].ruleId.groupName, rule.startCondition.ruleCompleted[ j ].ruleId.ruleName, j );
+            PCD_DEBUG_PRINTF( "Parsed rule %s_%s, index %d", ruleCompleted[ j ].ruleId.groupName, ruleCompleted[ j ].ruleId.ruleName, j );
             j++;
         }
 
         /* We did not get any rule */
         if ( j == 0 )
         {
-            PCD_PRINTF_STDERR( "Invalid or missing start condition token for %s", startCondKeywords[ j ] );
+            PCD_PRINTF_STDERR( "Invalid or missing start condition token for %s", startCondKeywords[ i ] );
             return -1;
         }
 
+        rule.startCondition.ruleCompleted = ruleCompleted;
+        rule.startCondition.numRuleCompleted = j;
+
         return 0;
     }
 
@@ -674,12 +796,14 @@ static int32_t PCD_parser_handle_START_COND( char *line )
     switch ( i )
     {
         case PCD_START_COND_KEYWORD_FILE:
-			memset( rule.startCondition.filename, 0, sizeof( rule.startCondition.filename ) );
-            strncpy( rule.startCondition.filename, token2, PCD_COND_MAX_SIZE - 1 );
+            if ( ( rule.startCondition.filename = PCD_parser_intern_string( token2 ) ) == NULL )
+                return -1;
             break;
         case PCD_START_COND_KEYWORD_NETDEVICE:
-		    memset( rule.startCondition.netDevice, 0, sizeof( rule.startCondition.netDevice ) );
-            strncpy( rule.startCondition.netDevice, token2, IF_NAMESIZE - 1 );
+            if ( ( rule.startCondition.netDevice = PCD_parser_intern_string( token2 ) ) == NULL )
+                return -1;
+            if ( PCD_parser_parse_netdevice_state( &rule.startCondition.netDeviceState, strtok(NULL, PCD_PARSER_DELIMITERS) ) < 0 )
+                return -1;
             break;
         case PCD_START_COND_KEYWORD_IPC_OWNER:
             rule.startCondition.ipcOwner = atoi( token2 );
@@ -695,8 +819,11 @@ static int32_t PCD_parser_handle_START_COND( char *line )
                     return -1;
                 }
 
-                strncpy( rule.startCondition.envVar.envVarName, token2, PCD_COND_MAX_SIZE );
-                strncpy( rule.startCondition.envVar.envVarValue, token3, PCD_COND_MAX_SIZE );
+                rule.startCondition.envVar.envVarName = PCD_parser_intern_string( token2 );
+                rule.startCondition.envVar.envVarValue = PCD_parser_intern_string( token3 );
+
+                if ( ( !rule.startCondition.envVar.envVarName ) || ( !rule.startCondition.envVar.envVarValue ) )
+                    return -1;
             }
             break;
         default:
@@ -858,6 +985,65 @@ static int32_t PCD_parser_handle_USER( char *line )
     return 0;
 }
 
+static int32_t PCD_parser_handle_STOP_SIGNAL( char *line )
+{
+    char *name = line;
+    char *endptr;
+    u_int32_t i;
+
+    PCD_FUNC_ENTER_PRINT
+
+    /* A signal number */
+    errno = 0;
+    rule.stopSignal = strtol( line, &endptr, 0 );
+
+    if ( ( errno == 0 ) && ( endptr != line ) && ( *endptr == '\0' ) )
+    {
+        if ( ( rule.stopSignal <= 0 ) || ( rule.stopSignal >= NSIG ) )
+        {
+            PCD_PRINTF_STDERR( "Invalid stop signal %s", line );
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /* A signal name */
+    if ( strncasecmp( name, "SIG", 3 ) == 0 )
+        name += 3;
+
+    for ( i = 0; parserStopSignals[ i ].name; i++ )
+    {
+        if ( strcasecmp( name, parserStopSignals[ i ].name ) == 0 )
+        {
+            rule.stopSignal = parserStopSignals[ i ].sig;
+            return 0;
+        }
+    }
+
+    PCD_PRINTF_STDERR( "Invalid stop signal %s", line );
+    return -1;
+}
+
+static int32_t PCD_parser_handle_STOP_TIMEOUT( char *line )
+{
+    char *endptr;
+
+    PCD_FUNC_ENTER_PRINT
+
+    /* Milliseconds from the stop signal until the process is killed */
+    errno = 0;
+    rule.stopTimeout = strtoul( line, &endptr, 0 );
+
+    if ( ( errno != 0 ) || ( endptr == line ) || ( *endptr != '\0' ) || ( rule.stopTimeout == 0 ) )
+    {
+        PCD_PRINTF_STDERR( "Invalid stop timeout %s", line );
+        return -1;
+    }
+
+    return 0;
+}
+
 static int32_t PCD_parser_handle_END_COND( char *line )
 {
     char *token1, *token2;
@@ -907,12 +1093,14 @@ static int32_t PCD_parser_handle_END_COND( char *line )
     switch ( i )
     {
         case PCD_END_COND_KEYWORD_FILE:
-            memset( rule.endCondition.filename, 0, sizeof( rule.endCondition.filename ) );
-			strncpy( rule.endCondition.filename, token2, PCD_COND_MAX_SIZE - 1 );
+            if ( ( rule.endCondition.filename = PCD_parser_intern_string( token2 ) ) == NULL )
+                return -1;
             break;
         case PCD_END_COND_KEYWORD_NETDEVICE:
-		    memset( rule.endCondition.netDevice, 0, sizeof( rule.endCondition.netDevice ) );
-            strncpy( rule.endCondition.netDevice, token2, IF_NAMESIZE - 1 );
+            if ( ( rule.endCondition.netDevice = PCD_parser_intern_string( token2 ) ) == NULL )
+                return -1;
+            if ( PCD_parser_parse_netdevice_state( &rule.endCondition.netDeviceState, strtok(NULL, PCD_PARSER_DELIMITERS) ) < 0 )
+                return -1;
             break;
         case PCD_END_COND_KEYWORD_IPC_OWNER:
             rule.endCondition.ipcOwner = atoi( token2 );
@@ -994,7 +1182,13 @@ static int32_t PCD_parser_handle_FAILURE_ACTION( char *line )
             return -1;
         }
 
-        return PCD_parser_parse_rule_id( &rule.failureAction.ruleId, token2 );
+        if ( ( rule.failureAction.ruleId = malloc( sizeof( ruleId_t ) ) ) == NULL )
+        {
+            PCD_PRINTF_STDERR( "failed to allocate memory" );
+            return -1;
+        }
+
+        return PCD_parser_parse_rule_id( rule.failureAction.ruleId, token2 );
     }
 
     return 0;
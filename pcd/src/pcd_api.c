@@ -35,6 +35,7 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -47,13 +48,81 @@
 #include "timer.h"
 #include "ipc.h"
 #include "pcd_api.h"
+#include "event.h"
 #include "pcd.h"
 #include "misc.h"
+#include "trace.h"
+#include "stats.h"
 
 /**************************************************************************/
 /*      LOCAL DEFINITIONS AND VARIABLES                                   */
 /**************************************************************************/
+/* Number of messages received from the socket in a single system call */
+#define PCD_API_RECV_BATCH          16
+
+/* Time spent on API requests in a single main loop iteration, in usec */
+#define PCD_API_TIME_BUDGET_US      5000
+
+/* Maximum number of requests waiting in the queue of a single client, as many as a client sends asynchronously.
+   The queues of the clients are separate, so a client cannot hold back the requests of the others */
+#define PCD_API_CLIENT_QUEUE_SIZE   32
+
+/* Tokens are counted in thousandths, each request takes a whole token */
+#define PCD_API_TOKEN               1000
+
+/* Interval of sending the replies which a client could not receive, in ms */
+#define PCD_API_REPLY_RETRY_MS      2
+
+/* Replies which a client does not receive for this long are dropped, in ms */
+#define PCD_API_REPLY_EXPIRY_MS     1000
+
+/* Interval of telling a subscriber which stopped receiving its events that events were lost, in ms */
+#define PCD_API_EVENT_RETRY_MS      100
+
+/* A reply which waits until the client can receive it */
+typedef struct pcdApiReply_t
+{
+    IPC_message_t   *msg;
+    IPC_message_t   *replyMsg;
+
+} pcdApiReply_t;
+
+/* Requests of a client, waiting for their turn, and replies waiting for the client */
+typedef struct pcdApiClient_t
+{
+    IPC_message_t   *queue[ PCD_API_CLIENT_QUEUE_SIZE ];
+    u_int32_t       head;
+    u_int32_t       count;
+    u_int32_t       tokens;
+    u_int64_t       lastRefill;
+    pcdApiReply_t   replies[ PCD_API_CLIENT_QUEUE_SIZE ];
+    u_int32_t       replyHead;
+    u_int32_t       replyCount;
+    u_int64_t       replyExpiry;
+
+} pcdApiClient_t;
+
+/* Subscriptions of a destination point, and its state change events which were not sent yet */
+typedef struct pcdApiSubscriber_t
+{
+    pid_t           pid;
+    u_int32_t       numSubscriptions;
+    u_int32_t       ids[ PCD_API_MAX_SUBSCRIPTIONS ];
+    ruleId_t        ruleIds[ PCD_API_MAX_SUBSCRIPTIONS ];
+    IPC_message_t   *eventMsg;
+    bool_t          eventsLost;
+
+} pcdApiSubscriber_t;
+
 static IPC_context_t pcdContext;
+static int32_t pcdFd = -1;
+static pcdApiClient_t apiClients[ IPC_MAX_LIST_SIZE ];
+static u_int32_t apiNextClient = 0;
+static u_int32_t apiPending = 0;
+static u_int32_t apiPendingReplies = 0;
+static bool_t apiSocketReadable = False;
+static pcdApiSubscriber_t apiSubscribers[ IPC_MAX_LIST_SIZE ];
+static u_int32_t apiNumSubscriptions = 0;
 
 /**************************************************************************/
 /*      IMPLEMENTATION                                                    */
@@ -77,7 +146,7 @@ static PCD_status_e PCD_api_stop( rule_t *rule, bool_t brutal, void *cookie )
         if ( retval == PCD_STATUS_OK )
         {
             /* Rule is now idle */
-            rule->ruleState = PCD_RULE_IDLE;
+            PCD_rulesdb_set_rule_state( rule, PCD_RULE_IDLE );
 
             /* Wait for end of process */
             if ( cookie )
@@ -107,8 +176,626 @@ static PCD_status_e PCD_api_signal( rule_t *rule, int32_t sig )
     return PCD_STATUS_BAD_PARAMS;
 }
 
+static PCD_status_e PCD_api_rule_state( rule_t *rule, pcdApiRuleState_e *ruleState )
+{
+    switch ( rule->ruleState )
+    {
+        case PCD_RULE_IDLE:
+            *ruleState = PCD_API_RULE_IDLE;
+            break;
+
+        case PCD_RULE_ACTIVE:
+        case PCD_RULE_START_CONDITION_WAITING:
+        case PCD_RULE_END_CONDITION_WAITING:
+            *ruleState = PCD_API_RULE_RUNNING;
+            break;
+
+        case PCD_RULE_COMPLETED:
+            if ( rule->proc )
+            {
+                *ruleState = PCD_API_RULE_COMPLETED_PROCESS_RUNNING;
+            }
+            else
+            {
+                *ruleState = PCD_API_RULE_COMPLETED_PROCESS_EXITED;
+            }
+            break;
+
+        case PCD_RULE_FAILED:
+            *ruleState = PCD_API_RULE_FAILED;
+            break;
+
+        case PCD_RULE_NOT_COMPLETED:
+            *ruleState = PCD_API_RULE_NOT_COMPLETED;
+            break;
+
+        default:
+            return PCD_STATUS_NOK;
+    }
+
+    return PCD_STATUS_OK;
+}
+
+static PCD_status_e PCD_api_handle_rule_request( rule_t *rule, pcdApi_e type, int32_t sig, char *params, pcdApiRuleState_e *ruleState, void *cookie )
+{
+    PCD_status_e retval;
+
+    switch ( type )
+    {
+        case PCD_API_START_PROCESS:
+            if ( ( params ) && ( params[ 0 ] ) )
+                PCD_rulesdb_setup_optional_params( rule, params );
+            retval = PCD_api_start( rule );
+            break;
+
+        case PCD_API_TERMINATE_PROCESS_SYNC:
+            /* The reply is sent with the cookie when the process terminates */
+            retval = PCD_api_stop( rule, False, cookie );
+            break;
+
+        case PCD_API_TERMINATE_PROCESS:
+            retval = PCD_api_stop( rule, False, NULL );
+            break;
+
+        case PCD_API_KILL_PROCESS:
+            retval = PCD_api_stop( rule, True, NULL );
+            break;
+
+        case PCD_API_SIGNAL_PROCESS:
+            retval = PCD_api_signal( rule, sig );
+            break;
+
+        case PCD_API_GET_RULE_STATE:
+            retval = ( ruleState ) ? PCD_api_rule_state( rule, ruleState ) : PCD_STATUS_OK;
+            break;
+
+        default:
+            retval = PCD_STATUS_BAD_PARAMS;
+            PCD_PRINTF_WARNING_STDOUT( "Invalid request %d (for rule %s_%s), aborting", type, rule->ruleId.groupName, rule->ruleId.ruleName );
+            break;
+    }
+
+    return retval;
+}
+
+static PCD_status_e PCD_api_handle_batch( pcdApiBatch_t *batch, pcdApiBatchResult_t *results )
+{
+    pcdApiBatchResult_t localResults[ PCD_API_BATCH_MAX_ENTRIES ];
+    rule_t *rules[ PCD_API_BATCH_MAX_ENTRIES ];
+    PCD_status_e retval = PCD_STATUS_OK;
+    u_int32_t i;
+
+    if ( batch->numEntries > PCD_API_BATCH_MAX_ENTRIES )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    if ( !results )
+    {
+        results = localResults;
+    }
+
+    /* Check all the entries first, none of them is handled if one is invalid */
+    for ( i = 0; i < batch->numEntries; i++ )
+    {
+        pcdApiBatchRequest_t *entry = &batch->entries[ i ];
+        u_int16_t offset = entry->paramsOffset;
+
+        results[ i ].retval = PCD_STATUS_OK;
+        results[ i ].ruleState = PCD_API_RULE_IDLE;
+
+        rules[ i ] = PCD_rulesdb_get_rule_by_id( &entry->ruleId );
+
+        if ( !rules[ i ] )
+        {
+            PCD_PRINTF_WARNING_STDOUT( "Rule %s_%s not found, aborting batch request", entry->ruleId.groupName, entry->ruleId.ruleName );
+            results[ i ].retval = PCD_STATUS_INVALID_RULE;
+        }
+        else if ( ( ( entry->type != PCD_API_START_PROCESS ) && ( entry->type != PCD_API_TERMINATE_PROCESS ) &&
+                    ( entry->type != PCD_API_KILL_PROCESS ) && ( entry->type != PCD_API_SIGNAL_PROCESS ) &&
+                    ( entry->type != PCD_API_GET_RULE_STATE ) ) ||
+                  ( ( entry->type == PCD_API_SIGNAL_PROCESS ) && ( entry->sig != SIGUSR1 ) && ( entry->sig != SIGUSR2 ) ) ||
+                  ( ( offset ) && ( ( offset > PCD_API_BATCH_STRINGS_SIZE ) ||
+                                    ( !memchr( &batch->strings[ offset - 1 ], '\0', PCD_API_BATCH_STRINGS_SIZE - offset + 1 ) ) ) ) )
+        {
+            results[ i ].retval = PCD_STATUS_BAD_PARAMS;
+        }
+
+        if ( ( retval == PCD_STATUS_OK ) && ( results[ i ].retval != PCD_STATUS_OK ) )
+        {
+            retval = results[ i ].retval;
+        }
+    }
+
+    if ( retval != PCD_STATUS_OK )
+    {
+        /* The valid entries were not handled either */
+        for ( i = 0; i < batch->numEntries; i++ )
+        {
+            if ( results[ i ].retval == PCD_STATUS_OK )
+            {
+                results[ i ].retval = PCD_STATUS_NOK;
+            }
+        }
+
+        return retval;
+    }
+
+    /* Handle the entries in order */
+    for ( i = 0; i < batch->numEntries; i++ )
+    {
+        pcdApiBatchRequest_t *entry = &batch->entries[ i ];
+
+        results[ i ].retval = PCD_api_handle_rule_request( rules[ i ], entry->type, entry->sig,
+                                                           entry->paramsOffset ? &batch->strings[ entry->paramsOffset - 1 ] : NULL,
+                                                           &results[ i ].ruleState, NULL );
+
+        if ( ( retval == PCD_STATUS_OK ) && ( results[ i ].retval != PCD_STATUS_OK ) )
+        {
+            retval = results[ i ].retval;
+        }
+    }
+
+    return retval;
+}
+
+/* Any local user may ask for the trace, so it is written only to a new file in the temporary files path */
+static PCD_status_e PCD_api_handle_dump_trace( const char *name )
+{
+    char filename[ sizeof( CONFIG_PCD_TEMP_PATH ) + CONFIG_PCD_MAX_PARAM_SIZE + 1 ];
+
+    if ( ( name[ 0 ] == '\0' ) || ( name[ 0 ] == '.' ) || ( strchr( name, '/' ) ) )
+        return PCD_STATUS_BAD_PARAMS;
+
+    sprintf( filename, CONFIG_PCD_TEMP_PATH "/%s", name );
+
+    return PCD_trace_dump( filename, True );
+}
+
+static void PCD_api_event_handler( int32_t fd, void *data )
+{
+    /* The messages are received in the main loop, after all the events were dispatched */
+    apiSocketReadable = True;
+}
+
+static void PCD_api_client_refill( pcdApiClient_t *client, u_int64_t now )
+{
+#if ( CONFIG_PCD_API_CLIENT_RATE > 0 )
+    u_int64_t tokens;
+
+    /* The rate is in requests per second, which is thousandths of a token per ms */
+    tokens = client->tokens + ( now - client->lastRefill ) * CONFIG_PCD_API_CLIENT_RATE;
+
+    client->tokens = ( tokens < CONFIG_PCD_API_CLIENT_BURST * PCD_API_TOKEN ) ? tokens : CONFIG_PCD_API_CLIENT_BURST * PCD_API_TOKEN;
+#endif
+    client->lastRefill = now;
+}
+
+static bool_t PCD_api_client_ready( pcdApiClient_t *client )
+{
+#if ( CONFIG_PCD_API_CLIENT_RATE > 0 )
+    return ( client->count > 0 ) && ( client->tokens >= PCD_API_TOKEN );
+#else
+    return ( client->count > 0 );
+#endif
+}
+
+static void PCD_api_clear_subscriber( IPC_context_t context )
+{
+    pcdApiSubscriber_t *subscriber = &apiSubscribers[ context ];
+
+    apiNumSubscriptions -= subscriber->numSubscriptions;
+    subscriber->numSubscriptions = 0;
+    subscriber->eventsLost = False;
+
+    if ( subscriber->eventMsg )
+    {
+        IPC_free_msg( subscriber->eventMsg );
+        subscriber->eventMsg = NULL;
+    }
+}
+
+/* The destination point may have been reclaimed from a process which exited, and given to another one */
+static bool_t PCD_api_subscriber_valid( IPC_context_t context )
+{
+    pid_t pid;
+
+    if ( ( IPC_get_context_pid( context, &pid ) != IPC_STATUS_OK ) || ( pid != apiSubscribers[ context ].pid ) )
+    {
+        PCD_api_clear_subscriber( context );
+        return False;
+    }
+
+    return True;
+}
+
+static IPC_status_e PCD_api_send_to_client( IPC_context_t context, IPC_message_t *msg, IPC_message_t *replyMsg )
+{
+    /* Events are not replies to a request */
+    return ( msg ) ? IPC_reply_msg( msg, replyMsg ) : IPC_send_msg( context, replyMsg );
+}
+
+static void PCD_api_free_reply( IPC_context_t context )
+{
+    pcdApiClient_t *client = &apiClients[ context ];
+    pcdApiReply_t *reply = &client->replies[ client->replyHead ];
+
+    if ( reply->msg )
+    {
+        IPC_free_msg( reply->msg );
+    }
+    else if ( reply->replyMsg )
+    {
+        /* An event message which was not sent */
+        apiSubscribers[ context ].eventsLost = True;
+    }
+
+    if ( reply->replyMsg )
+    {
+        IPC_free_msg( reply->replyMsg );
+    }
+
+    client->replyHead = ( client->replyHead + 1 ) % PCD_API_CLIENT_QUEUE_SIZE;
+    client->replyCount--;
+    apiPendingReplies--;
+}
+
+static void PCD_api_flush_replies( IPC_context_t context, u_int64_t now )
+{
+    pcdApiClient_t *client = &apiClients[ context ];
+
+    while ( client->replyCount )
+    {
+        pcdApiReply_t *reply = &client->replies[ client->replyHead ];
+        IPC_status_e ret = PCD_api_send_to_client( context, reply->msg, reply->replyMsg );
+        bool_t isEvent = ( reply->msg == NULL );
+
+        if ( ret == IPC_STATUS_BUSY )
+        {
+            break;
+        }
+
+        /* The reply is freed when sent */
+        if ( ret == IPC_STATUS_OK )
+        {
+            reply->replyMsg = NULL;
+        }
+
+        PCD_api_free_reply( context );
+        client->replyExpiry = now + PCD_API_REPLY_EXPIRY_MS;
+
+        /* The subscriber does not exist anymore */
+        if ( ( ret == IPC_STATUS_NOK ) && ( isEvent ) )
+        {
+            PCD_api_clear_subscriber( context );
+        }
+    }
+
+    /* The client stopped reading its replies */
+    if ( ( client->replyCount ) && ( now >= client->replyExpiry ) )
+    {
+        PCD_PRINTF_WARNING_STDOUT( "Client does not receive its replies, dropping %u replies", client->replyCount );
+
+        while ( client->replyCount )
+        {
+            PCD_api_free_reply( context );
+        }
+    }
+}
+
+static void PCD_api_send_reply( IPC_context_t context, IPC_message_t *msg, IPC_message_t *replyMsg )
+{
+    pcdApiClient_t *client = &apiClients[ context ];
+    pcdApiReply_t *reply;
+    IPC_status_e ret = IPC_STATUS_BUSY;
+
+    /* Keep the order of the replies, send now only if none is waiting */
+    if ( !client->replyCount )
+    {
+        ret = PCD_api_send_to_client( context, msg, replyMsg );
+    }
+
+    if ( ret == IPC_STATUS_OK )
+    {
+        if ( msg )
+        {
+            IPC_free_msg( msg );
+        }
+
+        return;
+    }
+
+    if ( ( ret == IPC_STATUS_NOK ) || ( client->replyCount == PCD_API_CLIENT_QUEUE_SIZE ) )
+    {
+        if ( msg )
+        {
+            PCD_PRINTF_STDERR( "Failed to send reply message" );
+            IPC_free_msg( msg );
+        }
+        else if ( ret == IPC_STATUS_NOK )
+        {
+            /* The subscriber does not exist anymore */
+            PCD_api_clear_subscriber( context );
+        }
+        else
+        {
+            apiSubscribers[ context ].eventsLost = True;
+        }
+
+        IPC_free_msg( replyMsg );
+        return;
+    }
+
+    /* The receive queue of the client is full, send when it reads its previous replies */
+    if ( !client->replyCount )
+    {
+        client->replyExpiry = PCD_event_get_time() + PCD_API_REPLY_EXPIRY_MS;
+    }
+
+    reply = &client->replies[ ( client->replyHead + client->replyCount ) % PCD_API_CLIENT_QUEUE_SIZE ];
+    reply->msg = msg;
+    reply->replyMsg = replyMsg;
+    client->replyCount++;
+    apiPendingReplies++;
+}
+
+static PCD_status_e PCD_api_handle_subscription( pcdApiMessage_t *data )
+{
+    int32_t context = data->subscription.context;
+    pcdApiSubscriber_t *subscriber;
+    ruleId_t *ruleId = &data->ruleId;
+    u_int32_t i = 0;
+    pid_t pid;
+
+    if ( ( context < 0 ) || ( context >= IPC_MAX_LIST_SIZE ) )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    /* Only the process which started the destination point gets its events */
+    if ( ( IPC_get_context_pid( context, &pid ) != IPC_STATUS_OK ) || ( pid == 0 ) || ( pid != data->pid ) )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    subscriber = &apiSubscribers[ context ];
+
+    /* The destination point was given to another process, forget the subscriptions of the previous one */
+    if ( subscriber->pid != data->pid )
+    {
+        PCD_api_clear_subscriber( context );
+        subscriber->pid = data->pid;
+    }
+
+    if ( data->type == PCD_API_UNSUBSCRIBE )
+    {
+        while ( i < subscriber->numSubscriptions )
+        {
+            if ( ( data->subscription.subscriptionId == 0 ) || ( subscriber->ids[ i ] == data->subscription.subscriptionId ) )
+            {
+                /* Move the last subscription instead */
+                subscriber->numSubscriptions--;
+                apiNumSubscriptions--;
+                subscriber->ids[ i ] = subscriber->ids[ subscriber->numSubscriptions ];
+                subscriber->ruleIds[ i ] = subscriber->ruleIds[ subscriber->numSubscriptions ];
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        return PCD_STATUS_OK;
+    }
+
+    ruleId->groupName[ PCD_RULEID_MAX_GROUP_NAME_SIZE - 1 ] = '\0';
+    ruleId->ruleName[ PCD_RULEID_MAX_RULE_NAME_SIZE - 1 ] = '\0';
+
+    if ( ( !ruleId->groupName[ 0 ] ) || ( !ruleId->ruleName[ 0 ] ) )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    /* A single rule must exist, groups may be subscribed before their rules are loaded */
+    if ( ( strcmp( ruleId->groupName, PCD_API_ANY ) ) && ( strcmp( ruleId->ruleName, PCD_API_ANY ) ) &&
+         ( !PCD_rulesdb_get_rule_by_id( ruleId ) ) )
+    {
+        return PCD_STATUS_INVALID_RULE;
+    }
+
+    if ( subscriber->numSubscriptions == PCD_API_MAX_SUBSCRIPTIONS )
+    {
+        PCD_PRINTF_WARNING_STDOUT( "Too many subscriptions of process %d", data->pid );
+        return PCD_STATUS_NOK;
+    }
+
+    subscriber->ids[ subscriber->numSubscriptions ] = data->subscription.subscriptionId;
+    subscriber->ruleIds[ subscriber->numSubscriptions ] = *ruleId;
+    subscriber->numSubscriptions++;
+    apiNumSubscriptions++;
+
+    return PCD_STATUS_OK;
+}
+
+static bool_t PCD_api_subscription_match( const ruleId_t *pattern, const ruleId_t *ruleId )
+{
+    if ( !strcmp( pattern->groupName, PCD_API_ANY ) )
+    {
+        return True;
+    }
+
+    if ( strncmp( pattern->groupName, ruleId->groupName, PCD_RULEID_MAX_GROUP_NAME_SIZE ) )
+    {
+        return False;
+    }
+
+    return ( !strcmp( pattern->ruleName, PCD_API_ANY ) ) || ( !strncmp( pattern->ruleName, ruleId->ruleName, PCD_RULEID_MAX_RULE_NAME_SIZE ) );
+}
+
+static void PCD_api_send_event( IPC_context_t context )
+{
+    pcdApiSubscriber_t *subscriber = &apiSubscribers[ context ];
+    IPC_message_t *eventMsg = subscriber->eventMsg;
+    pcdApiReplyMessage_t *eventData = IPC_get_msg( eventMsg );
+
+    /* Tell the subscriber if earlier events were lost */
+    eventData->retval = ( subscriber->eventsLost ) ? PCD_STATUS_NOK : PCD_STATUS_OK;
+    subscriber->eventsLost = False;
+    subscriber->eventMsg = NULL;
+
+    PCD_api_send_reply( context, NULL, eventMsg );
+}
+
+static void PCD_api_add_event( IPC_context_t context, rule_t *rule, pcdApiRuleState_e ruleState )
+{
+    pcdApiSubscriber_t *subscriber = &apiSubscribers[ context ];
+    pcdApiReplyMessage_t *eventData;
+    pcdApiEvent_t *event;
+
+    /* A full event message is sent right away */
+    if ( ( subscriber->eventMsg ) &&
+         ( ( ( pcdApiReplyMessage_t *)IPC_get_msg( subscriber->eventMsg ) )->events.numEvents == PCD_API_EVENT_MAX_ENTRIES ) )
+    {
+        PCD_api_send_event( context );
+    }
+
+    if ( !subscriber->eventMsg )
+    {
+        /* The events of a new message go to the process which subscribed only */
+        if ( !PCD_api_subscriber_valid( context ) )
+        {
+            return;
+        }
+
+        subscriber->eventMsg = IPC_alloc_msg( pcdContext, PCD_API_REPLY_MESSAGE_SIZE( PCD_API_EVENT ) );
+
+        if ( !subscriber->eventMsg )
+        {
+            subscriber->eventsLost = True;
+            return;
+        }
+
+        /* A zero msgId tells the events from the replies */
+        memset( IPC_get_msg( subscriber->eventMsg ), 0, PCD_API_REPLY_MESSAGE_SIZE( PCD_API_EVENT ) );
+    }
+
+    eventData = IPC_get_msg( subscriber->eventMsg );
+    event = &eventData->events.entries[ eventData->events.numEvents++ ];
+    event->ruleId = rule->ruleId;
+    event->ruleState = ruleState;
+}
+
+void PCD_api_notify_rule( rule_t *rule )
+{
+    pcdApiRuleState_e ruleState;
+    u_int32_t i, j;
+
+    if ( ( PCD_api_rule_state( rule, &ruleState ) != PCD_STATUS_OK ) || ( (u_int32_t)ruleState == rule->apiState ) )
+    {
+        return;
+    }
+
+    /* Several rule states look the same to the API */
+    rule->apiState = ruleState;
+
+    for ( i = 0; ( i < IPC_MAX_LIST_SIZE ) && ( apiNumSubscriptions ); i++ )
+    {
+        pcdApiSubscriber_t *subscriber = &apiSubscribers[ i ];
+
+        for ( j = 0; j < subscriber->numSubscriptions; j++ )
+        {
+            if ( PCD_api_subscription_match( &subscriber->ruleIds[ j ], &rule->ruleId ) )
+            {
+                PCD_api_add_event( i, rule, ruleState );
+                break;
+            }
+        }
+    }
+}
+
+static bool_t PCD_api_lost_events_waiting( IPC_context_t context )
+{
+    pcdApiSubscriber_t *subscriber = &apiSubscribers[ context ];
+
+    /* No event message follows, which tells the subscriber */
+    return ( subscriber->eventsLost ) && ( subscriber->numSubscriptions ) &&
+           ( !subscriber->eventMsg ) && ( !apiClients[ context ].replyCount );
+}
+
+static void PCD_api_send_lost_events( IPC_context_t context )
+{
+    IPC_message_t *eventMsg;
+    pcdApiReplyMessage_t *eventData;
+    IPC_status_e ret;
+
+    if ( !PCD_api_subscriber_valid( context ) )
+    {
+        return;
+    }
+
+    eventMsg = IPC_alloc_msg( pcdContext, PCD_API_REPLY_MESSAGE_SIZE( PCD_API_EVENT ) );
+
+    if ( !eventMsg )
+    {
+        return;
+    }
+
+    /* An empty event message, sent only if the subscriber receives it right away */
+    eventData = IPC_get_msg( eventMsg );
+    memset( eventData, 0, PCD_API_REPLY_MESSAGE_SIZE( PCD_API_EVENT ) );
+    eventData->retval = PCD_STATUS_NOK;
+
+    ret = PCD_api_send_to_client( context, NULL, eventMsg );
+
+    if ( ret == IPC_STATUS_OK )
+    {
+        apiSubscribers[ context ].eventsLost = False;
+        return;
+    }
+
+    IPC_free_msg( eventMsg );
+
+    if ( ret == IPC_STATUS_NOK )
+    {
+        PCD_api_clear_subscriber( context );
+    }
+}
+
+void PCD_api_send_events( void )
+{
+    u_int32_t i;
+
+    for ( i = 0; ( i < IPC_MAX_LIST_SIZE ) && ( apiNumSubscriptions ); i++ )
+    {
+        if ( apiSubscribers[ i ].eventMsg )
+        {
+            PCD_api_send_event( i );
+        }
+        else if ( PCD_api_lost_events_waiting( i ) )
+        {
+            PCD_api_send_lost_events( i );
+        }
+    }
+}
+
+void PCD_api_cleanup_proc( pid_t pid )
+{
+    u_int32_t i;
+
+    for ( i = 0; ( i < IPC_MAX_LIST_SIZE ) && ( apiNumSubscriptions ); i++ )
+    {
+        if ( ( apiSubscribers[ i ].pid == pid ) && ( apiSubscribers[ i ].numSubscriptions ) )
+        {
+            PCD_api_clear_subscriber( i );
+        }
+    }
+}
+
 PCD_status_e PCD_api_init( void )
 {
+    int32_t fd;
+    u_int32_t i;
+
     /* Init IPC */
     if ( IPC_init( 0 ) != IPC_STATUS_OK )
     {
@@ -135,6 +822,26 @@ PCD_status_e PCD_api_init( void )
         return PCD_STATUS_NOK;
     }
 
+    /* Incoming messages wake up the main loop */
+    if ( ( IPC_get_fd( pcdContext, &fd ) != IPC_STATUS_OK ) ||
+         ( PCD_event_add( fd, PCD_api_event_handler, NULL ) != PCD_STATUS_OK ) )
+    {
+        IPC_stop( pcdContext );
+
+        PCD_PRINTF_STDERR( "Failed to listen to incoming messages");
+
+        return PCD_STATUS_NOK;
+    }
+
+    pcdFd = fd;
+
+    /* Every client starts with a full bucket */
+    for ( i = 0; i < IPC_MAX_LIST_SIZE; i++ )
+    {
+        apiClients[ i ].tokens = CONFIG_PCD_API_CLIENT_BURST * PCD_API_TOKEN;
+        apiClients[ i ].lastRefill = PCD_event_get_time();
+    }
+
     return PCD_STATUS_OK;
 }
 
@@ -146,200 +853,336 @@ PCD_status_e PCD_api_deinit( void )
     return PCD_STATUS_OK;
 }
 
-PCD_status_e PCD_api_check_messages( void )
+static void PCD_api_handle_message( IPC_message_t *msg )
 {
-    IPC_message_t *msg;
-    u_int32_t budget = 5;
+    pcdApiMessage_t *data = IPC_get_msg( msg );
+    rule_t *rule;
+    PCD_status_e retval = PCD_STATUS_NOK;
+    IPC_message_t *replyMsg = NULL;
+    pcdApiReplyMessage_t *replyData = NULL;
+    IPC_context_t msgContext;
+
+    PCD_stats_count_message();
 
-    /* Check for incoming messages */
-    while ( budget-- && IPC_wait_msg( pcdContext, &msg, IPC_TIMEOUT_IMMEDIATE ) == 0 )
+    /* Check if we need to reply */
+    if ( IPC_get_msg_context( msg, &msgContext ) == IPC_STATUS_OK )
     {
-        pcdApiMessage_t *data = IPC_get_msg( msg );
-        rule_t *rule;
-        PCD_status_e retval = PCD_STATUS_NOK;
-        IPC_message_t *replyMsg = NULL;
-        pcdApiReplyMessage_t *replyData = NULL;
-        IPC_context_t msgContext;
+        /* Allocate memory for reply message, the statistics and batch results are sent only when requested */
+        replyMsg = IPC_alloc_msg( pcdContext, PCD_API_REPLY_MESSAGE_SIZE( data->type ) );
 
-        /* Check if we need to reply */
-        if ( IPC_get_msg_context( msg, &msgContext ) == IPC_STATUS_OK )
+        if ( !replyMsg )
         {
-            /* Allocate memory for reply message */
-            replyMsg = IPC_alloc_msg( pcdContext, sizeof( pcdApiReplyMessage_t ) );
-
-            if ( !replyMsg )
-            {
-                PCD_PRINTF_STDERR( "Failed to allocate memory for reply message" );
-                IPC_free_msg( msg );
-                return PCD_STATUS_NOK;
-            }
-            else
-            {
-                /* Initialize the reply pointer */
-                replyData = IPC_get_msg( replyMsg );
+            PCD_PRINTF_STDERR( "Failed to allocate memory for reply message" );
+            IPC_free_msg( msg );
+            return;
+        }
+        else
+        {
+            /* Initialize the reply pointer */
+            replyData = IPC_get_msg( replyMsg );
 
-                /* Return the message ID */
-                replyData->msgId = data->msgId;
-            }
+            /* Return the message ID */
+            replyData->msgId = data->msgId;
         }
+    }
+
+    if ( data->type == PCD_API_PROCESS_READY )
+    {
+        /* Find the rule */
+        rule = PCD_process_get_rule_by_pid( data->pid );
 
-        if ( data->type == PCD_API_PROCESS_READY )
+        if ( !rule )
+        {
+            PCD_PRINTF_WARNING_STDOUT( "Got READY event, but cannot find an associated rule to pid %d", data->pid );
+            retval = PCD_STATUS_INVALID_RULE;
+        }
+        else
         {
-            /* Find the rule */
-            rule = PCD_process_get_rule_by_pid( data->pid );
+            /* Setup ready only if this is the end condition */
+            PCD_TRACE( rule, PCD_TRACE_READY, data->pid );
+            PCD_stats_process_ready( rule );
 
-            if ( !rule )
+            if ( rule->endCondition.type == PCD_END_COND_KEYWORD_PROCESS_READY )
             {
-                PCD_PRINTF_WARNING_STDOUT( "Got READY event, but cannot find an associated rule to pid %d", data->pid );
-                retval = PCD_STATUS_INVALID_RULE;
+                rule->endCondition.processReady = True;
+                PCD_timer_notify_rule( rule );
+                retval = PCD_STATUS_OK;
             }
             else
             {
-                /* Setup ready only if this is the end condition */
-                if ( rule->endCondition.type == PCD_END_COND_KEYWORD_PROCESS_READY )
-                {
-                    rule->endCondition.processReady = True;
-                    retval = PCD_STATUS_OK;
-                }
-                else
-                {
-                    PCD_PRINTF_WARNING_STDOUT( "Got READY event, but rule end condition is different" );
-                    retval = PCD_STATUS_BAD_PARAMS;
-                }
+                PCD_PRINTF_WARNING_STDOUT( "Got READY event, but rule end condition is different" );
+                retval = PCD_STATUS_BAD_PARAMS;
             }
         }
-        else if ( ( data->type == PCD_API_REDUCE_NETRX_PRIORITY ) || ( data->type == PCD_API_RESTORE_NETRX_PRIORITY ) )
+    }
+    else if ( ( data->type == PCD_API_REDUCE_NETRX_PRIORITY ) || ( data->type == PCD_API_RESTORE_NETRX_PRIORITY ) )
+    {
+        /* Handle net-rx related commands */
+        if ( data->type == PCD_API_REDUCE_NETRX_PRIORITY )
         {
-            /* Handle net-rx related commands */
-            if ( data->type == PCD_API_REDUCE_NETRX_PRIORITY )
-            {
-                retval = PCD_misc_reduce_net_rx_priority( data->priority );
-            }
-            else
+            retval = PCD_misc_reduce_net_rx_priority( data->priority );
+        }
+        else
+        {
+            retval = PCD_misc_restore_net_rx_priority();
+        }
+    }
+    else if ( data->type == PCD_API_DUMP_TRACE )
+    {
+        /* The file name is passed in the parameters */
+        data->params[ CONFIG_PCD_MAX_PARAM_SIZE - 1 ] = '\0';
+        retval = PCD_api_handle_dump_trace( data->params );
+    }
+    else if ( data->type == PCD_API_GET_STATS )
+    {
+        /* The counters of a rule are returned only if a rule is given */
+        rule = data->ruleId.groupName[ 0 ] ? PCD_rulesdb_get_rule_by_id( &data->ruleId ) : NULL;
+
+        if ( ( data->ruleId.groupName[ 0 ] ) && ( !rule ) )
+        {
+            retval = PCD_STATUS_INVALID_RULE;
+        }
+        else if ( replyData )
+        {
+            retval = PCD_stats_get( rule, &replyData->stats );
+        }
+    }
+    else if ( data->type == PCD_API_BATCH )
+    {
+        retval = PCD_api_handle_batch( &data->batch, replyData ? replyData->results : NULL );
+    }
+    else if ( ( data->type == PCD_API_SUBSCRIBE ) || ( data->type == PCD_API_UNSUBSCRIBE ) )
+    {
+        retval = PCD_api_handle_subscription( data );
+    }
+    else
+    {
+        /* Find the rule */
+        rule = PCD_rulesdb_get_rule_by_id( &data->ruleId );
+
+        if ( rule )
+        {
+            /* Activate the required command, send the incoming message as a cookie */
+            retval = PCD_api_handle_rule_request( rule, data->type, data->sig, data->params,
+                                                  replyData ? &replyData->ruleState : NULL, ( void *)msg );
+
+            if ( ( retval == PCD_STATUS_WAIT ) && ( replyMsg ) )
             {
-                retval = PCD_misc_restore_net_rx_priority();
+                /* We don't reply now. Calling context is blocked */
+                IPC_free_msg( replyMsg );
+                replyMsg = NULL;
             }
         }
         else
         {
-            /* Find the rule */
-            rule = PCD_rulesdb_get_rule_by_id( &data->ruleId );
+            PCD_PRINTF_WARNING_STDOUT( "Rule %s_%s not found, aborting request %d", data->ruleId.groupName, data->ruleId.ruleName, data->type );
+
+            /* Rule not found */
+            retval = PCD_STATUS_INVALID_RULE;
+        }
+    }
+
+    if ( replyMsg )
+    {
+        /* Return value in response */
+        replyData->retval = retval;
+
+        /* Send response, the incoming message is freed once it is sent */
+        PCD_api_send_reply( msg->context, msg, replyMsg );
+    }
+    else if ( retval != PCD_STATUS_WAIT )
+    {
+        /* Free only if completed. Don't free in sync termination */
+        IPC_free_msg( msg );
+    }
+}
+
+static void PCD_api_enqueue_message( IPC_message_t *msg )
+{
+    pcdApiMessage_t *data = IPC_get_msg( msg );
+    pcdApiClient_t *client = &apiClients[ msg->context ];
+
+    /* The message must hold the whole request */
+    if ( ( msg->size < sizeof( IPC_message_t ) + PCD_API_MESSAGE_SIZE( PCD_API_START_PROCESS ) ) ||
+         ( msg->size < sizeof( IPC_message_t ) + PCD_API_MESSAGE_SIZE( data->type ) ) )
+    {
+        PCD_PRINTF_WARNING_STDOUT( "Got a truncated request (%u bytes), dropping", msg->size );
+        IPC_free_msg( msg );
+        return;
+    }
+
+    /* Ready events release the rules which wait for them, never delay them */
+    if ( data->type == PCD_API_PROCESS_READY )
+    {
+        PCD_api_handle_message( msg );
+        return;
+    }
+
+    if ( client->count == PCD_API_CLIENT_QUEUE_SIZE )
+    {
+        /* The client does not wait for its replies, reject the request */
+        PCD_api_reply_message( msg, PCD_STATUS_NOK );
+        return;
+    }
+
+    client->queue[ ( client->head + client->count ) % PCD_API_CLIENT_QUEUE_SIZE ] = msg;
+    client->count++;
+    apiPending++;
+}
+
+static IPC_message_t *PCD_api_dequeue_message( pcdApiClient_t *client )
+{
+    IPC_message_t *msg = client->queue[ client->head ];
+
+    client->head = ( client->head + 1 ) % PCD_API_CLIENT_QUEUE_SIZE;
+    client->count--;
+    apiPending--;
+
+#if ( CONFIG_PCD_API_CLIENT_RATE > 0 )
+    client->tokens -= PCD_API_TOKEN;
+#endif
+
+    return msg;
+}
+
+PCD_status_e PCD_api_check_messages( void )
+{
+    IPC_message_t *msgs[ PCD_API_RECV_BATCH ];
+    u_int64_t deadline = PCD_stats_get_time_us() + PCD_API_TIME_BUDGET_US;
+    u_int64_t now;
+    u_int32_t numMsgs, i, served;
+
+    /* Drain the socket until it is empty, even while requests wait for their turn, so that
+       PROCESS_READY events are never held back. Requests which do not fit in the queue of
+       their client are rejected */
+    while ( ( apiSocketReadable ) && ( PCD_stats_get_time_us() < deadline ) )
+    {
+        numMsgs = PCD_API_RECV_BATCH;
 
-            if ( rule )
+        if ( ( IPC_recv_msgs( pcdContext, msgs, &numMsgs ) != IPC_STATUS_OK ) || ( numMsgs == 0 ) )
+        {
+            apiSocketReadable = False;
+            break;
+        }
+
+        for ( i = 0; i < numMsgs; i++ )
+        {
+            PCD_api_enqueue_message( msgs[ i ] );
+        }
+    }
+
+    now = PCD_event_get_time();
+
+    /* Send the replies which the clients could not receive before */
+    for ( i = 0; ( i < IPC_MAX_LIST_SIZE ) && ( apiPendingReplies ); i++ )
+    {
+        if ( apiClients[ i ].replyCount )
+        {
+            PCD_api_flush_replies( i, now );
+        }
+    }
+
+    /* Serve the clients in turns, a single request of each client at a time */
+    do
+    {
+        served = 0;
+
+        for ( i = 0; ( i < IPC_MAX_LIST_SIZE ) && ( apiPending ) && ( PCD_stats_get_time_us() < deadline ); i++ )
+        {
+            pcdApiClient_t *client = &apiClients[ apiNextClient ];
+
+            apiNextClient = ( apiNextClient + 1 ) % IPC_MAX_LIST_SIZE;
+
+            /* A client which does not read its replies waits until it does */
+            if ( ( !client->count ) || ( client->replyCount ) )
             {
-                /* Activate the required command */
-                switch ( data->type )
-                {
-                    case PCD_API_START_PROCESS:
-                        if ( data->params[ 0 ] )
-                            PCD_rulesdb_setup_optional_params( rule, data->params );
-                        retval = PCD_api_start( rule );
-                        break;
-
-                    case PCD_API_TERMINATE_PROCESS_SYNC:
-                        /* Send the incoming message as a cookie */
-                        retval = PCD_api_stop( rule, False, ( void *)msg );
-
-                        if ( retval == PCD_STATUS_WAIT )
-                        {
-                            /* We don't reply now. Calling context is blocked */
-                            if ( replyMsg )
-                            {
-                                IPC_free_msg( replyMsg );
-                                replyMsg = NULL;
-                            }
-                        }
-                        break;
-
-                    case PCD_API_TERMINATE_PROCESS:
-                        retval = PCD_api_stop( rule, False, NULL );
-                        break;
-
-                    case PCD_API_KILL_PROCESS:
-                        retval = PCD_api_stop( rule, True, NULL );
-                        break;
-
-                    case PCD_API_SIGNAL_PROCESS:
-                        retval = PCD_api_signal( rule, data->sig );
-                        break;
-
-                    case PCD_API_GET_RULE_STATE:
-                        retval = PCD_STATUS_OK;
-
-                        switch ( rule->ruleState )
-                        {
-                            case PCD_RULE_IDLE:
-                                replyData->ruleState = PCD_API_RULE_IDLE;
-                                break;
-
-                            case PCD_RULE_ACTIVE:
-                            case PCD_RULE_START_CONDITION_WAITING:
-                            case PCD_RULE_END_CONDITION_WAITING:
-                                replyData->ruleState = PCD_API_RULE_RUNNING;
-                                break;
-
-                            case PCD_RULE_COMPLETED:
-                                if ( rule->proc )
-                                {
-                                    replyData->ruleState = PCD_API_RULE_COMPLETED_PROCESS_RUNNING;
-                                }
-                                else
-                                {
-                                    replyData->ruleState = PCD_API_RULE_COMPLETED_PROCESS_EXITED;
-                                }
-                                break;
-
-                            case PCD_RULE_FAILED:
-                                replyData->ruleState = PCD_API_RULE_FAILED;
-                                break;
-
-                            case PCD_RULE_NOT_COMPLETED:
-                                replyData->ruleState = PCD_API_RULE_NOT_COMPLETED;
-                                break;
-
-                            default:
-                                retval = PCD_STATUS_NOK;
-                                break;
-                        }
-                        break;
-
-                    default:
-                        retval = PCD_STATUS_BAD_PARAMS;
-                        PCD_PRINTF_WARNING_STDOUT( "Invalid request %d (for rule %s_%s), aborting", data->type, data->ruleId.groupName, data->ruleId.ruleName );
-                        break;
-                }
+                continue;
             }
-            else
-            {
-                PCD_PRINTF_WARNING_STDOUT( "Rule %s_%s not found, aborting request %d", data->ruleId.groupName, data->ruleId.ruleName, data->type );
 
-                /* Rule not found */
-                retval = PCD_STATUS_INVALID_RULE;
+            PCD_api_client_refill( client, now );
+
+            if ( PCD_api_client_ready( client ) )
+            {
+                PCD_api_handle_message( PCD_api_dequeue_message( client ) );
+                served++;
             }
         }
 
-        if ( replyMsg )
-        {
-            /* Return value in response */
-            replyData->retval = retval;
+    } while ( ( served ) && ( apiPending ) && ( PCD_stats_get_time_us() < deadline ) );
+
+    return PCD_STATUS_OK;
+}
+
+u_int32_t PCD_api_get_timeout( void )
+{
+    u_int32_t timeout = PCD_EVENT_TIMEOUT_FOREVER;
+    u_int32_t i;
+#if ( CONFIG_PCD_API_CLIENT_RATE > 0 )
+    u_int64_t now;
+#endif
+
+    /* Messages are still waiting in the socket */
+    if ( apiSocketReadable )
+    {
+        return 0;
+    }
 
-            /* Send response */
-            if ( IPC_reply_msg( msg, replyMsg ) != IPC_STATUS_OK )
+    /* Retry the replies which the clients could not receive */
+    if ( apiPendingReplies )
+    {
+        timeout = PCD_API_REPLY_RETRY_MS;
+    }
+    else
+    {
+        /* Retry telling the subscribers that they lost events */
+        for ( i = 0; ( i < IPC_MAX_LIST_SIZE ) && ( apiNumSubscriptions ); i++ )
+        {
+            if ( PCD_api_lost_events_waiting( i ) )
             {
-                IPC_free_msg( replyMsg );
+                timeout = PCD_API_EVENT_RETRY_MS;
+                break;
             }
+        }
+    }
 
+    if ( !apiPending )
+    {
+        return timeout;
+    }
+
+#if ( CONFIG_PCD_API_CLIENT_RATE > 0 )
+    now = PCD_event_get_time();
+#endif
+
+    for ( i = 0; i < IPC_MAX_LIST_SIZE; i++ )
+    {
+        pcdApiClient_t *client = &apiClients[ i ];
+
+        if ( ( !client->count ) || ( client->replyCount ) )
+        {
+            continue;
         }
 
-        /* Free only if completed. Don't free in sync termination */
-        if ( retval != PCD_STATUS_WAIT )
+#if ( CONFIG_PCD_API_CLIENT_RATE > 0 )
+        PCD_api_client_refill( client, now );
+
+        if ( client->tokens < PCD_API_TOKEN )
         {
-            /* Free incoming message */
-            IPC_free_msg( msg );
+            /* Wake up when the client gets its next token */
+            u_int32_t wait = ( PCD_API_TOKEN - client->tokens + CONFIG_PCD_API_CLIENT_RATE - 1 ) / CONFIG_PCD_API_CLIENT_RATE;
+
+            if ( wait < timeout )
+            {
+                timeout = wait;
+            }
+
+            continue;
         }
+#endif
+        return 0;
     }
 
-    return PCD_STATUS_OK;
+    return timeout;
 }
 
 void PCD_api_reply_message( void *cookie, PCD_status_e retval )
@@ -361,11 +1204,11 @@ void PCD_api_reply_message( void *cookie, PCD_status_e retval )
     if ( IPC_get_msg_context( msg, &msgContext ) == IPC_STATUS_OK )
     {
         /* Allocate memory for reply message */
-        replyMsg = IPC_alloc_msg( pcdContext, sizeof( pcdApiReplyMessage_t ) );
+        replyMsg = IPC_alloc_msg( pcdContext, PCD_API_REPLY_MESSAGE_SIZE( data->type ) );
 
         if ( !replyMsg )
         {
-            PCD_PRINTF_STDERR( "Failed to allocate memory for termination reply message" );
+            PCD_PRINTF_STDERR( "Failed to allocate memory for reply message" );
             IPC_free_msg( msg );
             return;
         }
@@ -373,24 +1216,28 @@ void PCD_api_reply_message( void *cookie, PCD_status_e retval )
         {
             /* Initialize the reply pointer */
             replyData = IPC_get_msg( replyMsg );
+            memset( replyData, 0, PCD_API_REPLY_MESSAGE_SIZE( data->type ) );
 
             /* Return the message ID */
             replyData->msgId = data->msgId;
         }
 
-        /* Return value in response */
+        /* Return value in response, a rejected batch fails in all its entries */
         replyData->retval = retval;
 
-        /* Send response */
-        if ( IPC_reply_msg( msg, replyMsg ) != IPC_STATUS_OK )
+        if ( data->type == PCD_API_BATCH )
         {
-            PCD_PRINTF_STDERR( "Failed to send termination reply message" );
-            IPC_free_msg( replyMsg );
+            u_int32_t i;
 
-            /* Free incoming message */
-            IPC_free_msg( msg );
-            return;
+            for ( i = 0; i < PCD_API_BATCH_MAX_ENTRIES; i++ )
+            {
+                replyData->results[ i ].retval = retval;
+            }
         }
+
+        /* Send response, the incoming message is freed once it is sent */
+        PCD_api_send_reply( msg->context, msg, replyMsg );
+        return;
     }
 
     /* Free incoming message */
@@ -77,6 +77,122 @@ typedef enum
 
 } pcdApiRuleState_e;
 
+/*! \def PCD_API_STATS_BUCKETS
+ *  \brief Latency histogram buckets, the last bucket counts the samples above all the bounds
+ */
+#define PCD_API_STATS_BUCKETS           11
+
+/*! \def PCD_API_STATS_BUCKET_BOUNDS
+ *  \brief Upper bounds of the latency histogram buckets, in us
+ */
+#define PCD_API_STATS_BUCKET_BOUNDS     { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000 }
+
+#define PCD_API_STATS_MAX_POOLS         8
+#define PCD_API_STATS_POOL_NAME_SIZE    16
+
+typedef struct pcdApiHistogram_t
+{
+    u_int32_t   buckets[ PCD_API_STATS_BUCKETS ];   /* Samples in each bucket, not cumulative */
+    u_int32_t   count;
+    u_int64_t   sum;                                /* Sum of the samples in us */
+
+} pcdApiHistogram_t;
+
+typedef struct pcdApiPoolStats_t
+{
+    char        name[ PCD_API_STATS_POOL_NAME_SIZE ];
+    u_int32_t   used;
+    u_int32_t   highWater;                          /* Maximum objects in use at the same time */
+    u_int32_t   capacity;
+    u_int32_t   failures;                           /* Allocations which failed */
+
+} pcdApiPoolStats_t;
+
+typedef struct pcdApiRuleStats_t
+{
+    u_int32_t   starts;                             /* Start condition met, the rule was started */
+    u_int32_t   restarts;                           /* Restarts by the RESTART failure action */
+    u_int32_t   failures;                           /* Process failures */
+    u_int32_t   timeouts;                           /* End condition timeouts */
+    int32_t     lastExitCode;                       /* Exit code of the last process, 128 + signal if it was killed, -1 if none exited */
+    int32_t     readyLatencyMs;                     /* From the spawn of the last process to PROCESS_READY, -1 if none */
+    u_int64_t   uptimeMs;                           /* Time the processes of the rule ran */
+
+} pcdApiRuleStats_t;
+
+typedef struct pcdApiStats_t
+{
+    u_int32_t           loopIterations;             /* Main loop iterations */
+    u_int32_t           loopOverruns;               /* Iterations which took longer than the timer tick */
+    u_int32_t           messages;                   /* Handled API messages */
+    u_int32_t           errlogWrites;               /* Writes to the error log */
+    pcdApiHistogram_t   loopLatency;                /* Time it took to handle a main loop iteration */
+    pcdApiHistogram_t   readyLatency;               /* From the spawn of a process to PROCESS_READY */
+    u_int32_t           numPools;
+    pcdApiPoolStats_t   pools[ PCD_API_STATS_MAX_POOLS ];
+    pcdApiRuleStats_t   rule;                       /* Counters of the requested rule */
+
+} pcdApiStats_t;
+
+/*! \def PCD_API_BATCH_MAX_ENTRIES
+ *  \brief Maximum number of entries in a batch request
+ */
+#define PCD_API_BATCH_MAX_ENTRIES       32
+
+/*! \enum pcdApiBatchOp_e
+ *  \brief Operations of the entries of a batch request
+ */
+typedef enum
+{
+    PCD_API_BATCH_START_PROCESS,            /* Start a process, with the optional parameters */
+    PCD_API_BATCH_TERMINATE_PROCESS,        /* Terminate a process, does not wait for its termination */
+    PCD_API_BATCH_KILL_PROCESS,             /* Kill a process */
+    PCD_API_BATCH_SIGNAL_PROCESS,           /* Signal a process */
+    PCD_API_BATCH_GET_RULE_STATE,           /* Get rule state */
+
+} pcdApiBatchOp_e;
+
+/*! \struct pcdApiBatchEntry_t
+ *  \brief An entry of a batch request, and its result
+ */
+typedef struct pcdApiBatchEntry_t
+{
+    ruleId_t            ruleId;
+    pcdApiBatchOp_e     op;
+    int32_t             sig;                /* Signal of PCD_API_BATCH_SIGNAL_PROCESS */
+    const char          *optionalParams;    /* Optional parameters of PCD_API_BATCH_START_PROCESS, may be NULL */
+    PCD_status_e        retval;             /* Result of the entry */
+    pcdApiRuleState_e   ruleState;          /* Result of PCD_API_BATCH_GET_RULE_STATE */
+
+} pcdApiBatchEntry_t;
+
+/*! \def PCD_API_ASYNC_MAX_REQUESTS
+ *  \brief Maximum number of asynchronous requests in flight
+ */
+#define PCD_API_ASYNC_MAX_REQUESTS      32
+
+/*! \typedef pcdApiCallback_t
+ *  \brief Completion callback of an asynchronous request, called from PCD_api_async_dispatch.
+ *  The rule state is valid only in the completion of PCD_api_async_get_rule_state.
+ */
+typedef void ( *pcdApiCallback_t )( u_int32_t requestId, PCD_status_e status, pcdApiRuleState_e ruleState, void *cookie );
+
+/*! \def PCD_API_MAX_SUBSCRIPTIONS
+ *  \brief Maximum number of state change subscriptions of a process
+ */
+#define PCD_API_MAX_SUBSCRIPTIONS       16
+
+/*! \def PCD_API_ANY
+ *  \brief Group or rule name of a subscription which matches any group or any rule of the group
+ */
+#define PCD_API_ANY                     "*"
+
+/*! \typedef pcdApiEventCallback_t
+ *  \brief State change callback of a subscription, called from PCD_api_async_dispatch.
+ *  Called with a NULL ruleId if events were lost, the rule states should be read again.
+ */
+typedef void ( *pcdApiEventCallback_t )( const struct ruleId_t *ruleId, pcdApiRuleState_e ruleState, void *cookie );
+
 /**************************************************************************/
 /*      INTERFACE FUNCTIONS Prototypes:                                   */
 /**************************************************************************/
@@ -166,6 +282,136 @@ PCD_status_e PCD_api_reduce_net_rx_priority( int32_t priority );
  */
 PCD_status_e PCD_api_restore_net_rx_priority( void );
 
+/*! \fn PCD_api_dump_trace
+ *  \brief Write the trace of the rule state transitions to a file, in Chrome trace event JSON format
+ *  \param[in] 		Name of a new file in the temporary files path of the PCD
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_dump_trace( const char *filename );
+
+/*! \fn PCD_api_get_stats
+ *  \brief Get the runtime statistics of the PCD, and the counters of a rule
+ *  \param[in] 		ruleId, NULL for the daemon statistics only
+ *  \param[in,out] 	stats
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_get_stats( const struct ruleId_t *ruleId, pcdApiStats_t *stats );
+
+/*! \fn PCD_api_batch
+ *  \brief Send several requests to the PCD in a single message. The PCD checks all the entries before it
+ *  handles any of them, and handles them in order, in a single main loop iteration.
+ *  \param[in] 		Number of entries, up to PCD_API_BATCH_MAX_ENTRIES
+ *  \param[in,out] 	entries, the results are returned in the retval and ruleState fields
+ *  \return			PCD_STATUS_OK - All the entries succeeded, <0 - Error of the first failed entry, or of the request
+ */
+PCD_status_e PCD_api_batch( pcdApiBatchEntry_t *entries, u_int32_t numEntries );
+
+/*! \fn PCD_api_close_session
+ *  \brief Close the client session of the calling thread. The session is opened on the first
+ *  API call of a thread, and is closed when the thread or the process exits.
+ *  \param[in] 		None
+ *  \param[in,out] 	None
+ *  \return			None
+ */
+void PCD_api_close_session( void );
+
+/*! \fn PCD_api_async_get_fd
+ *  \brief Get the file descriptor on which the replies to asynchronous requests are received.
+ *  Add it to the event loop of the application, and call PCD_api_async_dispatch when it is readable.
+ *  \param[in,out] 	fd
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_async_get_fd( int32_t *fd );
+
+/*! \fn PCD_api_async_start_process
+ *  \brief Start a process associated with a rule, without waiting for the reply
+ *  \param[in] 		ruleId, optional parameters, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_start_process( const struct ruleId_t *ruleId, const char *optionalParams, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId );
+
+/*! \fn PCD_api_async_signal_process
+ *  \brief Signal a process associated with a rule, without waiting for the reply
+ *  \param[in] 		ruleId, signal id, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_signal_process( const struct ruleId_t *ruleId, int32_t sig, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId );
+
+/*! \fn PCD_api_async_terminate_process
+ *  \brief Terminate a process associated with a rule. The request completes when the process has terminated.
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_terminate_process( const struct ruleId_t *ruleId, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId );
+
+/*! \fn PCD_api_async_kill_process
+ *  \brief Kill a process associated with a rule, without waiting for the reply
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_kill_process( const struct ruleId_t *ruleId, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId );
+
+/*! \fn PCD_api_async_get_rule_state
+ *  \brief Get rule state, without waiting for the reply
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_get_rule_state( const struct ruleId_t *ruleId, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId );
+
+/*! \fn PCD_api_async_dispatch
+ *  \brief Handle the received replies and the expired requests, and call their callbacks. Never blocks.
+ *  \param[in] 		None
+ *  \param[in,out] 	None
+ *  \return			Number of completed requests - Success, <0 - Error
+ */
+int32_t PCD_api_async_dispatch( void );
+
+/*! \fn PCD_api_async_get_timeout
+ *  \brief Get the time until the next request expires, to be used as the timeout of the event loop
+ *  \param[in] 		None
+ *  \param[in,out] 	None
+ *  \return			Time in ms, -1 if there are no requests in flight
+ */
+int32_t PCD_api_async_get_timeout( void );
+
+/*! \fn PCD_api_async_cancel
+ *  \brief Cancel a request in flight, its callback is not called. The request itself is not recalled from the PCD.
+ *  \param[in] 		requestId
+ *  \param[in,out] 	None
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_async_cancel( u_int32_t requestId );
+
+/*! \fn PCD_api_subscribe
+ *  \brief Subscribe to the state changes of a rule, of the rules of a group (rule name PCD_API_ANY), or of all
+ *  the rules (NULL ruleId). The events are received on the descriptor of PCD_api_async_get_fd.
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	subscriptionId, optional
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_subscribe( const struct ruleId_t *ruleId, pcdApiEventCallback_t callback, void *cookie, u_int32_t *subscriptionId );
+
+/*! \fn PCD_api_unsubscribe
+ *  \brief Cancel a subscription, its callback is not called anymore
+ *  \param[in] 		subscriptionId
+ *  \param[in,out] 	None
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_unsubscribe( u_int32_t subscriptionId );
+
+/*! \fn PCD_api_wait_rule_state
+ *  \brief Wait until a rule reaches a state, or until the timeout expires
+ *  \param[in] 		ruleId, rule state, timeout in ms
+ *  \param[in,out] 	None
+ *  \return			PCD_STATUS_OK - The rule is in the state, PCD_STATUS_TIMEOUT - Timeout, <0 - Error
+ */
+PCD_status_e PCD_api_wait_rule_state( const struct ruleId_t *ruleId, pcdApiRuleState_e ruleState, u_int32_t timeout );
+
 /*! \fn PCD_api_reboot( char *reason )
  *  \brief Display a reboot reason (optional) and reboot the system.
  *  \param[in] 		Reboot reason (optinal)
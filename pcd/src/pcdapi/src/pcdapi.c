@@ -26,6 +26,7 @@
  * - Support x86 platform
  * - Support x64 platform
  * - Fix the process find function
+ * - Keep a client session per thread, instead of a destination point per call
  */
 
 /* Author:
@@ -53,6 +54,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include "rules_db.h"
 #include "system_types.h"
 #include "ipc.h"
@@ -66,7 +68,70 @@
  */
 #define PCD_API_REPLY_TIMEOUT     5000
 
-static bool_t pcdApiInitDone = False;
+/*! \def PCD_API_BUSY_RETRY_MS
+ *  \brief Interval of trying again while the IPC is busy, in ms
+ */
+#define PCD_API_BUSY_RETRY_MS     1
+
+/*! \struct pcdApiSession_t
+ *  \brief Client session of a thread: its destination point, kept open across
+ *  the API calls, and the cached destination point of the PCD
+ */
+typedef struct pcdApiSession_t
+{
+    IPC_context_t   myCtx;
+    IPC_context_t   pcdCtx;
+    bool_t          pcdCtxValid;
+    pid_t           pid;
+
+} pcdApiSession_t;
+
+/*! \struct pcdApiAsyncRequest_t
+ *  \brief An asynchronous request in flight
+ */
+typedef struct pcdApiAsyncRequest_t
+{
+    u_int32_t           msgId;      /* Zero if the entry is free */
+    pcdApi_e            type;
+    pcdApiCallback_t    callback;
+    void                *cookie;
+    u_int64_t           deadline;   /* Monotonic time in ms */
+
+} pcdApiAsyncRequest_t;
+
+/*! \struct pcdApiEventHandler_t
+ *  \brief A state change subscription of the process
+ */
+typedef struct pcdApiEventHandler_t
+{
+    u_int32_t               subscriptionId;     /* Zero if the entry is free */
+    ruleId_t                ruleId;
+    pcdApiEventCallback_t   callback;
+    void                    *cookie;
+
+} pcdApiEventHandler_t;
+
+/*! \struct pcdApiBatchCall_t
+ *  \brief A batch request and the results of its entries
+ */
+typedef struct pcdApiBatchCall_t
+{
+    pcdApiBatch_t           batch;
+    pcdApiBatchResult_t     results[ PCD_API_BATCH_MAX_ENTRIES ];
+
+} pcdApiBatchCall_t;
+
+static pthread_once_t pcdApiInitOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t pcdApiSessionKey;
+static u_int32_t pcdApiSessionId = 0;
+static u_int32_t pcdApiMsgId = 0;
+
+/* The asynchronous requests of all the threads share a session, and are protected by a lock */
+static pthread_mutex_t pcdApiAsyncLock = PTHREAD_MUTEX_INITIALIZER;
+static pcdApiSession_t *pcdApiAsyncSession = NULL;
+static pcdApiAsyncRequest_t pcdApiAsyncRequests[ PCD_API_ASYNC_MAX_REQUESTS ];
+static pcdApiEventHandler_t pcdApiEventHandlers[ PCD_API_MAX_SUBSCRIPTIONS ];
+static u_int32_t pcdApiSubscriptionId = 0;
 bool_t verboseOutput = True;
 static char procName[ PCD_EXCEPTION_MAX_PROCESS_NAME ];
 static Cleanup_func cleanupFunc = NULL;
@@ -87,66 +152,239 @@ static void PCD_exception_default_handler(int32_t signo, siginfo_t *info, void *
 /**************************************************************************/
 
 /**************************************************************************/
-/*! \fn PCD_api_malloc_and_send()									*/
+/*! \fn PCD_api_session_destroy()									*/
 /**************************************************************************/
-/*  \brief 		Allocate and send an IPC message                       *
- *  \param[in] 		ruleId, type, optional parameters, pid 			*
+/*  \brief 		Stop the destination point of a session, and free it	*
+ *  \param[in] 		session										*
  *  \param[in,out] 	None										*
- *  \return			PCD_STATUS_OK - Success, <0 - Error	               *
+ *  \return			None										*
  **************************************************************************/
-static PCD_status_e PCD_api_malloc_and_send( const struct ruleId_t *ruleId, pcdApi_e type, void *ptr, int32_t value )
+static void PCD_api_session_destroy( void *ptr )
 {
-    IPC_message_t *msg;
-    IPC_context_t pcdCtx, pcdTmpCtx;
-    IPC_timeout_e timeout = PCD_API_REPLY_TIMEOUT;
-    pcdApiMessage_t *data;
-    PCD_status_e retval = PCD_STATUS_OK;
-    u_int32_t msgId;
+    pcdApiSession_t *session = ( pcdApiSession_t *)ptr;
+
+    /* A session inherited from the parent process belongs to the parent */
+    if ( session->pid == getpid() )
+    {
+        IPC_stop( session->myCtx );
+    }
+
+    free( session );
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_session_exit()									*/
+/**************************************************************************/
+/*  \brief 		Close the session of the exiting thread, thread       *
+ *  				specific destructors are not called on process exit	*
+ *  \param[in] 		None										*
+ *  \param[in,out] 	None										*
+ *  \return			None										*
+ **************************************************************************/
+static void PCD_api_session_exit( void )
+{
+    PCD_api_close_session();
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    if ( pcdApiAsyncSession )
+    {
+        PCD_api_session_destroy( pcdApiAsyncSession );
+        pcdApiAsyncSession = NULL;
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_session_init()									*/
+/**************************************************************************/
+/*  \brief 		Initialize the IPC and the sessions, once per process	*
+ *  \param[in] 		None										*
+ *  \param[in,out] 	None										*
+ *  \return			None										*
+ **************************************************************************/
+static void PCD_api_session_init( void )
+{
+    IPC_init( 0 );
+    pthread_key_create( &pcdApiSessionKey, PCD_api_session_destroy );
+    atexit( PCD_api_session_exit );
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_session_start()									*/
+/**************************************************************************/
+/*  \brief 		Start a session, with a destination point of its own	*
+ *  \param[in] 		None										*
+ *  \param[in,out] 	None										*
+ *  \return			Session - Success, NULL - Error	               *
+ **************************************************************************/
+static pcdApiSession_t *PCD_api_session_start( void )
+{
+    pcdApiSession_t *session;
     char pcdClient[ 32 ];
+    u_int32_t busyTimeout;
+    IPC_status_e ret;
+
+    session = malloc( sizeof( pcdApiSession_t ) );
+
+    if ( !session )
+    {
+        printf( "pcd: Error: Failed to allocate memory\n" );
+        return NULL;
+    }
+
+    memset( session, 0, sizeof( pcdApiSession_t ) );
+    session->pid = getpid();
+
+    /* Sessions of the same process get different destination points */
+    snprintf( pcdClient, sizeof( pcdClient ), CONFIG_PCD_CLIENTS_NAME_PREFIX "%d-%u",
+              session->pid, __sync_fetch_and_add( &pcdApiSessionId, 1 ) );
+
+    ret = IPC_start( pcdClient, &session->myCtx, 0 );
+
+    /* All the destination points are taken, wait until another client stops its own */
+    for ( busyTimeout = PCD_API_REPLY_TIMEOUT; ( ret == IPC_STATUS_BUSY ) && ( busyTimeout >= PCD_API_BUSY_RETRY_MS ); busyTimeout -= PCD_API_BUSY_RETRY_MS )
+    {
+        usleep( PCD_API_BUSY_RETRY_MS * 1000 );
+        ret = IPC_start( pcdClient, &session->myCtx, 0 );
+    }
 
-    if ( !pcdApiInitDone )
+    if ( ret != IPC_STATUS_OK )
     {
-        IPC_init( 0 );
-        pcdApiInitDone = True;
+        printf( "pcd: Error: Failed to start IPC%s\n", ( ret == IPC_STATUS_BUSY ) ? ", too many clients" : "" );
+        free( session );
+        return NULL;
     }
 
-    if ( IPC_get_context_by_owner( &pcdCtx, CONFIG_PCD_OWNER_ID ) != IPC_STATUS_OK )
+    return session;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_session_find_pcd()								*/
+/**************************************************************************/
+/*  \brief 		Find the destination point of the PCD, unless cached	*
+ *  \param[in,out] 	session										*
+ *  \return			PCD_STATUS_OK - Success, <0 - Error	               *
+ **************************************************************************/
+static PCD_status_e PCD_api_session_find_pcd( pcdApiSession_t *session )
+{
+    if ( !session->pcdCtxValid )
     {
-        printf( "pcd: Error: Failed to find PCD context\n");       
-        return PCD_STATUS_INVALID_RULE;
+        if ( IPC_get_context_by_owner( &session->pcdCtx, CONFIG_PCD_OWNER_ID ) != IPC_STATUS_OK )
+        {
+            printf( "pcd: Error: Failed to find PCD context\n");
+            return PCD_STATUS_NOK;
+        }
+
+        session->pcdCtxValid = True;
     }
 
-    sprintf( pcdClient, CONFIG_PCD_CLIENTS_NAME_PREFIX "%d", getpid() );
+    return PCD_STATUS_OK;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_get_session()									*/
+/**************************************************************************/
+/*  \brief 		Get the session of the calling thread, start it on the	*
+ *  				first call										*
+ *  \param[in] 		None										*
+ *  \param[in,out] 	None										*
+ *  \return			Session - Success, NULL - Error	               *
+ **************************************************************************/
+static pcdApiSession_t *PCD_api_get_session( void )
+{
+    pcdApiSession_t *session;
+
+    pthread_once( &pcdApiInitOnce, PCD_api_session_init );
+
+    session = pthread_getspecific( pcdApiSessionKey );
 
-    /* Create temporary destination point */
-    if ( IPC_start( pcdClient, &pcdTmpCtx, 0) != IPC_STATUS_OK )
+    if ( ( session ) && ( session->pid != getpid() ) )
     {
-        printf( "pcd: Error: Failed to start IPC\n");
-        return PCD_STATUS_NOK;
+        /* A forked child needs a destination point of its own */
+        PCD_api_session_destroy( session );
+        pthread_setspecific( pcdApiSessionKey, NULL );
+        session = NULL;
     }
 
-    /* Allocate a message */
-    msg = IPC_alloc_msg( pcdTmpCtx, sizeof( pcdApiMessage_t ) );
+    if ( !session )
+    {
+        if ( ( session = PCD_api_session_start() ) == NULL )
+        {
+            return NULL;
+        }
+
+        pthread_setspecific( pcdApiSessionKey, session );
+    }
+
+    return ( PCD_api_session_find_pcd( session ) == PCD_STATUS_OK ) ? session : NULL;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_async_get_session()								*/
+/**************************************************************************/
+/*  \brief 		Get the session of the asynchronous requests, start it	*
+ *  				on the first call. Called with the lock held		*
+ *  \param[in] 		None										*
+ *  \param[in,out] 	None										*
+ *  \return			Session - Success, NULL - Error	               *
+ **************************************************************************/
+static pcdApiSession_t *PCD_api_async_get_session( void )
+{
+    pthread_once( &pcdApiInitOnce, PCD_api_session_init );
 
-    if ( !msg )
+    if ( ( pcdApiAsyncSession ) && ( pcdApiAsyncSession->pid != getpid() ) )
     {
-        printf( "pcd: Error: Failed to allocate memory\n" );
-        retval = PCD_STATUS_NOK;
+        /* A forked child needs a destination point of its own, the requests and subscriptions belong to the parent */
+        PCD_api_session_destroy( pcdApiAsyncSession );
+        pcdApiAsyncSession = NULL;
+        memset( pcdApiAsyncRequests, 0, sizeof( pcdApiAsyncRequests ) );
+        memset( pcdApiEventHandlers, 0, sizeof( pcdApiEventHandlers ) );
+    }
 
-        goto end_malloc_and_send;
+    if ( !pcdApiAsyncSession )
+    {
+        pcdApiAsyncSession = PCD_api_session_start();
     }
 
-    data = IPC_get_msg( msg );
+    return pcdApiAsyncSession;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_close_session()									*/
+/**************************************************************************/
+/*  \brief 		Close the session of the calling thread				*
+ *  \param[in] 		None										*
+ *  \param[in,out] 	None										*
+ *  \return			None										*
+ **************************************************************************/
+void PCD_api_close_session( void )
+{
+    pcdApiSession_t *session;
 
-    /* Generate a message ID using an uninitialized data[0] */
-    msgId = *(u_int32_t *)( data ) - (u_int32_t)(pcdTmpCtx);
+    pthread_once( &pcdApiInitOnce, PCD_api_session_init );
 
-    /* Clear data */
-    memset( data, 0, sizeof( pcdApiMessage_t ) );
+    session = pthread_getspecific( pcdApiSessionKey );
 
-    /* Setup message */
-    data->type = type;
-    data->msgId = msgId;
+    if ( session )
+    {
+        pthread_setspecific( pcdApiSessionKey, NULL );
+        PCD_api_session_destroy( session );
+    }
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_alloc_request()									*/
+/**************************************************************************/
+/*  \brief 		Allocate and setup a request message                   *
+ *  \param[in] 		session, ruleId, type, optional parameters, pid 	*
+ *  \param[in,out] 	msg, msgId									*
+ *  \return			PCD_STATUS_OK - Success, <0 - Error	               *
+ **************************************************************************/
+static PCD_status_e PCD_api_alloc_request( pcdApiSession_t *session, const struct ruleId_t *ruleId, pcdApi_e type, const void *ptr, int32_t value, IPC_message_t **msg, u_int32_t *msgId )
+{
+    pcdApiMessage_t *data;
 
     if ( ruleId )
     {
@@ -154,12 +392,39 @@ static PCD_status_e PCD_api_malloc_and_send( const struct ruleId_t *ruleId, pcdA
         if ( ( !ruleId->groupName[ 0 ] ) || ( !ruleId->ruleName[ 0 ] ) )
         {
             printf( "pcd: Error: Invalid rule ID\n" );
-            IPC_free_msg( msg );
-            retval = PCD_STATUS_NOK;
-
-            goto end_malloc_and_send;
+            return PCD_STATUS_NOK;
         }
+    }
+
+    /* Allocate a message */
+    *msg = IPC_alloc_msg( session->myCtx, PCD_API_MESSAGE_SIZE( type ) );
+
+    if ( !*msg )
+    {
+        printf( "pcd: Error: Failed to allocate memory\n" );
+        return PCD_STATUS_NOK;
+    }
+
+    data = IPC_get_msg( *msg );
+
+    /* A late reply to an earlier request is told apart by its ID, zero is never used. The destination
+       point of an exited process is given to another one, which must not take the late replies of the
+       previous one, so the IDs of different processes differ */
+    do
+    {
+        *msgId = ( (u_int32_t)session->pid << 16 ) ^ __sync_add_and_fetch( &pcdApiMsgId, 1 );
+
+    } while ( *msgId == 0 );
+
+    /* Clear data */
+    memset( data, 0, PCD_API_MESSAGE_SIZE( type ) );
+
+    /* Setup message */
+    data->type = type;
+    data->msgId = *msgId;
 
+    if ( ruleId )
+    {
         /* Initialize rule */
         memcpy( &data->ruleId, ruleId, sizeof( ruleId_t ) );
     }
@@ -171,10 +436,11 @@ static PCD_status_e PCD_api_malloc_and_send( const struct ruleId_t *ruleId, pcdA
             break;
 
         case PCD_API_START_PROCESS:
+        case PCD_API_DUMP_TRACE:
             if ( ptr )
             {
                 /* Copy optional parameters to activate the rule differently */
-                strncpy( data->params, ( char *)ptr, CONFIG_PCD_MAX_PARAM_SIZE - 1 );
+                strncpy( data->params, ( const char *)ptr, CONFIG_PCD_MAX_PARAM_SIZE - 1 );
             }
             break;
 
@@ -182,82 +448,193 @@ static PCD_status_e PCD_api_malloc_and_send( const struct ruleId_t *ruleId, pcdA
             data->sig = value;
             break;
 
-        case PCD_API_TERMINATE_PROCESS_SYNC:
-            /* Process termination may take longer */
-            timeout = PCD_API_REPLY_TIMEOUT * 4;
-            break;
-
         case PCD_API_REDUCE_NETRX_PRIORITY:
             data->priority = value;
             break;
 
+        case PCD_API_BATCH:
+            memcpy( &data->batch, &( ( const pcdApiBatchCall_t *)ptr )->batch, sizeof( pcdApiBatch_t ) );
+            break;
+
+        case PCD_API_SUBSCRIBE:
+        case PCD_API_UNSUBSCRIBE:
+            /* The PCD forgets the subscriptions of a destination point which another process reuses */
+            memcpy( &data->subscription, ptr, sizeof( pcdApiSubscription_t ) );
+            data->pid = getpid();
+            break;
+
         case PCD_API_RESTORE_NETRX_PRIORITY:
         case PCD_API_KILL_PROCESS:
         case PCD_API_TERMINATE_PROCESS:
+        case PCD_API_TERMINATE_PROCESS_SYNC:
         case PCD_API_GET_RULE_STATE:
+        case PCD_API_GET_STATS:
             break;
 
         default:
-            IPC_free_msg( msg );
-            retval = PCD_STATUS_BAD_PARAMS;
-            goto end_malloc_and_send;
+            IPC_free_msg( *msg );
+            return PCD_STATUS_BAD_PARAMS;
     }
 
-    /* Send the request to the PCD */
-    if ( IPC_send_msg( pcdCtx, msg ) == 0 )
+    return PCD_STATUS_OK;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_get_reply_timeout()								*/
+/**************************************************************************/
+/*  \brief 		Get the time to wait for the reply of a request		*
+ *  \param[in] 		type										*
+ *  \param[in,out] 	None										*
+ *  \return			Timeout in ms									*
+ **************************************************************************/
+static IPC_timeout_e PCD_api_get_reply_timeout( pcdApi_e type )
+{
+    /* Process termination may take longer */
+    return ( type == PCD_API_TERMINATE_PROCESS_SYNC ) ? PCD_API_REPLY_TIMEOUT * 4 : PCD_API_REPLY_TIMEOUT;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_send_request()									*/
+/**************************************************************************/
+/*  \brief 		Send a request message to the PCD. The message is     *
+ *  				freed in any case								*
+ *  \param[in] 		session, msg, time to wait while the receive queue	*
+ *  				of the PCD is full, in ms						*
+ *  \param[in,out] 	None										*
+ *  \return			PCD_STATUS_OK - Success, <0 - Error	               *
+ **************************************************************************/
+static PCD_status_e PCD_api_send_request( pcdApiSession_t *session, IPC_message_t *msg, u_int32_t busyTimeout )
+{
+    IPC_status_e ret = IPC_send_msg( session->pcdCtx, msg );
+
+    /* Many clients may send at once, such as daemons sending their READY events */
+    while ( ( ret == IPC_STATUS_BUSY ) && ( busyTimeout >= PCD_API_BUSY_RETRY_MS ) )
     {
-        IPC_message_t *replyMsg;
+        usleep( PCD_API_BUSY_RETRY_MS * 1000 );
+        busyTimeout -= PCD_API_BUSY_RETRY_MS;
+        ret = IPC_send_msg( session->pcdCtx, msg );
+    }
 
-        do
-        {
-            /* Wait for incoming reply */
-            if ( IPC_wait_msg( pcdTmpCtx, &replyMsg, timeout ) == 0 )
-            {
-                pcdApiReplyMessage_t *replyData = IPC_get_msg( replyMsg );
+    if ( ret == IPC_STATUS_OK )
+    {
+        return PCD_STATUS_OK;
+    }
 
-                if ( replyData->msgId != msgId )
-                {
-                    /* This is not our message!? - Delete it to avoid resource leak */
-                    IPC_free_msg( replyMsg );
-                    continue;
-                }
+    if ( ret == IPC_STATUS_BUSY )
+    {
+        IPC_free_msg( msg );
+        return PCD_STATUS_NOK;
+    }
 
-                retval = replyData->retval;
+    /* The PCD may have restarted on another destination point, look it up again */
+    session->pcdCtxValid = False;
 
-                if ( type == PCD_API_GET_RULE_STATE )
-                {
-                    pcdApiRuleState_e *ruleState = (pcdApiRuleState_e *)ptr;
+    if ( ( IPC_get_context_by_owner( &session->pcdCtx, CONFIG_PCD_OWNER_ID ) == IPC_STATUS_OK ) &&
+         ( IPC_send_msg( session->pcdCtx, msg ) == 0 ) )
+    {
+        session->pcdCtxValid = True;
+        return PCD_STATUS_OK;
+    }
 
-                    if ( ruleState )
-                    {
-                        /* Return rule state */
-                        *ruleState = replyData->ruleState;
-                    }
-                }
+    IPC_free_msg( msg );
 
-                /* Free the message, we are done */
-                IPC_free_msg( replyMsg );
-                break;
-            }
-            else
-            {
-                /* Return with status timeout, don't dispose message */
-                retval = PCD_STATUS_TIMEOUT;
-                break;
-            }
+    return PCD_STATUS_NOK;
+}
 
-        } while ( 1 );
+/**************************************************************************/
+/*! \fn PCD_api_handle_reply()									*/
+/**************************************************************************/
+/*  \brief 		Return the results of a reply to the caller			*
+ *  \param[in] 		type, reply									*
+ *  \param[in,out] 	ptr, the result of the request					*
+ *  \return			The status of the request						*
+ **************************************************************************/
+static PCD_status_e PCD_api_handle_reply( pcdApi_e type, void *ptr, const pcdApiReplyMessage_t *replyData )
+{
+    if ( ( type == PCD_API_GET_RULE_STATE ) && ( ptr ) && ( replyData->retval == PCD_STATUS_OK ) )
+    {
+        /* Return rule state */
+        *(pcdApiRuleState_e *)ptr = replyData->ruleState;
     }
-    else
+    else if ( ( type == PCD_API_GET_STATS ) && ( ptr ) && ( replyData->retval == PCD_STATUS_OK ) )
     {
-        retval = PCD_STATUS_NOK;
-        IPC_free_msg( msg );
+        /* Return the statistics */
+        memcpy( ptr, &replyData->stats, sizeof( pcdApiStats_t ) );
+    }
+    else if ( ( type == PCD_API_BATCH ) && ( ptr ) )
+    {
+        /* Return the results of the entries, also when some failed */
+        memcpy( ( ( pcdApiBatchCall_t *)ptr )->results, replyData->results, sizeof( replyData->results ) );
+    }
+
+    return replyData->retval;
+}
+
+/**************************************************************************/
+/*! \fn PCD_api_malloc_and_send()									*/
+/**************************************************************************/
+/*  \brief 		Allocate and send an IPC message, wait for the reply   *
+ *  \param[in] 		ruleId, type, optional parameters, pid 			*
+ *  \param[in,out] 	None										*
+ *  \return			PCD_STATUS_OK - Success, <0 - Error	               *
+ **************************************************************************/
+static PCD_status_e PCD_api_malloc_and_send( const struct ruleId_t *ruleId, pcdApi_e type, void *ptr, int32_t value )
+{
+    IPC_message_t *msg, *replyMsg;
+    pcdApiSession_t *session;
+    PCD_status_e retval;
+    u_int32_t msgId;
+
+    session = PCD_api_get_session();
+
+    if ( !session )
+    {
+        return PCD_STATUS_NOK;
+    }
+
+    retval = PCD_api_alloc_request( session, ruleId, type, ptr, value, &msg, &msgId );
+
+    if ( retval != PCD_STATUS_OK )
+    {
+        return retval;
+    }
+
+    /* Send the request to the PCD */
+    if ( PCD_api_send_request( session, msg, PCD_api_get_reply_timeout( type ) ) != PCD_STATUS_OK )
+    {
+        return PCD_STATUS_NOK;
     }
 
-    end_malloc_and_send:
+    do
+    {
+        /* Wait for incoming reply */
+        if ( IPC_wait_msg( session->myCtx, &replyMsg, PCD_api_get_reply_timeout( type ) ) == 0 )
+        {
+            pcdApiReplyMessage_t *replyData = IPC_get_msg( replyMsg );
+
+            if ( replyData->msgId != msgId )
+            {
+                /* A late reply to an earlier request - Delete it to avoid resource leak */
+                IPC_free_msg( replyMsg );
+                continue;
+            }
+
+            retval = PCD_api_handle_reply( type, ptr, replyData );
+
+            /* Free the message, we are done */
+            IPC_free_msg( replyMsg );
+            break;
+        }
+        else
+        {
+            /* Return with status timeout, don't dispose message. Look
+             * up the PCD again on the next call, it may have restarted */
+            session->pcdCtxValid = False;
+            retval = PCD_STATUS_TIMEOUT;
+            break;
+        }
 
-    /* Delete temporary dest point */
-    IPC_stop( pcdTmpCtx );
+    } while ( 1 );
 
     return retval;
 }
@@ -337,7 +714,13 @@ PCD_status_e PCD_api_kill_process( const struct ruleId_t *ruleId )
  **************************************************************************/
 PCD_status_e PCD_api_send_process_ready( void )
 {
-    return PCD_api_malloc_and_send( NULL, PCD_API_PROCESS_READY, NULL, getpid() );
+    PCD_status_e retval = PCD_api_malloc_and_send( NULL, PCD_API_PROCESS_READY, NULL, getpid() );
+
+    /* A daemon sends its READY event once and then runs for long, don't keep its
+       record in the IPC clients list */
+    PCD_api_close_session();
+
+    return retval;
 }
 
 /**************************************************************************/
@@ -615,3 +998,757 @@ PCD_status_e PCD_api_restore_net_rx_priority( void )
 {
     return PCD_api_malloc_and_send( NULL, PCD_API_RESTORE_NETRX_PRIORITY, NULL, 0 );
 }
+
+/*! \fn PCD_api_dump_trace
+ *  \brief Write the trace of the rule state transitions to a file, in Chrome trace event JSON format
+ *  \param[in] 		Name of a new file in the temporary files path of the PCD
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_dump_trace( const char *filename )
+{
+    /* The PCD picks the directory, only a plain file name is accepted */
+    if ( ( !filename ) || ( filename[ 0 ] == '\0' ) || ( filename[ 0 ] == '.' ) || ( strchr( filename, '/' ) ) ||
+         ( strlen( filename ) >= CONFIG_PCD_MAX_PARAM_SIZE ) )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    return PCD_api_malloc_and_send( NULL, PCD_API_DUMP_TRACE, ( void *)filename, 0 );
+}
+
+/*! \fn PCD_api_get_stats
+ *  \brief Get the runtime statistics of the PCD, and the counters of a rule
+ *  \param[in] 		ruleId, NULL for the daemon statistics only
+ *  \param[in,out] 	stats
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_get_stats( const struct ruleId_t *ruleId, pcdApiStats_t *stats )
+{
+    if ( !stats )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    return PCD_api_malloc_and_send( ruleId, PCD_API_GET_STATS, ( void *)stats, 0 );
+}
+
+static u_int64_t PCD_api_get_time_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (u_int64_t)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
+
+/*! \fn PCD_api_async_send
+ *  \brief Send a request to the PCD, and keep it in flight until its reply is received or it expires
+ *  \param[in] 		ruleId, type, optional parameters, value, callback, cookie
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+static PCD_status_e PCD_api_async_send( const struct ruleId_t *ruleId, pcdApi_e type, const void *ptr, int32_t value,
+                                        pcdApiCallback_t callback, void *cookie, u_int32_t *requestId )
+{
+    pcdApiAsyncRequest_t *request = NULL;
+    pcdApiSession_t *session;
+    IPC_message_t *msg;
+    PCD_status_e retval;
+    u_int32_t msgId, i;
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    session = PCD_api_async_get_session();
+
+    if ( ( !session ) || ( PCD_api_session_find_pcd( session ) != PCD_STATUS_OK ) )
+    {
+        pthread_mutex_unlock( &pcdApiAsyncLock );
+        return PCD_STATUS_NOK;
+    }
+
+    for ( i = 0; ( i < PCD_API_ASYNC_MAX_REQUESTS ) && ( !request ); i++ )
+    {
+        if ( pcdApiAsyncRequests[ i ].msgId == 0 )
+        {
+            request = &pcdApiAsyncRequests[ i ];
+        }
+    }
+
+    if ( !request )
+    {
+        pthread_mutex_unlock( &pcdApiAsyncLock );
+        printf( "pcd: Error: Too many requests in flight\n" );
+        return PCD_STATUS_NOK;
+    }
+
+    retval = PCD_api_alloc_request( session, ruleId, type, ptr, value, &msg, &msgId );
+
+    if ( retval == PCD_STATUS_OK )
+    {
+        /* Never blocks */
+        retval = PCD_api_send_request( session, msg, 0 );
+    }
+
+    if ( retval == PCD_STATUS_OK )
+    {
+        /* The reply is handled only after the lock is released */
+        request->msgId = msgId;
+        request->type = type;
+        request->callback = callback;
+        request->cookie = cookie;
+        request->deadline = PCD_api_get_time_ms() + PCD_api_get_reply_timeout( type );
+
+        if ( requestId )
+        {
+            *requestId = msgId;
+        }
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return retval;
+}
+
+/*! \fn PCD_api_async_get_fd
+ *  \brief Get the file descriptor on which the replies to asynchronous requests are received.
+ *  \param[in,out] 	fd
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_async_get_fd( int32_t *fd )
+{
+    pcdApiSession_t *session;
+    PCD_status_e retval = PCD_STATUS_NOK;
+
+    if ( !fd )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    session = PCD_api_async_get_session();
+
+    if ( ( session ) && ( IPC_get_fd( session->myCtx, fd ) == IPC_STATUS_OK ) )
+    {
+        retval = PCD_STATUS_OK;
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return retval;
+}
+
+/*! \fn PCD_api_async_start_process
+ *  \brief Start a process associated with a rule, without waiting for the reply
+ *  \param[in] 		ruleId, optional parameters, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_start_process( const struct ruleId_t *ruleId, const char *optionalParams, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId )
+{
+    return PCD_api_async_send( ruleId, PCD_API_START_PROCESS, optionalParams, -1, callback, cookie, requestId );
+}
+
+/*! \fn PCD_api_async_signal_process
+ *  \brief Signal a process associated with a rule, without waiting for the reply
+ *  \param[in] 		ruleId, signal id, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_signal_process( const struct ruleId_t *ruleId, int32_t sig, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId )
+{
+    return PCD_api_async_send( ruleId, PCD_API_SIGNAL_PROCESS, NULL, sig, callback, cookie, requestId );
+}
+
+/*! \fn PCD_api_async_terminate_process
+ *  \brief Terminate a process associated with a rule. The request completes when the process has terminated.
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_terminate_process( const struct ruleId_t *ruleId, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId )
+{
+    return PCD_api_async_send( ruleId, PCD_API_TERMINATE_PROCESS_SYNC, NULL, -1, callback, cookie, requestId );
+}
+
+/*! \fn PCD_api_async_kill_process
+ *  \brief Kill a process associated with a rule, without waiting for the reply
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_kill_process( const struct ruleId_t *ruleId, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId )
+{
+    return PCD_api_async_send( ruleId, PCD_API_KILL_PROCESS, NULL, -1, callback, cookie, requestId );
+}
+
+/*! \fn PCD_api_async_get_rule_state
+ *  \brief Get rule state, without waiting for the reply
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	requestId, optional
+ *  \return			PCD_STATUS_OK - Request sent, <0 - Error
+ */
+PCD_status_e PCD_api_async_get_rule_state( const struct ruleId_t *ruleId, pcdApiCallback_t callback, void *cookie, u_int32_t *requestId )
+{
+    return PCD_api_async_send( ruleId, PCD_API_GET_RULE_STATE, NULL, -1, callback, cookie, requestId );
+}
+
+/*! \fn PCD_api_async_complete
+ *  \brief Complete a request, and call its callback. Called with the lock held, which is released meanwhile.
+ *  \param[in] 		request, status, rule state
+ *  \return			None
+ */
+static void PCD_api_async_complete( pcdApiAsyncRequest_t *request, PCD_status_e status, pcdApiRuleState_e ruleState )
+{
+    pcdApiAsyncRequest_t done = *request;
+
+    /* Free the entry first, the callback may send new requests */
+    request->msgId = 0;
+
+    if ( done.callback )
+    {
+        pthread_mutex_unlock( &pcdApiAsyncLock );
+        done.callback( done.msgId, status, ruleState, done.cookie );
+        pthread_mutex_lock( &pcdApiAsyncLock );
+    }
+}
+
+/*! \fn PCD_api_event_match
+ *  \brief Check if a rule matches the rule ID of a subscription
+ *  \param[in] 		rule ID of the subscription, rule ID
+ *  \return			True - Match, False - No match
+ */
+static bool_t PCD_api_event_match( const ruleId_t *pattern, const ruleId_t *ruleId )
+{
+    if ( !strcmp( pattern->groupName, PCD_API_ANY ) )
+    {
+        return True;
+    }
+
+    if ( strncmp( pattern->groupName, ruleId->groupName, PCD_RULEID_MAX_GROUP_NAME_SIZE ) )
+    {
+        return False;
+    }
+
+    return ( !strcmp( pattern->ruleName, PCD_API_ANY ) ) || ( !strncmp( pattern->ruleName, ruleId->ruleName, PCD_RULEID_MAX_RULE_NAME_SIZE ) );
+}
+
+/*! \fn PCD_api_async_call_handler
+ *  \brief Call the callback of a subscription. Called with the lock held, which is released meanwhile.
+ *  \param[in] 		subscription, rule ID, rule state
+ *  \return			None
+ */
+static void PCD_api_async_call_handler( const pcdApiEventHandler_t *handler, const ruleId_t *ruleId, pcdApiRuleState_e ruleState )
+{
+    pcdApiEventHandler_t called = *handler;
+
+    /* The callback may subscribe or unsubscribe */
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+    called.callback( ruleId, ruleState, called.cookie );
+    pthread_mutex_lock( &pcdApiAsyncLock );
+}
+
+/*! \fn PCD_api_async_handle_events
+ *  \brief Call the callbacks of the subscriptions which match the events of a message, and free it.
+ *  Called with the lock held.
+ *  \param[in] 		event message
+ *  \return			Number of called callbacks
+ */
+static int32_t PCD_api_async_handle_events( IPC_message_t *eventMsg )
+{
+    pcdApiReplyMessage_t *eventData = IPC_get_msg( eventMsg );
+    int32_t handled = 0;
+    u_int32_t i, j;
+
+    if ( ( eventMsg->size < sizeof( IPC_message_t ) + PCD_API_REPLY_MESSAGE_SIZE( PCD_API_EVENT ) ) ||
+         ( eventData->events.numEvents > PCD_API_EVENT_MAX_ENTRIES ) )
+    {
+        IPC_free_msg( eventMsg );
+        return 0;
+    }
+
+    /* Events were lost before these, all the subscriptions should read the rule states again */
+    if ( eventData->retval != PCD_STATUS_OK )
+    {
+        for ( j = 0; j < PCD_API_MAX_SUBSCRIPTIONS; j++ )
+        {
+            if ( pcdApiEventHandlers[ j ].subscriptionId != 0 )
+            {
+                PCD_api_async_call_handler( &pcdApiEventHandlers[ j ], NULL, PCD_API_RULE_IDLE );
+                handled++;
+            }
+        }
+    }
+
+    for ( i = 0; i < eventData->events.numEvents; i++ )
+    {
+        pcdApiEvent_t *event = &eventData->events.entries[ i ];
+
+        for ( j = 0; j < PCD_API_MAX_SUBSCRIPTIONS; j++ )
+        {
+            if ( ( pcdApiEventHandlers[ j ].subscriptionId != 0 ) &&
+                 ( PCD_api_event_match( &pcdApiEventHandlers[ j ].ruleId, &event->ruleId ) ) )
+            {
+                PCD_api_async_call_handler( &pcdApiEventHandlers[ j ], &event->ruleId, event->ruleState );
+                handled++;
+            }
+        }
+    }
+
+    IPC_free_msg( eventMsg );
+
+    return handled;
+}
+
+/*! \fn PCD_api_async_dispatch
+ *  \brief Handle the received replies, events and the expired requests, and call their callbacks. Never blocks.
+ *  \param[in] 		None
+ *  \param[in,out] 	None
+ *  \return			Number of completed requests and handled events - Success, <0 - Error
+ */
+int32_t PCD_api_async_dispatch( void )
+{
+    pcdApiSession_t *session;
+    IPC_message_t *replyMsg;
+    int32_t completed = 0;
+    u_int64_t now;
+    u_int32_t i;
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    session = PCD_api_async_get_session();
+
+    if ( !session )
+    {
+        pthread_mutex_unlock( &pcdApiAsyncLock );
+        return PCD_STATUS_NOK;
+    }
+
+    /* Handle all the received replies */
+    while ( IPC_wait_msg( session->myCtx, &replyMsg, IPC_TIMEOUT_IMMEDIATE ) == 0 )
+    {
+        pcdApiReplyMessage_t *replyData = IPC_get_msg( replyMsg );
+        pcdApiRuleState_e ruleState = PCD_API_RULE_IDLE;
+        PCD_status_e status;
+
+        if ( replyData->msgId == 0 )
+        {
+            /* State change events of the subscriptions */
+            completed += PCD_api_async_handle_events( replyMsg );
+            continue;
+        }
+
+        for ( i = 0; i < PCD_API_ASYNC_MAX_REQUESTS; i++ )
+        {
+            if ( ( pcdApiAsyncRequests[ i ].msgId != 0 ) && ( pcdApiAsyncRequests[ i ].msgId == replyData->msgId ) )
+            {
+                break;
+            }
+        }
+
+        if ( i < PCD_API_ASYNC_MAX_REQUESTS )
+        {
+            /* Only the rule state is returned asynchronously */
+            status = PCD_api_handle_reply( pcdApiAsyncRequests[ i ].type,
+                                           ( pcdApiAsyncRequests[ i ].type == PCD_API_GET_RULE_STATE ) ? &ruleState : NULL, replyData );
+            IPC_free_msg( replyMsg );
+
+            PCD_api_async_complete( &pcdApiAsyncRequests[ i ], status, ruleState );
+            completed++;
+        }
+        else
+        {
+            /* A late reply to an expired or cancelled request */
+            IPC_free_msg( replyMsg );
+        }
+    }
+
+    /* Expire the requests which were not answered in time */
+    now = PCD_api_get_time_ms();
+
+    for ( i = 0; i < PCD_API_ASYNC_MAX_REQUESTS; i++ )
+    {
+        if ( ( pcdApiAsyncRequests[ i ].msgId != 0 ) && ( pcdApiAsyncRequests[ i ].deadline <= now ) )
+        {
+            /* Look up the PCD again on the next request, it may have restarted */
+            session->pcdCtxValid = False;
+
+            PCD_api_async_complete( &pcdApiAsyncRequests[ i ], PCD_STATUS_TIMEOUT, PCD_API_RULE_IDLE );
+            completed++;
+        }
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return completed;
+}
+
+/*! \fn PCD_api_async_get_timeout
+ *  \brief Get the time until the next request expires, to be used as the timeout of the event loop
+ *  \param[in] 		None
+ *  \param[in,out] 	None
+ *  \return			Time in ms, -1 if there are no requests in flight
+ */
+int32_t PCD_api_async_get_timeout( void )
+{
+    u_int64_t now = PCD_api_get_time_ms();
+    int32_t timeout = -1;
+    u_int32_t i;
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    for ( i = 0; i < PCD_API_ASYNC_MAX_REQUESTS; i++ )
+    {
+        if ( pcdApiAsyncRequests[ i ].msgId != 0 )
+        {
+            int32_t left = ( pcdApiAsyncRequests[ i ].deadline > now ) ? (int32_t)( pcdApiAsyncRequests[ i ].deadline - now ) : 0;
+
+            if ( ( timeout < 0 ) || ( left < timeout ) )
+            {
+                timeout = left;
+            }
+        }
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return timeout;
+}
+
+/*! \fn PCD_api_async_cancel
+ *  \brief Cancel a request in flight, its callback is not called
+ *  \param[in] 		requestId
+ *  \param[in,out] 	None
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_async_cancel( u_int32_t requestId )
+{
+    PCD_status_e retval = PCD_STATUS_BAD_PARAMS;
+    u_int32_t i;
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    for ( i = 0; ( i < PCD_API_ASYNC_MAX_REQUESTS ) && ( requestId != 0 ); i++ )
+    {
+        if ( pcdApiAsyncRequests[ i ].msgId == requestId )
+        {
+            pcdApiAsyncRequests[ i ].msgId = 0;
+            retval = PCD_STATUS_OK;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return retval;
+}
+
+/*! \fn PCD_api_batch
+ *  \brief Send several requests to the PCD in a single message, and wait for the results of all the entries
+ *  \param[in] 		Number of entries, up to PCD_API_BATCH_MAX_ENTRIES
+ *  \param[in,out] 	entries, the results are returned in the retval and ruleState fields
+ *  \return			PCD_STATUS_OK - All the entries succeeded, <0 - Error of the first failed entry, or of the request
+ */
+PCD_status_e PCD_api_batch( pcdApiBatchEntry_t *entries, u_int32_t numEntries )
+{
+    static const pcdApi_e batchTypes[] =
+    {
+        [ PCD_API_BATCH_START_PROCESS ] = PCD_API_START_PROCESS,
+        [ PCD_API_BATCH_TERMINATE_PROCESS ] = PCD_API_TERMINATE_PROCESS,
+        [ PCD_API_BATCH_KILL_PROCESS ] = PCD_API_KILL_PROCESS,
+        [ PCD_API_BATCH_SIGNAL_PROCESS ] = PCD_API_SIGNAL_PROCESS,
+        [ PCD_API_BATCH_GET_RULE_STATE ] = PCD_API_GET_RULE_STATE,
+    };
+    pcdApiBatchCall_t call;
+    PCD_status_e retval;
+    u_int32_t i, used = 0;
+
+    if ( ( !entries ) || ( numEntries == 0 ) || ( numEntries > PCD_API_BATCH_MAX_ENTRIES ) )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    memset( &call, 0, sizeof( call ) );
+    call.batch.numEntries = numEntries;
+
+    for ( i = 0; i < numEntries; i++ )
+    {
+        pcdApiBatchRequest_t *request = &call.batch.entries[ i ];
+
+        if ( ( (u_int32_t)entries[ i ].op >= sizeof( batchTypes ) / sizeof( batchTypes[ 0 ] ) ) ||
+             ( !entries[ i ].ruleId.groupName[ 0 ] ) || ( !entries[ i ].ruleId.ruleName[ 0 ] ) )
+        {
+            printf( "pcd: Error: Invalid batch entry %u\n", i );
+            return PCD_STATUS_BAD_PARAMS;
+        }
+
+        /* Kept if the PCD does not reply */
+        call.results[ i ].retval = PCD_STATUS_NOK;
+
+        memcpy( &request->ruleId, &entries[ i ].ruleId, sizeof( ruleId_t ) );
+        request->type = batchTypes[ entries[ i ].op ];
+        request->sig = entries[ i ].sig;
+
+        if ( ( entries[ i ].op == PCD_API_BATCH_START_PROCESS ) && ( entries[ i ].optionalParams ) )
+        {
+            size_t len = strlen( entries[ i ].optionalParams ) + 1;
+
+            /* The optional parameters of all the entries share the strings buffer */
+            if ( ( len > CONFIG_PCD_MAX_PARAM_SIZE ) || ( used + len > PCD_API_BATCH_STRINGS_SIZE ) )
+            {
+                printf( "pcd: Error: Optional parameters of batch entry %u do not fit\n", i );
+                return PCD_STATUS_BAD_PARAMS;
+            }
+
+            memcpy( &call.batch.strings[ used ], entries[ i ].optionalParams, len );
+            request->paramsOffset = used + 1;
+            used += len;
+        }
+    }
+
+    retval = PCD_api_malloc_and_send( NULL, PCD_API_BATCH, &call, 0 );
+
+    for ( i = 0; i < numEntries; i++ )
+    {
+        entries[ i ].retval = call.results[ i ].retval;
+        entries[ i ].ruleState = call.results[ i ].ruleState;
+    }
+
+    return retval;
+}
+
+/*! \fn PCD_api_new_subscription_id
+ *  \brief Get a new subscription ID, zero is never used
+ *  \param[in] 		None
+ *  \return			Subscription ID
+ */
+static u_int32_t PCD_api_new_subscription_id( void )
+{
+    u_int32_t subscriptionId;
+
+    do
+    {
+        subscriptionId = __sync_add_and_fetch( &pcdApiSubscriptionId, 1 );
+
+    } while ( subscriptionId == 0 );
+
+    return subscriptionId;
+}
+
+/*! \fn PCD_api_subscribe
+ *  \brief Subscribe to the state changes of a rule, of the rules of a group, or of all the rules
+ *  \param[in] 		ruleId, callback, cookie passed to the callback
+ *  \param[in,out] 	subscriptionId, optional
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_subscribe( const struct ruleId_t *ruleId, pcdApiEventCallback_t callback, void *cookie, u_int32_t *subscriptionId )
+{
+    pcdApiEventHandler_t *handler = NULL;
+    pcdApiSubscription_t subscription;
+    pcdApiSession_t *session;
+    ruleId_t pattern;
+    PCD_status_e retval;
+    u_int32_t i;
+
+    if ( !callback )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    /* All the rules if no rule is given */
+    memset( &pattern, 0, sizeof( pattern ) );
+
+    if ( ( ruleId ) && ( strcmp( ruleId->groupName, PCD_API_ANY ) ) )
+    {
+        memcpy( &pattern, ruleId, sizeof( ruleId_t ) );
+    }
+    else
+    {
+        strcpy( pattern.groupName, PCD_API_ANY );
+        strcpy( pattern.ruleName, PCD_API_ANY );
+    }
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    /* The events are received on the session of the asynchronous requests */
+    session = PCD_api_async_get_session();
+
+    for ( i = 0; ( i < PCD_API_MAX_SUBSCRIPTIONS ) && ( !handler ); i++ )
+    {
+        if ( pcdApiEventHandlers[ i ].subscriptionId == 0 )
+        {
+            handler = &pcdApiEventHandlers[ i ];
+        }
+    }
+
+    if ( ( !session ) || ( !handler ) )
+    {
+        pthread_mutex_unlock( &pcdApiAsyncLock );
+
+        if ( !handler )
+        {
+            printf( "pcd: Error: Too many subscriptions\n" );
+        }
+
+        return PCD_STATUS_NOK;
+    }
+
+    /* Ready before the PCD sends the first event */
+    handler->subscriptionId = PCD_api_new_subscription_id();
+    handler->ruleId = pattern;
+    handler->callback = callback;
+    handler->cookie = cookie;
+
+    subscription.subscriptionId = handler->subscriptionId;
+    subscription.context = session->myCtx;
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    retval = PCD_api_malloc_and_send( &pattern, PCD_API_SUBSCRIBE, &subscription, 0 );
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    for ( i = 0; i < PCD_API_MAX_SUBSCRIPTIONS; i++ )
+    {
+        if ( pcdApiEventHandlers[ i ].subscriptionId == subscription.subscriptionId )
+        {
+            if ( retval != PCD_STATUS_OK )
+            {
+                pcdApiEventHandlers[ i ].subscriptionId = 0;
+            }
+            else if ( subscriptionId )
+            {
+                *subscriptionId = subscription.subscriptionId;
+            }
+        }
+    }
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return retval;
+}
+
+/*! \fn PCD_api_unsubscribe
+ *  \brief Cancel a subscription
+ *  \param[in] 		subscriptionId
+ *  \param[in,out] 	None
+ *  \return			PCD_STATUS_OK - Success, <0 - Error
+ */
+PCD_status_e PCD_api_unsubscribe( u_int32_t subscriptionId )
+{
+    pcdApiSubscription_t subscription;
+    pcdApiSession_t *session;
+    u_int32_t i;
+
+    pthread_mutex_lock( &pcdApiAsyncLock );
+
+    session = PCD_api_async_get_session();
+
+    for ( i = 0; ( i < PCD_API_MAX_SUBSCRIPTIONS ) && ( subscriptionId != 0 ); i++ )
+    {
+        if ( pcdApiEventHandlers[ i ].subscriptionId == subscriptionId )
+        {
+            break;
+        }
+    }
+
+    if ( ( !session ) || ( subscriptionId == 0 ) || ( i == PCD_API_MAX_SUBSCRIPTIONS ) )
+    {
+        pthread_mutex_unlock( &pcdApiAsyncLock );
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    /* No more callbacks, even if the PCD does not reply */
+    pcdApiEventHandlers[ i ].subscriptionId = 0;
+
+    subscription.subscriptionId = subscriptionId;
+    subscription.context = session->myCtx;
+
+    pthread_mutex_unlock( &pcdApiAsyncLock );
+
+    return PCD_api_malloc_and_send( NULL, PCD_API_UNSUBSCRIBE, &subscription, 0 );
+}
+
+/*! \fn PCD_api_wait_rule_state
+ *  \brief Wait until a rule reaches a state, or until the timeout expires
+ *  \param[in] 		ruleId, rule state, timeout in ms
+ *  \param[in,out] 	None
+ *  \return			PCD_STATUS_OK - The rule is in the state, PCD_STATUS_TIMEOUT - Timeout, <0 - Error
+ */
+PCD_status_e PCD_api_wait_rule_state( const struct ruleId_t *ruleId, pcdApiRuleState_e ruleState, u_int32_t timeout )
+{
+    u_int64_t deadline = PCD_api_get_time_ms() + timeout;
+    pcdApiSubscription_t subscription;
+    pcdApiRuleState_e currentState;
+    pcdApiSession_t *session;
+    IPC_message_t *eventMsg;
+    PCD_status_e retval;
+    u_int32_t i;
+
+    if ( !ruleId )
+    {
+        return PCD_STATUS_BAD_PARAMS;
+    }
+
+    session = PCD_api_get_session();
+
+    if ( !session )
+    {
+        return PCD_STATUS_NOK;
+    }
+
+    /* The events are received on the session of the calling thread. Subscribe before
+       reading the state, so no state change is missed */
+    subscription.subscriptionId = PCD_api_new_subscription_id();
+    subscription.context = session->myCtx;
+
+    retval = PCD_api_malloc_and_send( ruleId, PCD_API_SUBSCRIBE, &subscription, 0 );
+
+    if ( retval != PCD_STATUS_OK )
+    {
+        return retval;
+    }
+
+    retval = PCD_api_get_rule_state( ruleId, &currentState );
+
+    while ( ( retval == PCD_STATUS_OK ) && ( currentState != ruleState ) )
+    {
+        u_int64_t now = PCD_api_get_time_ms();
+        pcdApiReplyMessage_t *eventData;
+
+        if ( ( now >= deadline ) || ( IPC_wait_msg( session->myCtx, &eventMsg, ( IPC_timeout_e )( deadline - now ) ) != 0 ) )
+        {
+            retval = PCD_STATUS_TIMEOUT;
+            break;
+        }
+
+        eventData = IPC_get_msg( eventMsg );
+
+        /* Late replies to earlier requests are dropped */
+        if ( ( eventData->msgId == 0 ) && ( eventMsg->size >= sizeof( IPC_message_t ) + PCD_API_REPLY_MESSAGE_SIZE( PCD_API_EVENT ) ) )
+        {
+            if ( eventData->retval != PCD_STATUS_OK )
+            {
+                /* Events were lost, read the state again */
+                IPC_free_msg( eventMsg );
+                retval = PCD_api_get_rule_state( ruleId, &currentState );
+                continue;
+            }
+
+            for ( i = 0; ( i < eventData->events.numEvents ) && ( i < PCD_API_EVENT_MAX_ENTRIES ) && ( currentState != ruleState ); i++ )
+            {
+                if ( PCD_api_event_match( ruleId, &eventData->events.entries[ i ].ruleId ) )
+                {
+                    currentState = eventData->events.entries[ i ].ruleState;
+                }
+            }
+        }
+
+        IPC_free_msg( eventMsg );
+    }
+
+    /* Remove the subscription of this call */
+    PCD_api_malloc_and_send( NULL, PCD_API_UNSUBSCRIBE, &subscription, 0 );
+
+    return retval;
+}
@@ -0,0 +1,156 @@
+/*
+ * pool.c
+ * Description:
+ * PCD object pools implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "system_types.h"
+#include "pool.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+/* Objects are aligned for any type they may hold */
+#define PCD_POOL_ALIGN              sizeof( long long )
+
+/* Pools which allocated a slab */
+static pool_t *poolList = NULL;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static u_int32_t PCD_pool_obj_size( pool_t *pool )
+{
+    u_int32_t size = pool->objSize;
+
+    /* A free object holds the free list link */
+    if ( size < sizeof( void * ) )
+        size = sizeof( void * );
+
+    return ( size + PCD_POOL_ALIGN - 1 ) & ~( PCD_POOL_ALIGN - 1 );
+}
+
+static PCD_status_e PCD_pool_grow( pool_t *pool )
+{
+    u_int32_t objSize = PCD_pool_obj_size( pool );
+    char *slab;
+    u_int32_t i;
+
+#ifdef CONFIG_PCD_POOL_FIXED
+    /* A fixed pool never grows beyond its first slab */
+    if ( pool->numSlabs )
+        return PCD_STATUS_NOK;
+#endif
+
+    slab = malloc( objSize * pool->slabObjs );
+
+    if ( !slab )
+        return PCD_STATUS_NOK;
+
+    /* Thread the new objects on the free list */
+    for ( i = 0; i < pool->slabObjs; i++ )
+    {
+        void **obj = (void **)( slab + ( i * objSize ) );
+
+        *obj = pool->freeList;
+        pool->freeList = obj;
+    }
+
+    if ( !pool->numSlabs )
+    {
+        pool->next = poolList;
+        poolList = pool;
+    }
+
+    pool->numSlabs++;
+
+    return PCD_STATUS_OK;
+}
+
+void *PCD_pool_alloc( pool_t *pool )
+{
+    void **obj;
+
+    if ( ( !pool->freeList ) && ( PCD_pool_grow( pool ) != PCD_STATUS_OK ) )
+    {
+        pool->failures++;
+        return NULL;
+    }
+
+    obj = pool->freeList;
+    pool->freeList = *obj;
+
+    if ( ++pool->used > pool->highWater )
+        pool->highWater = pool->used;
+
+    memset( obj, 0, pool->objSize );
+
+    return obj;
+}
+
+void PCD_pool_free( pool_t *pool, void *obj )
+{
+    if ( !obj )
+        return;
+
+    *(void **)obj = pool->freeList;
+    pool->freeList = obj;
+    pool->used--;
+}
+
+pool_t *PCD_pool_get_first( void )
+{
+    return poolList;
+}
+
+void PCD_pool_dump( void )
+{
+    pool_t *pool;
+
+    for ( pool = poolList; pool; pool = pool->next )
+    {
+        fprintf( stdout, PCD_PRINT_PREFIX "Pool %s: object size %u, in use %u, high-water %u, capacity %u%s, failures %u.\n",
+                 pool->name, pool->objSize, pool->used, pool->highWater, pool->numSlabs * pool->slabObjs,
+#ifdef CONFIG_PCD_POOL_FIXED
+                 " (fixed)",
+#else
+                 "",
+#endif
+                 pool->failures );
+    }
+
+    fflush( stdout );
+}
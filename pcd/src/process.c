@@ -23,6 +23,8 @@
  *   can be executed as an arbitrary user.
  * - Hai Shalom: Experimental: support uClinux vfork instead of fork for 
  *   MMU-less platforms.
+ * - Command line is prepared before spawning, support vfork and posix_spawn
+ *   on all platforms.
  */
 
 /* Author:
@@ -52,18 +54,30 @@
 #include <sys/stat.h>
 #include <sys/ucontext.h>
 #include <sys/time.h>
+#include <sys/signalfd.h>
 #include <fcntl.h>
 #include <sched.h>
 #include "rules_db.h"
+#include "cmdline.h"
 #include "process.h"
+#include "pool.h"
 #include "timer.h"
+#include "trace.h"
+#include "stats.h"
 #include "pcd.h"
 #include "except.h"
 #include "pcd_api.h"
+#include "event.h"
 #include "ipc.h"
 
 #include "sys/resource.h"
 
+/* The configuration is known only after pcd.h */
+#ifdef CONFIG_PCD_USE_POSIX_SPAWN
+#include <spawn.h>
+extern char **environ;
+#endif
+
 /**************************************************************************/
 /*      LOCAL DEFINITIONS AND VARIABLES                                   */
 /**************************************************************************/
@@ -71,7 +85,26 @@ extern int32_t errno;
 
 procObj_t *procList = NULL;
 
-#define PCD_PROCESS_MAX_PARAMS 32
+PCD_POOL_DECLARE( procPool, "processes", procObj_t, CONFIG_PCD_POOL_PROCESSES );
+
+/* Exited processes, waiting to be handled by the state machine */
+static procObj_t *exitQueue = NULL;
+
+/* Live processes hashed by pid, must be a power of 2 */
+#define PCD_PROCESS_PID_HASH_SIZE   256
+#define PCD_PROCESS_PID_HASH( pid ) ( (u_int32_t)( pid ) & ( PCD_PROCESS_PID_HASH_SIZE - 1 ) )
+
+static procObj_t *pidHash[ PCD_PROCESS_PID_HASH_SIZE ];
+
+/* Process state transition times in ms */
+#define PCD_PROCESS_STARTING_TIME   4500    /* Starting until considered running */
+#define PCD_PROCESS_KILL_TIME       10000   /* Stop signal until SIGKILL of a non-responsive process, unless STOP_TIMEOUT is set */
+#define PCD_PROCESS_RETRY_TIME      1500    /* Retry of a failed stop handling, or wait for a killed process to exit */
+
+/* Time spent on spawning processes in a single main loop iteration, in usec. The rest are spawned in
+   the next iterations, after the API requests are handled */
+#define PCD_PROCESS_SPAWN_BUDGET_US 5000
+
 #define PCD_PROCESS_NAME       "/var/pcd_proc"
 
 #define NODE_ADD(head, node)    \
@@ -101,29 +134,72 @@ procObj_t *procList = NULL;
         sigaction(sig, &sa, 0L); \
     }
 
-#define PCD_PROCESS_WHITE_SPACES    " \t\n\r"
-
-#ifdef PCD_USE_VFORK
+#if defined( CONFIG_PCD_USE_VFORK ) || defined( CONFIG_PCD_USE_POSIX_SPAWN )
 #define __fork vfork
-#define __exit exit
 #else
 #define __fork fork
-#define __exit _exit
 #endif
 
+
 /* Signal handlers */
 static void PCD_process_terminate(int signo, siginfo_t *info, void *context);
 static void PCD_process_chld(pid_t pid, int st);
-static void PCD_process_chld_handler(int p);
+static void PCD_process_reap( void );
+static void PCD_process_signal_handler( int32_t fd, void *data );
+
+/* Synchronous signals, delivered through the main loop */
+static int32_t signalFd = -1;
+static sigset_t signalMask;
+
+/* Shutdown sequence. Rules are stopped after all the rules that depend on them have stopped */
+static bool_t shuttingDown = False;
+static u_int32_t shutdownRules = 0;     /* Rules which did not stop yet */
+static u_int32_t shutdownProcs = 0;     /* Processes being stopped */
+
+/* Sending a signal to a process, by pid or by pidfd */
+static int32_t PCD_process_send_signal( procObj_t *proc, int32_t sig );
+
+#ifdef CONFIG_PCD_USE_PIDFD
+#include <sys/syscall.h>
+
+/* Older C libraries do not define the pidfd system calls */
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open              434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal       424
+#endif
+
+/* The running kernel supports pidfd, each child is watched through its own descriptor */
+static bool_t pidfdSupported = False;
+
+static void PCD_process_pidfd_open( procObj_t *proc );
+static void PCD_process_pidfd_close( procObj_t *proc );
+static void PCD_process_pidfd_handler( int32_t fd, void *data );
+static void PCD_process_pidfd_orphan_handler( int32_t fd, void *data );
+#endif
 
 /* Internal functions */
-static procObj_t *PCD_process_find_by_state(procObj_t *p, procState_e state);
+static void PCD_process_hash_add( procObj_t *proc );
+static void PCD_process_hash_del( procObj_t *proc );
+static procObj_t *PCD_process_find_by_pid( pid_t pid );
+static PCD_status_e PCD_process_handle_stopped( procObj_t *p );
 static void PCD_process_free( procObj_t *ptr );
 static procObj_t *PCD_process_spawn(procObj_t *proc);
+static void PCD_process_exec( rule_t *rule, char **args, const char *redirect );
+#ifdef CONFIG_PCD_USE_POSIX_SPAWN
+static pid_t PCD_process_posix_spawn( rule_t *rule, char **args, const char *redirect );
+#endif
 static procObj_t *PCD_process_new( rule_t *rule );
 static void PCD_process_free( procObj_t *ptr );
 static PCD_status_e PCD_process_trigger_action( rule_t *rule );
 
+/* Shutdown sequence functions */
+static void PCD_process_shutdown( void );
+static void PCD_process_shutdown_stop( rule_t *rule );
+static void PCD_process_shutdown_release( rule_t *rule );
+static void PCD_process_shutdown_check( void );
+
 char *strsignal( int );
 
 /**************************************************************************/
@@ -217,40 +293,92 @@ static void PCD_process_terminate(int signo, siginfo_t *info, void *context)
     exit(1);
 }
 
-static void PCD_process_chld(pid_t pid, int st)
+static void PCD_process_hash_add( procObj_t *proc )
+{
+    procObj_t **bucket = &pidHash[ PCD_PROCESS_PID_HASH( proc->pid ) ];
+
+    proc->hashNext = *bucket;
+    *bucket = proc;
+}
+
+static void PCD_process_hash_del( procObj_t *proc )
+{
+    procObj_t **bucket = &pidHash[ PCD_PROCESS_PID_HASH( proc->pid ) ];
+
+    while ( *bucket )
+    {
+        if ( *bucket == proc )
+        {
+            *bucket = proc->hashNext;
+            proc->hashNext = NULL;
+            return;
+        }
+
+        bucket = &(*bucket)->hashNext;
+    }
+}
+
+static procObj_t *PCD_process_find_by_pid( pid_t pid )
 {
-    procObj_t *ptr = procList;
+    procObj_t *ptr = pidHash[ PCD_PROCESS_PID_HASH( pid ) ];
 
     while ( ptr )
     {
-        /* Find out what happend to the process, and what is the return code */
         if ( ptr->pid == pid )
-        {
-            if ( WIFEXITED(st) )
-            {
-                ptr->retstat = PCD_PROCESS_RETEXITED;
-                ptr->retcode = WEXITSTATUS(st);
-            }
-            else if ( WIFSIGNALED(st) )
-            {
-                ptr->retstat = PCD_PROCESS_RETSIGNALED;
-                ptr->retcode = WTERMSIG(st);
-            }
-            else if ( WIFSTOPPED(st) )
-            {
-                ptr->retstat = PCD_PROCESS_RETSTOPPED;
-                ptr->retcode = WSTOPSIG(st);
-            }
+            return ptr;
 
-            /* STOPPING is a special case, due to the asynch signal */
-            ptr->state = PCD_PROCESS_STOPPING;
-            break;
-        }
-        ptr = ptr->next;
+        ptr = ptr->hashNext;
+    }
+
+    return NULL;
+}
+
+static void PCD_process_chld(pid_t pid, int st)
+{
+    procObj_t *ptr = PCD_process_find_by_pid( pid );
+
+    /* Not one of ours */
+    if ( !ptr )
+        return;
+
+    PCD_TRACE( ptr->rule, PCD_TRACE_EXIT, st );
+    PCD_stats_process_exited( ptr->rule, st );
+
+    /* Find out what happend to the process, and what is the return code */
+    if ( WIFEXITED(st) )
+    {
+        ptr->retstat = PCD_PROCESS_RETEXITED;
+        ptr->retcode = WEXITSTATUS(st);
+    }
+    else if ( WIFSIGNALED(st) )
+    {
+        ptr->retstat = PCD_PROCESS_RETSIGNALED;
+        ptr->retcode = WTERMSIG(st);
     }
+    else if ( WIFSTOPPED(st) )
+    {
+        ptr->retstat = PCD_PROCESS_RETSTOPPED;
+        ptr->retcode = WSTOPSIG(st);
+    }
+
+    /* The pid is free for reuse from now on */
+    PCD_process_hash_del( ptr );
+
+#ifdef CONFIG_PCD_USE_PIDFD
+    PCD_process_pidfd_close( ptr );
+#endif
+
+    /* Queue the process for PCD_process_iterate_exited, which runs after the
+       timer had a chance to check the exit status against the end condition */
+    ptr->state = PCD_PROCESS_STOPPING;
+    ptr->exitNext = exitQueue;
+    exitQueue = ptr;
+
+    /* Check the end condition of the rule */
+    PCD_timer_notify_rule( ptr->rule );
 }
 
-static void PCD_process_chld_handler(int p)
+static void PCD_process_reap( void )
 {
     int st;
     pid_t pid;
@@ -261,289 +389,313 @@ static void PCD_process_chld_handler(int p)
     }
 }
 
-static procObj_t *PCD_process_spawn(procObj_t *proc)
+static void PCD_process_signal_handler( int32_t fd, void *data )
 {
-    pid_t pid;
-    sigset_t nmask, omask;
-    int i;
-    char *args[PCD_PROCESS_MAX_PARAMS+3];
-    procObj_t *next;
-    char params[ CONFIG_PCD_MAX_PARAM_SIZE ] = { 0};
-    rule_t *rule;
+    struct signalfd_siginfo info;
 
-    /* Check validity of parameters */
-    if ( !proc )
-        return NULL;
+    /* Drain the pending signals. SIGCHLD instances are merged by the kernel,
+       so the reaping below collects all the exited children anyway */
+    while ( read( fd, &info, sizeof( info ) ) == sizeof( info ) )
+    {
+        if ( ( info.ssi_signo == SIGTERM ) || ( info.ssi_signo == SIGINT ) )
+        {
+            PCD_process_shutdown();
+        }
+        else if ( info.ssi_signo == SIGUSR1 )
+        {
+            /* Memory usage report */
+            PCD_pool_dump();
+        }
+    }
 
-    rule = proc->rule;
+    PCD_process_reap();
+}
 
-    if ( !rule )
-        return NULL;
+static int32_t PCD_process_send_signal( procObj_t *proc, int32_t sig )
+{
+    /* Never signal a reaped process, its pid may belong to someone else by now */
+    if ( proc->retstat != PCD_PROCESS_RETNOTHING )
+    {
+        errno = ESRCH;
+        return -1;
+    }
 
-    sigemptyset(&nmask);
-    sigaddset(&nmask, SIGCHLD);
-    sigprocmask(SIG_BLOCK, &nmask, &omask);
+#ifdef CONFIG_PCD_USE_PIDFD
+    if ( proc->pidfd >= 0 )
+    {
+        return syscall( SYS_pidfd_send_signal, proc->pidfd, sig, NULL, 0 );
+    }
+#endif
+
+    return kill( proc->pid, sig );
+}
+
+#ifdef CONFIG_PCD_USE_PIDFD
+static void PCD_process_pidfd_open( procObj_t *proc )
+{
+    if ( !pidfdSupported )
+        return;
 
-    /* Fork, create a child process */
-    pid = __fork();
+    /* The pidfd is close-on-exec by default */
+    proc->pidfd = syscall( SYS_pidfd_open, proc->pid, 0 );
 
-    if ( !pid )
+    if ( proc->pidfd >= 0 )
     {
-        char *token;
-        char vars[ CONFIG_PCD_MAX_PARAM_SIZE ];
-        u_int32_t varsIdx = 0;
+        if ( PCD_event_add( proc->pidfd, PCD_process_pidfd_handler, proc ) == PCD_STATUS_OK )
+            return;
 
-        /* Setup executable name */
-        args[0] = args[1] = rule->command;
-        i = 2;
+        close( proc->pidfd );
+        proc->pidfd = -1;
+    }
 
-        if ( rule->optionalParams )
-        {
-            /* Spawn the process with the optional parameters received by the PCD API */
-            strcpy( params, rule->optionalParams );
-        }
-        else if ( rule->params )
-        {
-            /* Use default parameters */
-            strncpy( params, rule->params, CONFIG_PCD_MAX_PARAM_SIZE - 1 );
-        }
-        else
-        {
-            /* Skip the params handling code */
-            goto no_params;
-        }
+    /* Fall back to SIGCHLD for good. Reaping with waitpid(-1) is safe for the watched
+       processes as well, the pid hash makes sure each exit is handled only once */
+    if ( !sigismember( &signalMask, SIGCHLD ) )
+    {
+        PCD_PRINTF_WARNING_STDOUT( "Failed to open pidfd for process %s (%d), falling back to SIGCHLD", proc->rule->command, proc->pid );
+        sigaddset( &signalMask, SIGCHLD );
+        signalfd( signalFd, &signalMask, 0 );
+    }
+}
 
-        /* Clear parameters array */
-        memset( vars, 0, CONFIG_PCD_MAX_PARAM_SIZE );
+static void PCD_process_pidfd_close( procObj_t *proc )
+{
+    if ( proc->pidfd < 0 )
+        return;
 
-        /* Get first token */
-        token = strtok( params, PCD_PROCESS_WHITE_SPACES );
+    PCD_event_remove( proc->pidfd );
+    close( proc->pidfd );
+    proc->pidfd = -1;
+}
 
-        /* Setup parameters */
-        while ( ( token != NULL ) && ( i < PCD_PROCESS_MAX_PARAMS ) )
-        {
-            char *ptr;
-            char *p_var = NULL;
+static void PCD_process_pidfd_handler( int32_t fd, void *data )
+{
+    procObj_t *proc = data;
+    int st;
 
-            /* Check if we have an environment variable in the parameters list */
-            ptr = strchr( token, '$' );
+    /* The pidfd becomes readable when the process exits */
+    if ( waitpid( proc->pid, &st, WNOHANG ) == proc->pid )
+    {
+        /* Closes the pidfd as well */
+        PCD_process_chld( proc->pid, st );
+    }
+}
 
-            if ( ptr )
-            {
-                char *env = NULL;
-                char *var;
-                char buff[ CONFIG_PCD_MAX_PARAM_SIZE ];
-                char var_name[ 64 ];
+static void PCD_process_pidfd_orphan_handler( int32_t fd, void *data )
+{
+    pid_t pid = (pid_t)(long)data;
+    int st;
 
-                if( ( *(ptr + 1) ) == '{' )
-                {
-                	p_var = strchr( ptr + 2, '}' );
+    /* A killed process which was already deleted, just collect it */
+    if ( waitpid( pid, &st, WNOHANG ) != 0 )
+    {
+        PCD_event_remove( fd );
+        close( fd );
+    }
+}
+#endif
 
-                	if( p_var )
-                	{
-                    	u_int32_t val = p_var - ( ptr + 2 );
+static void PCD_process_exec( rule_t *rule, char **args, const char *redirect )
+{
+    sigset_t nmask;
+    int i;
 
-                		memset( var_name, 0, sizeof( var_name ) );
-                    	if( val >= sizeof( var_name ) )
-                			goto parse_param_next;
+    /* The child may share the memory of the PCD (vfork), only system calls from here on */
+    if ( redirect )
+    {
+        int32_t fd;
 
-                		memcpy( var_name, ptr + 2, val );
-                	}
-                }
+        fd = open( redirect, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+        if ( fd >= 0 )
+        {
+            dup2(fd, 1); // redirect output to the file
+            close(fd);
+        }
+    }
 
-                /* Get the variable value from CONFIG_PCD_TEMP_PATH */
-                {
-                    int32_t fd;
-                    char filename[ 255 ];
+    /* Setup default signals for the new process, all signals are still blocked */
+    for ( i = 1; i < NSIG; i++ )
+        signal(i, SIG_DFL);
 
-                    sprintf( filename, CONFIG_PCD_TEMP_PATH "/%s", var_name );
+    /* Signals are blocked in PCD, unblock all signals in the new process */
+    sigemptyset(&nmask);
+    sigprocmask(SIG_SETMASK, &nmask, 0L);
 
-                    fd =  open( filename, O_RDONLY );
-                    if ( fd > 0 )
-                    {
-                        memset( buff, 0, CONFIG_PCD_MAX_PARAM_SIZE );
+    /* Setup the priority of the process */
+    {
+        struct sched_param setParam;
 
-                        /* Read the variable value from the file */
-                        if ( read( fd, buff, CONFIG_PCD_MAX_PARAM_SIZE-1 ) > 0 )
-                        {
-                            env = buff;
-                        }
-                        close(fd);
-                    }
-                }
+        if ( sched_getparam( 0, &setParam ) == 0 )
+        {
+            if ( rule->sched.type == PCD_SCHED_TYPE_NICE )
+            {
+                setParam.sched_priority = 0;
+                sched_setscheduler( 0, SCHED_OTHER, &setParam );
+                setpriority( PRIO_PROCESS, 0, rule->sched.niceSched );
+            }
+            else
+            {
+                setParam.sched_priority = rule->sched.fifoSched;
+                sched_setscheduler( 0, SCHED_FIFO, &setParam );
+            }
+        }
+    }
 
-                if ( !env )
-                {
-                    /* Perhaps it is in the environment ? */
-                    env = getenv( var_name );
+    /* Change the UID of the process if necessary
+     * Note: If the UID = 0, we do not change the UID because if we're
+     * already root, no need to change to UID 0, and if we're not root,
+     * then we don't allow running as root when PCD is running as a
+     * non-root user */
+    if ( rule->uid )
+    {
+        setreuid( rule->uid, rule->uid );
+    }
 
-                    if ( !env )
-                    {
-                        /* No such variable, ignore */
-                        goto parse_param_next;
-                    }
-                    else
-                    {
-                        memset( buff, 0, CONFIG_PCD_MAX_PARAM_SIZE );
+    /* Execute the file */
+    execvp( args[0], args );
 
-                        /* Copy the value to the temporary buffer */
-                        strncpy( buff, env, CONFIG_PCD_MAX_PARAM_SIZE-1 );
-                        env = buff;
-                    }
-                }
+    /* Not reaching here, unless the execution failed */
+    _exit( SIGABRT );
+}
 
-                /* Copy to a local buffer */
-                strncpy( vars + varsIdx, env, CONFIG_PCD_MAX_PARAM_SIZE-varsIdx-1 );
-                env = &vars[ varsIdx ];
+#ifdef CONFIG_PCD_USE_POSIX_SPAWN
+static pid_t PCD_process_posix_spawn( rule_t *rule, char **args, const char *redirect )
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    struct sched_param schedParam;
+    sigset_t sigs;
+    pid_t pid;
+    int ret;
 
-                /* Advance the index for next buffer */
-                varsIdx += strlen( vars ) + 1;
-                if ( varsIdx >= CONFIG_PCD_MAX_PARAM_SIZE - 1 )
-                {
-                    /* No place in buffer */
-                    varsIdx = CONFIG_PCD_MAX_PARAM_SIZE - 1;
-                }
+    /* posix_spawn cannot change the UID or the nice value, these rules use the fork path */
+    if ( ( rule->uid ) || ( ( rule->sched.type == PCD_SCHED_TYPE_NICE ) && ( rule->sched.niceSched ) ) )
+        return -1;
 
-                /* Replace white spaces with NULLs */
-                if ( (var = strpbrk( env, PCD_PROCESS_WHITE_SPACES ) ) != NULL )
-                {
-                    *var = 0;
-                }
+    if ( posix_spawnattr_init( &attr ) != 0 )
+        return -1;
 
-                while ( i < PCD_PROCESS_MAX_PARAMS )
-                {
-                    /* Init argument */
-                    args[ i ] = env;
+    if ( posix_spawn_file_actions_init( &actions ) != 0 )
+    {
+        posix_spawnattr_destroy( &attr );
+        return -1;
+    }
 
-                    if ( !var )
-                    {
-                    	/* No more arguments in the buffer, look for other strings in the buffer */
-                    	if( p_var )
-                        {
-                        	strncat( env, p_var + 1, CONFIG_PCD_MAX_PARAM_SIZE-varsIdx-1 );
-                        	varsIdx += strlen( p_var + 1 );
-                        }
-                        break;
-                    }
+    /* Unblock all signals and setup default signals for the new process */
+    sigemptyset( &sigs );
+    posix_spawnattr_setsigmask( &attr, &sigs );
+    sigfillset( &sigs );
+    posix_spawnattr_setsigdefault( &attr, &sigs );
 
-                    /* Advance to next argument in the buffer */
-                    env = var + 1;
+    /* Setup the priority of the process */
+    memset( &schedParam, 0, sizeof( schedParam ) );
 
-                    /* Replace white spaces with NULLs */
-                    if ( (var = strpbrk( env, PCD_PROCESS_WHITE_SPACES ) ) != NULL )
-                    {
-                        *var = 0;
-                    }
-                    else
-                    {
-                        if ( !(*env) )
-                        {
-                            /* No more arguments in the buffer, look for other strings in the buffer */
-                            if( p_var )
-                            {
-                            	strncat( args[ i ], p_var + 1, CONFIG_PCD_MAX_PARAM_SIZE-varsIdx-1 );
-                            	varsIdx += strlen( p_var + 1 );
-                            }
-
-                        	break;
-                        }
-                    }
+    if ( rule->sched.type == PCD_SCHED_TYPE_NICE )
+    {
+        posix_spawnattr_setschedpolicy( &attr, SCHED_OTHER );
+    }
+    else
+    {
+        schedParam.sched_priority = rule->sched.fifoSched;
+        posix_spawnattr_setschedpolicy( &attr, SCHED_FIFO );
+    }
 
-                    /* Advance to next index */
-                    i++;
-                }
+    posix_spawnattr_setschedparam( &attr, &schedParam );
 
-                goto parse_param_advance;
-            }
+    posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSCHEDULER
+#ifdef POSIX_SPAWN_USEVFORK
+                              | POSIX_SPAWN_USEVFORK
+#endif
+                            );
 
-            /* Check redirection */
-            ptr = strchr( token, '>' );
+    if ( redirect )
+    {
+        posix_spawn_file_actions_addopen( &actions, 1, redirect, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+    }
 
-            if ( ptr )
-            {
-                /* Get next token */
-                token = strtok( NULL, PCD_PROCESS_WHITE_SPACES );
+    ret = posix_spawnp( &pid, args[0], &actions, &attr, args, environ );
 
-                if ( token )
-                {
-                    int32_t fd;
+    posix_spawn_file_actions_destroy( &actions );
+    posix_spawnattr_destroy( &attr );
 
-                    fd = open( token, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
-                    dup2(fd, 1); // redirect output to the file
-                    close(fd);
-                }
-                goto parse_param_next;
-            }
+    /* On failure, the fork path retries and reports an execution failure as a process exit */
+    return ( ret == 0 ) ? pid : -1;
+}
+#endif
 
-            args[ i ] = token;
+static procObj_t *PCD_process_spawn(procObj_t *proc)
+{
+    pid_t pid = -1;
+    sigset_t nmask, omask;
+    procObj_t *next;
+    rule_t *rule;
+    struct cmdLine_t *cmdLine;
+    const char *redirect;
+    char **args;
 
-            parse_param_advance:
-            /* Advance args index */
-            i++;
+    /* Check validity of parameters */
+    if ( !proc )
+        return NULL;
 
-            parse_param_next:
-            /* Get next token */
-            token = strtok( NULL, PCD_PROCESS_WHITE_SPACES );
-        }
+    rule = proc->rule;
 
-        no_params:
-        args[ i ] = 0;
+    if ( !rule )
+        return NULL;
+
+    /* Prepare the command line in the PCD, the child only executes it.
+       The arguments are shared with a vfork child until it executes */
+    cmdLine = rule->optionalParams ? rule->optionalCmdLine : rule->cmdLine;
+    args = PCD_cmdline_get_args( cmdLine );
+    redirect = PCD_cmdline_get_redirect( cmdLine );
 
-        sigprocmask(SIG_SETMASK, &omask, 0L);
+    if ( !args )
+    {
+        PCD_PRINTF_STDERR( "Failed to prepare the command line of %s", rule->command );
+    }
+    else
+    {
+        PCD_TRACE( rule, PCD_TRACE_SPAWN, 0 );
 
-        /* Setup default signals for the new process */
-        for ( i = 1; i <= NSIG; i++ )
-            signal(i, SIG_DFL);
+#ifdef CONFIG_PCD_USE_POSIX_SPAWN
+        pid = PCD_process_posix_spawn( rule, args, redirect );
 
-        /* Setup the priority of the process */
+        if ( pid < 0 )
+#endif
         {
-            struct sched_param setParam;
+            /* Block all signals, no PCD signal handler may run in the child before it resets them */
+            sigfillset(&nmask);
+            sigprocmask(SIG_BLOCK, &nmask, &omask);
 
-            if ( sched_getparam( pid, &setParam ) == 0 )
+            /* Fork, create a child process */
+            pid = __fork();
+
+            if ( !pid )
             {
-                if ( rule->sched.type == PCD_SCHED_TYPE_NICE )
-                {
-                    setParam.sched_priority = 0;
-                    sched_setscheduler( pid, SCHED_OTHER, &setParam );
-                    setpriority( PRIO_PROCESS, 0, rule->sched.niceSched );
-                }
-                else
-                {
-                    setParam.sched_priority = rule->sched.fifoSched;
-                    sched_setscheduler( pid, SCHED_FIFO, &setParam );
-                }
+                PCD_process_exec( rule, args, redirect );
             }
-        }
-        
-        /* Change the UID of the process if necessary 
-         * Note: If the UID = 0, we do not change the UID because if we're 
-         * already root, no need to change to UID 0, and if we're not root, 
-         * then we don't allow running as root when PCD is running as a 
-         * non-root user */
-        if ( rule->uid )
-        {
-            setreuid( rule->uid, rule->uid );
-        }
 
-        /* Execute the file */
-        if ( execvp(args[1], args+1)<0 )
-        {
-            exit( SIGABRT );
+            sigprocmask(SIG_SETMASK, &omask, 0L);
         }
-
-        /* Not reaching here... */
-        __exit(0);
     }
 
     proc->pid = pid;
     proc->state = PCD_PROCESS_STARTING;
 
-    /* Wait for 3 iterations until marking the process as running-state */
-    proc->tm = 3;
+    if ( pid > 0 )
+    {
+        /* With vfork and posix_spawn the child has already executed, with fork it may not have yet */
+        PCD_TRACE( rule, PCD_TRACE_EXEC, pid );
+        PCD_stats_process_spawned( rule );
+        PCD_process_hash_add( proc );
+#ifdef CONFIG_PCD_USE_PIDFD
+        PCD_process_pidfd_open( proc );
+#endif
+    }
 
-    next = proc->next;
+    /* Wait until marking the process as running-state */
+    proc->deadline = PCD_event_get_time() + PCD_PROCESS_STARTING_TIME;
 
-    sigprocmask(SIG_SETMASK, &omask, 0L);
+    next = proc->next;
 
     return next;
 }
@@ -555,15 +707,15 @@ static procObj_t *PCD_process_new( rule_t *rule )
     if ( !rule )
         return NULL;
 
-    ptr = malloc( sizeof(procObj_t) );
+    ptr = PCD_pool_alloc( &procPool );
 
     if ( ptr )
     {
-        memset( ptr, 0, sizeof(procObj_t) );
         ptr->state = PCD_PROCESS_RUNME;
         ptr->retstat = PCD_PROCESS_RETNOTHING;
         ptr->rule = rule;
         ptr->signaled = False;
+        ptr->pidfd = -1;
     }
 
     return ptr;
@@ -576,18 +728,7 @@ static void PCD_process_free( procObj_t *ptr )
 
     ptr->rule = NULL;
 
-    free(ptr);
-}
-
-static procObj_t *PCD_process_find_by_state(procObj_t *p, procState_e state)
-{
-    while ( p )
-    {
-        if ( p->state == state )
-            return p;
-        p = p->next;
-    }
-    return 0;
+    PCD_pool_free( &procPool, ptr );
 }
 
 PCD_status_e PCD_process_enqueue( rule_t *rule )
@@ -660,7 +801,7 @@ PCD_status_e PCD_process_stop( rule_t *rule, bool_t brutal, void *cookie )
     }
 
     /* Terminate the process immediately */
-    proc->tm = 0;
+    proc->deadline = 0;
 
     /* Setup cookie */
     proc->cookie = cookie;
@@ -675,6 +816,7 @@ PCD_status_e PCD_process_init( void )
 {
     int32_t i;
     struct sigaction sa;
+    sigset_t mask;
 
     /* Ignore all signals! */
     for ( i = 1; i <= NSIG; i++ )
@@ -682,10 +824,68 @@ PCD_status_e PCD_process_init( void )
         signal(i, SIG_IGN);
     }
 
+    /* Child termination is handled synchronously by the main loop. SIGCHLD must
+       not be ignored, otherwise the kernel reaps the children for us */
+    signal(SIGCHLD, SIG_DFL);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, 0L);
+
+    /* Termination requests start the shutdown sequence from the main loop,
+       SIGUSR1 prints the pool statistics */
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGUSR1, SIG_DFL);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, 0L);
+
+    sigemptyset(&signalMask);
+    sigaddset(&signalMask, SIGTERM);
+    sigaddset(&signalMask, SIGINT);
+    sigaddset(&signalMask, SIGUSR1);
+
+#ifdef CONFIG_PCD_USE_PIDFD
+    {
+        int32_t fd;
+
+        /* Probe the running kernel, pidfd_open was introduced in Linux 5.3 */
+        fd = syscall( SYS_pidfd_open, getpid(), 0 );
+
+        if ( fd >= 0 )
+        {
+            close( fd );
+            pidfdSupported = True;
+        }
+        else
+        {
+            PCD_PRINTF_WARNING_STDOUT( "pidfd is not supported by the kernel, using SIGCHLD" );
+        }
+    }
+
+    /* Children are watched through their pidfd, SIGCHLD stays blocked and unread */
+    if ( !pidfdSupported )
+#endif
+    sigaddset(&signalMask, SIGCHLD);
+
+    signalFd = signalfd( -1, &signalMask, SFD_NONBLOCK | SFD_CLOEXEC );
+
+    if ( signalFd < 0 )
+    {
+        PCD_PRINTF_STDERR( "Failed to create signal file descriptor" );
+        return PCD_STATUS_NOK;
+    }
+
+    if ( PCD_event_add( signalFd, PCD_process_signal_handler, NULL ) != PCD_STATUS_OK )
+    {
+        close( signalFd );
+        signalFd = -1;
+        return PCD_STATUS_NOK;
+    }
+
     /* Install signal handlers */
-    SETSIG(sa, SIGCHLD, PCD_process_chld_handler);
-    SETSIGINFO(sa, SIGTERM, PCD_process_terminate);
-    SETSIGINFO(sa, SIGINT,  PCD_process_terminate);
     SETSIGINFO(sa, SIGSEGV, PCD_process_terminate);
     SETSIGINFO(sa, SIGILL,  PCD_process_terminate);
     SETSIGINFO(sa, SIGBUS,  PCD_process_terminate);
@@ -695,9 +895,174 @@ PCD_status_e PCD_process_init( void )
 }
 
 
+static PCD_status_e PCD_process_handle_stopped( procObj_t *p )
+{
+    rule_t *rule = p->rule;
+
+    p->state = PCD_PROCESS_STOPPED;
+
+    /* Disconnect from rule, a completed rule shows its process exited */
+    if ( rule->proc == p )
+    {
+        rule->proc = NULL;
+        PCD_api_notify_rule( rule );
+    }
+
+    /* IPC resource cleanup */
+    PCD_api_cleanup_proc( p->pid );
+    IPC_cleanup_proc( p->pid );
+
+    switch ( p->retstat )
+    {
+        case PCD_PROCESS_RETEXITED:
+
+            /* Check first if the process exited due to PCD termination signal */
+            if ( p->signaled == False )
+            {
+                if ( rule->daemon == True )
+                {
+                    PCD_PRINTF_STDERR( "Process %s (%d) exited unexpectedly (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
+                    if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
+                    {
+                        /* Try again next iteration */
+                        return PCD_STATUS_NOK;
+                    }
+                }
+                else
+                {
+                    bool_t trigger = False;
+
+                    if ( rule->endCondition.type == PCD_END_COND_KEYWORD_EXIT )
+                    {
+                        /* The process has existed with a differnt exit code */
+                        if ( p->retcode != rule->endCondition.exitStatus )
+                        {
+                            trigger = True;
+                        }
+                    }
+                    else
+                    {
+                        if ( p->retcode != 0 )
+                        {
+                            trigger = True;
+                        }
+                    }
+
+                    if ( trigger )
+                    {
+                        PCD_PRINTF_STDERR( "Process %s (%d) exited with result code %d (Rule %s_%s)", rule->command, p->pid, p->retcode, rule->ruleId.groupName, rule->ruleId.ruleName );
+
+                        /* Trigger failure action */
+                        if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
+                        {
+                            /* Try again next iteration */
+                            return PCD_STATUS_NOK;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                if ( p->cookie )
+                {
+                    PCD_api_reply_message( p->cookie, PCD_STATUS_OK );
+                }
+            }
+            break;
+
+        case PCD_PROCESS_RETSIGNALED:
+            /* Nothing to do here, it might be signaled by PCD */
+            if ( p->signaled == False )
+            {
+                if ( rule->daemon == True )
+                {
+                    PCD_PRINTF_STDERR( "Unhandled exception %d (%s) in process %s (%d) (Rule %s_%s)", p->retcode, strsignal( p->retcode ), rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
+                    if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
+                    {
+                        /* Try again next iteration */
+                        return PCD_STATUS_NOK;
+                    }
+                }
+            }
+            else
+            {
+                if ( p->cookie )
+                {
+                    PCD_api_reply_message( p->cookie, PCD_STATUS_OK );
+                }
+            }
+            break;
+
+        case PCD_PROCESS_RETSTOPPED:
+            PCD_PRINTF_STDERR( "Exception %d (%s) caused process %s (%d) to stop (Rule %s_%s)", p->retcode, strsignal( p->retcode ), rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
+            if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
+            {
+                /* Try again next iteration */
+                return PCD_STATUS_NOK;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    PCD_DEBUG_PRINTF("Deleting process %s (%d) (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
+    NODE_DEL(procList, p);
+    PCD_process_hash_del( p );
+
+#ifdef CONFIG_PCD_USE_PIDFD
+    if ( p->pidfd >= 0 )
+    {
+        /* Killed but not reaped yet, keep watching it so it does not remain a zombie */
+        PCD_event_remove( p->pidfd );
+        if ( PCD_event_add( p->pidfd, PCD_process_pidfd_orphan_handler, (void *)(long)p->pid ) != PCD_STATUS_OK )
+        {
+            close( p->pidfd );
+        }
+        p->pidfd = -1;
+    }
+#endif
+
+    /* The rules this one depends on may stop now */
+    if ( p->shutdown )
+    {
+        shutdownProcs--;
+        PCD_process_shutdown_release( rule );
+    }
+
+    p->rule = NULL;
+    PCD_process_free(p);
+
+    return PCD_STATUS_OK;
+}
+
+PCD_status_e PCD_process_iterate_exited( void )
+{
+    /* Hand every exited process to the state machine */
+    while ( exitQueue )
+    {
+        procObj_t *p = exitQueue;
+
+        exitQueue = p->exitNext;
+        p->exitNext = NULL;
+
+        if ( PCD_process_handle_stopped( p ) != PCD_STATUS_OK )
+        {
+            /* Try again later */
+            p->deadline = PCD_event_get_time() + PCD_PROCESS_RETRY_TIME;
+        }
+    }
+
+    PCD_process_shutdown_check();
+
+    return PCD_STATUS_OK;
+}
+
 PCD_status_e PCD_process_iterate_start( void )
 {
     procObj_t *p;
+    u_int64_t now = PCD_event_get_time();
+    u_int64_t deadline = PCD_stats_get_time_us() + PCD_PROCESS_SPAWN_BUDGET_US;
 
     p = procList;
 
@@ -708,18 +1073,19 @@ PCD_status_e PCD_process_iterate_start( void )
         switch ( p->state )
         {
             case PCD_PROCESS_RUNME:
+                /* Nothing starts during shutdown. Spawning blocks until the process executes */
+                if ( ( shuttingDown ) || ( PCD_stats_get_time_us() >= deadline ) )
+                    break;
+
                 PCD_PRINTF_STDOUT( "Starting process %s (Rule %s_%s)", rule->command, rule->ruleId.groupName, rule->ruleId.ruleName );
                 PCD_process_spawn(p);
                 break;
 
             case PCD_PROCESS_STARTING:
-                if ( p->tm == 0 )
+                if ( now >= p->deadline )
                 {
                     p->state = PCD_PROCESS_RUNNING;
-                }
-                else
-                {
-                    p->tm--;
+                    p->deadline = 0;
                 }
                 break;
             default:
@@ -736,6 +1102,7 @@ PCD_status_e PCD_process_iterate_stop( void )
 {
     procObj_t *p;
     procObj_t *next;
+    u_int64_t now = PCD_event_get_time();
 
     p = procList;
 
@@ -746,174 +1113,72 @@ PCD_status_e PCD_process_iterate_stop( void )
         switch ( p->state )
         {
             case PCD_PROCESS_STOPPING:
-                /* Deal with this in the next iteration */
-                p->state = PCD_PROCESS_STOPPED;
-                break;
-
             case PCD_PROCESS_STOPPED:
-                {
-                    /* Disconnect from rule */
-                    if ( rule->proc == p )
-                        rule->proc = NULL;
+                /* Normally handled by PCD_process_iterate_exited, get here on retries */
+                next = p->next;
 
-                    /* IPC resource cleanup */
-                    IPC_cleanup_proc( p->pid );
-
-                    switch ( p->retstat )
-                    {
-                        case PCD_PROCESS_RETEXITED:
-
-                            /* Check first if the process exited due to PCD termination signal */
-                            if ( p->signaled == False )
-                            {
-                                if ( rule->daemon == True )
-                                {
-                                    PCD_PRINTF_STDERR( "Process %s (%d) exited unexpectedly (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
-                                    if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
-                                    {
-                                        /* Try again next iteration */
-                                        continue;
-                                    }
-                                }
-                                else
-                                {
-                                    bool_t trigger = False;
-
-                                    if ( rule->endCondition.type == PCD_END_COND_KEYWORD_EXIT )
-                                    {
-                                        /* The process has existed with a differnt exit code */
-                                        if ( p->retcode != rule->endCondition.exitStatus )
-                                        {
-                                            trigger = True;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        if ( p->retcode != 0 )
-                                        {
-                                            trigger = True;
-                                        }
-                                    }
-
-                                    if ( trigger )
-                                    {
-                                        PCD_PRINTF_STDERR( "Process %s (%d) exited with result code %d (Rule %s_%s)", rule->command, p->pid, p->retcode, rule->ruleId.groupName, rule->ruleId.ruleName );
-
-                                        /* Trigger failure action */
-                                        if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
-                                        {
-                                            /* Try again next iteration */
-                                            continue;
-                                        }
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                if ( p->cookie )
-                                {
-                                    PCD_api_reply_message( p->cookie, PCD_STATUS_OK );
-                                }
-                            }
-                            break;
-
-                        case PCD_PROCESS_RETSIGNALED:
-                            /* Nothing to do here, it might be signaled by PCD */
-                            if ( p->signaled == False )
-                            {
-                                if ( rule->daemon == True )
-                                {
-                                    PCD_PRINTF_STDERR( "Unhandled exception %d (%s) in process %s (%d) (Rule %s_%s)", p->retcode, strsignal( p->retcode ), rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
-                                    if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
-                                    {
-                                        /* Try again next iteration */
-                                        continue;
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                if ( p->cookie )
-                                {
-                                    PCD_api_reply_message( p->cookie, PCD_STATUS_OK );
-                                }
-                            }
-                            break;
-
-                        case PCD_PROCESS_RETSTOPPED:
-                            PCD_PRINTF_STDERR( "Exception %d (%s) caused process %s (%d) to stop (Rule %s_%s)", p->retcode, strsignal( p->retcode ), rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
-                            if ( PCD_process_trigger_action( rule ) != PCD_STATUS_OK )
-                            {
-                                /* Try again next iteration */
-                                continue;
-                            }
-                            break;
-
-                        default:
-                            break;
-                    }
-
-                    next = p->next;
-                    PCD_DEBUG_PRINTF("Deleting process %s (%d) (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
-                    NODE_DEL(procList, p);
-
-                    p->rule = NULL;
-                    PCD_process_free(p);
-                    p = next;
-                    continue;
+                if ( ( now >= p->deadline ) && ( PCD_process_handle_stopped( p ) != PCD_STATUS_OK ) )
+                {
+                    /* Try again later */
+                    p->deadline = now + PCD_PROCESS_RETRY_TIME;
                 }
-                break;
+
+                p = next;
+                continue;
 
             case PCD_PROCESS_TERMME:
-                /* Check if other process is terminating */
-                if ( !PCD_process_find_by_state(procList, PCD_PROCESS_KILLME) )
+                /* Processes are terminated concurrently, each with its own deadline */
+                if ( p->pid > 0 )
                 {
-                    if ( p->pid > 0 )
-                    {
-                        /* Check if corresponding process was already spawned */
-                        p->state = PCD_PROCESS_KILLME;
-
-                        /* Wait for 7 iterations (~10 seconds) before sending SIGKILL to a non-responsive process */
-                        p->tm = 7;
-                        PCD_PRINTF_STDOUT(  "Terminating process %s (%d) (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
-                        p->signaled = True;
-                        if( kill(p->pid, SIGTERM) < 0 )
-						{
-							p->state = PCD_PROCESS_STOPPED;
-						}
-                    }
-                    else
+                    /* Check if corresponding process was already spawned */
+                    p->state = PCD_PROCESS_KILLME;
+
+                    /* Wait before sending SIGKILL to a non-responsive process */
+                    p->deadline = now + ( rule->stopTimeout ? rule->stopTimeout : PCD_PROCESS_KILL_TIME );
+                    PCD_PRINTF_STDOUT(  "Terminating process %s (%d) (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
+                    p->signaled = True;
+                    if( PCD_process_send_signal(p, rule->stopSignal ? rule->stopSignal : SIGTERM) < 0 )
                     {
                         p->state = PCD_PROCESS_STOPPED;
+                        p->deadline = 0;
                     }
                 }
+                else
+                {
+                    p->state = PCD_PROCESS_STOPPED;
+                    p->deadline = 0;
+                }
                 break;
 
             case PCD_PROCESS_KILLME:
-                if ( p->tm == 0 )
+                if ( now >= p->deadline )
                 {
                     if ( p->pid > 0 )
                     {
                         PCD_PRINTF_STDOUT(  "Killing process %s (%d) (Rule %s_%s)", rule->command, p->pid, rule->ruleId.groupName, rule->ruleId.ruleName );
                         p->state = PCD_PROCESS_STOPPED;
                         p->signaled = True;
-                        kill(p->pid, SIGKILL);
+
+                        /* Give the exit a chance to arrive before the process is removed */
+                        p->deadline = now + PCD_PROCESS_RETRY_TIME;
+                        PCD_process_send_signal(p, SIGKILL);
                     }
                     else
                     {
                         PCD_PRINTF_STDERR( "No process %s spawned, removing (Rule %s_%s)", rule->command, rule->ruleId.groupName, rule->ruleId.ruleName );
                         p->state = PCD_PROCESS_STOPPED;
+                        p->deadline = 0;
                     }
                 }
-                else
-                {
-                    p->tm--;
-                }
                 break;
 
             case PCD_PROCESS_RUNME:
-                /* Special case on quit */
-                p->state = PCD_PROCESS_STOPPED;
+                /* Special case on quit, otherwise it is spawned in the next iterations */
+                if ( shuttingDown )
+                {
+                    p->state = PCD_PROCESS_STOPPED;
+                    p->deadline = 0;
+                }
                 break;
 
             default:
@@ -922,6 +1187,8 @@ PCD_status_e PCD_process_iterate_stop( void )
         p = p->next;
     }
 
+    PCD_process_shutdown_check();
+
     return PCD_STATUS_OK;
 }
 
@@ -947,7 +1214,7 @@ PCD_status_e PCD_process_signal_by_rule( rule_t *rule, int sig )
     if ( ( proc->state == PCD_PROCESS_STARTING ) || ( proc->state == PCD_PROCESS_RUNNING ) )
     {
         /* Signal the process */
-        kill(proc->pid, sig);
+        PCD_process_send_signal(proc, sig);
     }
     else
     {
@@ -964,6 +1231,10 @@ static PCD_status_e PCD_process_trigger_action( rule_t *rule )
     rule_t *tmpRule;
     PCD_status_e retval;
 
+    /* Processes are expected to exit during shutdown */
+    if ( shuttingDown )
+        return PCD_STATUS_OK;
+
     /* Dequeue the rule from the timer queue, we are triggering failure action now. */
     PCD_timer_dequeue_rule( rule, True );
 
@@ -982,22 +1253,188 @@ static PCD_status_e PCD_process_trigger_action( rule_t *rule )
     return PCD_STATUS_OK;
 }
 
-rule_t *PCD_process_get_rule_by_pid( pid_t pid )
+u_int32_t PCD_process_get_timeout( void )
 {
     procObj_t *p = procList;
+    u_int32_t timeout = PCD_EVENT_TIMEOUT_FOREVER;
+    u_int64_t now = PCD_event_get_time();
 
     while ( p )
     {
-        if ( p->pid == pid )
+        switch ( p->state )
         {
-            /* Found */
-            return p->rule;
+            case PCD_PROCESS_RUNME:
+                /* Spawn right away, unless shutting down */
+                if ( !shuttingDown )
+                    return 0;
+                break;
+
+            case PCD_PROCESS_TERMME:
+                return 0;
+
+            case PCD_PROCESS_STARTING:
+            case PCD_PROCESS_KILLME:
+            case PCD_PROCESS_STOPPING:
+            case PCD_PROCESS_STOPPED:
+                if ( p->deadline <= now )
+                    return 0;
+
+                if ( p->deadline - now < timeout )
+                    timeout = (u_int32_t)( p->deadline - now );
+                break;
+
+            default:
+                break;
         }
 
         p = p->next;
     }
 
-    return NULL;
+    return timeout;
+}
+
+rule_t *PCD_process_get_rule_by_pid( pid_t pid )
+{
+    procObj_t *p = PCD_process_find_by_pid( pid );
+
+    return p ? p->rule : NULL;
+}
+
+static void PCD_process_shutdown( void )
+{
+    const char msg[]= "pcd: Terminating PCD, rebooting system...\n";
+    rule_t *rule;
+
+    if ( shuttingDown )
+        return;
+
+    /* Display reboot message */
+    if ( write( STDERR_FILENO, msg, sizeof(msg) ) < 0 )
+    {
+        /* Nothing to do */
+    }
+
+    shuttingDown = True;
+
+    /* Stop PCD timer, no rule is started from now on */
+    PCD_timer_stop();
+
+    /* Every rule waits for the rules which depend on it */
+    for ( rule = PCD_rulesdb_get_first(); rule; rule = PCD_rulesdb_get_next() )
+    {
+        rule->stopPending = rule->numDependents;
+        shutdownRules++;
+    }
+
+    /* Stop all the rules that nothing depends on, concurrently */
+    for ( rule = PCD_rulesdb_get_first(); rule; rule = PCD_rulesdb_get_next() )
+    {
+        if ( rule->numDependents == 0 )
+        {
+            PCD_process_shutdown_stop( rule );
+        }
+    }
+
+    PCD_process_shutdown_check();
+}
+
+static void PCD_process_shutdown_stop( rule_t *rule )
+{
+    procObj_t *proc = rule->proc;
+
+    /* The dependencies are released when the process is gone */
+    if ( ( proc ) && ( PCD_process_stop( rule, False, NULL ) == PCD_STATUS_OK ) )
+    {
+        proc->shutdown = True;
+        shutdownProcs++;
+        return;
+    }
+
+    PCD_process_shutdown_release( rule );
+}
+
+static void PCD_process_shutdown_release( rule_t *rule )
+{
+    u_int32_t i, j;
+
+    shutdownRules--;
+
+    if ( rule->startCondition.type != PCD_START_COND_KEYWORD_RULE_COMPLETED )
+        return;
+
+    for ( i = 0; i < rule->startCondition.numRuleCompleted; i++ )
+    {
+        rule_t *depRule = rule->startCondition.ruleCompleted[ i ].rule;
+
+        if ( ( !depRule ) || ( depRule->stopPending == 0 ) )
+            continue;
+
+        /* Release every dependency once */
+        for ( j = 0; j < i; j++ )
+        {
+            if ( rule->startCondition.ruleCompleted[ j ].rule == depRule )
+                break;
+        }
+
+        if ( j < i )
+            continue;
+
+        /* Only rules which were linked as dependents are counted */
+        for ( j = 0; j < depRule->numDependents; j++ )
+        {
+            if ( depRule->dependents[ j ] == rule )
+                break;
+        }
+
+        if ( ( j < depRule->numDependents ) && ( --depRule->stopPending == 0 ) )
+        {
+            PCD_process_shutdown_stop( depRule );
+        }
+    }
+}
+
+static void PCD_process_shutdown_check( void )
+{
+    rule_t *rule;
+
+    if ( !shuttingDown )
+        return;
+
+    /* Nothing is being stopped, but some rules still wait for their dependents.
+       This happens with dependency loops only, stop the remaining rules together */
+    if ( ( shutdownRules > 0 ) && ( shutdownProcs == 0 ) )
+    {
+        for ( rule = PCD_rulesdb_get_first(); rule; rule = PCD_rulesdb_get_next() )
+        {
+            if ( rule->stopPending > 0 )
+            {
+                rule->stopPending = 0;
+                PCD_process_shutdown_stop( rule );
+            }
+        }
+    }
+
+    /* Wait until all the processes are gone */
+    if ( ( shutdownRules > 0 ) || ( procList ) )
+        return;
+
+    /* Stop IPC */
+    PCD_api_deinit();
+
+    /* The trace and the statistics include the shutdown */
+    PCD_trace_write_output();
+    PCD_stats_write_output();
+
+    /* Avoid unsafe prints */
+    verboseOutput = False;
+
+    /* Close exception file */
+    PCD_exception_close();
+
+    /* Kill the remaining child processes and reboot */
+    PCD_process_reboot();
+
+    exit(1);
 }
 
 void PCD_process_reboot( void )
@@ -36,100 +36,245 @@
 #include <string.h>
 #include "system_types.h"
 #include "rules_db.h"
+#include "cmdline.h"
+#include "pool.h"
 #include "process.h"
 #include "timer.h"
+#include "trace.h"
+#include "pcd_api.h"
 #include "pcd.h"
 
 /**************************************************************************/
 /*      LOCAL DEFINITIONS AND VARIABLES                                   */
 /**************************************************************************/
 
+/* Hash tables grow when they hold more entries than their size, sizes are powers of 2 */
+#define PCD_RULESDB_HASH_INIT_SIZE  64
+#define PCD_RULESDB_HASH_SEED       2166136261U
+
+/* Initial size of the dependents array of a rule */
+#define PCD_RULESDB_MIN_DEPENDENTS  4
+
 static ruleGroup_t *rulesListHead = NULL;
+static ruleGroup_t *rulesListTail = NULL;
+
+/* Groups hashed by name */
+static ruleGroup_t **groupHash = NULL;
+static u_int32_t groupHashSize = 0;
+static u_int32_t numGroups = 0;
+
+/* Rules hashed by group and rule name */
+static rule_t **ruleHash = NULL;
+static u_int32_t ruleHashSize = 0;
+static u_int32_t numRules = 0;
+
+PCD_POOL_DECLARE( rulePool, "rules", rule_t, CONFIG_PCD_POOL_RULES );
 static ruleGroup_t *lastReturnedGroup = NULL;
 static rule_t *lastReturnedRule = NULL;
 
+static PCD_status_e PCD_rulesdb_add_dependent( rule_t *rule, rule_t *dependent );
+
 /**************************************************************************/
 /*      IMPLEMENTATION                                                    */
 /**************************************************************************/
 
-static PCD_status_e PCD_rulesdb_add_rule_to_group( ruleGroup_t *group, rule_t *newRule )
+static u_int32_t PCD_rulesdb_hash( const char *str, u_int32_t hash )
 {
-    char *ruleName = newRule->ruleId.ruleName;
-    rule_t *ruleList = group->firstRule;
-    rule_t *prevRule;
-
-    if ( !ruleList )
+    /* FNV-1a */
+    while ( *str )
     {
-         ruleList = newRule;
-         ruleList->next = NULL;
+         hash ^= (unsigned char)*str++;
+         hash *= 16777619U;
+    }
 
-         return PCD_STATUS_OK;
+    return hash;
+}
+
+static u_int32_t PCD_rulesdb_rule_hash( ruleGroup_t *group, const char *ruleName )
+{
+    /* The rule name hash continues the hash of its group name */
+    return PCD_rulesdb_hash( ruleName, group->hash );
+}
+
+static ruleGroup_t *PCD_rulesdb_find_group( const char *groupName )
+{
+    ruleGroup_t *group;
+    u_int32_t hash;
+
+    if ( !groupHash )
+         return NULL;
+
+    hash = PCD_rulesdb_hash( groupName, PCD_RULESDB_HASH_SEED );
+
+    for ( group = groupHash[ hash & ( groupHashSize - 1 ) ]; group; group = group->hashNext )
+    {
+         if ( ( group->hash == hash ) && ( strcmp( group->groupName, groupName ) == 0 ) )
+              return group;
     }
 
-    prevRule = NULL;
+    return NULL;
+}
+
+static rule_t *PCD_rulesdb_find_rule( ruleGroup_t *group, const char *ruleName )
+{
+    rule_t *rule;
+    u_int32_t hash;
 
+    if ( !ruleHash )
+         return NULL;
+
+    hash = PCD_rulesdb_rule_hash( group, ruleName );
 
-    while ( 1 )
+    /* Group names are interned, the group is compared by its pointer */
+    for ( rule = ruleHash[ hash & ( ruleHashSize - 1 ) ]; rule; rule = rule->hashNext )
     {
-         int32_t val;
+         if ( ( rule->group == group ) && ( strcmp( rule->ruleId.ruleName, ruleName ) == 0 ) )
+              return rule;
+    }
 
-         val = strcmp( ruleName, ruleList->ruleId.ruleName );
+    return NULL;
+}
 
-         if ( val == 0 )
-         {
-              PCD_PRINTF_STDERR( "Multiple definitions of rule %s_%s, ignoring", newRule->ruleId.groupName, newRule->ruleId.ruleName );
-              return PCD_STATUS_NOK;
-         }
+static PCD_status_e PCD_rulesdb_grow_groups( void )
+{
+    u_int32_t newSize = groupHashSize ? groupHashSize * 2 : PCD_RULESDB_HASH_INIT_SIZE;
+    ruleGroup_t **newHash;
+    u_int32_t i;
 
-         /* Search for the right place to put the rule */
-         if ( val > 0 )
+    newHash = calloc( newSize, sizeof( ruleGroup_t * ) );
+
+    if ( !newHash )
+         return PCD_STATUS_NOK;
+
+    for ( i = 0; i < groupHashSize; i++ )
+    {
+         while ( groupHash[ i ] )
          {
-              if ( ruleList->next )
-              {
-                   /* Move to next rule in the list */
-                   prevRule = ruleList;
-                   ruleList = ruleList->next;
-                   continue;
-              }
-              else
-              {
-                   /* Add rule to the end of the list */
-                   ruleList->next = newRule;
-                   newRule->next = NULL;
-                   break;
-              }
+              ruleGroup_t *group = groupHash[ i ];
+
+              groupHash[ i ] = group->hashNext;
+              group->hashNext = newHash[ group->hash & ( newSize - 1 ) ];
+              newHash[ group->hash & ( newSize - 1 ) ] = group;
          }
-         else
+    }
+
+    free( groupHash );
+    groupHash = newHash;
+    groupHashSize = newSize;
+
+    return PCD_STATUS_OK;
+}
+
+static PCD_status_e PCD_rulesdb_grow_rules( void )
+{
+    u_int32_t newSize = ruleHashSize ? ruleHashSize * 2 : PCD_RULESDB_HASH_INIT_SIZE;
+    rule_t **newHash;
+    u_int32_t i;
+
+    newHash = calloc( newSize, sizeof( rule_t * ) );
+
+    if ( !newHash )
+         return PCD_STATUS_NOK;
+
+    for ( i = 0; i < ruleHashSize; i++ )
+    {
+         while ( ruleHash[ i ] )
          {
-              if ( !prevRule )
-              {
-                   /* Update the first rule */
-                   newRule->next = group->firstRule;
-                   group->firstRule = newRule;
-                   break;
-              }
-              else
-              {
-                   /* Add new rule between the two elements */
-                   newRule->next = ruleList;
-                   prevRule->next = newRule;
-                   break;
-              }
+              rule_t *rule = ruleHash[ i ];
+              u_int32_t idx = PCD_rulesdb_rule_hash( rule->group, rule->ruleId.ruleName ) & ( newSize - 1 );
+
+              ruleHash[ i ] = rule->hashNext;
+              rule->hashNext = newHash[ idx ];
+              newHash[ idx ] = rule;
          }
     }
 
+    free( ruleHash );
+    ruleHash = newHash;
+    ruleHashSize = newSize;
+
     return PCD_STATUS_OK;
 }
 
+static ruleGroup_t *PCD_rulesdb_add_group( const char *groupName )
+{
+    ruleGroup_t *group;
+
+    /* Keep the table at most as full as its size */
+    if ( ( numGroups >= groupHashSize ) && ( PCD_rulesdb_grow_groups() != PCD_STATUS_OK ) )
+         return NULL;
+
+    group = malloc( sizeof( ruleGroup_t ) );
+
+    if ( !group )
+         return NULL;
+
+    group->groupName = malloc( strlen( groupName ) + 1 );
+
+    if ( !group->groupName )
+    {
+         free( group );
+         return NULL;
+    }
+
+    strcpy( group->groupName, groupName );
+    group->hash = PCD_rulesdb_hash( groupName, PCD_RULESDB_HASH_SEED );
+    group->firstRule = NULL;
+    group->indexedRules = NULL;
+    group->next = NULL;
+
+    group->hashNext = groupHash[ group->hash & ( groupHashSize - 1 ) ];
+    groupHash[ group->hash & ( groupHashSize - 1 ) ] = group;
+    numGroups++;
+
+    /* Groups are iterated in the order of their creation */
+    if ( !rulesListHead )
+    {
+         rulesListHead = group;
+    }
+    else
+    {
+         rulesListTail->next = group;
+    }
+
+    rulesListTail = group;
+
+    return group;
+}
+
+static void PCD_rulesdb_add_rule_to_group( ruleGroup_t *group, rule_t *newRule )
+{
+    char *ruleName = newRule->ruleId.ruleName;
+    rule_t **ruleList = &group->firstRule;
+
+    /* Rules are kept sorted in the group */
+    while ( ( *ruleList ) && ( strcmp( ruleName, (*ruleList)->ruleId.ruleName ) > 0 ) )
+    {
+         ruleList = &(*ruleList)->next;
+    }
+
+    newRule->next = *ruleList;
+    *ruleList = newRule;
+}
+
 PCD_status_e PCD_rulesdb_add_rule( rule_t *newrule )
 {
-    ruleGroup_t *searchList = rulesListHead;
+    ruleGroup_t *group;
     rule_t *rule;
+    u_int32_t idx;
 
     if( !newrule )
          return PCD_STATUS_NOK;
 
-    rule = malloc( sizeof( rule_t ) );
+    group = PCD_rulesdb_find_group( newrule->ruleId.groupName );
+
+    if ( ( group ) && ( PCD_rulesdb_find_rule( group, newrule->ruleId.ruleName ) ) )
+    {
+         PCD_PRINTF_STDERR( "Multiple definitions of rule %s_%s, ignoring", newrule->ruleId.groupName, newrule->ruleId.ruleName );
+         return PCD_STATUS_OK;
+    }
+
+    rule = PCD_pool_alloc( &rulePool );
 
     if ( !rule )
     {
@@ -139,68 +284,60 @@ PCD_status_e PCD_rulesdb_add_rule( rule_t *newrule )
 
     memcpy( rule, newrule, sizeof( rule_t ) );
 
-    while ( searchList )
-    {
-         /* Find if the group already exists */
-         if ( strcmp( searchList->groupName, rule->ruleId.groupName ) == 0 )
-         {
-              if ( PCD_rulesdb_add_rule_to_group( searchList, rule ) == PCD_STATUS_NOK )
-              {
-                   free( rule );
-                   rule = NULL;
-              }
-              return PCD_STATUS_OK;
-         }
-
-         searchList = searchList->next;
-    }
-
-    /* Create a new group */
-    if ( !searchList )
+    /* Runtime fields are not inherited, the new rule may be a clone of an indexed rule */
+    rule->timerObj = NULL;
+    rule->dependents = NULL;
+    rule->numDependents = 0;
+    rule->maxDependents = 0;
+    rule->pendingDeps = 0;
+    rule->stopPending = 0;
+    rule->cmdLine = NULL;
+    rule->optionalCmdLine = NULL;
+    rule->hashNext = NULL;
+    rule->indexedNext = NULL;
+    memset( &rule->stats, 0, sizeof( rule->stats ) );
+
+    /* Compile the command line once, spawning only expands its variables */
+    if ( ( rule->command ) && ( strcmp( rule->command, "NONE" ) != 0 ) )
     {
-         searchList = malloc( sizeof( ruleGroup_t ) );
+         rule->cmdLine = PCD_cmdline_compile( rule->command, rule->params );
 
-         if ( !searchList )
+         if ( !rule->cmdLine )
          {
-              free( rule );
-              PCD_PRINTF_STDERR(  "failed to allocate memory" );
+              PCD_pool_free( &rulePool, rule );
               return PCD_STATUS_NOK;
          }
+    }
 
-         searchList->groupName = malloc( strlen( rule->ruleId.groupName ) + 1 );
-
-         if ( !searchList->groupName )
-         {
-              free( rule );
-              free( searchList );
-              PCD_PRINTF_STDERR(  "failed to allocate memory" );
-              return PCD_STATUS_NOK;
-         }
+    if ( ( !group ) && ( ( group = PCD_rulesdb_add_group( rule->ruleId.groupName ) ) == NULL ) )
+    {
+         PCD_PRINTF_STDERR( "failed to allocate memory" );
+         PCD_cmdline_free( rule->cmdLine );
+         PCD_pool_free( &rulePool, rule );
+         return PCD_STATUS_NOK;
+    }
 
-         strcpy( searchList->groupName, rule->ruleId.groupName );
+    if ( ( numRules >= ruleHashSize ) && ( PCD_rulesdb_grow_rules() != PCD_STATUS_OK ) )
+    {
+         PCD_PRINTF_STDERR( "failed to allocate memory" );
+         PCD_cmdline_free( rule->cmdLine );
+         PCD_pool_free( &rulePool, rule );
+         return PCD_STATUS_NOK;
+    }
 
-         /* Add the first rule to the new group */
-         searchList->firstRule = rule;
-         searchList->next = NULL;
+    rule->group = group;
 
-         /* Check if this is the first group */
-         if ( !rulesListHead )
-         {
-              rulesListHead = searchList;
-         }
-         else
-         {
-              ruleGroup_t *newSearchList = rulesListHead;
+    PCD_rulesdb_add_rule_to_group( group, rule );
 
-              /* Find the next free space */
-              while ( newSearchList->next )
-              {
-                   newSearchList = newSearchList->next;
-              }
+    idx = PCD_rulesdb_rule_hash( group, rule->ruleId.ruleName ) & ( ruleHashSize - 1 );
+    rule->hashNext = ruleHash[ idx ];
+    ruleHash[ idx ] = rule;
+    numRules++;
 
-              /* Add a new element */
-              newSearchList->next = searchList;
-         }
+    if ( rule->indexed )
+    {
+         rule->indexedNext = group->indexedRules;
+         group->indexedRules = rule;
     }
 
     return PCD_STATUS_OK;
@@ -208,42 +345,35 @@ PCD_status_e PCD_rulesdb_add_rule( rule_t *newrule )
 
 rule_t *PCD_rulesdb_get_rule_by_id( ruleId_t *ruleId )
 {
-    ruleGroup_t *searchList = rulesListHead;
-    rule_t *searchRuleList;
+    ruleGroup_t *group;
+    rule_t *searchRule;
     rule_t *tmpRule = NULL;
 
     if( !ruleId )
          return NULL;
 
-    while ( searchList )
-    {
-         if( strcmp( ruleId->groupName, searchList->groupName ) == 0 )
-              break;
-         else
-              searchList = searchList->next;
-    }
+    group = PCD_rulesdb_find_group( ruleId->groupName );
 
     /* Not found...? */
-    if( !searchList )
+    if( !group )
          return NULL;
 
-    searchRuleList = searchList->firstRule;
+    searchRule = PCD_rulesdb_find_rule( group, ruleId->ruleName );
 
-    /* Note, the search can be optimized because the list is sorted */
-    while ( searchRuleList )
+    /* Found */
+    if ( searchRule )
+         return searchRule;
+
+    /* Find the indexed rule with the longest name which prefixes the rule name */
+    for ( searchRule = group->indexedRules; searchRule; searchRule = searchRule->indexedNext )
     {
-         /* Found */
-         if( strcmp( searchRuleList->ruleId.ruleName, ruleId->ruleName ) == 0 )
-         {
-              return searchRuleList;
-         }
-         else if( ( searchRuleList->indexed ) && ( strncmp( searchRuleList->ruleId.ruleName, ruleId->ruleName, strlen(searchRuleList->ruleId.ruleName) ) == 0 ) )
+         size_t len = strlen( searchRule->ruleId.ruleName );
+
+         if( ( strncmp( searchRule->ruleId.ruleName, ruleId->ruleName, len ) == 0 ) &&
+             ( ( !tmpRule ) || ( len > strlen( tmpRule->ruleId.ruleName ) ) ) )
          {
-              /* Save the last match as a temporary rule */
-              tmpRule = searchRuleList;
+              tmpRule = searchRule;
          }
-
-         searchRuleList = searchRuleList->next;
     }
 
     if( tmpRule )
@@ -258,7 +388,7 @@ rule_t *PCD_rulesdb_get_rule_by_id( ruleId_t *ruleId )
 
          if( PCD_rulesdb_add_rule( &newRule ) == PCD_STATUS_OK )
          {
-              return PCD_rulesdb_get_rule_by_id( ruleId );
+              return PCD_rulesdb_find_rule( group, ruleId->ruleName );
          }
     }
 
@@ -267,27 +397,8 @@ rule_t *PCD_rulesdb_get_rule_by_id( ruleId_t *ruleId )
 
 rule_t *PCD_rulesdb_get_rule_by_pid( int32_t pid )
 {
-    ruleGroup_t *searchList = rulesListHead;
-
-    while ( searchList )
-    {
-         rule_t *searchRuleList;
-
-         searchRuleList = searchList->firstRule;
-
-         while ( searchRuleList )
-         {
-              /* Found */
-              if( searchRuleList->proc->pid == pid )
-                   return searchRuleList;
-
-              searchRuleList = searchRuleList->next;
-         }
-
-         searchList = searchList->next;
-    }
-
-    return NULL;
+    /* Live processes are hashed by pid in the process module */
+    return PCD_process_get_rule_by_pid( pid );
 }
 
 rule_t *PCD_rulesdb_get_first( void )
@@ -327,6 +438,147 @@ rule_t *PCD_rulesdb_get_next( void )
     return NULL;
 }
 
+static PCD_status_e PCD_rulesdb_add_dependent( rule_t *rule, rule_t *dependent )
+{
+    rule_t **newDependents;
+    u_int32_t i;
+
+    /* A rule may list the same dependency more than once */
+    for ( i = 0; i < rule->numDependents; i++ )
+    {
+         if ( rule->dependents[ i ] == dependent )
+              return PCD_STATUS_OK;
+    }
+
+    /* Grow the array by doubling, a rule may have many dependents */
+    if ( rule->numDependents == rule->maxDependents )
+    {
+         u_int32_t newMax = rule->maxDependents ? ( rule->maxDependents * 2 ) : PCD_RULESDB_MIN_DEPENDENTS;
+
+         newDependents = realloc( rule->dependents, newMax * sizeof( rule_t * ) );
+
+         if ( !newDependents )
+         {
+              PCD_PRINTF_STDERR( "failed to allocate memory" );
+              return PCD_STATUS_NOK;
+         }
+
+         rule->dependents = newDependents;
+         rule->maxDependents = newMax;
+    }
+
+    rule->dependents[ rule->numDependents ] = dependent;
+    rule->numDependents++;
+
+    return PCD_STATUS_OK;
+}
+
+u_int32_t PCD_rulesdb_count_pending_deps( rule_t *rule )
+{
+    u_int32_t pendingDeps = 0;
+    u_int32_t i, j;
+
+    if ( ( !rule ) || ( rule->startCondition.type != PCD_START_COND_KEYWORD_RULE_COMPLETED ) )
+         return 0;
+
+    for ( i = 0; i < rule->startCondition.numRuleCompleted; i++ )
+    {
+         rule_t *depRule = rule->startCondition.ruleCompleted[ i ].rule;
+
+         if ( !depRule )
+         {
+              /* Fetch rule from db, and store in cache for the condition check */
+              depRule = PCD_rulesdb_get_rule_by_id( &rule->startCondition.ruleCompleted[ i ].ruleId );
+              rule->startCondition.ruleCompleted[ i ].rule = depRule;
+
+              /* Missing rules are reported by the condition check */
+              if ( !depRule )
+                   continue;
+         }
+
+         /* Link the reverse edge, so the dependency wakes this rule up when it completes */
+         if ( PCD_rulesdb_add_dependent( depRule, rule ) != PCD_STATUS_OK )
+              continue;
+
+         /* Count every dependency once */
+         for ( j = 0; j < i; j++ )
+         {
+              if ( rule->startCondition.ruleCompleted[ j ].rule == depRule )
+                   break;
+         }
+
+         if ( ( j == i ) && ( depRule->ruleState != PCD_RULE_COMPLETED ) )
+              pendingDeps++;
+    }
+
+    return pendingDeps;
+}
+
+void PCD_rulesdb_set_rule_state( rule_t *rule, pcdRuleState_e ruleState )
+{
+    bool_t wasCompleted = ( rule->ruleState == PCD_RULE_COMPLETED );
+    u_int32_t i;
+
+    rule->ruleState = ruleState;
+
+    if ( ruleState == PCD_RULE_END_CONDITION_WAITING )
+    {
+         rule->stats.starts++;
+    }
+    else if ( ruleState == PCD_RULE_FAILED )
+    {
+         rule->stats.failures++;
+    }
+
+#if CONFIG_PCD_TRACE_ENTRIES > 0
+    switch ( ruleState )
+    {
+         case PCD_RULE_START_CONDITION_WAITING:
+              PCD_TRACE( rule, PCD_TRACE_ENQUEUE, 0 );
+              break;
+         case PCD_RULE_END_CONDITION_WAITING:
+              PCD_TRACE( rule, PCD_TRACE_START_COND, 0 );
+              break;
+         case PCD_RULE_COMPLETED:
+              PCD_TRACE( rule, PCD_TRACE_COMPLETED, 0 );
+              break;
+         case PCD_RULE_NOT_COMPLETED:
+              PCD_TRACE( rule, PCD_TRACE_NOT_COMPLETED, 0 );
+              break;
+         case PCD_RULE_FAILED:
+              PCD_TRACE( rule, PCD_TRACE_FAILED, 0 );
+              break;
+         case PCD_RULE_IDLE:
+              PCD_TRACE( rule, PCD_TRACE_IDLE, 0 );
+              break;
+         default:
+              break;
+    }
+#endif
+
+    /* Tell the subscribers */
+    PCD_api_notify_rule( rule );
+
+    /* Only completion changes the dependents */
+    if ( wasCompleted == ( ruleState == PCD_RULE_COMPLETED ) )
+         return;
+
+    for ( i = 0; i < rule->numDependents; i++ )
+    {
+         rule_t *dependent = rule->dependents[ i ];
+
+         if ( ruleState != PCD_RULE_COMPLETED )
+         {
+              dependent->pendingDeps++;
+         }
+         else if ( ( dependent->pendingDeps > 0 ) && ( --dependent->pendingDeps == 0 ) )
+         {
+              /* The last dependency completed, check the start condition */
+              PCD_timer_notify_rule( dependent );
+         }
+    }
+}
+
 PCD_status_e PCD_rulesdb_activate( void )
 {
     rule_t *rule;
@@ -359,17 +611,24 @@ PCD_status_e PCD_rulesdb_setup_optional_params( rule_t *rule, const char *option
     if( ( !rule ) || ( !optionalParams ) )
          return PCD_STATUS_NOK;
 
-    if( rule->optionalParams )
+    /* Synchronization rules do not start a process */
+    if ( ( !rule->command ) || ( strcmp( rule->command, "NONE" ) == 0 ) )
+         return PCD_STATUS_OK;
+
+    /* Restarts with the same parameters reuse the compiled command line */
+    if ( ( !rule->optionalCmdLine ) || ( strcmp( PCD_cmdline_get_params( rule->optionalCmdLine ), optionalParams ) != 0 ) )
     {
-         free( rule->optionalParams );
-    }
+         rule->optionalParams = NULL;
+         PCD_cmdline_free( rule->optionalCmdLine );
+         rule->optionalCmdLine = PCD_cmdline_compile( rule->command, optionalParams );
 
-    rule->optionalParams = malloc( strlen( optionalParams ) + 1 );
+         if ( !rule->optionalCmdLine )
+              return PCD_STATUS_NOK;
+    }
 
-    if( !rule->optionalParams )
-         return PCD_STATUS_NOK;
+    /* The parameters are held by the compiled command line */
+    rule->optionalParams = PCD_cmdline_get_params( rule->optionalCmdLine );
 
-    strcpy( rule->optionalParams, optionalParams );
     return PCD_STATUS_OK;
 }
 
@@ -378,11 +637,8 @@ PCD_status_e PCD_rulesdb_clear_optional_params( rule_t *rule )
     if( !rule )
          return PCD_STATUS_NOK;
 
-    if ( rule->optionalParams )
-    {
-         free( rule->optionalParams );
-         rule->optionalParams = NULL;
-    }
+    /* Keep the compiled command line, the rule is likely to be started again with the same parameters */
+    rule->optionalParams = NULL;
 
     return PCD_STATUS_OK;
 }
@@ -0,0 +1,403 @@
+/*
+ * stats.c
+ * Description:
+ * PCD runtime statistics implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "system_types.h"
+#include "rules_db.h"
+#include "pool.h"
+#include "event.h"
+#include "timer.h"
+#include "pcd_api.h"
+#include "stats.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+/* The daemon counters are kept in the format of the API reply, the rule counters
+   are kept in the rules and converted on request */
+static pcdApiStats_t pcdStats;
+
+static const u_int32_t statsBucketBounds[ PCD_API_STATS_BUCKETS - 1 ] = PCD_API_STATS_BUCKET_BOUNDS;
+
+static const char *statsOutput = NULL;
+static u_int64_t statsNextWrite = 0;
+
+/* Metrics of the rules in the Prometheus text format */
+typedef enum
+{
+    PCD_STATS_RULE_STARTS,
+    PCD_STATS_RULE_RESTARTS,
+    PCD_STATS_RULE_FAILURES,
+    PCD_STATS_RULE_TIMEOUTS,
+    PCD_STATS_RULE_LAST_EXIT_CODE,
+    PCD_STATS_RULE_UPTIME,
+    PCD_STATS_RULE_READY_LATENCY,
+    PCD_STATS_RULE_LAST,
+
+} statsRuleMetric_e;
+
+static const struct
+{
+    const char  *name;
+    const char  *type;
+    const char  *help;
+
+} statsRuleMetrics[ PCD_STATS_RULE_LAST ] =
+{
+    { "pcd_rule_starts_total", "counter", "Times the start condition of the rule was met." },
+    { "pcd_rule_restarts_total", "counter", "Restarts of the rule by the RESTART failure action." },
+    { "pcd_rule_failures_total", "counter", "Failures of the rule." },
+    { "pcd_rule_timeouts_total", "counter", "End condition timeouts of the rule." },
+    { "pcd_rule_last_exit_code", "gauge", "Exit code of the last process of the rule, 128 + signal if it was killed." },
+    { "pcd_rule_uptime_seconds_total", "counter", "Time the processes of the rule ran." },
+    { "pcd_rule_ready_latency_seconds", "gauge", "Time from the spawn of the last process of the rule to PROCESS_READY." },
+};
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+u_int64_t PCD_stats_get_time_us( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (u_int64_t)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
+
+static void PCD_stats_histogram_add( pcdApiHistogram_t *histogram, u_int64_t sample )
+{
+    u_int32_t i;
+
+    for ( i = 0; ( i < PCD_API_STATS_BUCKETS - 1 ) && ( sample > statsBucketBounds[ i ] ); i++ );
+
+    histogram->buckets[ i ]++;
+    histogram->count++;
+    histogram->sum += sample;
+}
+
+void PCD_stats_loop_iteration( u_int64_t startTime )
+{
+    u_int64_t elapsed = PCD_stats_get_time_us() - startTime;
+
+    pcdStats.loopIterations++;
+    PCD_stats_histogram_add( &pcdStats.loopLatency, elapsed );
+
+    if ( elapsed > (u_int64_t)PCD_TIMER_TICK * 1000 )
+    {
+        pcdStats.loopOverruns++;
+    }
+}
+
+void PCD_stats_count_message( void )
+{
+    pcdStats.messages++;
+}
+
+void PCD_stats_count_errlog_write( void )
+{
+    pcdStats.errlogWrites++;
+}
+
+void PCD_stats_process_spawned( rule_t *rule )
+{
+    rule->stats.spawnTime = PCD_event_get_time();
+}
+
+void PCD_stats_process_ready( rule_t *rule )
+{
+    u_int64_t latency;
+
+    if ( !rule->stats.spawnTime )
+        return;
+
+    latency = PCD_event_get_time() - rule->stats.spawnTime;
+
+    rule->stats.readyLatency = (u_int32_t)latency;
+    rule->stats.readies++;
+
+    PCD_stats_histogram_add( &pcdStats.readyLatency, latency * 1000 );
+}
+
+void PCD_stats_process_exited( rule_t *rule, int32_t status )
+{
+    if ( rule->stats.spawnTime )
+    {
+        rule->stats.uptime += PCD_event_get_time() - rule->stats.spawnTime;
+        rule->stats.spawnTime = 0;
+    }
+
+    rule->stats.lastExitStatus = status;
+    rule->stats.exits++;
+}
+
+static void PCD_stats_get_rule( const rule_t *rule, pcdApiRuleStats_t *ruleStats )
+{
+    const ruleStats_t *stats = &rule->stats;
+    int32_t status = stats->lastExitStatus;
+
+    ruleStats->starts = stats->starts;
+    ruleStats->restarts = stats->restarts;
+    ruleStats->failures = stats->failures;
+    ruleStats->timeouts = stats->timeouts;
+
+    if ( !stats->exits )
+        ruleStats->lastExitCode = -1;
+    else if ( WIFSIGNALED( status ) )
+        ruleStats->lastExitCode = 128 + WTERMSIG( status );
+    else
+        ruleStats->lastExitCode = WEXITSTATUS( status );
+
+    ruleStats->readyLatencyMs = stats->readies ? (int32_t)stats->readyLatency : -1;
+
+    /* The running process counts too */
+    ruleStats->uptimeMs = stats->uptime;
+
+    if ( stats->spawnTime )
+        ruleStats->uptimeMs += PCD_event_get_time() - stats->spawnTime;
+}
+
+PCD_status_e PCD_stats_get( const rule_t *rule, pcdApiStats_t *stats )
+{
+    pool_t *pool;
+
+    memcpy( stats, &pcdStats, sizeof( pcdApiStats_t ) );
+
+    stats->numPools = 0;
+
+    for ( pool = PCD_pool_get_first(); ( pool ) && ( stats->numPools < PCD_API_STATS_MAX_POOLS ); pool = pool->next )
+    {
+        pcdApiPoolStats_t *poolStats = &stats->pools[ stats->numPools++ ];
+
+        strncpy( poolStats->name, pool->name, PCD_API_STATS_POOL_NAME_SIZE - 1 );
+        poolStats->name[ PCD_API_STATS_POOL_NAME_SIZE - 1 ] = '\0';
+        poolStats->used = pool->used;
+        poolStats->highWater = pool->highWater;
+        poolStats->capacity = pool->numSlabs * pool->slabObjs;
+        poolStats->failures = pool->failures;
+    }
+
+    if ( rule )
+    {
+        PCD_stats_get_rule( rule, &stats->rule );
+    }
+    else
+    {
+        memset( &stats->rule, 0, sizeof( pcdApiRuleStats_t ) );
+    }
+
+    return PCD_STATUS_OK;
+}
+
+static void PCD_stats_write_counter( FILE *out, const char *name, const char *help, u_int32_t value )
+{
+    fprintf( out, "# HELP %s %s\n# TYPE %s counter\n%s %u\n", name, help, name, name, value );
+}
+
+static void PCD_stats_write_histogram( FILE *out, const char *name, const char *help, const pcdApiHistogram_t *histogram )
+{
+    u_int32_t count = 0, i;
+
+    fprintf( out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name );
+
+    /* Prometheus buckets are cumulative */
+    for ( i = 0; i < PCD_API_STATS_BUCKETS - 1; i++ )
+    {
+        count += histogram->buckets[ i ];
+        fprintf( out, "%s_bucket{le=\"%g\"} %u\n", name, (double)statsBucketBounds[ i ] / 1000000, count );
+    }
+
+    fprintf( out, "%s_bucket{le=\"+Inf\"} %u\n%s_sum %.6f\n%s_count %u\n",
+             name, histogram->count, name, (double)histogram->sum / 1000000, name, histogram->count );
+}
+
+static void PCD_stats_write_rules( FILE *out )
+{
+    u_int32_t metric;
+    rule_t *rule;
+
+    for ( metric = 0; metric < PCD_STATS_RULE_LAST; metric++ )
+    {
+        fprintf( out, "# HELP %s %s\n# TYPE %s %s\n", statsRuleMetrics[ metric ].name, statsRuleMetrics[ metric ].help,
+                 statsRuleMetrics[ metric ].name, statsRuleMetrics[ metric ].type );
+
+        for ( rule = PCD_rulesdb_get_first(); rule; rule = PCD_rulesdb_get_next() )
+        {
+            pcdApiRuleStats_t ruleStats;
+
+            PCD_stats_get_rule( rule, &ruleStats );
+
+            /* A gauge without a value has no sample */
+            if ( ( ( metric == PCD_STATS_RULE_LAST_EXIT_CODE ) && ( ruleStats.lastExitCode < 0 ) ) ||
+                 ( ( metric == PCD_STATS_RULE_READY_LATENCY ) && ( ruleStats.readyLatencyMs < 0 ) ) )
+            {
+                continue;
+            }
+
+            fprintf( out, "%s{group=\"%s\",rule=\"%s\"} ", statsRuleMetrics[ metric ].name, rule->ruleId.groupName, rule->ruleId.ruleName );
+
+            switch ( metric )
+            {
+                case PCD_STATS_RULE_STARTS:
+                    fprintf( out, "%u\n", ruleStats.starts );
+                    break;
+                case PCD_STATS_RULE_RESTARTS:
+                    fprintf( out, "%u\n", ruleStats.restarts );
+                    break;
+                case PCD_STATS_RULE_FAILURES:
+                    fprintf( out, "%u\n", ruleStats.failures );
+                    break;
+                case PCD_STATS_RULE_TIMEOUTS:
+                    fprintf( out, "%u\n", ruleStats.timeouts );
+                    break;
+                case PCD_STATS_RULE_LAST_EXIT_CODE:
+                    fprintf( out, "%d\n", ruleStats.lastExitCode );
+                    break;
+                case PCD_STATS_RULE_UPTIME:
+                    fprintf( out, "%.3f\n", (double)ruleStats.uptimeMs / 1000 );
+                    break;
+                default:
+                    fprintf( out, "%.3f\n", (double)ruleStats.readyLatencyMs / 1000 );
+                    break;
+            }
+        }
+    }
+}
+
+/* Write the statistics to a temporary file and rename it, readers never see a partial file */
+static PCD_status_e PCD_stats_write( const char *filename )
+{
+    char tmpFilename[ PATH_MAX ];
+    pcdApiStats_t stats;
+    FILE *out;
+    u_int32_t i;
+
+    snprintf( tmpFilename, sizeof( tmpFilename ), "%s.tmp", filename );
+
+    if ( ( out = fopen( tmpFilename, "w" ) ) == NULL )
+    {
+        PCD_PRINTF_STDERR( "Failed to open metrics file %s.tmp", filename );
+        return PCD_STATUS_NOK;
+    }
+
+    PCD_stats_get( NULL, &stats );
+
+    PCD_stats_write_counter( out, "pcd_loop_iterations_total", "Main loop iterations.", stats.loopIterations );
+    PCD_stats_write_counter( out, "pcd_loop_overruns_total", "Main loop iterations which took longer than the timer tick.", stats.loopOverruns );
+    PCD_stats_write_counter( out, "pcd_messages_total", "Handled API messages.", stats.messages );
+    PCD_stats_write_counter( out, "pcd_errlog_writes_total", "Writes to the error log.", stats.errlogWrites );
+    PCD_stats_write_histogram( out, "pcd_loop_duration_seconds", "Time it took to handle a main loop iteration.", &stats.loopLatency );
+    PCD_stats_write_histogram( out, "pcd_ready_latency_seconds", "Time from the spawn of a process to PROCESS_READY.", &stats.readyLatency );
+
+    fprintf( out, "# HELP pcd_pool_used Objects in use in the pool.\n# TYPE pcd_pool_used gauge\n" );
+
+    for ( i = 0; i < stats.numPools; i++ )
+        fprintf( out, "pcd_pool_used{pool=\"%s\"} %u\n", stats.pools[ i ].name, stats.pools[ i ].used );
+
+    fprintf( out, "# HELP pcd_pool_high_water Maximum objects in use in the pool at the same time.\n# TYPE pcd_pool_high_water gauge\n" );
+
+    for ( i = 0; i < stats.numPools; i++ )
+        fprintf( out, "pcd_pool_high_water{pool=\"%s\"} %u\n", stats.pools[ i ].name, stats.pools[ i ].highWater );
+
+    fprintf( out, "# HELP pcd_pool_capacity Objects allocated in the pool.\n# TYPE pcd_pool_capacity gauge\n" );
+
+    for ( i = 0; i < stats.numPools; i++ )
+        fprintf( out, "pcd_pool_capacity{pool=\"%s\"} %u\n", stats.pools[ i ].name, stats.pools[ i ].capacity );
+
+    fprintf( out, "# HELP pcd_pool_failures_total Allocations from the pool which failed.\n# TYPE pcd_pool_failures_total counter\n" );
+
+    for ( i = 0; i < stats.numPools; i++ )
+        fprintf( out, "pcd_pool_failures_total{pool=\"%s\"} %u\n", stats.pools[ i ].name, stats.pools[ i ].failures );
+
+    PCD_stats_write_rules( out );
+
+    if ( ( fclose( out ) != 0 ) || ( rename( tmpFilename, filename ) < 0 ) )
+    {
+        PCD_PRINTF_STDERR( "Failed to write metrics file %s", filename );
+        unlink( tmpFilename );
+        return PCD_STATUS_NOK;
+    }
+
+    return PCD_STATUS_OK;
+}
+
+void PCD_stats_set_output( const char *filename )
+{
+    statsOutput = filename;
+}
+
+void PCD_stats_write_output( void )
+{
+    if ( statsOutput )
+    {
+        PCD_stats_write( statsOutput );
+    }
+}
+
+u_int32_t PCD_stats_get_timeout( void )
+{
+    u_int64_t now;
+
+    if ( !statsOutput )
+        return PCD_EVENT_TIMEOUT_FOREVER;
+
+    now = PCD_event_get_time();
+
+    return ( statsNextWrite > now ) ? (u_int32_t)( statsNextWrite - now ) : 0;
+}
+
+void PCD_stats_iterate( void )
+{
+    u_int64_t now;
+
+    if ( !statsOutput )
+        return;
+
+    now = PCD_event_get_time();
+
+    if ( now < statsNextWrite )
+        return;
+
+    PCD_stats_write( statsOutput );
+
+    statsNextWrite = now + CONFIG_PCD_METRICS_INTERVAL * 1000;
+}
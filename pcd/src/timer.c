@@ -47,6 +47,10 @@
 #include "condchk.h"
 #include "process.h"
 #include "failact.h"
+#include "event.h"
+#include "netwatch.h"
+#include "pool.h"
+#include "trace.h"
 #include "pcd.h"
 
 /**************************************************************************/
@@ -56,8 +60,27 @@
 extern int32_t errno;
 
 static timerObj_t *timerObjHead = NULL;
+static timerObj_t *timerObjTail = NULL;
 static bool_t timerEnabled = False;
 
+/* Rules whose conditions are checked on the next iteration */
+static timerObj_t *readyList = NULL;
+
+/* Rules which poll their conditions every tick */
+static timerObj_t *pollList = NULL;
+static u_int64_t lastPollTime = 0;
+
+/* Rules which wait for a watched file or network device, and a change indication */
+static timerObj_t *watchList = NULL;
+static bool_t watchChanged = False;
+
+/* Pending deadlines, a binary min-heap of timer objects ordered by deadline */
+#define PCD_TIMER_HEAP_NONE     (~0U)
+
+static timerObj_t **deadlineHeap = NULL;
+static u_int32_t deadlineHeapSize = 0;
+static u_int32_t deadlineHeapCapacity = 0;
+
 typedef struct timerQueueList
 {
     timerObj_t *timerObj;
@@ -69,6 +92,9 @@ typedef struct timerQueueList
 static timerQueueList *enqueueList = NULL;
 static timerQueueList *dequeueList = NULL;
 
+PCD_POOL_DECLARE( timerPool, "timers", timerObj_t, CONFIG_PCD_POOL_TIMERS );
+PCD_POOL_DECLARE( queuePool, "timer queue", timerQueueList, CONFIG_PCD_POOL_QUEUE );
+
 /* Functions to add to queues */
 static void PCD_timer_add_to_dequeue_list( timerObj_t *timerObj );
 static void PCD_timer_add_to_enqueue_list( rule_t *rule );
@@ -84,7 +110,22 @@ static void PCD_timer_enqueue_handle( void );
 
 /* Handle conditions */
 static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj );
-static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj );
+static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj, u_int64_t now );
+static void PCD_timer_start_end_condition( timerObj_t *timerObj );
+static timerObj_t **PCD_timer_get_wait_list( timerObj_t *timerObj );
+
+/* Ready and wait list functions */
+static void PCD_timer_ready_add( timerObj_t *timerObj );
+static void PCD_timer_ready_del( timerObj_t *timerObj );
+static void PCD_timer_wait_set( timerObj_t *timerObj, timerObj_t **waitList );
+
+/* Deadline heap functions */
+static void PCD_timer_heap_set( u_int32_t idx, timerObj_t *timerObj );
+static void PCD_timer_heap_sift_up( u_int32_t idx );
+static void PCD_timer_heap_sift_down( u_int32_t idx );
+static PCD_status_e PCD_timer_heap_push( timerObj_t *timerObj );
+static void PCD_timer_heap_remove( timerObj_t *timerObj );
+static void PCD_timer_update_deadline( timerObj_t *timerObj, u_int64_t now );
 
 #define PCD_START_COND_KEYWORD( keyword ) \
     &PCD_START_COND_FUNCTION( keyword ),
@@ -118,41 +159,107 @@ extern int32_t errno;
 
 PCD_status_e PCD_timer_init( void )
 {
+    /* Every timer object is at most once in the heap, size it as the timer pool
+       so that it grows only when the pool does */
+    deadlineHeap = malloc( CONFIG_PCD_POOL_TIMERS * sizeof( timerObj_t * ) );
+
+    if ( !deadlineHeap )
+    {
+        PCD_PRINTF_STDERR( "memory allocation failure" );
+        return PCD_STATUS_NOK;
+    }
+
+    deadlineHeapCapacity = CONFIG_PCD_POOL_TIMERS;
+
     return PCD_STATUS_OK;
 }
 
 bool_t PCD_timer_iterate( void )
 {
-    timerObj_t *searchList;
+    timerObj_t *timerObj;
+    timerObj_t *readyObjs;
     bool_t processFlag = False;
+    u_int64_t now;
 
     /* Check if we have something to do */
     if ( ( timerEnabled == False ) || ( !timerObjHead ) )
+    {
         return False;
+    }
 
-    searchList = timerObjHead;
+    now = PCD_event_get_time();
 
-    while ( searchList )
+    /* Rules whose deadline expired */
+    while ( ( deadlineHeapSize > 0 ) && ( deadlineHeap[ 0 ]->deadline <= now ) )
+    {
+        timerObj = deadlineHeap[ 0 ];
+        PCD_timer_heap_remove( timerObj );
+        PCD_timer_ready_add( timerObj );
+    }
+
+    /* Polled conditions are checked once in a tick */
+    if ( ( pollList ) && ( now - lastPollTime >= PCD_TIMER_TICK ) )
+    {
+        for ( timerObj = pollList; timerObj; timerObj = timerObj->waitNext )
+        {
+            PCD_timer_ready_add( timerObj );
+        }
+
+        lastPollTime = now;
+    }
+
+    /* A watched file or network device changed */
+    if ( watchChanged )
+    {
+        for ( timerObj = watchList; timerObj; timerObj = timerObj->waitNext )
+        {
+            PCD_timer_ready_add( timerObj );
+        }
+
+        watchChanged = False;
+    }
+
+    /* Check only the ready rules. Rules which become ready while checking,
+       such as the dependents of a completed rule, are checked on the next iteration */
+    readyObjs = readyList;
+    readyList = NULL;
+
+    while ( readyObjs )
     {
-        rule_t *rule = searchList->rule;
+        timerObj = readyObjs;
+        readyObjs = timerObj->readyNext;
+
+        timerObj->ready = False;
+        timerObj->readyPrev = NULL;
+        timerObj->readyNext = NULL;
 
-        switch ( rule->ruleState )
+        switch ( timerObj->rule->ruleState )
         {
             case PCD_RULE_START_CONDITION_WAITING:
-                processFlag |= PCD_timer_handle_start_condition( searchList );
+                processFlag |= PCD_timer_handle_start_condition( timerObj );
                 break;
 
             case PCD_RULE_END_CONDITION_WAITING:
-                processFlag |= PCD_timer_handle_end_condition( searchList );
+                processFlag |= PCD_timer_handle_end_condition( timerObj, now );
                 break;
 
             default:
                 /* Remove from queue */
-                PCD_timer_add_to_dequeue_list( searchList );
+                PCD_timer_add_to_dequeue_list( timerObj );
                 break;
         }
 
-        searchList = searchList->next;
+        if ( timerObj->dequeued )
+            continue;
+
+        /* Re-arm an expired deadline of a rule which is still waiting */
+        if ( timerObj->heapIndex == PCD_TIMER_HEAP_NONE )
+        {
+            PCD_timer_update_deadline( timerObj, now );
+        }
+
+        /* Find out what wakes the rule up next time */
+        PCD_timer_wait_set( timerObj, PCD_timer_get_wait_list( timerObj ) );
     }
 
     /* Enqueue and Dequeue as required, note that we still have the semaphore! */
@@ -162,6 +269,61 @@ bool_t PCD_timer_iterate( void )
     return processFlag;
 }
 
+bool_t PCD_timer_is_idle( void )
+{
+    return ( timerObjHead == NULL ) ? True : False;
+}
+
+u_int32_t PCD_timer_get_timeout( void )
+{
+    u_int32_t timeout = PCD_EVENT_TIMEOUT_FOREVER;
+    u_int64_t now;
+
+    if ( ( timerEnabled == False ) || ( !timerObjHead ) )
+        return PCD_EVENT_TIMEOUT_FOREVER;
+
+    /* Notified rules, such as the dependents of a completed rule, are checked right away */
+    if ( ( readyList ) || ( watchChanged ) )
+        return 0;
+
+    now = PCD_event_get_time();
+
+    /* Sleep exactly until the nearest deadline */
+    if ( deadlineHeapSize > 0 )
+    {
+        if ( deadlineHeap[ 0 ]->deadline <= now )
+            return 0;
+
+        if ( deadlineHeap[ 0 ]->deadline - now < PCD_EVENT_TIMEOUT_FOREVER )
+            timeout = (u_int32_t)( deadlineHeap[ 0 ]->deadline - now );
+    }
+
+    /* Conditions without a deadline or an event are polled every tick */
+    if ( pollList )
+    {
+        u_int64_t elapsed = now - lastPollTime;
+        u_int32_t remaining = ( elapsed >= PCD_TIMER_TICK ) ? 0 : PCD_TIMER_TICK - (u_int32_t)elapsed;
+
+        if ( remaining < timeout )
+            timeout = remaining;
+    }
+
+    return timeout;
+}
+
+void PCD_timer_notify_rule( rule_t *rule )
+{
+    if ( ( rule ) && ( rule->timerObj ) )
+    {
+        PCD_timer_ready_add( rule->timerObj );
+    }
+}
+
+void PCD_timer_notify_watch( void )
+{
+    watchChanged = True;
+}
+
 PCD_status_e PCD_timer_start( void )
 {
     timerEnabled = True;
@@ -177,6 +339,16 @@ PCD_status_e PCD_timer_stop( void )
 
 static void PCD_timer_dequeue( timerObj_t *timerObj )
 {
+    PCD_timer_heap_remove( timerObj );
+    PCD_timer_ready_del( timerObj );
+    PCD_timer_wait_set( timerObj, NULL );
+    PCD_filewatch_release( timerObj->fileWatch );
+
+    if ( timerObj->rule->timerObj == timerObj )
+    {
+        timerObj->rule->timerObj = NULL;
+    }
+
     /* Remove from timer queue */
     if ( timerObj->prev )
     {
@@ -192,8 +364,13 @@ static void PCD_timer_dequeue( timerObj_t *timerObj )
     {
         timerObj->next->prev = timerObj->prev;
     }
+    else
+    {
+        /* No tail */
+        timerObjTail = timerObj->prev;
+    }
 
-    free( timerObj );
+    PCD_pool_free( &timerPool, timerObj );
     timerObj = NULL;
 }
 
@@ -205,7 +382,7 @@ static timerObj_t *PCD_timer_new( rule_t *rule )
         return NULL;
 
     /* Create a new timer object */
-    newObj = malloc( sizeof( timerObj_t ) );
+    newObj = PCD_pool_alloc( &timerPool );
 
     if ( !newObj )
     {
@@ -217,32 +394,50 @@ static timerObj_t *PCD_timer_new( rule_t *rule )
     newObj->endCondCheckFunc = PCD_end_cond_check_get_function( rule->endCondition.type );
     newObj->failureActionFunc = PCD_failure_action_get_function( rule->failureAction.action );
     newObj->rule = rule;
-    newObj->timeout = rule->timeout;
+    newObj->timeoutDeadline = 0;
+    newObj->deadline = 0;
+    newObj->heapIndex = PCD_TIMER_HEAP_NONE;
+    newObj->fileWatch = NULL;
+    newObj->retry = False;
+    newObj->ready = False;
+    newObj->dequeued = False;
     newObj->prev = NULL;
     newObj->next = NULL;
+    newObj->readyPrev = NULL;
+    newObj->readyNext = NULL;
+    newObj->waitPrev = NULL;
+    newObj->waitNext = NULL;
+    newObj->waitList = NULL;
+
+    /* New objects wait for the start condition */
+    if ( rule->startCondition.type == PCD_START_COND_KEYWORD_FILE )
+    {
+        newObj->fileWatch = PCD_filewatch_add( rule->startCondition.filename );
+    }
 
     return newObj;
 }
 
 static void PCD_timer_enqueue( timerObj_t *newObj )
 {
-    timerObj_t *timerObj = timerObjHead;
+    /* Link the rule to its dependencies once, their state changes keep the count afterwards */
+    newObj->rule->pendingDeps = PCD_rulesdb_count_pending_deps( newObj->rule );
+
+    /* Check the start condition on the next iteration */
+    newObj->rule->timerObj = newObj;
+    PCD_timer_ready_add( newObj );
 
     if ( !timerObjHead )
     {
         /* Create the new head */
-        timerObjHead = newObj;
+        timerObjHead = timerObjTail = newObj;
         return;
     }
 
-    while ( timerObj->next )
-    {
-        timerObj = timerObj->next;
-    }
-
     /* Put new object in the end */
-    timerObj->next = newObj;
-    newObj->prev = timerObj;
+    timerObjTail->next = newObj;
+    newObj->prev = timerObjTail;
+    timerObjTail = newObj;
 }
 
 PCD_status_e PCD_timer_enqueue_rule( rule_t *rule )
@@ -265,7 +460,7 @@ PCD_status_e PCD_timer_enqueue_rule( rule_t *rule )
     }
 
     /* Enqueue the new rule in the timer queue */
-    rule->ruleState = PCD_RULE_START_CONDITION_WAITING;
+    PCD_rulesdb_set_rule_state( rule, PCD_RULE_START_CONDITION_WAITING );
     PCD_timer_enqueue( newObj );
 
     return PCD_STATUS_OK;
@@ -273,50 +468,37 @@ PCD_status_e PCD_timer_enqueue_rule( rule_t *rule )
 
 PCD_status_e PCD_timer_dequeue_rule( rule_t *rule, bool_t failed )
 {
-    timerObj_t *searchList;
-
     if ( !rule )
         return PCD_STATUS_NOK;
 
-    searchList = timerObjHead;
+    if ( !rule->timerObj )
+        return PCD_STATUS_INVALID_RULE;
 
-    while ( searchList )
+    /* In this case, a process is already running. We need to stop it first */
+    if ( rule->proc )
     {
-        /* Find the requsted rule to be removed */
-        if ( searchList->rule == rule )
-        {
-            /* In this case, a process is already running. We need to stop it first */
-            if ( rule->proc )
-            {
-                PCD_process_stop( rule, False, NULL );
-            }
-
-            /* Remove from queue */
-            PCD_timer_dequeue( searchList );
+        PCD_process_stop( rule, False, NULL );
+    }
 
-            /* Failed flag comes only from process module, which detects process failures */
-            if ( failed )
-            {
-                rule->ruleState = PCD_RULE_FAILED;
-            }
-            else
-            {
-                /* Do not change rule state if it completed successfully or idle */
-                if ( ( rule->ruleState != PCD_RULE_COMPLETED ) && ( rule->ruleState != PCD_RULE_IDLE ) )
-                {
-                    /* We are here because the rule did not complete */
-                    rule->ruleState = PCD_RULE_NOT_COMPLETED;
-                }
-            }
+    /* Remove from queue */
+    PCD_timer_dequeue( rule->timerObj );
 
-            return PCD_STATUS_OK;
+    /* Failed flag comes only from process module, which detects process failures */
+    if ( failed )
+    {
+        PCD_rulesdb_set_rule_state( rule, PCD_RULE_FAILED );
+    }
+    else
+    {
+        /* Do not change rule state if it completed successfully or idle */
+        if ( ( rule->ruleState != PCD_RULE_COMPLETED ) && ( rule->ruleState != PCD_RULE_IDLE ) )
+        {
+            /* We are here because the rule did not complete */
+            PCD_rulesdb_set_rule_state( rule, PCD_RULE_NOT_COMPLETED );
         }
-
-        searchList = searchList->next;
     }
 
-
-    return PCD_STATUS_INVALID_RULE;
+    return PCD_STATUS_OK;
 }
 
 static void PCD_timer_dequeue_handle( void )
@@ -335,7 +517,7 @@ static void PCD_timer_dequeue_handle( void )
         searchListTmp = searchList;
         searchList = searchList->next;
 
-        free( searchListTmp );
+        PCD_pool_free( &queuePool, searchListTmp );
         searchListTmp = NULL;
     }
 
@@ -362,7 +544,7 @@ static void PCD_timer_enqueue_handle( void )
         }
 
         /* Set rule to start condition */
-        searchList->rule->ruleState = PCD_RULE_START_CONDITION_WAITING;
+        PCD_rulesdb_set_rule_state( searchList->rule, PCD_RULE_START_CONDITION_WAITING );
 
         /* Add new object to timer list */
         PCD_timer_enqueue( newObj );
@@ -370,7 +552,7 @@ static void PCD_timer_enqueue_handle( void )
         searchListTmp = searchList;
         searchList = searchList->next;
 
-        free( searchListTmp );
+        PCD_pool_free( &queuePool, searchListTmp );
         searchListTmp = NULL;
     }
 
@@ -382,7 +564,11 @@ static void PCD_timer_add_to_dequeue_list( timerObj_t *timerObj )
     timerQueueList *searchList = dequeueList;
     timerQueueList *newObj;
 
-    newObj = malloc( sizeof( timerQueueList) );
+    /* The object may already be on its way out */
+    if ( timerObj->dequeued )
+        return;
+
+    newObj = PCD_pool_alloc( &queuePool );
 
     if ( !newObj )
     {
@@ -390,6 +576,9 @@ static void PCD_timer_add_to_dequeue_list( timerObj_t *timerObj )
         return;
     }
 
+    timerObj->dequeued = True;
+    PCD_timer_ready_del( timerObj );
+
     newObj->timerObj = timerObj;
     newObj->rule = NULL;
     newObj->next = searchList;
@@ -406,7 +595,7 @@ static void PCD_timer_add_to_enqueue_list( rule_t *rule )
     if ( !rule )
         return;
 
-    newObj = malloc( sizeof( timerQueueList) );
+    newObj = PCD_pool_alloc( &queuePool );
 
     if ( !newObj )
     {
@@ -427,6 +616,8 @@ static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj )
     PCD_status_e retval;
     PCD_DEBUG_PRINTF( "Rule %s_%s: Waiting for start condition", rule->ruleId.groupName, rule->ruleId.ruleName );
 
+    timerObj->retry = False;
+
     if ( timerObj->startCondCheckFunc )
     {
         /* Check start condition */
@@ -447,7 +638,7 @@ static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj )
             PCD_DEBUG_PRINTF( "Rule %s_%s: Pseudo rule start condition success", rule->ruleId.groupName, rule->ruleId.ruleName );
 
             /* Update rule state */
-            rule->ruleState = PCD_RULE_END_CONDITION_WAITING;
+            PCD_timer_start_end_condition( timerObj );
             return False;
         }
 
@@ -455,7 +646,7 @@ static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj )
         if ( ( retval = PCD_process_enqueue( rule ) ) == PCD_STATUS_OK )
         {
             /* Update rule state */
-            rule->ruleState = PCD_RULE_END_CONDITION_WAITING;
+            PCD_timer_start_end_condition( timerObj );
             return True;
         }
         else
@@ -464,8 +655,9 @@ static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj )
             if ( retval == PCD_STATUS_INVALID_RULE )
             {
                 /* In this case, we already have a running process (how could this be??)
-                 Lets kill it and try again in the next iteration */
+                 Lets kill it and try again in the next tick */
                 PCD_process_stop( rule, True, NULL );
+                timerObj->retry = True;
 
                 return True;
             }
@@ -475,7 +667,7 @@ static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj )
                 PCD_PRINTF_STDERR( "Rule %s_%s: Failed to enqueue process %s", rule->ruleId.groupName, rule->ruleId.ruleName, rule->command );
 
                 /* We failed */
-                rule->ruleState = PCD_RULE_FAILED;
+                PCD_rulesdb_set_rule_state( rule, PCD_RULE_FAILED );
 
                 /* Remove from queue */
                 PCD_timer_add_to_dequeue_list( timerObj );
@@ -488,11 +680,16 @@ static bool_t PCD_timer_handle_start_condition( timerObj_t *timerObj )
             }
         }
     }
+    else if ( rule->ruleState != PCD_RULE_START_CONDITION_WAITING )
+    {
+        /* The condition can never be satisfied */
+        PCD_timer_add_to_dequeue_list( timerObj );
+    }
 
     return False;
 }
 
-static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj )
+static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj, u_int64_t now )
 {
     rule_t *rule = timerObj->rule;
     PCD_status_e retval;
@@ -513,6 +710,8 @@ static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj )
     /* Condition ok, remove from queue */
     if ( retval == PCD_STATUS_OK )
     {
+        PCD_TRACE( rule, PCD_TRACE_END_COND, 0 );
+
         if ( rule->proc )
         {
             PCD_PRINTF_STDOUT( "Rule %s_%s: Success (Process %s (%d))", rule->ruleId.groupName, rule->ruleId.ruleName, rule->command, rule->proc->pid );
@@ -523,7 +722,7 @@ static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj )
         }
 
 
-        rule->ruleState = PCD_RULE_COMPLETED;
+        PCD_rulesdb_set_rule_state( rule, PCD_RULE_COMPLETED );
 
         /* Remove from queue */
         PCD_timer_add_to_dequeue_list( timerObj );
@@ -531,19 +730,20 @@ static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj )
     }
 
     /* Check if Timeout is forever */
-    if ( timerObj->timeout == ~0 )
+    if ( timerObj->timeoutDeadline == 0 )
         return False;
 
     /* Now check if timeout expiered */
-    if ( timerObj->timeout == 0 )
+    if ( now >= timerObj->timeoutDeadline )
     {
         PCD_PRINTF_STDERR( "Rule %s_%s: Timeout", rule->ruleId.groupName, rule->ruleId.ruleName );
+        rule->stats.timeouts++;
 
         /* If a process is running, kill it */
         if ( rule->proc )
             PCD_process_stop( rule, True, NULL );
 
-        rule->ruleState = PCD_RULE_NOT_COMPLETED;
+        PCD_rulesdb_set_rule_state( rule, PCD_RULE_NOT_COMPLETED );
 
         /* Remove from queue */
         PCD_timer_add_to_dequeue_list( timerObj );
@@ -556,20 +756,296 @@ static bool_t PCD_timer_handle_end_condition( timerObj_t *timerObj )
 
         return True;
     }
-    else
+
+    return False;
+}
+
+static void PCD_timer_start_end_condition( timerObj_t *timerObj )
+{
+    rule_t *rule = timerObj->rule;
+    u_int64_t now = PCD_event_get_time();
+
+    PCD_rulesdb_set_rule_state( rule, PCD_RULE_END_CONDITION_WAITING );
+
+    /* Both the end condition timeout and the WAIT delay count from now */
+    timerObj->timeoutDeadline = ( rule->timeout == ~0 ) ? 0 : now + rule->timeout;
+
+    if ( rule->endCondition.type == PCD_END_COND_KEYWORD_WAIT )
+    {
+        rule->endCondition.waitDeadline = now + rule->endCondition.delay[ 1 ];
+    }
+
+    PCD_timer_update_deadline( timerObj, now );
+
+    /* Replace the watch of the start condition */
+    PCD_filewatch_release( timerObj->fileWatch );
+    timerObj->fileWatch = NULL;
+
+    if ( rule->endCondition.type == PCD_END_COND_KEYWORD_FILE )
     {
-        if ( timerObj->timeout <= PCD_TIMER_TICK )
+        timerObj->fileWatch = PCD_filewatch_add( rule->endCondition.filename );
+    }
+
+    /* Check the end condition on the next iteration */
+    PCD_timer_ready_add( timerObj );
+}
+
+static timerObj_t **PCD_timer_get_wait_list( timerObj_t *timerObj )
+{
+    rule_t *rule = timerObj->rule;
+
+    switch ( rule->ruleState )
+    {
+        case PCD_RULE_START_CONDITION_WAITING:
+            if ( timerObj->retry )
+                return &pollList;
+
+            /* Watched files wake the main loop up */
+            if ( rule->startCondition.type == PCD_START_COND_KEYWORD_FILE )
+                return PCD_filewatch_is_active( timerObj->fileWatch ) ? &watchList : &pollList;
+
+            if ( rule->startCondition.type == PCD_START_COND_KEYWORD_NETDEVICE )
+                return PCD_netwatch_is_active() ? &watchList : &pollList;
+
+            /* Completed rules notify their dependents */
+            if ( ( rule->startCondition.type == PCD_START_COND_KEYWORD_NONE ) ||
+                 ( rule->startCondition.type == PCD_START_COND_KEYWORD_RULE_COMPLETED ) )
+                return NULL;
+
+            return &pollList;
+
+        case PCD_RULE_END_CONDITION_WAITING:
+            /* A deadline which could not be queued is polled as well */
+            if ( ( timerObj->deadline ) && ( timerObj->heapIndex == PCD_TIMER_HEAP_NONE ) )
+                return &pollList;
+
+            if ( rule->endCondition.type == PCD_END_COND_KEYWORD_FILE )
+                return PCD_filewatch_is_active( timerObj->fileWatch ) ? &watchList : &pollList;
+
+            if ( rule->endCondition.type == PCD_END_COND_KEYWORD_NETDEVICE )
+                return PCD_netwatch_is_active() ? &watchList : &pollList;
+
+            /* Process exit and readiness notify the rule, WAIT has a deadline */
+            return ( rule->endCondition.type == PCD_END_COND_KEYWORD_IPC_OWNER ) ? &pollList : NULL;
+
+        default:
+            return NULL;
+    }
+}
+
+static void PCD_timer_ready_add( timerObj_t *timerObj )
+{
+    if ( ( timerObj->ready ) || ( timerObj->dequeued ) )
+        return;
+
+    timerObj->ready = True;
+    timerObj->readyPrev = NULL;
+    timerObj->readyNext = readyList;
+
+    if ( readyList )
+    {
+        readyList->readyPrev = timerObj;
+    }
+
+    readyList = timerObj;
+}
+
+static void PCD_timer_ready_del( timerObj_t *timerObj )
+{
+    if ( !timerObj->ready )
+        return;
+
+    if ( timerObj->readyPrev )
+    {
+        timerObj->readyPrev->readyNext = timerObj->readyNext;
+    }
+    else if ( readyList == timerObj )
+    {
+        readyList = timerObj->readyNext;
+    }
+
+    if ( timerObj->readyNext )
+    {
+        timerObj->readyNext->readyPrev = timerObj->readyPrev;
+    }
+
+    timerObj->ready = False;
+    timerObj->readyPrev = NULL;
+    timerObj->readyNext = NULL;
+}
+
+static void PCD_timer_wait_set( timerObj_t *timerObj, timerObj_t **waitList )
+{
+    if ( timerObj->waitList == waitList )
+        return;
+
+    /* Leave the current list */
+    if ( timerObj->waitList )
+    {
+        if ( timerObj->waitPrev )
         {
-            /* Round timeout for the next iteration */
-            timerObj->timeout = 0;
+            timerObj->waitPrev->waitNext = timerObj->waitNext;
         }
         else
         {
-            /* Reduce a tick */
-            timerObj->timeout -= PCD_TIMER_TICK;
+            *timerObj->waitList = timerObj->waitNext;
+        }
+
+        if ( timerObj->waitNext )
+        {
+            timerObj->waitNext->waitPrev = timerObj->waitPrev;
         }
     }
 
-    return False;
+    timerObj->waitList = waitList;
+    timerObj->waitPrev = NULL;
+    timerObj->waitNext = NULL;
+
+    if ( !waitList )
+        return;
+
+    /* Join the new list */
+    timerObj->waitNext = *waitList;
+
+    if ( *waitList )
+    {
+        ( *waitList )->waitPrev = timerObj;
+    }
+
+    *waitList = timerObj;
+}
+
+static void PCD_timer_heap_set( u_int32_t idx, timerObj_t *timerObj )
+{
+    deadlineHeap[ idx ] = timerObj;
+    timerObj->heapIndex = idx;
+}
+
+static void PCD_timer_heap_sift_up( u_int32_t idx )
+{
+    timerObj_t *timerObj = deadlineHeap[ idx ];
+
+    while ( idx > 0 )
+    {
+        u_int32_t parent = ( idx - 1 ) / 2;
+
+        if ( deadlineHeap[ parent ]->deadline <= timerObj->deadline )
+            break;
+
+        PCD_timer_heap_set( idx, deadlineHeap[ parent ] );
+        idx = parent;
+    }
+
+    PCD_timer_heap_set( idx, timerObj );
+}
+
+static void PCD_timer_heap_sift_down( u_int32_t idx )
+{
+    timerObj_t *timerObj = deadlineHeap[ idx ];
+
+    while ( True )
+    {
+        u_int32_t child = ( idx * 2 ) + 1;
+
+        if ( child >= deadlineHeapSize )
+            break;
+
+        /* Pick the nearer of the two children */
+        if ( ( child + 1 < deadlineHeapSize ) && ( deadlineHeap[ child + 1 ]->deadline < deadlineHeap[ child ]->deadline ) )
+            child++;
+
+        if ( timerObj->deadline <= deadlineHeap[ child ]->deadline )
+            break;
+
+        PCD_timer_heap_set( idx, deadlineHeap[ child ] );
+        idx = child;
+    }
+
+    PCD_timer_heap_set( idx, timerObj );
+}
+
+static PCD_status_e PCD_timer_heap_push( timerObj_t *timerObj )
+{
+    if ( deadlineHeapSize == deadlineHeapCapacity )
+    {
+        u_int32_t newCapacity = deadlineHeapCapacity ? ( deadlineHeapCapacity * 2 ) : 16;
+        timerObj_t **newHeap;
+
+        newHeap = realloc( deadlineHeap, newCapacity * sizeof( timerObj_t * ) );
+
+        if ( !newHeap )
+        {
+            PCD_PRINTF_STDERR( "memory allocation failure" );
+            return PCD_STATUS_NOK;
+        }
+
+        deadlineHeap = newHeap;
+        deadlineHeapCapacity = newCapacity;
+    }
+
+    deadlineHeap[ deadlineHeapSize ] = timerObj;
+    deadlineHeapSize++;
+    PCD_timer_heap_sift_up( deadlineHeapSize - 1 );
+
+    return PCD_STATUS_OK;
 }
 
+static void PCD_timer_heap_remove( timerObj_t *timerObj )
+{
+    u_int32_t idx = timerObj->heapIndex;
+    timerObj_t *last;
+
+    if ( idx == PCD_TIMER_HEAP_NONE )
+        return;
+
+    timerObj->heapIndex = PCD_TIMER_HEAP_NONE;
+    deadlineHeapSize--;
+
+    if ( idx == deadlineHeapSize )
+        return;
+
+    /* Fill the hole with the last object and restore the heap order */
+    last = deadlineHeap[ deadlineHeapSize ];
+    PCD_timer_heap_set( idx, last );
+
+    if ( ( idx > 0 ) && ( deadlineHeap[ ( idx - 1 ) / 2 ]->deadline > last->deadline ) )
+    {
+        PCD_timer_heap_sift_up( idx );
+    }
+    else
+    {
+        PCD_timer_heap_sift_down( idx );
+    }
+}
+
+static void PCD_timer_update_deadline( timerObj_t *timerObj, u_int64_t now )
+{
+    rule_t *rule = timerObj->rule;
+    u_int64_t deadline = 0;
+
+    PCD_timer_heap_remove( timerObj );
+
+    /* Only rules waiting for the end condition have deadlines */
+    if ( rule->ruleState == PCD_RULE_END_CONDITION_WAITING )
+    {
+        if ( timerObj->timeoutDeadline > now )
+        {
+            deadline = timerObj->timeoutDeadline;
+        }
+
+        if ( ( rule->endCondition.type == PCD_END_COND_KEYWORD_WAIT ) && ( rule->endCondition.waitDeadline > now ) )
+        {
+            if ( ( !deadline ) || ( rule->endCondition.waitDeadline < deadline ) )
+            {
+                deadline = rule->endCondition.waitDeadline;
+            }
+        }
+    }
+
+    timerObj->deadline = deadline;
+
+    if ( deadline )
+    {
+        PCD_timer_heap_push( timerObj );
+    }
+}
@@ -0,0 +1,379 @@
+/*
+ * trace.c
+ * Description:
+ * PCD rule state trace implementation file
+ *
+ * Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Author:
+ * Hai Shalom, hai@rt-embedded.com
+ *
+ * PCD Homepage: http://www.rt-embedded.com/pcd/
+ * PCD Project at SourceForge: http://sourceforge.net/projects/pcd/
+ *
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "system_types.h"
+#include "rules_db.h"
+#include "trace.h"
+#include "pcd.h"
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#if CONFIG_PCD_TRACE_ENTRIES > 0
+
+/* The trace has one process per rule group, and one thread per rule. Each
+   rule shows the time it waited for its start and end conditions as slices,
+   and every event as an instant */
+
+/* Slice of a rule which is open in the trace */
+typedef enum
+{
+    PCD_TRACE_SLICE_NONE,
+    PCD_TRACE_SLICE_START_COND,
+    PCD_TRACE_SLICE_END_COND,
+
+} traceSlice_e;
+
+typedef struct traceEntry_t
+{
+    u_int64_t           timestamp;      /* Monotonic time in us */
+    const rule_t        *rule;
+    int32_t             value;
+    pcdTraceEvent_e     event;
+
+} traceEntry_t;
+
+typedef struct traceTrack_t
+{
+    const rule_t        *rule;
+    u_int32_t           pid;            /* Group number */
+    u_int32_t           tid;            /* Rule number */
+    u_int32_t           first;          /* First event of the rule, orders the tracks in the viewer */
+    traceSlice_e        slice;
+
+} traceTrack_t;
+
+static const char *traceEventNames[ PCD_TRACE_LAST ] =
+{
+    "enqueue",
+    "start_cond",
+    "spawn",
+    "exec",
+    "ready",
+    "end_cond",
+    "completed",
+    "not_completed",
+    "failed",
+    "idle",
+    "exit",
+};
+
+static const char *traceSliceNames[] =
+{
+    NULL,
+    "START_COND",
+    "END_COND",
+};
+
+static traceEntry_t traceBuffer[ CONFIG_PCD_TRACE_ENTRIES ];
+
+/* Number of events recorded since startup */
+static u_int32_t traceCount = 0;
+
+#endif
+
+static const char *traceOutput = NULL;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+void PCD_trace_add( const rule_t *rule, pcdTraceEvent_e event, int32_t value )
+{
+#if CONFIG_PCD_TRACE_ENTRIES > 0
+    traceEntry_t *entry = &traceBuffer[ traceCount % CONFIG_PCD_TRACE_ENTRIES ];
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    entry->timestamp = ( (u_int64_t)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+    entry->rule = rule;
+    entry->value = value;
+    entry->event = event;
+
+    traceCount++;
+#endif
+}
+
+#if CONFIG_PCD_TRACE_ENTRIES > 0
+static int PCD_trace_track_cmp( const void *a, const void *b )
+{
+    const rule_t *ruleA = ( (const traceTrack_t *)a )->rule;
+    const rule_t *ruleB = ( (const traceTrack_t *)b )->rule;
+
+    /* Rules of the same group are adjacent */
+    if ( ruleA->group != ruleB->group )
+        return ( ruleA->group < ruleB->group ) ? -1 : 1;
+
+    if ( ruleA != ruleB )
+        return ( ruleA < ruleB ) ? -1 : 1;
+
+    return 0;
+}
+
+/* Build the tracks of the rules which appear in the trace, sorted by group and rule */
+static traceTrack_t *PCD_trace_build_tracks( u_int32_t first, u_int32_t numEntries, u_int32_t *numTracks )
+{
+    traceTrack_t *tracks;
+    u_int32_t i, num = 0;
+
+    tracks = malloc( numEntries * sizeof( traceTrack_t ) );
+
+    if ( !tracks )
+        return NULL;
+
+    for ( i = 0; i < numEntries; i++ )
+    {
+        tracks[ i ].rule = traceBuffer[ ( first + i ) % CONFIG_PCD_TRACE_ENTRIES ].rule;
+        tracks[ i ].first = i;
+    }
+
+    qsort( tracks, numEntries, sizeof( traceTrack_t ), PCD_trace_track_cmp );
+
+    for ( i = 0; i < numEntries; i++ )
+    {
+        if ( ( num > 0 ) && ( tracks[ num - 1 ].rule == tracks[ i ].rule ) )
+        {
+            if ( tracks[ i ].first < tracks[ num - 1 ].first )
+                tracks[ num - 1 ].first = tracks[ i ].first;
+            continue;
+        }
+
+        tracks[ num ].rule = tracks[ i ].rule;
+        tracks[ num ].first = tracks[ i ].first;
+        tracks[ num ].slice = PCD_TRACE_SLICE_NONE;
+
+        if ( num == 0 )
+        {
+            tracks[ num ].pid = 1;
+            tracks[ num ].tid = 1;
+        }
+        else if ( tracks[ num - 1 ].rule->group != tracks[ num ].rule->group )
+        {
+            tracks[ num ].pid = tracks[ num - 1 ].pid + 1;
+            tracks[ num ].tid = 1;
+        }
+        else
+        {
+            tracks[ num ].pid = tracks[ num - 1 ].pid;
+            tracks[ num ].tid = tracks[ num - 1 ].tid + 1;
+        }
+
+        num++;
+    }
+
+    *numTracks = num;
+
+    return tracks;
+}
+
+static void PCD_trace_write_slice( FILE *out, traceTrack_t *track, traceSlice_e slice, u_int64_t timestamp )
+{
+    if ( track->slice != PCD_TRACE_SLICE_NONE )
+    {
+        fprintf( out, ",\n{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%llu,\"pid\":%u,\"tid\":%u}",
+                 traceSliceNames[ track->slice ], (unsigned long long)timestamp, track->pid, track->tid );
+    }
+
+    if ( slice != PCD_TRACE_SLICE_NONE )
+    {
+        fprintf( out, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%llu,\"pid\":%u,\"tid\":%u}",
+                 traceSliceNames[ slice ], (unsigned long long)timestamp, track->pid, track->tid );
+    }
+
+    track->slice = slice;
+}
+
+static void PCD_trace_write_event( FILE *out, const traceEntry_t *entry, traceTrack_t *track )
+{
+    fprintf( out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":%u,\"tid\":%u",
+             traceEventNames[ entry->event ], (unsigned long long)entry->timestamp, track->pid, track->tid );
+
+    if ( entry->event == PCD_TRACE_EXEC )
+    {
+        fprintf( out, ",\"args\":{\"pid\":%d}", entry->value );
+    }
+    else if ( entry->event == PCD_TRACE_EXIT )
+    {
+        if ( WIFSIGNALED( entry->value ) )
+            fprintf( out, ",\"args\":{\"signal\":%d}", WTERMSIG( entry->value ) );
+        else
+            fprintf( out, ",\"args\":{\"status\":%d}", WEXITSTATUS( entry->value ) );
+    }
+
+    fprintf( out, "}" );
+
+    switch ( entry->event )
+    {
+        case PCD_TRACE_ENQUEUE:
+            PCD_trace_write_slice( out, track, PCD_TRACE_SLICE_START_COND, entry->timestamp );
+            break;
+
+        case PCD_TRACE_START_COND:
+            PCD_trace_write_slice( out, track, PCD_TRACE_SLICE_END_COND, entry->timestamp );
+            break;
+
+        case PCD_TRACE_COMPLETED:
+        case PCD_TRACE_NOT_COMPLETED:
+        case PCD_TRACE_FAILED:
+        case PCD_TRACE_IDLE:
+            PCD_trace_write_slice( out, track, PCD_TRACE_SLICE_NONE, entry->timestamp );
+            break;
+
+        default:
+            break;
+    }
+}
+#endif
+
+PCD_status_e PCD_trace_dump( const char *filename, bool_t create )
+{
+#if CONFIG_PCD_TRACE_ENTRIES > 0
+    traceTrack_t *tracks = NULL;
+    u_int32_t first, numEntries, numTracks = 0, i;
+    FILE *out;
+
+    /* The oldest event is the next one to be overwritten */
+    numEntries = ( traceCount < CONFIG_PCD_TRACE_ENTRIES ) ? traceCount : CONFIG_PCD_TRACE_ENTRIES;
+    first = ( traceCount < CONFIG_PCD_TRACE_ENTRIES ) ? 0 : traceCount % CONFIG_PCD_TRACE_ENTRIES;
+
+    if ( ( numEntries > 0 ) && ( ( tracks = PCD_trace_build_tracks( first, numEntries, &numTracks ) ) == NULL ) )
+    {
+        PCD_PRINTF_STDERR( "Failed to allocate memory for the trace" );
+        return PCD_STATUS_NOK;
+    }
+
+    if ( create )
+    {
+        /* Never overwrite an existing file or follow a link, the name may come from any local user */
+        int32_t fd = open( filename, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+
+        out = ( fd >= 0 ) ? fdopen( fd, "w" ) : NULL;
+
+        if ( ( fd >= 0 ) && ( !out ) )
+            close( fd );
+    }
+    else
+    {
+        out = fopen( filename, "w" );
+    }
+
+    if ( !out )
+    {
+        PCD_PRINTF_STDERR( "Failed to open trace file %s", filename );
+        free( tracks );
+        return PCD_STATUS_NOK;
+    }
+
+    fprintf( out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"events\":%u,\"dropped\":%u},\"traceEvents\":[\n",
+             numEntries, traceCount - numEntries );
+
+    for ( i = 0; i < numTracks; i++ )
+    {
+        if ( ( i == 0 ) || ( tracks[ i ].pid != tracks[ i - 1 ].pid ) )
+        {
+            u_int32_t groupFirst = tracks[ i ].first, j;
+
+            /* Groups and rules appear in the order of their first event */
+            for ( j = i + 1; ( j < numTracks ) && ( tracks[ j ].pid == tracks[ i ].pid ); j++ )
+            {
+                if ( tracks[ j ].first < groupFirst )
+                    groupFirst = tracks[ j ].first;
+            }
+
+            /* Every event but the first one follows a separator */
+            fprintf( out, "%s{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"sort_index\":%u}}",
+                     ( i == 0 ) ? "" : ",\n", tracks[ i ].pid, groupFirst );
+
+            fprintf( out, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"%s\"}}",
+                     tracks[ i ].pid, tracks[ i ].rule->ruleId.groupName );
+        }
+
+        fprintf( out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 tracks[ i ].pid, tracks[ i ].tid, tracks[ i ].rule->ruleId.ruleName );
+
+        fprintf( out, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                 tracks[ i ].pid, tracks[ i ].tid, tracks[ i ].first );
+    }
+
+    for ( i = 0; i < numEntries; i++ )
+    {
+        const traceEntry_t *entry = &traceBuffer[ ( first + i ) % CONFIG_PCD_TRACE_ENTRIES ];
+        traceTrack_t key, *track;
+
+        key.rule = entry->rule;
+        track = bsearch( &key, tracks, numTracks, sizeof( traceTrack_t ), PCD_trace_track_cmp );
+
+        if ( track )
+            PCD_trace_write_event( out, entry, track );
+    }
+
+    fprintf( out, "\n]}\n" );
+
+    free( tracks );
+
+    if ( fclose( out ) != 0 )
+    {
+        PCD_PRINTF_STDERR( "Failed to write trace file %s", filename );
+        return PCD_STATUS_NOK;
+    }
+
+    PCD_PRINTF_STDOUT( "Wrote %u trace events to %s", numEntries, filename );
+
+    return PCD_STATUS_OK;
+#else
+    PCD_PRINTF_STDERR( "Rule tracing is disabled in this build" );
+
+    return PCD_STATUS_NOK;
+#endif
+}
+
+void PCD_trace_set_output( const char *filename )
+{
+    traceOutput = filename;
+}
+
+void PCD_trace_write_output( void )
+{
+    if ( traceOutput )
+        PCD_trace_dump( traceOutput, False );
+}
@@ -0,0 +1,382 @@
+/*
+ * pcd_stress.c
+ * Description:
+ * Runs PCD against a generated rules file and reports how it scales
+ *
+ * Copyright (C) 2010 PCD Project - http://www.rt-embedded.com/pcd
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* PCD is started in debug mode with verbose output. The parse time is taken
+ * from the "Loaded N rules in M ms" message, and the completion time from the
+ * file which the STRESS_DONE rule of pcd_stress_gen writes. PCD daemonizes,
+ * the runner is a child subreaper so the daemon is reparented to it and can be
+ * found among its children. Once the set has
+ * completed, the peak RSS and the CPU time of PCD are read from /proc, before
+ * PCD is terminated. The results are printed as a single line of key=value
+ * pairs.
+ *
+ * Usage: pcd_stress -p PCD -f FILE [-t timeout in seconds]
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define STRESS_DEFAULT_TIMEOUT_SEC      120
+#define STRESS_POLL_INTERVAL_MS         10
+
+/* Time given to PCD to stop all the rules on termination */
+#define STRESS_TERM_TIMEOUT_MS          30000
+
+#define STRESS_LOADED_MSG               "Loaded "
+
+typedef struct stressResult_t
+{
+    unsigned int        rules;
+    unsigned long       parseMs;
+    unsigned long long  completeMs;
+    unsigned long       peakRssKb;
+    unsigned long       cpuMs;
+    unsigned int        errors;
+
+} stressResult_t;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static unsigned long long stress_get_time_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (unsigned long long)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
+
+static void stress_handle_line( const char *line, stressResult_t *result )
+{
+    const char *sp;
+
+    if ( ( sp = strstr( line, STRESS_LOADED_MSG ) ) != NULL )
+    {
+        sscanf( sp, STRESS_LOADED_MSG "%u rules in %lu ms", &result->rules, &result->parseMs );
+    }
+    else if ( strstr( line, "Error" ) )
+    {
+        /* Failing rules make the results meaningless, show them */
+        fprintf( stderr, "%s\n", line );
+        result->errors++;
+    }
+}
+
+/* Read the output of PCD, and handle it line by line */
+static void stress_read_output( int fd, char *buffer, size_t size, size_t *len, stressResult_t *result )
+{
+    ssize_t n;
+    char *start, *end;
+
+    while ( ( n = read( fd, buffer + *len, size - *len - 1 ) ) > 0 )
+    {
+        *len += n;
+        buffer[ *len ] = '\0';
+
+        start = buffer;
+
+        while ( ( end = strchr( start, '\n' ) ) != NULL )
+        {
+            *end = '\0';
+            stress_handle_line( start, result );
+            start = end + 1;
+        }
+
+        /* Keep the partial line, drop a line which does not fit */
+        *len -= start - buffer;
+
+        if ( *len == size - 1 )
+            *len = 0;
+
+        memmove( buffer, start, *len );
+    }
+}
+
+static int stress_read_mark( const char *filename, unsigned long long *mark )
+{
+    FILE *in = fopen( filename, "r" );
+    int ret;
+
+    if ( !in )
+        return -1;
+
+    ret = ( fscanf( in, "%llu", mark ) == 1 ) ? 0 : -1;
+    fclose( in );
+
+    return ret;
+}
+
+static void stress_read_proc( pid_t pid, stressResult_t *result )
+{
+    char filename[ 64 ];
+    char line[ 256 ];
+    FILE *in;
+
+    snprintf( filename, sizeof( filename ), "/proc/%d/status", pid );
+
+    if ( ( in = fopen( filename, "r" ) ) != NULL )
+    {
+        while ( fgets( line, sizeof( line ), in ) )
+        {
+            if ( sscanf( line, "VmHWM: %lu", &result->peakRssKb ) == 1 )
+                break;
+        }
+
+        fclose( in );
+    }
+
+    snprintf( filename, sizeof( filename ), "/proc/%d/stat", pid );
+
+    if ( ( in = fopen( filename, "r" ) ) != NULL )
+    {
+        unsigned long utime, stime;
+        char *sp;
+
+        /* The process name may contain spaces, skip to the last parenthesis */
+        if ( ( fgets( line, sizeof( line ), in ) ) && ( ( sp = strrchr( line, ')' ) ) != NULL ) &&
+             ( sscanf( sp + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime ) == 2 ) )
+        {
+            result->cpuMs = ( ( utime + stime ) * 1000 ) / sysconf( _SC_CLK_TCK );
+        }
+
+        fclose( in );
+    }
+}
+
+/* Find the daemonized PCD, it is the only child of the runner */
+static pid_t stress_find_child( void )
+{
+    struct dirent *entry;
+    pid_t child = -1;
+    DIR *dir;
+
+    if ( ( dir = opendir( "/proc" ) ) == NULL )
+        return -1;
+
+    while ( ( child < 0 ) && ( ( entry = readdir( dir ) ) != NULL ) )
+    {
+        char filename[ PATH_MAX ];
+        char line[ 256 ];
+        FILE *in;
+        char *sp;
+        int ppid;
+
+        if ( ( entry->d_name[ 0 ] < '0' ) || ( entry->d_name[ 0 ] > '9' ) )
+            continue;
+
+        snprintf( filename, sizeof( filename ), "/proc/%s/stat", entry->d_name );
+
+        if ( ( in = fopen( filename, "r" ) ) == NULL )
+            continue;
+
+        if ( ( fgets( line, sizeof( line ), in ) ) && ( ( sp = strrchr( line, ')' ) ) != NULL ) &&
+             ( sscanf( sp + 2, "%*c %d", &ppid ) == 1 ) && ( ppid == getpid() ) )
+        {
+            child = atoi( entry->d_name );
+        }
+
+        fclose( in );
+    }
+
+    closedir( dir );
+
+    return child;
+}
+
+/* Terminate PCD, its output is drained by a child until it exits and closes the pipe */
+static void stress_stop( pid_t pid, int fd )
+{
+    unsigned long long deadline = stress_get_time_ms() + STRESS_TERM_TIMEOUT_MS;
+    pid_t drainPid;
+    int status;
+
+    if ( ( drainPid = fork() ) == 0 )
+    {
+        char buffer[ 4096 ];
+
+        fcntl( fd, F_SETFL, 0 );
+        while ( read( fd, buffer, sizeof( buffer ) ) > 0 );
+        _exit( 0 );
+    }
+
+    close( fd );
+    kill( pid, SIGTERM );
+
+    while ( waitpid( pid, &status, WNOHANG ) == 0 )
+    {
+        if ( stress_get_time_ms() > deadline )
+        {
+            fprintf( stderr, "PCD did not terminate, killing it\n" );
+            kill( pid, SIGKILL );
+            waitpid( pid, &status, 0 );
+            break;
+        }
+
+        usleep( STRESS_POLL_INTERVAL_MS * 1000 );
+    }
+
+    if ( drainPid > 0 )
+        waitpid( drainPid, NULL, 0 );
+}
+
+int main( int argc, char *argv[] )
+{
+    stressResult_t result;
+    const char *pcdPath = NULL, *rulesFilename = NULL;
+    char markFilename[ PATH_MAX ];
+    char buffer[ 4096 ];
+    size_t len = 0;
+    unsigned int timeout = STRESS_DEFAULT_TIMEOUT_SEC;
+    unsigned long long startTime, mark = 0;
+    int fds[ 2 ];
+    pid_t pid;
+    int opt;
+
+    while ( ( opt = getopt( argc, argv, "p:f:t:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'p':
+                pcdPath = optarg;
+                break;
+            case 'f':
+                rulesFilename = optarg;
+                break;
+            case 't':
+                timeout = atoi( optarg );
+                break;
+            default:
+                fprintf( stderr, "Usage: %s -p PCD -f FILE [-t timeout in seconds]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( ( !pcdPath ) || ( !rulesFilename ) )
+    {
+        fprintf( stderr, "Invalid parameters\n" );
+        return 1;
+    }
+
+    memset( &result, 0, sizeof( result ) );
+    snprintf( markFilename, sizeof( markFilename ), "%s.done", rulesFilename );
+    unlink( markFilename );
+
+    if ( pipe( fds ) < 0 )
+    {
+        perror( "pipe" );
+        return 1;
+    }
+
+    if ( prctl( PR_SET_CHILD_SUBREAPER, 1 ) < 0 )
+    {
+        perror( "prctl" );
+        return 1;
+    }
+
+    /* ENV_VAR conditions of the generated rules wait for this variable */
+    setenv( "PCD_STRESS", "1", 1 );
+
+    startTime = stress_get_time_ms();
+
+    if ( ( pid = fork() ) == 0 )
+    {
+        dup2( fds[ 1 ], STDOUT_FILENO );
+        dup2( fds[ 1 ], STDERR_FILENO );
+        close( fds[ 0 ] );
+        close( fds[ 1 ] );
+        execl( pcdPath, pcdPath, "-d", "-v", "-f", rulesFilename, (char *)NULL );
+        _exit( 1 );
+    }
+
+    close( fds[ 1 ] );
+
+    if ( pid < 0 )
+    {
+        perror( "fork" );
+        return 1;
+    }
+
+    /* The started process exits as soon as PCD daemonizes */
+    waitpid( pid, NULL, 0 );
+
+    if ( ( pid = stress_find_child() ) < 0 )
+    {
+        fprintf( stderr, "PCD failed to start\n" );
+        stress_read_output( fds[ 0 ], buffer, sizeof( buffer ), &len, &result );
+        return 1;
+    }
+
+    fcntl( fds[ 0 ], F_SETFL, O_NONBLOCK );
+
+    while ( stress_read_mark( markFilename, &mark ) < 0 )
+    {
+        struct pollfd pfd = { fds[ 0 ], POLLIN, 0 };
+
+        poll( &pfd, 1, STRESS_POLL_INTERVAL_MS );
+        stress_read_output( fds[ 0 ], buffer, sizeof( buffer ), &len, &result );
+
+        if ( waitpid( pid, NULL, WNOHANG ) == pid )
+        {
+            fprintf( stderr, "PCD exited before rules file %s completed\n", rulesFilename );
+            return 1;
+        }
+
+        if ( stress_get_time_ms() > startTime + timeout * 1000ULL )
+        {
+            fprintf( stderr, "Rules file %s did not complete\n", rulesFilename );
+            stress_stop( pid, fds[ 0 ] );
+            return 1;
+        }
+    }
+
+    result.completeMs = mark - startTime;
+
+    /* Keep draining the output, PCD must not block while it is measured and stopped */
+    stress_read_output( fds[ 0 ], buffer, sizeof( buffer ), &len, &result );
+    stress_read_proc( pid, &result );
+    stress_stop( pid, fds[ 0 ] );
+
+    printf( "stress=pcd file=%s rules=%u parse_ms=%lu complete_ms=%llu peak_rss_kb=%lu cpu_ms=%lu errors=%u\n",
+            rulesFilename, result.rules, result.parseMs, result.completeMs, result.peakRssKb, result.cpuMs, result.errors );
+
+    return ( result.errors == 0 ) ? 0 : 1;
+}
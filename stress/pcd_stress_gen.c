@@ -0,0 +1,351 @@
+/*
+ * pcd_stress_gen.c
+ * Description:
+ * Synthetic rules file generator for the PCD stress harness
+ *
+ * Copyright (C) 2010 PCD Project - http://www.rt-embedded.com/pcd
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* The generator writes a rules file, and a chain of included files when an
+ * INCLUDE depth is requested. Rule N of the set is named Gg_RN, where g is
+ * N modulo the number of groups. RULE_COMPLETED conditions only point to
+ * earlier rules, so the dependency graph never has cycles. A last rule,
+ * STRESS_DONE, waits for every rule which no other rule depends on, and runs
+ * stress_ready to record the time when the whole set completed.
+ *
+ * Usage: pcd_stress_gen -f FILE [-n rules] [-g groups] [-i fan-in] [-o fan-out]
+ *                       [-I include depth] [-m none,completed,file,env]
+ *                       [-r ready percent] [-d ready delay ms] [-b stress_ready]
+ *                       [-s seed]
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+/**************************************************************************/
+/*      LOCAL DEFINITIONS AND VARIABLES                                   */
+/**************************************************************************/
+
+#define STRESS_GEN_DEFAULT_RULES        1000
+#define STRESS_GEN_DEFAULT_GROUPS       20
+#define STRESS_GEN_DEFAULT_FANIN        3
+#define STRESS_GEN_DEFAULT_FANOUT       8
+#define STRESS_GEN_DEFAULT_READY        10
+#define STRESS_GEN_DEFAULT_DELAY_MS     10
+#define STRESS_GEN_DEFAULT_READY_PATH   "./stress_ready"
+
+/* Tries to find a dependency which did not reach the fan-out limit */
+#define STRESS_GEN_DEP_TRIES            16
+
+/* Environment variable of the ENV_VAR conditions, set by pcd_stress */
+#define STRESS_GEN_ENV_NAME             "PCD_STRESS"
+#define STRESS_GEN_ENV_VALUE            "1"
+
+typedef enum stressCond_e
+{
+    STRESS_COND_NONE,
+    STRESS_COND_COMPLETED,
+    STRESS_COND_FILE,
+    STRESS_COND_ENV,
+    STRESS_COND_LAST,
+
+} stressCond_e;
+
+static unsigned int numRules = STRESS_GEN_DEFAULT_RULES;
+static unsigned int numGroups = STRESS_GEN_DEFAULT_GROUPS;
+static unsigned int fanIn = STRESS_GEN_DEFAULT_FANIN;
+static unsigned int fanOut = STRESS_GEN_DEFAULT_FANOUT;
+static unsigned int includeDepth = 0;
+static unsigned int readyPercent = STRESS_GEN_DEFAULT_READY;
+static unsigned int readyDelay = STRESS_GEN_DEFAULT_DELAY_MS;
+static unsigned int condWeights[ STRESS_COND_LAST ] = { 10, 70, 10, 10 };
+static const char *readyPath = STRESS_GEN_DEFAULT_READY_PATH;
+static const char *rulesFilename = NULL;
+
+/* Number of rules which depend on each rule */
+static unsigned int *numDependents;
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static stressCond_e stress_gen_pick_cond( void )
+{
+    unsigned int total = 0, pick, i;
+
+    for ( i = 0; i < STRESS_COND_LAST; i++ )
+        total += condWeights[ i ];
+
+    if ( total == 0 )
+        return STRESS_COND_NONE;
+
+    pick = rand() % total;
+
+    for ( i = 0; i < STRESS_COND_LAST; i++ )
+    {
+        if ( pick < condWeights[ i ] )
+            return i;
+
+        pick -= condWeights[ i ];
+    }
+
+    return STRESS_COND_NONE;
+}
+
+static void stress_gen_write_start_cond( FILE *out, unsigned int ruleIdx )
+{
+    stressCond_e cond = stress_gen_pick_cond();
+    unsigned int deps[ fanIn ? fanIn : 1 ];
+    unsigned int numDeps = 0, wanted, i, j;
+
+    if ( ( cond == STRESS_COND_COMPLETED ) && ( ruleIdx > 0 ) && ( fanIn > 0 ) )
+    {
+        wanted = 1 + ( rand() % fanIn );
+
+        while ( numDeps < wanted )
+        {
+            unsigned int dep = 0;
+
+            /* Prefer dependencies which did not reach the fan-out limit */
+            for ( i = 0; i < STRESS_GEN_DEP_TRIES; i++ )
+            {
+                dep = rand() % ruleIdx;
+
+                for ( j = 0; ( j < numDeps ) && ( deps[ j ] != dep ); j++ );
+
+                if ( ( j == numDeps ) && ( numDependents[ dep ] < fanOut ) )
+                    break;
+            }
+
+            if ( i == STRESS_GEN_DEP_TRIES )
+                break;
+
+            deps[ numDeps++ ] = dep;
+            numDependents[ dep ]++;
+        }
+    }
+
+    if ( numDeps > 0 )
+    {
+        fprintf( out, "START_COND = RULE_COMPLETED" );
+
+        for ( i = 0; i < numDeps; i++ )
+            fprintf( out, ",G%u_R%u", deps[ i ] % numGroups, deps[ i ] );
+
+        fprintf( out, "\n" );
+        return;
+    }
+
+    switch ( cond )
+    {
+        case STRESS_COND_FILE:
+            /* The rules file itself always exists */
+            fprintf( out, "START_COND = FILE,%s\n", rulesFilename );
+            break;
+        case STRESS_COND_ENV:
+            fprintf( out, "START_COND = ENV_VAR,%s,%s\n", STRESS_GEN_ENV_NAME, STRESS_GEN_ENV_VALUE );
+            break;
+        default:
+            fprintf( out, "START_COND = NONE\n" );
+            break;
+    }
+}
+
+static void stress_gen_write_rule( FILE *out, unsigned int ruleIdx )
+{
+    fprintf( out, "RULE = G%u_R%u\n", ruleIdx % numGroups, ruleIdx );
+
+    stress_gen_write_start_cond( out, ruleIdx );
+
+    if ( (unsigned int)( rand() % 100 ) < readyPercent )
+    {
+        /* A daemon which reports that it is ready after a delay */
+        fprintf( out, "COMMAND = %s -t %u\n", readyPath, readyDelay );
+        fprintf( out, "SCHED = NICE,0\nDAEMON = YES\nEND_COND = PROCESS_READY\nEND_COND_TIMEOUT = 30000\n" );
+    }
+    else if ( ruleIdx % 4 == 0 )
+    {
+        /* A synchronization rule */
+        fprintf( out, "COMMAND = NONE\nSCHED = NICE,0\nDAEMON = NO\nEND_COND = NONE\nEND_COND_TIMEOUT = -1\n" );
+    }
+    else
+    {
+        fprintf( out, "COMMAND = /bin/true\nSCHED = NICE,0\nDAEMON = NO\nEND_COND = EXIT,0\nEND_COND_TIMEOUT = 30000\n" );
+    }
+
+    fprintf( out, "FAILURE_ACTION = NONE\nACTIVE = YES\n\n" );
+}
+
+static void stress_gen_write_done_rule( FILE *out, const char *markFilename )
+{
+    unsigned int i;
+
+    fprintf( out, "RULE = STRESS_DONE\nSTART_COND = RULE_COMPLETED" );
+
+    for ( i = 0; i < numRules; i++ )
+    {
+        if ( numDependents[ i ] == 0 )
+            fprintf( out, ",G%u_R%u", i % numGroups, i );
+    }
+
+    fprintf( out, "\nCOMMAND = %s -o %s\n", readyPath, markFilename );
+    fprintf( out, "SCHED = NICE,0\nDAEMON = NO\nEND_COND = EXIT,0\nEND_COND_TIMEOUT = 30000\nFAILURE_ACTION = NONE\nACTIVE = YES\n" );
+}
+
+static int stress_gen_parse_weights( const char *str )
+{
+    unsigned int i;
+
+    for ( i = 0; i < STRESS_COND_LAST; i++ )
+    {
+        char *end;
+
+        condWeights[ i ] = strtoul( str, &end, 10 );
+
+        if ( end == str )
+            return -1;
+
+        if ( *end == '\0' )
+            return ( i == STRESS_COND_LAST - 1 ) ? 0 : -1;
+
+        if ( *end != ',' )
+            return -1;
+
+        str = end + 1;
+    }
+
+    return -1;
+}
+
+int main( int argc, char *argv[] )
+{
+    char markFilename[ PATH_MAX ];
+    unsigned int seed = 1;
+    unsigned int part, first, last, i;
+    int opt;
+
+    while ( ( opt = getopt( argc, argv, "f:n:g:i:o:I:m:r:d:b:s:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'f':
+                rulesFilename = optarg;
+                break;
+            case 'n':
+                numRules = atoi( optarg );
+                break;
+            case 'g':
+                numGroups = atoi( optarg );
+                break;
+            case 'i':
+                fanIn = atoi( optarg );
+                break;
+            case 'o':
+                fanOut = atoi( optarg );
+                break;
+            case 'I':
+                includeDepth = atoi( optarg );
+                break;
+            case 'm':
+                if ( stress_gen_parse_weights( optarg ) < 0 )
+                {
+                    fprintf( stderr, "Invalid condition mix %s\n", optarg );
+                    return 1;
+                }
+                break;
+            case 'r':
+                readyPercent = atoi( optarg );
+                break;
+            case 'd':
+                readyDelay = atoi( optarg );
+                break;
+            case 'b':
+                readyPath = optarg;
+                break;
+            case 's':
+                seed = atoi( optarg );
+                break;
+            default:
+                fprintf( stderr, "Usage: %s -f FILE [-n rules] [-g groups] [-i fan-in] [-o fan-out] [-I include depth]\n"
+                                 "       [-m none,completed,file,env] [-r ready percent] [-d ready delay ms] [-b stress_ready] [-s seed]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( ( !rulesFilename ) || ( numRules == 0 ) || ( numGroups == 0 ) || ( fanOut == 0 ) )
+    {
+        fprintf( stderr, "Invalid parameters\n" );
+        return 1;
+    }
+
+    numDependents = calloc( numRules, sizeof( unsigned int ) );
+
+    if ( !numDependents )
+    {
+        fprintf( stderr, "Failed to allocate memory\n" );
+        return 1;
+    }
+
+    srand( seed );
+    snprintf( markFilename, sizeof( markFilename ), "%s.done", rulesFilename );
+
+    /* The rules are split evenly between the main file and its included files */
+    for ( part = 0; part <= includeDepth; part++ )
+    {
+        char filename[ PATH_MAX ];
+        FILE *out;
+
+        if ( part == 0 )
+            snprintf( filename, sizeof( filename ), "%s", rulesFilename );
+        else
+            snprintf( filename, sizeof( filename ), "%s.%u", rulesFilename, part );
+
+        if ( ( out = fopen( filename, "w" ) ) == NULL )
+        {
+            perror( filename );
+            return 1;
+        }
+
+        fprintf( out, "# Generated by pcd_stress_gen: %u rules, %u groups, fan-in %u, fan-out %u, include depth %u\n\n",
+                 numRules, numGroups, fanIn, fanOut, includeDepth );
+
+        if ( part < includeDepth )
+            fprintf( out, "INCLUDE = %s.%u\n\n", rulesFilename, part + 1 );
+
+        first = ( numRules * part ) / ( includeDepth + 1 );
+        last = ( numRules * ( part + 1 ) ) / ( includeDepth + 1 );
+
+        for ( i = first; i < last; i++ )
+            stress_gen_write_rule( out, i );
+
+        /* The last rule is written after all the others, it depends on them */
+        if ( part == includeDepth )
+            stress_gen_write_done_rule( out, markFilename );
+
+        fclose( out );
+    }
+
+    free( numDependents );
+
+    return 0;
+}
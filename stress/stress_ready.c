@@ -0,0 +1,97 @@
+/*
+ * stress_ready.c
+ * Description:
+ * Dummy daemon for the PCD stress harness
+ *
+ * Copyright (C) 2010 PCD Project - http://www.rt-embedded.com/pcd
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* With -t, the daemon sleeps for the given delay, sends PROCESS_READY to PCD
+ * and waits until PCD stops it. With -o, it writes the current monotonic time
+ * in ms to the file and exits, the last rule of a stress set uses it to mark
+ * the completion of the whole set.
+ *
+ * Usage: stress_ready [-t delay in ms] [-o FILE]
+ */
+
+/**************************************************************************/
+/*      INCLUDES                                                          */
+/**************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include "pcdapi.h"
+
+/**************************************************************************/
+/*      IMPLEMENTATION                                                    */
+/**************************************************************************/
+
+static int stress_ready_mark( const char *filename )
+{
+    struct timespec ts;
+    FILE *out;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    if ( ( out = fopen( filename, "w" ) ) == NULL )
+    {
+        perror( filename );
+        return 1;
+    }
+
+    fprintf( out, "%llu\n", ( (unsigned long long)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 ) );
+    fclose( out );
+
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    unsigned int delay = 0;
+    int opt;
+
+    while ( ( opt = getopt( argc, argv, "t:o:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 't':
+                delay = atoi( optarg );
+                break;
+            case 'o':
+                return stress_ready_mark( optarg );
+            default:
+                fprintf( stderr, "Usage: %s [-t delay in ms] [-o FILE]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( delay )
+        usleep( delay * 1000 );
+
+    if ( PCD_api_send_process_ready() != PCD_STATUS_OK )
+    {
+        fprintf( stderr, "%s: Failed to send process ready\n", argv[ 0 ] );
+        return 1;
+    }
+
+    /* Run until PCD stops the daemon */
+    while ( 1 )
+        pause();
+
+    return 0;
+}